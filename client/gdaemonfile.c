@@ -748,7 +748,7 @@ g_daemon_file_enumerate_children (GFile      *file,
                                              path,
                                              obj_path,
                                              attributes ? attributes : "",
-                                             flags,
+                                             flags | G_VFS_ENUMERATE_FLAG_COMPACT_INFOS,
                                              uri,
                                              cancellable,
                                              &local_error);
@@ -1019,15 +1019,61 @@ typedef struct {
   gboolean make_backup;
   GFileCreateFlags flags;
   gulong cancelled_tag;
+  gchar *path;
+  guint32 pid;
 } AsyncCallFileReadWrite;
 
 static void
 async_call_file_read_write_free (AsyncCallFileReadWrite *data)
 {
   g_free (data->etag);
+  g_free (data->path);
   g_free (data);
 }
 
+/* Creates the stream for an OpenForReadFlags reply */
+static GFileInputStream *
+create_input_stream (GUnixFDList *fd_list,
+                     GVariant *fd_id_val,
+                     GVariant *ring_fd_id_val,
+                     guint32 flags,
+                     GError **error)
+{
+  GFileInputStream *stream;
+  GVfsSharedRing *ring;
+  GError *ring_error = NULL;
+  int fd, ring_fd;
+
+  if (fd_list == NULL ||
+      (fd = g_unix_fd_list_get (fd_list, g_variant_get_handle (fd_id_val), NULL)) == -1)
+    {
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                           _("Couldn’t get stream file descriptor"));
+      return NULL;
+    }
+
+  ring = NULL;
+  if (flags & OPEN_FOR_READ_FLAG_SHARED_MEMORY)
+    {
+      ring_fd = g_unix_fd_list_get (fd_list, g_variant_get_handle (ring_fd_id_val), &ring_error);
+      if (ring_fd != -1)
+        ring = g_vfs_shared_ring_new_from_fd (ring_fd, &ring_error);
+      if (ring == NULL)
+        {
+          g_debug ("create_input_stream: can't use shared memory: %s\n", ring_error->message);
+          g_clear_error (&ring_error);
+        }
+    }
+
+  stream = g_daemon_file_input_stream_new (fd, (flags & OPEN_FOR_READ_FLAG_CAN_SEEK) != 0);
+  if (ring != NULL)
+    g_daemon_file_input_stream_set_shared_ring (G_DAEMON_FILE_INPUT_STREAM (stream), ring);
+  else if (flags & OPEN_FOR_READ_FLAG_SHARED_MEMORY)
+    g_daemon_file_input_stream_use_inline_data (G_DAEMON_FILE_INPUT_STREAM (stream));
+
+  return stream;
+}
+
 static void
 read_async_cb (GVfsDBusMount *proxy,
                GAsyncResult *res,
@@ -1071,6 +1117,56 @@ out:
   g_object_unref (task);
 }
 
+static void
+read_flags_async_cb (GVfsDBusMount *proxy,
+                     GAsyncResult *res,
+                     gpointer user_data)
+{
+  GTask *task = G_TASK (user_data);
+  AsyncCallFileReadWrite *data = g_task_get_task_data (task);
+  GError *error = NULL;
+  guint32 flags;
+  GUnixFDList *fd_list;
+  GVariant *fd_id_val;
+  GVariant *ring_fd_id_val;
+  GFileInputStream *stream;
+
+  if (! gvfs_dbus_mount_call_open_for_read_flags_finish (proxy, &fd_id_val, &ring_fd_id_val, &flags, &fd_list, res, &error))
+    {
+      if (g_error_matches (error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD))
+        {
+          /* Older daemon, use the plain call */
+          g_error_free (error);
+          gvfs_dbus_mount_call_open_for_read (proxy,
+                                             data->path,
+                                             data->pid,
+                                             NULL,
+                                             g_task_get_cancellable (task),
+                                             (GAsyncReadyCallback) read_async_cb,
+                                             task);
+          return;
+        }
+
+      g_dbus_error_strip_remote_error (error);
+      g_task_return_error (task, error);
+      goto out;
+    }
+
+  stream = create_input_stream (fd_list, fd_id_val, ring_fd_id_val, flags, &error);
+  if (stream == NULL)
+    g_task_return_error (task, error);
+  else
+    g_task_return_pointer (task, stream, g_object_unref);
+
+  g_variant_unref (fd_id_val);
+  g_variant_unref (ring_fd_id_val);
+  g_clear_object (&fd_list);
+
+out:
+  _g_dbus_async_unsubscribe_cancellable (g_task_get_cancellable (task), data->cancelled_tag);
+  g_object_unref (task);
+}
+
 static void
 file_read_async_get_proxy_cb (GVfsDBusMount *proxy,
                                GDBusConnection *connection,
@@ -1079,17 +1175,18 @@ file_read_async_get_proxy_cb (GVfsDBusMount *proxy,
                                GTask *task)
 {
   AsyncCallFileReadWrite *data = g_task_get_task_data (task);
-  guint32 pid;
-
-  pid = get_pid_for_file (G_FILE (g_task_get_source_object (task)));
 
-  gvfs_dbus_mount_call_open_for_read (proxy,
-                                     path,
-                                     pid,
-                                     NULL,
-                                     g_task_get_cancellable (task),
-                                     (GAsyncReadyCallback) read_async_cb,
-                                     task);
+  data->pid = get_pid_for_file (G_FILE (g_task_get_source_object (task)));
+  data->path = g_strdup (path);
+
+  gvfs_dbus_mount_call_open_for_read_flags (proxy,
+                                           path,
+                                           OPEN_FOR_READ_FLAG_SHARED_MEMORY,
+                                           data->pid,
+                                           NULL,
+                                           g_task_get_cancellable (task),
+                                           (GAsyncReadyCallback) read_flags_async_cb,
+                                           task);
   data->cancelled_tag = _g_dbus_async_subscribe_cancellable (connection, g_task_get_cancellable (task));
 }
 
@@ -1133,9 +1230,12 @@ g_daemon_file_read (GFile *file,
   char *path;
   gboolean res;
   gboolean can_seek;
+  guint32 flags;
   GUnixFDList *fd_list;
   int fd;
   GVariant *fd_id_val = NULL;
+  GVariant *ring_fd_id_val = NULL;
+  GFileInputStream *stream;
   guint32 pid;
   GError *local_error = NULL;
 
@@ -1145,15 +1245,44 @@ g_daemon_file_read (GFile *file,
   if (proxy == NULL)
     return NULL;
 
-  res = gvfs_dbus_mount_call_open_for_read_sync (proxy,
-                                                 path,
-                                                 pid,
-                                                 NULL,
-                                                 &fd_id_val,
-                                                 &can_seek,
-                                                 &fd_list,
-                                                 cancellable,
-                                                 &local_error);
+  res = gvfs_dbus_mount_call_open_for_read_flags_sync (proxy,
+                                                       path,
+                                                       OPEN_FOR_READ_FLAG_SHARED_MEMORY,
+                                                       pid,
+                                                       NULL,
+                                                       &fd_id_val,
+                                                       &ring_fd_id_val,
+                                                       &flags,
+                                                       &fd_list,
+                                                       cancellable,
+                                                       &local_error);
+  if (res)
+    {
+      g_free (path);
+      g_object_unref (proxy);
+
+      stream = create_input_stream (fd_list, fd_id_val, ring_fd_id_val, flags, error);
+      g_variant_unref (fd_id_val);
+      g_variant_unref (ring_fd_id_val);
+      g_clear_object (&fd_list);
+
+      return stream;
+    }
+
+  /* Older daemon, use the plain call */
+  if (g_error_matches (local_error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD))
+    {
+      g_clear_error (&local_error);
+      res = gvfs_dbus_mount_call_open_for_read_sync (proxy,
+                                                     path,
+                                                     pid,
+                                                     NULL,
+                                                     &fd_id_val,
+                                                     &can_seek,
+                                                     &fd_list,
+                                                     cancellable,
+                                                     &local_error);
+    }
 
   if (! res)
     {
@@ -3284,7 +3413,7 @@ enumerate_children_async_get_proxy_cb (GVfsDBusMount *proxy,
                                   path,
                                   obj_path,
                                   data->attributes ? data->attributes : "",
-                                  data->flags,
+                                  data->flags | G_VFS_ENUMERATE_FLAG_COMPACT_INFOS,
                                   uri,
                                   g_task_get_cancellable (task),
                                   (GAsyncReadyCallback) enumerate_children_async_cb,
@@ -30,6 +30,7 @@
 #include <gio/gio.h>
 #include <gvfsdaemondbus.h>
 #include <gvfsdaemonprotocol.h>
+#include <gvfsfileinfo.h>
 #include "gdaemonfile.h"
 #include "metatree.h"
 #include <gvfsdbus.h>
@@ -254,6 +255,33 @@ handle_got_info (GVfsDBusEnumerator *object,
   return TRUE;
 }
 
+static gboolean
+handle_got_info_compact (GVfsDBusEnumerator *object,
+                         GDBusMethodInvocation *invocation,
+                         GVariant *arg_infos,
+                         gpointer user_data)
+{
+  GDaemonFileEnumerator *enumerator = G_DAEMON_FILE_ENUMERATOR (user_data);
+  GList *infos;
+  gconstpointer data;
+  gsize size;
+
+  data = g_variant_get_fixed_array (arg_infos, &size, 1);
+  infos = gvfs_file_info_demarshal_batch (data, size);
+
+  G_LOCK (infos);
+  enumerator->infos = g_list_concat (enumerator->infos, infos);
+  next_files_sync_check (enumerator);
+  G_UNLOCK (infos);
+
+  g_signal_emit (enumerator, signals[CHANGED], 0);
+
+  /* No reply is expected, this just frees the invocation */
+  gvfs_dbus_enumerator_complete_got_info_compact (object, invocation);
+
+  return TRUE;
+}
+
 static void
 create_skeleton (GDaemonFileEnumerator *daemon,
                  GDBusConnection *connection,
@@ -268,6 +296,7 @@ create_skeleton (GDaemonFileEnumerator *daemon,
   skeleton = gvfs_dbus_enumerator_skeleton_new ();
   g_signal_connect (skeleton, "handle-done", G_CALLBACK (handle_done), daemon);
   g_signal_connect (skeleton, "handle-got-info", G_CALLBACK (handle_got_info), daemon);
+  g_signal_connect (skeleton, "handle-got-info-compact", G_CALLBACK (handle_got_info_compact), daemon);
 
   error = NULL;
   if (!g_dbus_interface_skeleton_export (G_DBUS_INTERFACE_SKELETON (skeleton),
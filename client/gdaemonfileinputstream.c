@@ -66,6 +66,10 @@
 
 #define MAX_READ_SIZE (4*1024*1024)
 
+/* Reads this large are done by copies, thumbnailers and media players,
+ * which read sequentially, so tell the daemon to skip its slow start */
+#define STREAMING_HINT_READ_SIZE (64*1024)
+
 typedef enum {
   INPUT_STATE_IN_REPLY_HEADER,
   INPUT_STATE_IN_BLOCK
@@ -205,6 +209,7 @@ struct _GDaemonFileInputStream {
   GOutputStream *command_stream;
   GInputStream *data_stream;
   guint can_seek : 1;
+  guint sent_streaming_hint : 1;
   
   int seek_generation;
   guint32 seq_nr;
@@ -215,7 +220,12 @@ struct _GDaemonFileInputStream {
   InputState input_state;
   gsize input_block_size;
   int input_block_seek_generation;
+  gboolean input_block_shared;
+  guint32 input_block_position;
   GString *input_buffer;
+
+  /* Data blocks are passed here instead of the socket if set */
+  GVfsSharedRing *ring;
   
   GString *output_buffer;
 };
@@ -332,6 +342,9 @@ g_daemon_file_input_stream_finalize (GObject *object)
   
   g_string_free (file->input_buffer, TRUE);
   g_string_free (file->output_buffer, TRUE);
+
+  if (file->ring)
+    g_vfs_shared_ring_free (file->ring);
   
   if (G_OBJECT_CLASS (g_daemon_file_input_stream_parent_class)->finalize)
     (*G_OBJECT_CLASS (g_daemon_file_input_stream_parent_class)->finalize) (object);
@@ -392,6 +405,26 @@ g_daemon_file_input_stream_new (int fd,
   return G_FILE_INPUT_STREAM (stream);
 }
 
+/* Asks the daemon for plain data replies instead of the shared memory
+ * ring it offered. Must be called before the first request. */
+void
+g_daemon_file_input_stream_use_inline_data (GDaemonFileInputStream *stream)
+{
+  g_assert (stream->ring == NULL);
+  /* No reply, it goes out with the first request */
+  append_request (stream, G_VFS_DAEMON_SOCKET_PROTOCOL_REQUEST_INLINE_DATA,
+		  0, 0, 0, NULL);
+}
+
+/* Takes ownership of @ring */
+void
+g_daemon_file_input_stream_set_shared_ring (GDaemonFileInputStream *stream,
+					    GVfsSharedRing *ring)
+{
+  g_assert (stream->ring == NULL);
+  stream->ring = ring;
+}
+
 static gboolean
 error_is_cancel (GError *error)
 {
@@ -452,6 +485,9 @@ get_reply_header_missing_bytes (GString *buffer)
   if (type == G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_ERROR ||
       type == G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_INFO)
     return G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_SIZE + arg2 - buffer->len;
+  if (type == G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_DATA_SHARED &&
+      buffer->len < G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_SIZE + 4)
+    return G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_SIZE + 4 - buffer->len;
   return 0;
 }
 
@@ -477,6 +513,64 @@ decode_error (GVfsDaemonSocketProtocolReply *reply, char *data, GError **error)
         	       data + strlen (data) + 1);
 }
 
+static gboolean
+is_data_reply (GVfsDaemonSocketProtocolReply *reply)
+{
+  return reply->type == G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_DATA ||
+    reply->type == G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_DATA_SHARED;
+}
+
+static void
+start_input_block (GDaemonFileInputStream *file,
+		   GVfsDaemonSocketProtocolReply *reply,
+		   char *data)
+{
+  guint32 position;
+
+  file->input_state = INPUT_STATE_IN_BLOCK;
+  file->input_block_size = reply->arg1;
+  file->input_block_seek_generation = reply->arg2;
+  file->input_block_shared =
+    reply->type == G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_DATA_SHARED;
+  if (file->input_block_shared)
+    {
+      memcpy (&position, data, 4);
+      file->input_block_position = g_ntohl (position);
+    }
+}
+
+/* Reads or skips (buffer == NULL) the current block when it is in
+   the shared ring rather than on the socket */
+static gssize
+read_shared_block (GDaemonFileInputStream *file,
+		   void *buffer,
+		   gsize size,
+		   GError **error)
+{
+  const char *block;
+  gsize n;
+
+  if (file->ring == NULL ||
+      (block = g_vfs_shared_ring_peek (file->ring,
+				       file->input_block_position,
+				       file->input_block_size)) == NULL)
+    {
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+			   _("Invalid shared memory block"));
+      return -1;
+    }
+
+  n = MIN (size, file->input_block_size);
+  if (buffer)
+    memcpy (buffer, block, n);
+
+  file->input_block_position += n;
+  if (n == file->input_block_size)
+    g_vfs_shared_ring_release (file->ring, file->input_block_position);
+
+  return n;
+}
+
 
 static gboolean
 run_sync_state_machine (GDaemonFileInputStream *file,
@@ -503,7 +597,16 @@ run_sync_state_machine (GDaemonFileInputStream *file,
 	return TRUE;
       
       io_error = NULL;
-      if (io_op == STATE_OP_READ)
+      if (io_op != STATE_OP_WRITE &&
+	  file->input_state == INPUT_STATE_IN_BLOCK &&
+	  file->input_block_shared)
+	{
+	  res = read_shared_block (file,
+				   io_op == STATE_OP_READ ? io_data.io_buffer : NULL,
+				   io_data.io_size,
+				   &io_error);
+	}
+      else if (io_op == STATE_OP_READ)
 	{
 	  res = g_input_stream_read (file->data_stream,
 				     io_data.io_buffer, io_data.io_size,
@@ -628,6 +731,15 @@ iterate_read_state_machine (GDaemonFileInputStream *file, IOOperationData *io_op
 	      return STATE_OP_READ;
 	    }
 
+	  if (!file->sent_streaming_hint &&
+	      op->buffer_size >= STREAMING_HINT_READ_SIZE)
+	    {
+	      /* No reply, so it can go out with the read request */
+	      file->sent_streaming_hint = TRUE;
+	      append_request (file, G_VFS_DAEMON_SOCKET_PROTOCOL_REQUEST_STREAMING,
+			      0, 0, 0, NULL);
+	    }
+
 	  append_request (file, G_VFS_DAEMON_SOCKET_PROTOCOL_REQUEST_READ,
 			  op->buffer_size, 0, 0, &op->seq_nr);
 	  op->state = READ_STATE_WROTE_COMMAND;
@@ -773,12 +885,10 @@ iterate_read_state_machine (GDaemonFileInputStream *file, IOOperationData *io_op
 		g_string_truncate (file->input_buffer, 0);
 		return STATE_OP_DONE;
 	      }
-	    else if (reply.type == G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_DATA)
+	    else if (is_data_reply (&reply))
 	      {
+		start_input_block (file, &reply, data);
 		g_string_truncate (file->input_buffer, 0);
-		file->input_state = INPUT_STATE_IN_BLOCK;
-		file->input_block_size = reply.arg1;
-		file->input_block_seek_generation = reply.arg2;
 		op->state = READ_STATE_HANDLE_INPUT_BLOCK;
 		break;
 	      }
@@ -1033,12 +1143,10 @@ iterate_close_state_machine (GDaemonFileInputStream *file, IOOperationData *io_o
 		g_string_truncate (file->input_buffer, 0);
 		return STATE_OP_DONE;
 	      }
-	    else if (reply.type == G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_DATA)
+	    else if (is_data_reply (&reply))
 	      {
+		start_input_block (file, &reply, data);
 		g_string_truncate (file->input_buffer, 0);
-		file->input_state = INPUT_STATE_IN_BLOCK;
-		file->input_block_size = reply.arg1;
-		file->input_block_seek_generation = reply.arg2;
 		op->state = CLOSE_STATE_HANDLE_INPUT_BLOCK;
 		break;
 	      }
@@ -1300,12 +1408,10 @@ iterate_seek_state_machine (GDaemonFileInputStream *file, IOOperationData *io_op
 		g_string_truncate (file->input_buffer, 0);
 		return STATE_OP_DONE;
 	      }
-	    else if (reply.type == G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_DATA)
+	    else if (is_data_reply (&reply))
 	      {
+		start_input_block (file, &reply, data);
 		g_string_truncate (file->input_buffer, 0);
-		file->input_state = INPUT_STATE_IN_BLOCK;
-		file->input_block_size = reply.arg1;
-		file->input_block_seek_generation = reply.arg2;
 		op->state = SEEK_STATE_HANDLE_INPUT_BLOCK;
 		break;
 	      }
@@ -1580,12 +1686,10 @@ iterate_query_state_machine (GDaemonFileInputStream *file,
 		g_string_truncate (file->input_buffer, 0);
 		return STATE_OP_DONE;
 	      }
-	    else if (reply.type == G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_DATA)
+	    else if (is_data_reply (&reply))
 	      {
+		start_input_block (file, &reply, data);
 		g_string_truncate (file->input_buffer, 0);
-		file->input_state = INPUT_STATE_IN_BLOCK;
-		file->input_block_size = reply.arg1;
-		file->input_block_seek_generation = reply.arg2;
 		op->state = QUERY_STATE_HANDLE_INPUT_BLOCK;
 		break;
 	      }
@@ -1666,8 +1770,10 @@ struct AsyncIterator {
 
 static void async_iterate (AsyncIterator *iterator);
 
-static void
-async_op_handle (AsyncIterator *iterator,
+/* Stores the result of an i/o operation in the iterator. Returns FALSE
+   if that failed the task, the iterator is freed then */
+static gboolean
+async_op_result (AsyncIterator *iterator,
 		 gssize res,
 		 GError *io_error)
 {
@@ -1686,7 +1792,7 @@ async_op_handle (AsyncIterator *iterator,
                                    _("Error in stream protocol: %s"), io_error->message);
           g_object_unref (iterator->task);
           g_free (iterator);
-          return;
+          return FALSE;
 	}
     }
   else if (res == 0 && io_data->io_size != 0)
@@ -1695,15 +1801,24 @@ async_op_handle (AsyncIterator *iterator,
                                _("Error in stream protocol: %s"), _("End of stream"));
       g_object_unref (iterator->task);
       g_free (iterator);
-      return;
+      return FALSE;
     }
   else
     {
       io_data->io_res = res;
       io_data->io_cancelled = FALSE;
     }
-  
-  async_iterate (iterator);
+
+  return TRUE;
+}
+
+static void
+async_op_handle (AsyncIterator *iterator,
+		 gssize res,
+		 GError *io_error)
+{
+  if (async_op_result (iterator, res, io_error))
+    async_iterate (iterator);
 }
 
 static void
@@ -1762,20 +1877,45 @@ async_iterate (AsyncIterator *iterator)
   GCancellable *cancellable = g_task_get_cancellable (iterator->task);
   StateOp io_op;
 
-  io_data->cancelled = g_cancellable_is_cancelled (cancellable);
-
   file = G_DAEMON_FILE_INPUT_STREAM (g_task_get_source_object (iterator->task));
-  io_op = iterator->iterator (file, io_data, g_task_get_task_data (iterator->task));
 
-  if (io_op == STATE_OP_DONE)
+  /* Blocks in the shared ring are consumed right away, loop over them
+     rather than recursing through async_op_handle() for each one */
+  while (TRUE)
     {
-      iterator->done_cb (iterator->task);
-      g_free (iterator);
-      return;
+      GError *io_error = NULL;
+      gboolean ok;
+      gssize res;
+
+      io_data->cancelled = g_cancellable_is_cancelled (cancellable);
+
+      io_op = iterator->iterator (file, io_data, g_task_get_task_data (iterator->task));
+
+      if (io_op == STATE_OP_DONE)
+	{
+	  iterator->done_cb (iterator->task);
+	  g_free (iterator);
+	  return;
+	}
+
+      if (io_op == STATE_OP_WRITE ||
+	  file->input_state != INPUT_STATE_IN_BLOCK ||
+	  !file->input_block_shared)
+	break;
+
+      res = read_shared_block (file,
+			       io_op == STATE_OP_READ ? io_data->io_buffer : NULL,
+			       io_data->io_size,
+			       &io_error);
+      ok = async_op_result (iterator, res, io_error);
+      if (io_error)
+	g_error_free (io_error);
+      if (!ok)
+	return;
     }
 
   /* TODO: Handle allow_cancel... */
-  
+
   if (io_op == STATE_OP_READ)
     {
       g_input_stream_read_async (file->data_stream,
@@ -24,6 +24,7 @@
 #define __G_DAEMON_FILE_INPUT_STREAM_H__
 
 #include <gio/gio.h>
+#include <gvfssharedring.h>
 
 G_BEGIN_DECLS
 
@@ -46,6 +47,9 @@ GType g_daemon_file_input_stream_get_type (void);
 
 GFileInputStream *g_daemon_file_input_stream_new (int fd,
 						  gboolean can_seek);
+void              g_daemon_file_input_stream_use_inline_data (GDaemonFileInputStream *stream);
+void              g_daemon_file_input_stream_set_shared_ring (GDaemonFileInputStream *stream,
+							      GVfsSharedRing         *ring);
 
 G_END_DECLS
 
@@ -44,6 +44,11 @@
 
 #define MAX_WRITE_SIZE (4*1024*1024)
 
+/* Bytes that may be written ahead of the daemon acknowledging them, when
+   the daemon supports pipelined writes. Can be changed with the
+   GVFS_WRITE_BEHIND_SIZE environment variable, 0 disables write-behind. */
+#define DEFAULT_WRITE_BEHIND_SIZE (1024*1024)
+
 typedef enum {
   STATE_OP_DONE,
   STATE_OP_READ,
@@ -55,7 +60,8 @@ typedef enum {
   WRITE_STATE_INIT = 0,
   WRITE_STATE_WROTE_COMMAND,
   WRITE_STATE_SEND_DATA,
-  WRITE_STATE_HANDLE_INPUT
+  WRITE_STATE_HANDLE_INPUT,
+  WRITE_STATE_WAIT_FOR_ACKS
 } WriteState;
 
 typedef struct {
@@ -117,6 +123,19 @@ typedef struct {
   guint32 seq_nr;
 } TruncateOperation;
 
+typedef enum {
+  FLUSH_STATE_INIT = 0,
+  FLUSH_STATE_WAIT_FOR_ACKS
+} FlushState;
+
+typedef struct {
+  FlushState state;
+
+  /* Output */
+  gboolean ret_val;
+  GError *ret_error;
+} FlushOperation;
+
 typedef enum {
   CLOSE_STATE_INIT = 0,
   CLOSE_STATE_WROTE_REQUEST,
@@ -172,6 +191,11 @@ typedef struct {
 
 typedef StateOp (*state_machine_iterator) (GDaemonFileOutputStream *file, IOOperationData *io_op, gpointer data);
 
+typedef struct {
+  guint32 seq_nr;
+  gsize size;
+} PendingWrite;
+
 struct _GDaemonFileOutputStream {
   GFileOutputStream parent;
 
@@ -189,7 +213,13 @@ struct _GDaemonFileOutputStream {
   GString *output_buffer;
 
   char *etag;
-  
+
+  /* Write-behind, writes return once sent and are acknowledged later */
+  gboolean pipelined_writes;
+  gsize write_behind_max;
+  gsize write_behind_size;
+  GArray *pending_writes;
+  GError *write_error;
 };
 
 static gssize     g_daemon_file_output_stream_write             (GOutputStream        *stream,
@@ -197,6 +227,9 @@ static gssize     g_daemon_file_output_stream_write             (GOutputStream
 								 gsize                 count,
 								 GCancellable         *cancellable,
 								 GError              **error);
+static gboolean   g_daemon_file_output_stream_flush             (GOutputStream        *stream,
+								 GCancellable         *cancellable,
+								 GError              **error);
 static gboolean   g_daemon_file_output_stream_close             (GOutputStream        *stream,
 								 GCancellable         *cancellable,
 								 GError              **error);
@@ -227,6 +260,14 @@ static void       g_daemon_file_output_stream_write_async       (GOutputStream
 static gssize     g_daemon_file_output_stream_write_finish      (GOutputStream        *stream,
 								 GAsyncResult         *result,
 								 GError              **error);
+static void       g_daemon_file_output_stream_flush_async       (GOutputStream        *stream,
+								 int                   io_priority,
+								 GCancellable         *cancellable,
+								 GAsyncReadyCallback   callback,
+								 gpointer              data);
+static gboolean   g_daemon_file_output_stream_flush_finish      (GOutputStream        *stream,
+								 GAsyncResult         *result,
+								 GError              **error);
 static void       g_daemon_file_output_stream_close_async       (GOutputStream        *stream,
 								 int                   io_priority,
 								 GCancellable         *cancellable,
@@ -282,6 +323,8 @@ g_daemon_file_output_stream_finalize (GObject *object)
 
   g_string_free (file->input_buffer, TRUE);
   g_string_free (file->output_buffer, TRUE);
+  g_array_unref (file->pending_writes);
+  g_clear_error (&file->write_error);
 
   g_free (file->etag);
   
@@ -299,10 +342,13 @@ g_daemon_file_output_stream_class_init (GDaemonFileOutputStreamClass *klass)
   gobject_class->finalize = g_daemon_file_output_stream_finalize;
 
   stream_class->write_fn = g_daemon_file_output_stream_write;
+  stream_class->flush = g_daemon_file_output_stream_flush;
   stream_class->close_fn = g_daemon_file_output_stream_close;
   
   stream_class->write_async = g_daemon_file_output_stream_write_async;
   stream_class->write_finish = g_daemon_file_output_stream_write_finish;
+  stream_class->flush_async = g_daemon_file_output_stream_flush_async;
+  stream_class->flush_finish = g_daemon_file_output_stream_flush_finish;
   stream_class->close_async = g_daemon_file_output_stream_close_async;
   stream_class->close_finish = g_daemon_file_output_stream_close_finish;
   
@@ -322,9 +368,32 @@ g_daemon_file_output_stream_init (GDaemonFileOutputStream *info)
 {
   info->output_buffer = g_string_new ("");
   info->input_buffer = g_string_new ("");
+  info->pending_writes = g_array_new (FALSE, FALSE, sizeof (PendingWrite));
   info->seq_nr = 1;
 }
 
+static gsize
+get_write_behind_size (void)
+{
+  static gsize write_behind_size = 0;
+
+  if (g_once_init_enter (&write_behind_size))
+    {
+      const char *env;
+      gsize size;
+
+      size = DEFAULT_WRITE_BEHIND_SIZE;
+      env = g_getenv ("GVFS_WRITE_BEHIND_SIZE");
+      if (env != NULL)
+        size = g_ascii_strtoull (env, NULL, 10);
+
+      /* g_once_init_leave () doesn't take 0, keep the value off by one */
+      g_once_init_leave (&write_behind_size, size + 1);
+    }
+
+  return write_behind_size - 1;
+}
+
 GFileOutputStream *
 g_daemon_file_output_stream_new (int fd,
 				 guint32 flags,
@@ -339,6 +408,11 @@ g_daemon_file_output_stream_new (int fd,
   stream->can_seek = flags & OPEN_FOR_WRITE_FLAG_CAN_SEEK;
   stream->can_truncate = flags & OPEN_FOR_WRITE_FLAG_CAN_TRUNCATE;
   stream->current_offset = initial_offset;
+
+  stream->write_behind_max = get_write_behind_size ();
+  stream->pipelined_writes =
+    (flags & OPEN_FOR_WRITE_FLAG_PIPELINED_WRITES) != 0 &&
+    stream->write_behind_max > 0;
   
   return G_FILE_OUTPUT_STREAM (stream);
 }
@@ -428,6 +502,53 @@ decode_error (GVfsDaemonSocketProtocolReply *reply, char *data, GError **error)
 		       data + strlen (data) + 1);
 }
 
+/* Handles the reply to a pipelined write. The daemon may merge queued
+   writes, so a reply covers all pending writes up to its seq_nr. Errors
+   are kept and returned by the next write, flush or close. */
+static void
+handle_write_reply (GDaemonFileOutputStream *file,
+		    GVfsDaemonSocketProtocolReply *reply,
+		    char *data)
+{
+  PendingWrite *pending;
+  gsize acked_size;
+  guint i, n_acked;
+
+  if (reply->type != G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_WRITTEN &&
+      reply->type != G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_ERROR)
+    return;
+
+  acked_size = 0;
+  n_acked = 0;
+  for (i = 0; i < file->pending_writes->len; i++)
+    {
+      pending = &g_array_index (file->pending_writes, PendingWrite, i);
+      acked_size += pending->size;
+      if (pending->seq_nr == reply->seq_nr)
+	{
+	  n_acked = i + 1;
+	  break;
+	}
+    }
+
+  /* Not a reply to a pending write */
+  if (n_acked == 0)
+    return;
+
+  g_array_remove_range (file->pending_writes, 0, n_acked);
+  file->write_behind_size -= acked_size;
+
+  /* Only the first error is reported */
+  if (file->write_error != NULL)
+    return;
+
+  if (reply->type == G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_ERROR)
+    decode_error (reply, data, &file->write_error);
+  else if (reply->arg1 != acked_size)
+    g_set_error (&file->write_error, G_IO_ERROR, G_IO_ERROR_FAILED,
+		 _("Error in stream protocol: %s"), _("Short write"));
+}
+
 
 static gboolean
 run_sync_state_machine (GDaemonFileOutputStream *file,
@@ -532,6 +653,22 @@ iterate_write_state_machine (GDaemonFileOutputStream *file, IOOperationData *io_
 	{
 	  /* Initial state for read op */
 	case WRITE_STATE_INIT:
+	  /* An earlier pipelined write failed, the file contents are undefined */
+	  if (file->write_error != NULL)
+	    {
+	      op->ret_val = -1;
+	      op->ret_error = g_error_copy (file->write_error);
+	      return STATE_OP_DONE;
+	    }
+
+	  if (file->pipelined_writes &&
+	      file->pending_writes->len > 0 &&
+	      file->write_behind_size + op->buffer_size > file->write_behind_max)
+	    {
+	      op->state = WRITE_STATE_WAIT_FOR_ACKS;
+	      break;
+	    }
+
 	  append_request (file, G_VFS_DAEMON_SOCKET_PROTOCOL_REQUEST_WRITE,
 			  op->buffer_size, 0, op->buffer_size, &op->seq_nr);
 	  op->state = WRITE_STATE_WROTE_COMMAND;
@@ -584,6 +721,21 @@ iterate_write_state_machine (GDaemonFileOutputStream *file, IOOperationData *io_
 	      return STATE_OP_WRITE;
 	    }
 
+	  if (file->pipelined_writes)
+	    {
+	      PendingWrite pending;
+
+	      /* The daemon completes short writes itself, so consider this
+		 written and pick up the reply later */
+	      pending.seq_nr = op->seq_nr;
+	      pending.size = op->buffer_size;
+	      g_array_append_val (file->pending_writes, pending);
+	      file->write_behind_size += op->buffer_size;
+
+	      op->ret_val = op->buffer_size;
+	      return STATE_OP_DONE;
+	    }
+
 	  op->state = WRITE_STATE_HANDLE_INPUT;
 	  break;
 
@@ -650,6 +802,51 @@ iterate_write_state_machine (GDaemonFileOutputStream *file, IOOperationData *io_
 	  /* This wasn't interesting, read next reply */
 	  op->state = WRITE_STATE_HANDLE_INPUT;
 	  break;
+
+	  /* Too much written ahead, read replies to earlier writes */
+	case WRITE_STATE_WAIT_FOR_ACKS:
+	  if (io_op->io_size > 0)
+	    {
+	      gsize unread_size = io_op->io_size - io_op->io_res;
+	      g_string_set_size (file->input_buffer,
+				 file->input_buffer->len - unread_size);
+	    }
+
+	  /* Nothing was sent yet, so just keep any partial reply around */
+	  if (io_op->io_cancelled)
+	    {
+	      op->ret_val = -1;
+	      g_set_error_literal (&op->ret_error,
+				   G_IO_ERROR,
+				   G_IO_ERROR_CANCELLED,
+				   _("Operation was cancelled"));
+	      return STATE_OP_DONE;
+	    }
+
+	  len = get_reply_header_missing_bytes (file->input_buffer);
+	  if (len > 0)
+	    {
+	      gsize current_len = file->input_buffer->len;
+	      g_string_set_size (file->input_buffer,
+				 current_len + len);
+	      io_op->io_buffer = file->input_buffer->str + current_len;
+	      io_op->io_size = len;
+	      io_op->io_allow_cancel = TRUE;
+	      return STATE_OP_READ;
+	    }
+
+	  {
+	    GVfsDaemonSocketProtocolReply reply;
+	    char *data;
+	    data = decode_reply (file->input_buffer, &reply);
+	    handle_write_reply (file, &reply, data);
+	  }
+
+	  g_string_truncate (file->input_buffer, 0);
+
+	  /* Check the budget again */
+	  op->state = WRITE_STATE_INIT;
+	  break;
 	  
 	default:
 	  g_assert_not_reached ();
@@ -699,6 +896,112 @@ g_daemon_file_output_stream_write (GOutputStream *stream,
   return op.ret_val;
 }
 
+/* Waits until the daemon acknowledged all pipelined writes, so that
+   their errors are reported by the flush instead of a later call */
+static StateOp
+iterate_flush_state_machine (GDaemonFileOutputStream *file, IOOperationData *io_op, FlushOperation *op)
+{
+  gsize len;
+
+  while (TRUE)
+    {
+      switch (op->state)
+	{
+	case FLUSH_STATE_INIT:
+	  if (file->write_error != NULL)
+	    {
+	      op->ret_val = FALSE;
+	      op->ret_error = g_error_copy (file->write_error);
+	      return STATE_OP_DONE;
+	    }
+
+	  if (file->pending_writes->len == 0)
+	    {
+	      op->ret_val = TRUE;
+	      return STATE_OP_DONE;
+	    }
+
+	  op->state = FLUSH_STATE_WAIT_FOR_ACKS;
+	  break;
+
+	  /* Read replies to earlier writes */
+	case FLUSH_STATE_WAIT_FOR_ACKS:
+	  if (io_op->io_size > 0)
+	    {
+	      gsize unread_size = io_op->io_size - io_op->io_res;
+	      g_string_set_size (file->input_buffer,
+				 file->input_buffer->len - unread_size);
+	    }
+
+	  /* Nothing was sent, so just keep any partial reply around */
+	  if (io_op->io_cancelled)
+	    {
+	      op->ret_val = FALSE;
+	      g_set_error_literal (&op->ret_error,
+				   G_IO_ERROR,
+				   G_IO_ERROR_CANCELLED,
+				   _("Operation was cancelled"));
+	      return STATE_OP_DONE;
+	    }
+
+	  len = get_reply_header_missing_bytes (file->input_buffer);
+	  if (len > 0)
+	    {
+	      gsize current_len = file->input_buffer->len;
+	      g_string_set_size (file->input_buffer,
+				 current_len + len);
+	      io_op->io_buffer = file->input_buffer->str + current_len;
+	      io_op->io_size = len;
+	      io_op->io_allow_cancel = TRUE;
+	      return STATE_OP_READ;
+	    }
+
+	  {
+	    GVfsDaemonSocketProtocolReply reply;
+	    char *data;
+	    data = decode_reply (file->input_buffer, &reply);
+	    handle_write_reply (file, &reply, data);
+	  }
+
+	  g_string_truncate (file->input_buffer, 0);
+
+	  op->state = FLUSH_STATE_INIT;
+	  break;
+
+	default:
+	  g_assert_not_reached ();
+	}
+
+      /* Clear io_op between non-op state switches */
+      io_op->io_size = 0;
+      io_op->io_res = 0;
+      io_op->io_cancelled = FALSE;
+    }
+}
+
+static gboolean
+g_daemon_file_output_stream_flush (GOutputStream *stream,
+				   GCancellable  *cancellable,
+				   GError       **error)
+{
+  GDaemonFileOutputStream *file;
+  FlushOperation op;
+
+  file = G_DAEMON_FILE_OUTPUT_STREAM (stream);
+
+  memset (&op, 0, sizeof (op));
+  op.state = FLUSH_STATE_INIT;
+
+  if (!run_sync_state_machine (file, (state_machine_iterator)iterate_flush_state_machine,
+			       &op, cancellable, error))
+    return FALSE; /* IO Error */
+
+  if (!op.ret_val)
+    g_propagate_error (error, op.ret_error);
+
+  return op.ret_val;
+}
+
 static StateOp
 iterate_close_state_machine (GDaemonFileOutputStream *file, IOOperationData *io_op, CloseOperation *op)
 {
@@ -801,9 +1104,17 @@ iterate_close_state_machine (GDaemonFileOutputStream *file, IOOperationData *io_
 		if (reply.arg2 > 0)
 		  file->etag = g_strndup (data, reply.arg2);
 		g_string_truncate (file->input_buffer, 0);
+
+		/* All writes are acknowledged now, report any failed one */
+		if (file->write_error != NULL)
+		  {
+		    op->ret_val = FALSE;
+		    op->ret_error = g_error_copy (file->write_error);
+		  }
 		return STATE_OP_DONE;
 	      }
-	    /* Ignore other reply types */
+	    /* Pick up acknowledgements of earlier writes, ignore other reply types */
+	    handle_write_reply (file, &reply, data);
 	  }
 
 	  g_string_truncate (file->input_buffer, 0);
@@ -997,7 +1308,8 @@ iterate_seek_state_machine (GDaemonFileOutputStream *file, IOOperationData *io_o
 		g_string_truncate (file->input_buffer, 0);
 		return STATE_OP_DONE;
 	      }
-	    /* Ignore other reply types */
+	    /* Pick up acknowledgements of earlier writes, ignore other reply types */
+	    handle_write_reply (file, &reply, data);
 	  }
 
 	  g_string_truncate (file->input_buffer, 0);
@@ -1157,7 +1469,8 @@ iterate_truncate_state_machine (GDaemonFileOutputStream *file,
                 g_string_truncate (file->input_buffer, 0);
                 return STATE_OP_DONE;
               }
-            /* Ignore other reply types */
+            /* Pick up acknowledgements of earlier writes, ignore other reply types */
+            handle_write_reply (file, &reply, data);
           }
 
           g_string_truncate (file->input_buffer, 0);
@@ -1345,7 +1658,8 @@ iterate_query_state_machine (GDaemonFileOutputStream *file,
 		g_string_truncate (file->input_buffer, 0);
 		return STATE_OP_DONE;
 	      }
-	    /* Ignore other reply types */
+	    /* Pick up acknowledgements of earlier writes, ignore other reply types */
+	    handle_write_reply (file, &reply, data);
 	  }
 
 	  g_string_truncate (file->input_buffer, 0);
@@ -1629,6 +1943,56 @@ g_daemon_file_output_stream_write_finish (GOutputStream             *stream,
   return g_task_propagate_int (G_TASK (result), error);
 }
 
+static void
+async_flush_done (GTask *task)
+{
+  FlushOperation *op;
+
+  op = g_task_get_task_data (task);
+
+  if (!op->ret_val)
+    g_task_return_error (task, op->ret_error);
+  else
+    g_task_return_boolean (task, TRUE);
+
+  g_object_unref (task);
+}
+
+static void
+g_daemon_file_output_stream_flush_async (GOutputStream      *stream,
+					 int                  io_priority,
+					 GCancellable        *cancellable,
+					 GAsyncReadyCallback  callback,
+					 gpointer             data)
+{
+  FlushOperation *op;
+  GTask *task;
+
+  task = g_task_new (stream, cancellable, callback, data);
+  g_task_set_priority (task, io_priority);
+  g_task_set_source_tag (task, g_daemon_file_output_stream_flush_async);
+
+  op = g_new0 (FlushOperation, 1);
+  op->state = FLUSH_STATE_INIT;
+
+  g_task_set_task_data (task, op, g_free);
+
+  run_async_state_machine (task,
+			   (state_machine_iterator)iterate_flush_state_machine,
+			   async_flush_done);
+}
+
+static gboolean
+g_daemon_file_output_stream_flush_finish (GOutputStream  *stream,
+					  GAsyncResult   *result,
+					  GError        **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, stream), FALSE);
+  g_return_val_if_fail (g_async_result_is_tagged (result, g_daemon_file_output_stream_flush_async), FALSE);
+
+  return g_task_propagate_boolean (G_TASK (result), error);
+}
+
 static void
 async_close_done (GTask *task)
 {
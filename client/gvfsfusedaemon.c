@@ -64,16 +64,81 @@ typedef struct {
   time_t creation_time;
   char *name;
   GFile *root;
+  gdouble cache_timeout;
 } MountRecord;
 
+typedef struct {
+  gint        result;    /* 0, or -ENOENT for a negative entry */
+  struct stat sbuf;
+  gint64      expires;
+} AttrCacheEntry;
+
+/* How long file attributes are cached in-process, per mount type */
+typedef struct {
+  const gchar *scheme;
+  gdouble      timeout;
+} CacheTimeout;
+
+static const CacheTimeout cache_timeouts[] = {
+  { "sftp",    5.0 },
+  { "ftp",    10.0 },
+  { "ftps",   10.0 },
+  { "smb",     5.0 },
+  { "dav",     5.0 },
+  { "davs",    5.0 },
+  { "nfs",     5.0 },
+  { "afp",     5.0 },
+  { "mtp",    10.0 },
+  { "gphoto2", 30.0 },
+  { "afc",    10.0 },
+  { "trash",   0.0 },
+  { "recent",  0.0 },
+  { "admin",   0.0 },
+};
+
+#define DEFAULT_CACHE_TIMEOUT  1.0
+
+/* The kernel isn't told when the backends report changes, so it only
+ * caches briefly */
+#define KERNEL_CACHE_TIMEOUT   1.0
+
+#define ATTR_CACHE_MAX_ENTRIES 100000
+#define DIR_MONITORS_MAX       256
+
 typedef enum {
   FILE_OP_NONE,
   FILE_OP_READ,
   FILE_OP_WRITE
 } FileOp;
 
+/* Sequential reads are served in blocks of this size from a small
+ * per-handle cache, so that out-of-order and parallel reads from the
+ * kernel can be answered without seeking a single stream back and
+ * forth. Blocks start where the sequential reading did, other reads go
+ * straight to a stream with the size asked for. */
+#define READ_BLOCK_SIZE    (128 * 1024)
+#define READ_CACHE_BLOCKS  16
+#define READ_STREAMS_MAX   4
+
+typedef struct {
+  GInputStream *stream;  /* NULL until opened */
+  goffset       pos;     /* -1 if unknown */
+  gboolean      busy;
+  goffset       busy_end; /* Where a busy stream will be when done */
+  gboolean      primary; /* Shares FileHandle.stream, never reopened */
+} ReadStream;
+
+typedef struct {
+  goffset   offset;
+  gsize     size;        /* Less than READ_BLOCK_SIZE at end of file */
+  gchar    *data;
+  gboolean  loading;
+  guint64   last_used;
+} ReadBlock;
+
 typedef struct {
   gint      refcount;
+  gint      path_shard; /* Index of the shard path is in */
 
   GMutex    mutex;
   gchar    *path;
@@ -81,6 +146,14 @@ typedef struct {
   gpointer  stream;
   goffset   pos;
   goffset   size;
+
+  /* Read cache, protected by mutex */
+  GCond      read_cond;
+  GPtrArray *read_streams;
+  GPtrArray *read_blocks;
+  guint      n_busy_reads;
+  guint64    read_clock;
+  goffset    read_next;  /* End of the last read, -1 if none */
 } FileHandle;
 
 static GThread        *subthread             = NULL;
@@ -97,13 +170,34 @@ static time_t          daemon_creation_time;
 static uid_t           daemon_uid;
 static gid_t           daemon_gid;
 
-static GMutex          global_mutex          = {NULL};
-static GHashTable     *global_path_to_fh_map = NULL;
-static GHashTable     *global_active_fh_map  = NULL;
+/* The file handle maps are split in shards with their own lock, so
+ * lookups for unrelated paths don't contend */
+#define FH_MAP_SHARDS 16
+
+typedef struct {
+  GMutex      mutex;
+  GHashTable *map;
+} MapShard;
+
+static MapShard        path_to_fh_shards[FH_MAP_SHARDS];
+static MapShard        active_fh_shards[FH_MAP_SHARDS];
 
 static GDBusConnection *dbus_conn            = NULL;
 static guint            daemon_name_watcher;
 
+/* Attributes of paths without an open handle, filled by getattr and
+ * readdir and invalidated by changes and directory monitors */
+static GMutex          attr_cache_mutex      = {NULL};
+static GHashTable     *attr_cache            = NULL;
+static GHashTable     *dir_monitors          = NULL;
+
+/* Every invalidation ticks attr_cache_clock. attr_cache_generation is
+ * the tick of the last one that can affect any path, attr_cache_stamps
+ * maps paths that were written to the tick of their last write. */
+static guint           attr_cache_clock      = 0;
+static guint           attr_cache_generation = 0;
+static GHashTable     *attr_cache_stamps     = NULL;
+
 /* ------- *
  * Helpers *
  * ------- */
@@ -203,19 +297,62 @@ set_pid_for_file (GFile *file)
   ;
 }
 
+static gint
+path_shard_index (const gchar *path)
+{
+  return g_str_hash (path) % FH_MAP_SHARDS;
+}
+
+static MapShard *
+active_shard_for_handle (gconstpointer file_handle)
+{
+  /* Skip the bits that are always zero due to alignment */
+  return &active_fh_shards[(GPOINTER_TO_SIZE (file_handle) >> 4) % FH_MAP_SHARDS];
+}
+
+/* Locks the shard the handle's path is in, the path can't change
+ * while it is held */
+static MapShard *
+lock_path_shard_for_handle (FileHandle *file_handle)
+{
+  MapShard *shard;
+  gint      index;
+
+  while (TRUE)
+    {
+      index = g_atomic_int_get (&file_handle->path_shard);
+      shard = &path_to_fh_shards[index];
+      g_mutex_lock (&shard->mutex);
+
+      /* Moved by a rename meanwhile? */
+      if (g_atomic_int_get (&file_handle->path_shard) == index)
+        return shard;
+
+      g_mutex_unlock (&shard->mutex);
+    }
+}
+
+/* Call with the path shard locked */
 static FileHandle *
 file_handle_new (const gchar *path)
 {
   FileHandle *file_handle;
+  MapShard   *active_shard;
 
   file_handle = g_new0 (FileHandle, 1);
   file_handle->refcount = 1;
   g_mutex_init (&file_handle->mutex);
+  g_cond_init (&file_handle->read_cond);
   file_handle->op = FILE_OP_NONE;
   file_handle->path = g_strdup (path);
+  file_handle->path_shard = path_shard_index (path);
   file_handle->size = -1;
+  file_handle->read_next = -1;
 
-  g_hash_table_insert (global_active_fh_map, file_handle, file_handle);
+  active_shard = active_shard_for_handle (file_handle);
+  g_mutex_lock (&active_shard->mutex);
+  g_hash_table_add (active_shard->map, file_handle);
+  g_mutex_unlock (&active_shard->mutex);
 
   return file_handle;
 }
@@ -227,32 +364,90 @@ file_handle_ref (FileHandle *file_handle)
   return file_handle;
 }
 
+/* Doesn't revive a handle that is being freed */
+static gboolean
+file_handle_try_ref (FileHandle *file_handle)
+{
+  gint refs;
+
+  do
+    {
+      refs = g_atomic_int_get (&file_handle->refcount);
+      if (refs == 0)
+        return FALSE;
+    }
+  while (!g_atomic_int_compare_and_exchange (&file_handle->refcount, refs, refs + 1));
+
+  return TRUE;
+}
+
 static void
 file_handle_unref (FileHandle *file_handle)
 {
   if (g_atomic_int_dec_and_test (&file_handle->refcount))
     {
+      MapShard *shard;
       gint refs;
 
-      g_mutex_lock (&global_mutex);
+      shard = lock_path_shard_for_handle (file_handle);
 
       /* Test again, since e.g. get_file_handle_for_path() might have
-       * snatched the global mutex and revived the file handle between
-       * g_atomic_int_dec_and_test() and us obtaining the global lock. */
+       * snatched the shard mutex and revived the file handle between
+       * g_atomic_int_dec_and_test() and us obtaining the shard lock. */
 
       refs = g_atomic_int_get (&file_handle->refcount);
 
       if (refs == 0)
-        g_hash_table_remove (global_path_to_fh_map, file_handle->path);
+        g_hash_table_remove (shard->map, file_handle->path);
 
-      g_mutex_unlock (&global_mutex);
+      g_mutex_unlock (&shard->mutex);
     }
 }
 
+static void
+read_stream_free (ReadStream *read_stream)
+{
+  if (read_stream->stream)
+    {
+      /* The primary stream is closed along with the file handle */
+      if (!read_stream->primary)
+        g_input_stream_close (read_stream->stream, NULL, NULL);
+      g_object_unref (read_stream->stream);
+    }
+  g_free (read_stream);
+}
+
+static void
+read_block_free (ReadBlock *read_block)
+{
+  g_free (read_block->data);
+  g_free (read_block);
+}
+
+/* Call with fh locked */
+static void
+file_handle_wait_for_reads (FileHandle *fh)
+{
+  while (fh->n_busy_reads > 0)
+    g_cond_wait (&fh->read_cond, &fh->mutex);
+}
+
+/* Call with fh locked */
+static void
+file_handle_clear_read_cache (FileHandle *fh)
+{
+  file_handle_wait_for_reads (fh);
+
+  g_clear_pointer (&fh->read_streams, g_ptr_array_unref);
+  g_clear_pointer (&fh->read_blocks, g_ptr_array_unref);
+  fh->read_next = -1;
+}
+
 static void
 file_handle_close_stream (FileHandle *file_handle)
 {
   g_debug ("file_handle_close_stream\n");
+  file_handle_clear_read_cache (file_handle);
   if (file_handle->stream)
     {
       switch (file_handle->op)
@@ -276,13 +471,19 @@ file_handle_close_stream (FileHandle *file_handle)
     }
 }
 
-/* Called on hash table removal */
+/* Called on hash table removal, with the path shard locked */
 static void
 file_handle_free (FileHandle *file_handle)
 {
-  g_hash_table_remove (global_active_fh_map, file_handle);
+  MapShard *active_shard;
+
+  active_shard = active_shard_for_handle (file_handle);
+  g_mutex_lock (&active_shard->mutex);
+  g_hash_table_remove (active_shard->map, file_handle);
+  g_mutex_unlock (&active_shard->mutex);
 
   file_handle_close_stream (file_handle);
+  g_cond_clear (&file_handle->read_cond);
   g_mutex_clear (&file_handle->mutex);
   g_free (file_handle->path);
   g_free (file_handle);
@@ -291,27 +492,29 @@ file_handle_free (FileHandle *file_handle)
 static FileHandle *
 get_file_handle_for_path (const gchar *path)
 {
+  MapShard   *shard = &path_to_fh_shards[path_shard_index (path)];
   FileHandle *fh;
 
-  g_mutex_lock (&global_mutex);
+  g_mutex_lock (&shard->mutex);
 
-  fh = g_hash_table_lookup (global_path_to_fh_map, path);
+  fh = g_hash_table_lookup (shard->map, path);
 
   if (fh)
     file_handle_ref (fh);
 
-  g_mutex_unlock (&global_mutex);
+  g_mutex_unlock (&shard->mutex);
   return fh;
 }
 
 static FileHandle *
 get_or_create_file_handle_for_path (const gchar *path)
 {
+  MapShard   *shard = &path_to_fh_shards[path_shard_index (path)];
   FileHandle *fh;
 
-  g_mutex_lock (&global_mutex);
+  g_mutex_lock (&shard->mutex);
 
-  fh = g_hash_table_lookup (global_path_to_fh_map, path);
+  fh = g_hash_table_lookup (shard->map, path);
 
   if (fh)
     {
@@ -320,55 +523,102 @@ get_or_create_file_handle_for_path (const gchar *path)
   else
     {
       fh = file_handle_new (path);
-      g_hash_table_insert (global_path_to_fh_map, fh->path, fh);
+      g_hash_table_insert (shard->map, fh->path, fh);
     }
 
-  g_mutex_unlock (&global_mutex);
+  g_mutex_unlock (&shard->mutex);
   return fh;
 }
 
 static FileHandle *
 get_file_handle_from_info (struct fuse_file_info *fi)
 {
+  MapShard   *shard;
   FileHandle *fh;
 
-  g_mutex_lock (&global_mutex);
-
   fh = GET_FILE_HANDLE (fi);
+  shard = active_shard_for_handle (fh);
+
+  g_mutex_lock (&shard->mutex);
 
   /* If the file handle is still valid, its value won't change. If
    * invalid, it's set to NULL. */
-  fh = g_hash_table_lookup (global_active_fh_map, fh);
+  fh = g_hash_table_lookup (shard->map, fh);
 
-  if (fh)
-    file_handle_ref (fh);
+  if (fh && !file_handle_try_ref (fh))
+    fh = NULL;
 
-  g_mutex_unlock (&global_mutex);
+  g_mutex_unlock (&shard->mutex);
   return fh;
 }
 
 static void
 reindex_file_handle_for_path (const gchar *old_path, const gchar *new_path)
 {
+  gint        old_index = path_shard_index (old_path);
+  gint        new_index = path_shard_index (new_path);
+  MapShard   *old_shard = &path_to_fh_shards[old_index];
+  MapShard   *new_shard = &path_to_fh_shards[new_index];
   gchar      *old_path_internal;
   FileHandle *fh;
 
-  g_mutex_lock (&global_mutex);
+  /* Lock in index order to avoid deadlocks */
+  if (old_index <= new_index)
+    {
+      g_mutex_lock (&old_shard->mutex);
+      if (new_shard != old_shard)
+        g_mutex_lock (&new_shard->mutex);
+    }
+  else
+    {
+      g_mutex_lock (&new_shard->mutex);
+      g_mutex_lock (&old_shard->mutex);
+    }
 
-  if (!g_hash_table_lookup_extended (global_path_to_fh_map, old_path,
+  if (!g_hash_table_lookup_extended (old_shard->map, old_path,
                                      (gpointer *) &old_path_internal,
                                      (gpointer *) &fh))
       goto out;
 
-  g_hash_table_steal (global_path_to_fh_map, old_path);
+  g_hash_table_steal (old_shard->map, old_path);
 
   g_free (fh->path);
   fh->path = g_strdup (new_path);
+  g_atomic_int_set (&fh->path_shard, new_index);
 
-  g_hash_table_insert (global_path_to_fh_map, fh->path, fh);
+  g_hash_table_insert (new_shard->map, fh->path, fh);
 
  out:
-  g_mutex_unlock (&global_mutex);
+  if (new_shard != old_shard)
+    g_mutex_unlock (&new_shard->mutex);
+  g_mutex_unlock (&old_shard->mutex);
+}
+
+static gdouble
+get_cache_timeout_for_root (GFile *root)
+{
+  const gchar *env;
+  gchar       *scheme;
+  gdouble      timeout;
+  guint        i;
+
+  env = g_getenv ("GVFS_FUSE_CACHE_TIMEOUT");
+  if (env != NULL)
+    return g_ascii_strtod (env, NULL);
+
+  timeout = DEFAULT_CACHE_TIMEOUT;
+  scheme = g_file_get_uri_scheme (root);
+  for (i = 0; scheme != NULL && i < G_N_ELEMENTS (cache_timeouts); i++)
+    {
+      if (strcmp (scheme, cache_timeouts[i].scheme) == 0)
+        {
+          timeout = cache_timeouts[i].timeout;
+          break;
+        }
+    }
+  g_free (scheme);
+
+  return timeout;
 }
 
 static MountRecord *
@@ -381,6 +631,7 @@ mount_record_new (GMount *mount)
   mount_record->root = g_mount_get_root (mount);
   mount_record->name = g_strdup (g_object_get_data (G_OBJECT (mount), "g-stable-name"));
   mount_record->creation_time = time (NULL);
+  mount_record->cache_timeout = get_cache_timeout_for_root (mount_record->root);
   
   return mount_record;
 }
@@ -619,6 +870,277 @@ file_from_full_path (const gchar *path)
   return file;
 }
 
+/* ---------------- *
+ * Attribute cache  *
+ * ---------------- */
+
+static gdouble
+get_cache_timeout_for_path (const gchar *path)
+{
+  const gchar *s1, *s2;
+  gdouble      timeout = 0.0;
+  GList       *l;
+
+  s1 = path;
+  while (*s1 == '/')
+    s1++;
+  s2 = strchr (s1, '/');
+  if (s2 == NULL)
+    s2 = s1 + strlen (s1);
+
+  mount_list_lock ();
+
+  for (l = mount_list; l != NULL; l = l->next)
+    {
+      MountRecord *mount_record = l->data;
+
+      if (strncmp (s1, mount_record->name, s2 - s1) == 0 &&
+          mount_record->name[s2 - s1] == '\0')
+        {
+          timeout = mount_record->cache_timeout;
+          break;
+        }
+    }
+
+  mount_list_unlock ();
+
+  return timeout;
+}
+
+static guint
+attr_cache_get_generation (void)
+{
+  guint generation;
+
+  g_mutex_lock (&attr_cache_mutex);
+  generation = attr_cache_clock;
+  g_mutex_unlock (&attr_cache_mutex);
+
+  return generation;
+}
+
+static gboolean
+attr_cache_lookup (const gchar *path, struct stat *sbuf, gint *result)
+{
+  AttrCacheEntry *entry;
+  gboolean        found = FALSE;
+
+  g_mutex_lock (&attr_cache_mutex);
+
+  entry = g_hash_table_lookup (attr_cache, path);
+  if (entry != NULL && entry->expires > g_get_monotonic_time ())
+    {
+      *sbuf = entry->sbuf;
+      *result = entry->result;
+      found = TRUE;
+    }
+
+  g_mutex_unlock (&attr_cache_mutex);
+
+  return found;
+}
+
+/* Drops the result if something that affects path was invalidated
+ * since generation was taken, it may be stale then */
+static void
+attr_cache_insert (const gchar *path, const struct stat *sbuf, gint result,
+                   gdouble timeout, guint generation)
+{
+  AttrCacheEntry *entry;
+  guint           stamp;
+
+  if (timeout <= 0)
+    return;
+
+  g_mutex_lock (&attr_cache_mutex);
+
+  stamp = GPOINTER_TO_UINT (g_hash_table_lookup (attr_cache_stamps, path));
+
+  if (generation >= attr_cache_generation && generation >= stamp)
+    {
+      if (g_hash_table_size (attr_cache) >= ATTR_CACHE_MAX_ENTRIES)
+        g_hash_table_remove_all (attr_cache);
+
+      entry = g_new (AttrCacheEntry, 1);
+      entry->result = result;
+      entry->sbuf = *sbuf;
+      entry->expires = g_get_monotonic_time () + timeout * G_USEC_PER_SEC;
+      g_hash_table_insert (attr_cache, g_strdup (path), entry);
+    }
+
+  g_mutex_unlock (&attr_cache_mutex);
+}
+
+/* Call with attr_cache_mutex held */
+static void
+attr_cache_invalidate_unlocked (const gchar *path, gboolean recursive)
+{
+  GHashTableIter iter;
+  const gchar   *key;
+  gchar         *parent;
+  gsize          len;
+
+  attr_cache_generation = ++attr_cache_clock;
+
+  g_hash_table_remove (attr_cache, path);
+
+  /* The parent's times change with its entries */
+  parent = g_path_get_dirname (path);
+  g_hash_table_remove (attr_cache, parent);
+  g_free (parent);
+
+  if (recursive)
+    {
+      len = strlen (path);
+      g_hash_table_iter_init (&iter, attr_cache);
+      while (g_hash_table_iter_next (&iter, (gpointer *) &key, NULL))
+        {
+          if (strncmp (key, path, len) == 0 && key[len] == '/')
+            g_hash_table_iter_remove (&iter);
+        }
+    }
+}
+
+static void
+attr_cache_invalidate (const gchar *path)
+{
+  g_mutex_lock (&attr_cache_mutex);
+  attr_cache_invalidate_unlocked (path, FALSE);
+  g_mutex_unlock (&attr_cache_mutex);
+}
+
+/* Only drops path itself, for writes to a file. Unlike
+ * attr_cache_invalidate() this leaves lookups of other paths that are
+ * in flight alone. */
+static void
+attr_cache_invalidate_file (const gchar *path)
+{
+  g_mutex_lock (&attr_cache_mutex);
+
+  g_hash_table_remove (attr_cache, path);
+
+  if (g_hash_table_size (attr_cache_stamps) >= ATTR_CACHE_MAX_ENTRIES)
+    {
+      /* Forgetting stamps is only safe when nothing older is trusted */
+      g_hash_table_remove_all (attr_cache_stamps);
+      attr_cache_generation = ++attr_cache_clock;
+    }
+  else
+    {
+      g_hash_table_insert (attr_cache_stamps, g_strdup (path),
+                           GUINT_TO_POINTER (++attr_cache_clock));
+    }
+
+  g_mutex_unlock (&attr_cache_mutex);
+}
+
+/* Also drops everything below path, for renamed and removed directories */
+static void
+attr_cache_invalidate_tree (const gchar *path)
+{
+  g_mutex_lock (&attr_cache_mutex);
+  attr_cache_invalidate_unlocked (path, TRUE);
+  g_mutex_unlock (&attr_cache_mutex);
+}
+
+static void
+dir_monitor_invalidate_file (const gchar *dir_path, GFile *dir, GFile *file,
+                             gboolean recursive)
+{
+  gchar *basename;
+  gchar *path;
+
+  if (file == NULL)
+    return;
+
+  if (g_file_equal (file, dir))
+    {
+      attr_cache_invalidate_tree (dir_path);
+      return;
+    }
+
+  basename = g_file_get_basename (file);
+  path = g_build_path ("/", dir_path, basename, NULL);
+
+  g_mutex_lock (&attr_cache_mutex);
+  attr_cache_invalidate_unlocked (path, recursive);
+  g_mutex_unlock (&attr_cache_mutex);
+
+  g_free (path);
+  g_free (basename);
+}
+
+/* Runs in the subthread main loop */
+static void
+dir_monitor_changed_cb (GFileMonitor      *monitor,
+                        GFile             *file,
+                        GFile             *other_file,
+                        GFileMonitorEvent  event_type,
+                        gpointer           user_data)
+{
+  const gchar *dir_path = g_object_get_data (G_OBJECT (monitor), "gvfs-fuse-path");
+  GFile       *dir = g_object_get_data (G_OBJECT (monitor), "gvfs-fuse-dir");
+
+  g_debug ("dir_monitor_changed_cb: %s, event %d\n", dir_path, event_type);
+
+  if (event_type == G_FILE_MONITOR_EVENT_UNMOUNTED)
+    {
+      attr_cache_invalidate_tree (dir_path);
+      return;
+    }
+
+  /* Moved and deleted entries may be directories with cached children */
+  dir_monitor_invalidate_file (dir_path, dir, file, TRUE);
+  dir_monitor_invalidate_file (dir_path, dir, other_file, TRUE);
+}
+
+/* Watches a directory that was listed, so cached entries of it are
+ * dropped when the backend reports changes */
+static void
+dir_monitor_ensure (const gchar *path, GFile *dir)
+{
+  GFileMonitor *monitor;
+  gboolean      exists;
+
+  g_mutex_lock (&attr_cache_mutex);
+  exists = g_hash_table_contains (dir_monitors, path) ||
+           g_hash_table_size (dir_monitors) >= DIR_MONITORS_MAX;
+  g_mutex_unlock (&attr_cache_mutex);
+
+  if (exists)
+    return;
+
+  /* Many backends don't support monitors, they rely on the timeouts */
+  monitor = g_file_monitor_directory (dir, G_FILE_MONITOR_WATCH_MOVES, NULL, NULL);
+  if (monitor == NULL)
+    return;
+
+  g_object_set_data_full (G_OBJECT (monitor), "gvfs-fuse-path", g_strdup (path), g_free);
+  g_object_set_data_full (G_OBJECT (monitor), "gvfs-fuse-dir", g_object_ref (dir), g_object_unref);
+  g_signal_connect (monitor, "changed", G_CALLBACK (dir_monitor_changed_cb), NULL);
+
+  g_mutex_lock (&attr_cache_mutex);
+  if (!g_hash_table_contains (dir_monitors, path))
+    {
+      g_hash_table_insert (dir_monitors, g_strdup (path), monitor);
+      monitor = NULL;
+    }
+  g_mutex_unlock (&attr_cache_mutex);
+
+  if (monitor != NULL)
+    {
+      g_file_monitor_cancel (monitor);
+      g_object_unref (monitor);
+    }
+}
+
+static void
+dir_monitor_free (GFileMonitor *monitor)
+{
+  g_file_monitor_cancel (monitor);
+  g_object_unref (monitor);
+}
+
 /* ------------- *
  * VFS functions *
  * ------------- */
@@ -821,6 +1343,9 @@ getattr_for_file_handle (FileHandle *fh, struct stat *sbuf)
   GError    *error  = NULL;
   gint       result = 0;
 
+  /* The stream may be in use by a read without the lock */
+  file_handle_wait_for_reads (fh);
+
   switch (fh->op)
     {
     case FILE_OP_READ:
@@ -937,9 +1462,15 @@ vfs_getattr (const gchar *path, struct stat *sbuf, struct fuse_file_info *fi)
                 }
             }
         }
-      else
+      else if (!attr_cache_lookup (path, sbuf, &result))
         {
+          guint generation = attr_cache_get_generation ();
+
           result = getattr_for_file (file, sbuf);
+
+          if (result == 0 || result == -ENOENT)
+            attr_cache_insert (path, sbuf, result,
+                               get_cache_timeout_for_path (path), generation);
         }
 
       g_object_unref (file);
@@ -1029,6 +1560,7 @@ setup_output_stream (GFile *file, FileHandle *fh, int flags)
         }
       else
         {
+          file_handle_clear_read_cache (fh);
           g_input_stream_close (fh->stream, NULL, NULL);
           g_object_unref (fh->stream);
           fh->stream = NULL;
@@ -1235,6 +1767,8 @@ vfs_create (const gchar *path, mode_t mode, struct fuse_file_info *fi)
       result = -ENOENT;
     }
 
+  attr_cache_invalidate (path);
+
   g_debug ("vfs_create: -> %s\n", g_strerror (-result));
 
   return result;
@@ -1258,94 +1792,373 @@ vfs_release (const gchar *path, struct fuse_file_info *fi)
       file_handle_unref (fh);
     }
 
+  /* Written data may only show up in the attributes after closing */
+  attr_cache_invalidate (path);
+
   return 0;
 }
 
-static gint
-read_stream (FileHandle *fh, gchar *output_buf, size_t output_buf_size, off_t offset)
+/* Call with fh locked. Returns an idle stream to read the block at
+ * offset with, or NULL if all of them are busy. */
+static ReadStream *
+pick_read_stream (FileHandle *fh, goffset offset)
 {
-  GInputStream *input_stream;
-  gint          n_bytes_skipped = 0;
-  gsize         n_bytes_read    = 0;
-  gint          result          = 0;
-  GError       *error           = NULL;
+  ReadStream *read_stream;
+  ReadStream *seekable = NULL;
+  ReadStream *skippable = NULL;
+  ReadStream *reopenable = NULL;
+  guint i;
 
-  input_stream = fh->stream;
+  if (fh->read_streams == NULL)
+    {
+      fh->read_streams = g_ptr_array_new_with_free_func ((GDestroyNotify) read_stream_free);
+
+      read_stream = g_new0 (ReadStream, 1);
+      read_stream->stream = g_object_ref (fh->stream);
+      read_stream->pos = fh->pos;
+      read_stream->primary = TRUE;
+      g_ptr_array_add (fh->read_streams, read_stream);
+    }
 
-  if (offset != fh->pos)
+  for (i = 0; i < fh->read_streams->len; i++)
     {
-      if (g_seekable_can_seek (G_SEEKABLE (input_stream)))
-        {
-          /* Can seek */
+      read_stream = g_ptr_array_index (fh->read_streams, i);
 
-          g_debug ("read_stream: seeking to offset %jd.\n", offset);
+      if (read_stream->busy)
+        {
+          /* Wait for a stream that is about to get there, rather than
+           * having readahead of one reader open streams of its own */
+          if (read_stream->busy_end == offset)
+            return NULL;
+          continue;
+        }
 
-          if (g_seekable_seek (G_SEEKABLE (input_stream), offset, G_SEEK_SET, NULL, &error))
-            {
-              fh->pos = offset;
-            }
-          else
-            {
-              result = -errno_from_error (error);
-              g_error_free (error);
-            }
+      if (read_stream->stream == NULL)
+        {
+          /* Failed to open before */
+          reopenable = read_stream;
+          continue;
         }
-      else if (offset > fh->pos)
+
+      if (read_stream->pos == offset)
+        return read_stream;
+
+      if (g_seekable_can_seek (G_SEEKABLE (read_stream->stream)))
+        seekable = read_stream;
+      else if (read_stream->pos >= 0 && read_stream->pos < offset)
         {
-          /* Can skip ahead */
+          if (skippable == NULL || read_stream->pos > skippable->pos)
+            skippable = read_stream;
+        }
+      else if (!read_stream->primary)
+        reopenable = read_stream;
+    }
 
-          g_debug ("read_stream: skipping to offset %jd.\n", offset);
+  /* Rather open another stream than move one that is reading along
+   * elsewhere, parallel readers stay sequential that way */
+  if (fh->read_streams->len < READ_STREAMS_MAX)
+    {
+      read_stream = g_new0 (ReadStream, 1);
+      read_stream->pos = -1;
+      g_ptr_array_add (fh->read_streams, read_stream);
+      return read_stream;
+    }
 
-          n_bytes_skipped = g_input_stream_skip (input_stream, offset - fh->pos, NULL, &error);
+  if (seekable)
+    return seekable;
+  if (skippable)
+    return skippable;
+  return reopenable;
+}
 
-          if (n_bytes_skipped > 0)
-            fh->pos += n_bytes_skipped;
+/* Called without the lock, the stream is owned by the caller while busy */
+static gint
+read_stream_at (GFile *file, ReadStream *read_stream, goffset offset,
+                gchar *buf, gsize size, gsize *n_bytes_read)
+{
+  GError *error = NULL;
+  gssize  n_bytes_skipped;
+
+  *n_bytes_read = 0;
+
+  if (read_stream->stream != NULL &&
+      read_stream->pos != offset &&
+      !g_seekable_can_seek (G_SEEKABLE (read_stream->stream)) &&
+      (read_stream->pos < 0 || read_stream->pos > offset))
+    {
+      /* Can't seek, can't skip backwards, start over */
+
+      g_debug ("read_stream_at: reopening to get to offset %jd.\n", offset);
+
+      g_assert (!read_stream->primary);
+      g_input_stream_close (read_stream->stream, NULL, NULL);
+      g_clear_object (&read_stream->stream);
+    }
+
+  if (read_stream->stream == NULL)
+    {
+      read_stream->stream = G_INPUT_STREAM (g_file_read (file, NULL, &error));
+      if (read_stream->stream == NULL)
+        goto error;
+      read_stream->pos = 0;
+    }
+
+  if (read_stream->pos != offset)
+    {
+      if (g_seekable_can_seek (G_SEEKABLE (read_stream->stream)))
+        {
+          g_debug ("read_stream_at: seeking to offset %jd.\n", offset);
+
+          read_stream->pos = -1;
+          if (!g_seekable_seek (G_SEEKABLE (read_stream->stream), offset,
+                                G_SEEK_SET, NULL, &error))
+            goto error;
+          read_stream->pos = offset;
+        }
+      else
+        {
+          g_debug ("read_stream_at: skipping to offset %jd.\n", offset);
 
-          if (offset != fh->pos)
+          while (read_stream->pos < offset)
             {
-              if (error)
-                {
-                  result = -errno_from_error (error);
-                  g_error_free (error);
-                }
-              else
+              n_bytes_skipped = g_input_stream_skip (read_stream->stream,
+                                                     offset - read_stream->pos,
+                                                     NULL, &error);
+              if (n_bytes_skipped <= 0)
                 {
-                  result = -EIO;
+                  read_stream->pos = -1;
+                  goto error;
                 }
+              read_stream->pos += n_bytes_skipped;
             }
         }
-      else
-        {
-          /* Can't seek, can't skip backwards */
+    }
 
-          g_debug ("read_stream: can't seek nor skip to offset %jd!\n", offset);
+  g_input_stream_read_all (read_stream->stream,
+                           buf, size,
+                           n_bytes_read,
+                           NULL, &error);
+  if (error != NULL)
+    {
+      g_debug ("read_stream_at: wanted %zd bytes, but got %zd.\n", size, *n_bytes_read);
+      read_stream->pos = -1;
+      goto error;
+    }
 
-          result = -ENOTSUP;
-        }
+  read_stream->pos += *n_bytes_read;
+
+  return 0;
+
+ error:
+  if (error == NULL)
+    return -EIO;
+  else
+    {
+      gint result = -errno_from_error (error);
+      g_error_free (error);
+      return result;
     }
+}
 
-  if (result == 0)
+/* Call with fh locked. Marks a stream to read size bytes at offset with
+ * as busy, or returns NULL if there is none. The caller drops the lock
+ * while reading. */
+static ReadStream *
+acquire_read_stream (FileHandle *fh, goffset offset, gsize size)
+{
+  ReadStream *read_stream;
+
+  read_stream = pick_read_stream (fh, offset);
+  if (read_stream == NULL)
+    return NULL;
+
+  read_stream->busy = TRUE;
+  read_stream->busy_end = offset + size;
+  fh->n_busy_reads++;
+
+  return read_stream;
+}
+
+/* Call with fh locked */
+static void
+release_read_stream (FileHandle *fh, ReadStream *read_stream)
+{
+  read_stream->busy = FALSE;
+  fh->n_busy_reads--;
+  g_cond_broadcast (&fh->read_cond);
+}
+
+/* Call with fh locked, returns the block that offset is in if it is
+ * cached or being loaded. A block that came up short at the end of the
+ * file still covers a full block size, reads there get end of file. */
+static ReadBlock *
+find_read_block (FileHandle *fh, goffset offset)
+{
+  ReadBlock *block;
+  guint      i;
+
+  if (fh->read_blocks == NULL)
+    return NULL;
+
+  for (i = 0; i < fh->read_blocks->len; i++)
     {
-      g_input_stream_read_all (input_stream,
-                               output_buf,
-                               output_buf_size,
-                               &n_bytes_read,
-                               NULL,
-                               &error);
+      block = g_ptr_array_index (fh->read_blocks, i);
+      if (block->offset <= offset && offset < block->offset + READ_BLOCK_SIZE)
+        return block;
+    }
 
-      fh->pos += n_bytes_read;
-      result = n_bytes_read;
+  return NULL;
+}
+
+/* Call with fh locked, drops the lock while reading */
+static ReadBlock *
+get_read_block (FileHandle *fh, GFile *file, goffset offset, gint *result)
+{
+  ReadStream *read_stream = NULL;
+  ReadBlock  *block;
+  ReadBlock  *oldest;
+  gsize       n_bytes_read;
+  guint       i;
+
+  while (TRUE)
+    {
+      if (fh->op != FILE_OP_READ)
+        {
+          *result = -EIO;
+          return NULL;
+        }
 
-      if (error != NULL)
+      block = find_read_block (fh, offset);
+      if (block != NULL && !block->loading)
         {
-          g_debug ("read_stream: wanted %zd bytes, but got %zd.\n", output_buf_size, n_bytes_read);
+          block->last_used = ++fh->read_clock;
+          return block;
+        }
 
-          result = -errno_from_error (error);
-          g_error_free (error);
+      /* Wait for the other reader of this block, or for a free stream */
+      if (block != NULL ||
+          (read_stream = acquire_read_stream (fh, offset, READ_BLOCK_SIZE)) == NULL)
+        {
+          g_cond_wait (&fh->read_cond, &fh->mutex);
+          continue;
         }
+
+      break;
     }
 
-  return result;
+  if (fh->read_blocks == NULL)
+    fh->read_blocks = g_ptr_array_new_with_free_func ((GDestroyNotify) read_block_free);
+
+  if (fh->read_blocks->len >= READ_CACHE_BLOCKS)
+    {
+      oldest = NULL;
+      for (i = 0; i < fh->read_blocks->len; i++)
+        {
+          block = g_ptr_array_index (fh->read_blocks, i);
+          if (!block->loading &&
+              (oldest == NULL || block->last_used < oldest->last_used))
+            oldest = block;
+        }
+      if (oldest != NULL)
+        g_ptr_array_remove_fast (fh->read_blocks, oldest);
+    }
+
+  block = g_new0 (ReadBlock, 1);
+  block->offset = offset;
+  block->loading = TRUE;
+  block->data = g_malloc (READ_BLOCK_SIZE);
+  g_ptr_array_add (fh->read_blocks, block);
+  g_mutex_unlock (&fh->mutex);
+
+  *result = read_stream_at (file, read_stream, offset,
+                            block->data, READ_BLOCK_SIZE, &n_bytes_read);
+
+  g_mutex_lock (&fh->mutex);
+  release_read_stream (fh, read_stream);
+
+  if (*result < 0)
+    {
+      g_ptr_array_remove_fast (fh->read_blocks, block);
+      return NULL;
+    }
+
+  block->size = n_bytes_read;
+  block->loading = FALSE;
+  block->last_used = ++fh->read_clock;
+
+  return block;
+}
+
+/* Call with fh locked, drops the lock while reading */
+static gint
+read_uncached (FileHandle *fh, GFile *file, gchar *output_buf, size_t output_buf_size, off_t offset)
+{
+  ReadStream *read_stream;
+  gsize       n_bytes_read;
+  gint        result;
+
+  while (TRUE)
+    {
+      if (fh->op != FILE_OP_READ)
+        return -EIO;
+
+      read_stream = acquire_read_stream (fh, offset, output_buf_size);
+      if (read_stream != NULL)
+        break;
+
+      g_cond_wait (&fh->read_cond, &fh->mutex);
+    }
+
+  g_mutex_unlock (&fh->mutex);
+
+  result = read_stream_at (file, read_stream, offset,
+                           output_buf, output_buf_size, &n_bytes_read);
+
+  g_mutex_lock (&fh->mutex);
+  release_read_stream (fh, read_stream);
+
+  return result < 0 ? result : (gint) n_bytes_read;
+}
+
+/* Call with fh locked */
+static gint
+read_cached (FileHandle *fh, GFile *file, gchar *output_buf, size_t output_buf_size, off_t offset)
+{
+  ReadBlock *block;
+  gsize      n_bytes_read = 0;
+  gsize      skip;
+  gsize      n;
+  gint       result = 0;
+
+  /* Only read whole blocks once the file is read sequentially, or
+   * when the kernel reads ahead into a block that is already there */
+  if (offset != fh->read_next && find_read_block (fh, offset) == NULL)
+    {
+      fh->read_next = offset + output_buf_size;
+      return read_uncached (fh, file, output_buf, output_buf_size, offset);
+    }
+
+  fh->read_next = offset + output_buf_size;
+
+  while (n_bytes_read < output_buf_size)
+    {
+      block = get_read_block (fh, file, offset + n_bytes_read, &result);
+      if (block == NULL)
+        return n_bytes_read > 0 ? (gint) n_bytes_read : result;
+
+      skip = offset + n_bytes_read - block->offset;
+      if (skip >= block->size)
+        break;
+
+      n = MIN (block->size - skip, output_buf_size - n_bytes_read);
+      memcpy (output_buf + n_bytes_read, block->data + skip, n);
+      n_bytes_read += n;
+
+      if (block->size < READ_BLOCK_SIZE)
+        break;
+    }
+
+  return (gint) n_bytes_read;
 }
 
 static gint
@@ -1369,15 +2182,7 @@ vfs_read (const gchar *path, gchar *buf, size_t size,
 
           if (result == 0)
             {
-              result = read_stream (fh, buf, size, offset);
-
-              if (result == -ENOTSUP && offset < fh->pos)
-                {
-                  file_handle_close_stream (fh);
-                  result = setup_input_stream (file, fh);
-                  if (result == 0)
-                    result = read_stream (fh, buf, size, offset);
-                }
+              result = read_cached (fh, file, buf, size, offset);
             }
           else
             {
@@ -1516,6 +2321,8 @@ vfs_write (const gchar *path, const gchar *buf, size_t len, off_t offset,
       result = -EIO;
     }
 
+  attr_cache_invalidate_file (path);
+
   if (result < 0)
     g_debug ("vfs_write: -> %s\n", g_strerror (-result));
   else
@@ -1555,14 +2362,21 @@ vfs_opendir (const gchar *path, struct fuse_file_info *fi)
 }
 
 static gint
-readdir_for_file (GFile *base_file, gpointer buf, fuse_fill_dir_t filler)
+readdir_for_file (const gchar *path, GFile *base_file, gpointer buf, fuse_fill_dir_t filler)
 {
   GFileEnumerator *enumerator;
   GFileInfo       *file_info;
   GError          *error = NULL;
+  gdouble          timeout;
+  guint            generation;
 
   g_assert (base_file != NULL);
 
+  timeout = get_cache_timeout_for_path (path);
+  if (timeout > 0)
+    dir_monitor_ensure (path, base_file);
+  generation = attr_cache_get_generation ();
+
   enumerator = g_file_enumerate_children (base_file,
                                           G_FILE_ATTRIBUTE_STANDARD_NAME "," QUERY_ATTRIBTUES,
                                           0, NULL, &error);
@@ -1594,6 +2408,14 @@ readdir_for_file (GFile *base_file, gpointer buf, fuse_fill_dir_t filler)
 
       set_attributes_from_info (file_info, &sbuf);
 
+      if (timeout > 0)
+        {
+          gchar *child_path = g_build_path ("/", path, g_file_info_get_name (file_info), NULL);
+
+          attr_cache_insert (child_path, &sbuf, 0, timeout, generation);
+          g_free (child_path);
+        }
+
       filler (buf, g_file_info_get_name (file_info), &sbuf, 0, FUSE_FILL_DIR_PLUS);
       g_object_unref (file_info);
     }
@@ -1637,7 +2459,7 @@ vfs_readdir (const gchar *path, gpointer buf, fuse_fill_dir_t filler, off_t offs
     {
       /* Submount */
 
-      result = readdir_for_file (base_file, buf, filler);
+      result = readdir_for_file (path, base_file, buf, filler);
 
       g_object_unref (base_file);
     }
@@ -1712,6 +2534,9 @@ vfs_rename (const gchar *old_path, const gchar *new_path, unsigned int vfs_flags
   if (new_file)
     g_object_unref (new_file);
 
+  attr_cache_invalidate_tree (old_path);
+  attr_cache_invalidate_tree (new_path);
+
   g_debug ("vfs_rename: -> %s\n", g_strerror (-result));
 
   return result;
@@ -1761,6 +2586,8 @@ vfs_unlink (const gchar *path)
       result = -ENOENT;
     }
 
+  attr_cache_invalidate (path);
+
   g_debug ("vfs_unlink: -> %s\n", g_strerror (-result));
 
   return result;
@@ -1799,6 +2626,8 @@ vfs_mkdir (const gchar *path, mode_t mode)
       result = -ENOENT;
     }
 
+  attr_cache_invalidate (path);
+
   g_debug ("vfs_mkdir: -> %s\n", g_strerror (-result));
 
   return result;
@@ -1855,6 +2684,8 @@ vfs_rmdir (const gchar *path)
       result = -ENOENT;
     }
 
+  attr_cache_invalidate_tree (path);
+
   g_debug ("vfs_rmdir: -> %s\n", g_strerror (-result));
 
   return result;
@@ -1869,6 +2700,8 @@ file_handle_get_size (FileHandle *fh,
 
   if (fh->stream == NULL)
     return FALSE;
+
+  file_handle_wait_for_reads (fh);
   
   info = NULL;
   if (fh->op == FILE_OP_READ)
@@ -2015,6 +2848,8 @@ vfs_ftruncate (const gchar *path, off_t size, struct fuse_file_info *fi)
       result = -ENOENT;
     }
 
+  attr_cache_invalidate (path);
+
   g_debug ("vfs_ftruncate: -> %s\n", g_strerror (-result));
 
   return result;
@@ -2084,6 +2919,8 @@ vfs_truncate (const gchar *path, off_t size)
       result = -ENOENT;
     }
 
+  attr_cache_invalidate (path);
+
   g_debug ("vfs_truncate: -> %s\n", g_strerror (-result));
 
   return result;
@@ -2124,6 +2961,8 @@ vfs_symlink (const gchar *path_old, const gchar *path_new)
       result = -ENOENT;
     }
 
+  attr_cache_invalidate (path_new);
+
   g_debug ("vfs_symlink: -> %s\n", g_strerror (-result));
 
   return result;
@@ -2274,6 +3113,8 @@ vfs_utimens (const gchar *path, const struct timespec tv [2], struct fuse_file_i
       result = -ENOENT;
     }
 
+  attr_cache_invalidate (path);
+
   g_debug ("vfs_utimens: -> %s\n", g_strerror (-result));
   return result;
 }
@@ -2300,6 +3141,8 @@ vfs_chmod (const gchar *path, mode_t mode, struct fuse_file_info *fi)
       g_object_unref (file);
     }
 
+  attr_cache_invalidate (path);
+
   return result;
 }
 
@@ -2406,6 +3249,7 @@ vfs_init (struct fuse_conn_info *conn, struct fuse_config *cfg)
 {
   GVfsDBusMountTracker *proxy;
   GError *error;
+  guint i;
   
   g_log_set_handler (NULL, G_LOG_LEVEL_DEBUG, log_debug, NULL);
   gvfs_setup_debug_handler ();
@@ -2418,10 +3262,22 @@ vfs_init (struct fuse_conn_info *conn, struct fuse_config *cfg)
   daemon_uid = getuid ();
   daemon_gid = getgid ();
 
-  global_path_to_fh_map = g_hash_table_new_full (g_str_hash, g_str_equal,
-                                                 NULL, (GDestroyNotify) file_handle_free);
-  global_active_fh_map = g_hash_table_new_full (g_direct_hash, g_direct_equal,
-                                                NULL, NULL);
+  for (i = 0; i < FH_MAP_SHARDS; i++)
+    {
+      g_mutex_init (&path_to_fh_shards[i].mutex);
+      path_to_fh_shards[i].map = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                        NULL, (GDestroyNotify) file_handle_free);
+      g_mutex_init (&active_fh_shards[i].mutex);
+      active_fh_shards[i].map = g_hash_table_new (g_direct_hash, g_direct_equal);
+    }
+  attr_cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  attr_cache_stamps = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  dir_monitors = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                        g_free, (GDestroyNotify) dir_monitor_free);
+
+  cfg->entry_timeout = KERNEL_CACHE_TIMEOUT;
+  cfg->attr_timeout = KERNEL_CACHE_TIMEOUT;
+  cfg->negative_timeout = KERNEL_CACHE_TIMEOUT;
 
   
   error = NULL;
@@ -2478,12 +3334,12 @@ vfs_init (struct fuse_conn_info *conn, struct fuse_config *cfg)
   /* Indicate O_TRUNC support for open() */
   fuse_set_feature_flag(conn, FUSE_CAP_ATOMIC_O_TRUNC);
 
-  /* Prevent out-of-order readahead */
-  fuse_unset_feature_flag(conn, FUSE_CAP_ASYNC_READ);
+  /* Out-of-order and parallel reads are sorted out by the read cache */
+  fuse_set_feature_flag(conn, FUSE_CAP_ASYNC_READ);
 #else
   /* Same as above for libfuse <3.17 */
   conn->want |= FUSE_CAP_ATOMIC_O_TRUNC;
-  conn->want &= ~FUSE_CAP_ASYNC_READ;
+  conn->want |= FUSE_CAP_ASYNC_READ;
 #endif
 
   return NULL;
@@ -2504,6 +3360,10 @@ vfs_destroy (gpointer param)
 
   g_clear_pointer (&subthread_main_loop, g_main_loop_unref);
 
+  g_clear_pointer (&dir_monitors, g_hash_table_destroy);
+  g_clear_pointer (&attr_cache, g_hash_table_destroy);
+  g_clear_pointer (&attr_cache_stamps, g_hash_table_destroy);
+
   mount_list_free ();
 }
 
@@ -19,9 +19,20 @@ G_BEGIN_DECLS
 /* Normal ops are faster, one minute timeout */
 #define G_VFS_DBUS_TIMEOUT_MSECS (1000*60)
 
+/* Flags for the OpenForReadFlags method */
+#define OPEN_FOR_READ_FLAG_CAN_SEEK      (1<<0)
+/* Read data is passed in a shared memory ring, see gvfssharedring.c */
+#define OPEN_FOR_READ_FLAG_SHARED_MEMORY (1<<1)
+
 /* Flags for the OpenForWriteFlags method */
 #define OPEN_FOR_WRITE_FLAG_CAN_SEEK     (1<<0)
 #define OPEN_FOR_WRITE_FLAG_CAN_TRUNCATE (1<<1)
+/* Writes may be pipelined, see the socket protocol description below */
+#define OPEN_FOR_WRITE_FLAG_PIPELINED_WRITES (1<<2)
+
+/* Passed along with the GFileQueryInfoFlags of Enumerate by clients
+ * that handle GotInfoCompact */
+#define G_VFS_ENUMERATE_FLAG_COMPACT_INFOS (1<<30)
 
 typedef struct {
   guint32 command;
@@ -41,14 +52,32 @@ typedef struct {
 #define G_VFS_DAEMON_SOCKET_PROTOCOL_REQUEST_SEEK_END 5
 #define G_VFS_DAEMON_SOCKET_PROTOCOL_REQUEST_QUERY_INFO 6
 #define G_VFS_DAEMON_SOCKET_PROTOCOL_REQUEST_TRUNCATE 7
+#define G_VFS_DAEMON_SOCKET_PROTOCOL_REQUEST_STREAMING 8
+#define G_VFS_DAEMON_SOCKET_PROTOCOL_REQUEST_INLINE_DATA 9
 
 /*
+cancel, streaming, inline data:
+no reply, streaming tells the daemon that the client reads sequentially
+(older daemons reply with an error, which clients ignore), inline data
+tells it that the client could not map the shared memory ring offered
+with OPEN_FOR_READ_FLAG_SHARED_MEMORY, so read data has to be sent in
+plain data replies; it goes out before the first read request
+
 read, readahead reply:
 type, seek_generation, size, data
 
+shared data reply (read, readahead reply with OPEN_FOR_READ_FLAG_SHARED_MEMORY):
+type, seek_generation, size, 4 bytes position of the data in the ring
+
 seek reply:
 type, pos (64),
 
+written reply:
+type, seq_nr, size
+(with OPEN_FOR_WRITE_FLAG_PIPELINED_WRITES the daemon completes short
+writes and may merge queued writes, the reply then carries the seq_nr
+of the last merged write and covers all of them)
+
 error:
 type, code, size, data (size bytes, 2 strings: domain, message)
 
@@ -73,6 +102,7 @@ typedef struct {
 #define G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_CLOSED   4
 #define G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_INFO     5
 #define G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_TRUNCATED 6
+#define G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_DATA_SHARED 7
 
 
 typedef union {
@@ -92,24 +92,78 @@ read_stringv (GDataInputStream *in)
   return strv;
 }
 
-char *
-gvfs_file_info_marshal (GFileInfo *info,
-			gsize     *size)
+/* Interned keys are sent as their index in the table, new keys as the
+ * next free index followed by the key itself. */
+#define KEY_NOT_INTERNED G_MAXUINT16
+
+static void
+put_key (GDataOutputStream *out,
+	 GHashTable *keys,
+	 const char *key)
+{
+  gpointer index;
+  guint n_keys;
+
+  if (keys == NULL)
+    {
+      put_string (out, key);
+      return;
+    }
+
+  if (g_hash_table_lookup_extended (keys, key, NULL, &index))
+    {
+      g_data_output_stream_put_uint16 (out, GPOINTER_TO_UINT (index), NULL, NULL);
+      return;
+    }
+
+  n_keys = g_hash_table_size (keys);
+  if (n_keys >= KEY_NOT_INTERNED)
+    {
+      g_data_output_stream_put_uint16 (out, KEY_NOT_INTERNED, NULL, NULL);
+      put_string (out, key);
+      return;
+    }
+
+  g_hash_table_insert (keys, g_strdup (key), GUINT_TO_POINTER (n_keys));
+  g_data_output_stream_put_uint16 (out, n_keys, NULL, NULL);
+  put_string (out, key);
+}
+
+static char *
+read_key (GDataInputStream *in,
+	  GPtrArray *keys)
+{
+  guint index;
+  char *key;
+
+  if (keys == NULL)
+    return read_string (in);
+
+  index = g_data_input_stream_read_uint16 (in, NULL, NULL);
+  if (index < keys->len)
+    return g_strdup (g_ptr_array_index (keys, index));
+
+  if (index != keys->len && index != KEY_NOT_INTERNED)
+    return NULL;
+
+  key = read_string (in);
+  if (index == keys->len)
+    g_ptr_array_add (keys, g_strdup (key));
+
+  return key;
+}
+
+static void
+marshal_info (GDataOutputStream *out,
+	      GFileInfo *info,
+	      GHashTable *keys)
 {
-  GOutputStream *memstream;
-  GDataOutputStream *out;
   GFileAttributeType type;
   GFileAttributeStatus status;
   GObject *obj;
   char **attrs, *attr;
-  char *data;
   int i;
 
-  memstream = g_memory_output_stream_new (NULL, 0, g_realloc, NULL);
-
-  out = g_data_output_stream_new (memstream);
-  g_object_unref (memstream);
-
   attrs = g_file_info_list_attributes (info, NULL);
 
   g_data_output_stream_put_uint32 (out,
@@ -123,7 +177,7 @@ gvfs_file_info_marshal (GFileInfo *info,
       type = g_file_info_get_attribute_type  (info, attr);
       status = g_file_info_get_attribute_status  (info, attr);
       
-      put_string (out, attr);
+      put_key (out, keys, attr);
       g_data_output_stream_put_byte (out, type, 
 				     NULL, NULL);
       g_data_output_stream_put_byte (out, status, 
@@ -196,38 +250,67 @@ gvfs_file_info_marshal (GFileInfo *info,
 	}
     }
 
+  g_strfreev (attrs);
+}
+
+char *
+gvfs_file_info_marshal (GFileInfo *info,
+			gsize     *size)
+{
+  GOutputStream *memstream;
+  GDataOutputStream *out;
+  char *data;
+
+  memstream = g_memory_output_stream_new (NULL, 0, g_realloc, NULL);
+
+  out = g_data_output_stream_new (memstream);
+  g_object_unref (memstream);
+
+  marshal_info (out, info, NULL);
+
   data = g_memory_output_stream_get_data (G_MEMORY_OUTPUT_STREAM (memstream));
   *size = g_memory_output_stream_get_data_size (G_MEMORY_OUTPUT_STREAM (memstream));
   g_object_unref (out);
-  g_strfreev (attrs);
   return data;
 }
 
-GFileInfo *
-gvfs_file_info_demarshal (char      *data,
-			  gsize      size)
+/* Returns FALSE if the data is malformed, info then holds the
+ * attributes read so far */
+static gboolean
+demarshal_info (GDataInputStream *in,
+		GFileInfo *info,
+		GPtrArray *keys)
 {
   guint32 num_attrs, i;
-  GInputStream *memstream;
-  GDataInputStream *in;
-  GFileInfo *info;
   char *attr, *str, **strv;
   GFileAttributeType type;
   GFileAttributeStatus status;
   GObject *obj;
   int objtype;
+  GError *error;
 
-  memstream = g_memory_input_stream_new_from_data (data, size, NULL);
-  in = g_data_input_stream_new (memstream);
-  g_object_unref (memstream);
-
-  info = g_file_info_new ();
-  num_attrs = g_data_input_stream_read_uint32 (in, NULL, NULL);
+  error = NULL;
+  num_attrs = g_data_input_stream_read_uint32 (in, NULL, &error);
+  if (error != NULL)
+    {
+      g_error_free (error);
+      return FALSE;
+    }
 
   for (i = 0; i < num_attrs; i++)
     {
-      attr = read_string (in);
-      type = g_data_input_stream_read_byte (in, NULL, NULL);
+      attr = read_key (in, keys);
+      if (attr == NULL)
+	return FALSE;
+
+      /* Stop at the end of the data, num_attrs can't be trusted */
+      type = g_data_input_stream_read_byte (in, NULL, &error);
+      if (error != NULL)
+	{
+	  g_error_free (error);
+	  g_free (attr);
+	  return FALSE;
+	}
       status = g_data_input_stream_read_byte (in, NULL, NULL);
 
       switch (type)
@@ -293,7 +376,7 @@ gvfs_file_info_demarshal (char      *data,
 	    {
 	      g_warning ("Unsupported GFileInfo object type %d\n", objtype);
 	      g_free (attr);
-	      goto out;
+	      return FALSE;
 	    }
 	  g_file_info_set_attribute_object (info, attr, obj);
 	  if (obj)
@@ -304,16 +387,154 @@ gvfs_file_info_demarshal (char      *data,
 	default:
 	  g_warning ("Unsupported GFileInfo attribute type %d\n", type);
 	  g_free (attr);
-	  goto out;
-	  break;
+	  return FALSE;
 	}
       g_file_info_set_attribute_status (info, attr, status);
       g_free (attr);
     }
-  
- out:
+
+  return TRUE;
+}
+
+GFileInfo *
+gvfs_file_info_demarshal (char      *data,
+			  gsize      size)
+{
+  GInputStream *memstream;
+  GDataInputStream *in;
+  GFileInfo *info;
+
+  memstream = g_memory_input_stream_new_from_data (data, size, NULL);
+  in = g_data_input_stream_new (memstream);
+  g_object_unref (memstream);
+
+  info = g_file_info_new ();
+  demarshal_info (in, info, NULL);
+
   g_object_unref (in);
   return info;
 }
 
+/* A batch holds many infos in the format above, prefixed by their
+ * count. Attribute keys are interned within the batch, so each key is
+ * only sent once per batch. */
+struct _GVfsFileInfoBatch {
+  GOutputStream *memstream;
+  GDataOutputStream *out;
+  GHashTable *keys;
+  guint32 n_infos;
+};
+
+GVfsFileInfoBatch *
+gvfs_file_info_batch_new (void)
+{
+  GVfsFileInfoBatch *batch;
+
+  batch = g_new0 (GVfsFileInfoBatch, 1);
+  batch->memstream = g_memory_output_stream_new (NULL, 0, g_realloc, g_free);
+  batch->out = g_data_output_stream_new (batch->memstream);
+  batch->keys = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  /* Room for the count */
+  g_data_output_stream_put_uint32 (batch->out, 0, NULL, NULL);
+
+  return batch;
+}
+
+void
+gvfs_file_info_batch_add (GVfsFileInfoBatch *batch,
+			  GFileInfo *info)
+{
+  marshal_info (batch->out, info, batch->keys);
+  batch->n_infos++;
+}
+
+guint
+gvfs_file_info_batch_get_n_infos (GVfsFileInfoBatch *batch)
+{
+  return batch->n_infos;
+}
+
+gsize
+gvfs_file_info_batch_get_size (GVfsFileInfoBatch *batch)
+{
+  return g_memory_output_stream_get_data_size (G_MEMORY_OUTPUT_STREAM (batch->memstream));
+}
+
+GBytes *
+gvfs_file_info_batch_free_to_bytes (GVfsFileInfoBatch *batch)
+{
+  GBytes *bytes;
+  guint32 n_infos;
+
+  n_infos = GUINT32_TO_BE (batch->n_infos);
+  memcpy (g_memory_output_stream_get_data (G_MEMORY_OUTPUT_STREAM (batch->memstream)),
+	  &n_infos, sizeof (n_infos));
+
+  g_output_stream_close (batch->memstream, NULL, NULL);
+  bytes = g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (batch->memstream));
+
+  g_object_unref (batch->out);
+  g_object_unref (batch->memstream);
+  g_hash_table_unref (batch->keys);
+  g_free (batch);
+
+  return bytes;
+}
+
+/* Returns the infos of a batch in order, or the ones before the
+ * first malformed one */
+GList *
+gvfs_file_info_demarshal_batch (const char *data,
+				gsize size)
+{
+  GInputStream *memstream;
+  GDataInputStream *in;
+  GPtrArray *keys;
+  GFileInfo *info;
+  GList *infos;
+  guint32 n_infos, i;
+
+  /* Every info takes at least its attribute count, don't believe a
+   * count that can't fit in the data */
+  if (size < sizeof (guint32))
+    {
+      g_warning ("Malformed GFileInfo batch\n");
+      return NULL;
+    }
+  memcpy (&n_infos, data, sizeof (n_infos));
+  n_infos = GUINT32_FROM_BE (n_infos);
+  if (n_infos > (size - sizeof (guint32)) / sizeof (guint32))
+    {
+      g_warning ("Malformed GFileInfo batch\n");
+      return NULL;
+    }
+
+  memstream = g_memory_input_stream_new_from_data (data + sizeof (guint32),
+						   size - sizeof (guint32),
+						   NULL);
+  in = g_data_input_stream_new (memstream);
+  g_object_unref (memstream);
+
+  keys = g_ptr_array_new_with_free_func (g_free);
+  infos = NULL;
+
+  for (i = 0; i < n_infos; i++)
+    {
+      info = g_file_info_new ();
+      if (!demarshal_info (in, info, keys))
+	{
+	  g_warning ("Malformed GFileInfo batch\n");
+	  g_object_unref (info);
+	  break;
+	}
+      infos = g_list_prepend (infos, info);
+    }
+
+  g_ptr_array_unref (keys);
+  g_object_unref (in);
+
+  return g_list_reverse (infos);
+}
+
 
@@ -32,6 +32,17 @@ char *     gvfs_file_info_marshal   (GFileInfo *info,
 GFileInfo *gvfs_file_info_demarshal (char      *data,
 				     gsize      size);
 
+typedef struct _GVfsFileInfoBatch GVfsFileInfoBatch;
+
+GVfsFileInfoBatch *gvfs_file_info_batch_new           (void);
+void               gvfs_file_info_batch_add           (GVfsFileInfoBatch *batch,
+						       GFileInfo         *info);
+guint              gvfs_file_info_batch_get_n_infos   (GVfsFileInfoBatch *batch);
+gsize              gvfs_file_info_batch_get_size      (GVfsFileInfoBatch *batch);
+GBytes *           gvfs_file_info_batch_free_to_bytes (GVfsFileInfoBatch *batch);
+GList *            gvfs_file_info_demarshal_batch     (const char        *data,
+						       gsize              size);
+
 G_END_DECLS
 
 #endif /* __G_VFS_FILE_INFO_H__ */
@@ -0,0 +1,312 @@
+/* GIO - GLib Input, Output and Streaming Library
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+#include <glib/gi18n-lib.h>
+#include <gio/gio.h>
+#include "gvfssharedring.h"
+
+/* A single producer, single consumer byte ring in a sealed memfd, used
+ * to pass read data from a daemon to a client without copying it
+ * through the stream socket.
+ *
+ * Positions are free running 32bit counters, the ring size is a power
+ * of two so they map to the same offset after wrapping. A block never
+ * wraps around the end of the ring, the producer skips the tail end
+ * instead. The producer announces blocks by position and length over
+ * the socket, the consumer hands space back by storing the end
+ * position of the last block it is done with in the header.
+ */
+
+#define SHARED_RING_MAGIC 0x47565352 /* "GVSR" */
+#define SHARED_RING_HEADER_SIZE 4096
+
+typedef struct {
+  guint32 magic;
+  guint32 size;
+  gint released; /* Only written by the consumer */
+} SharedRingHeader;
+
+struct _GVfsSharedRing {
+  int fd;
+  char *map;
+  gsize map_size;
+  SharedRingHeader *header;
+  char *data;
+  guint32 size;
+
+  /* Producer only */
+  guint32 head;
+};
+
+static GVfsSharedRing *
+shared_ring_map (int fd,
+                 gsize map_size,
+                 GError **error)
+{
+  GVfsSharedRing *ring;
+  char *map;
+  int errsv;
+
+  map = mmap (NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED)
+    {
+      errsv = errno;
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                   "mmap: %s", g_strerror (errsv));
+      return NULL;
+    }
+
+  ring = g_new0 (GVfsSharedRing, 1);
+  ring->fd = fd;
+  ring->map = map;
+  ring->map_size = map_size;
+  ring->header = (SharedRingHeader *)map;
+  ring->data = map + SHARED_RING_HEADER_SIZE;
+
+  return ring;
+}
+
+/**
+ * g_vfs_shared_ring_new:
+ * @size: size of the data area, a power of two
+ * @error: return location for a #GError
+ *
+ * Creates a new ring in a memfd, to be filled by the caller and passed
+ * on to the consumer with g_vfs_shared_ring_get_fd().
+ *
+ * Returns: the new ring, or %NULL if shared memory isn't available.
+ **/
+GVfsSharedRing *
+g_vfs_shared_ring_new (gsize size,
+                       GError **error)
+{
+#if defined(HAVE_MEMFD_CREATE) && defined(F_ADD_SEALS)
+  GVfsSharedRing *ring;
+  int fd;
+  int errsv;
+
+  g_return_val_if_fail (size > 0 && (size & (size - 1)) == 0, NULL);
+  g_return_val_if_fail (size <= G_MAXINT32, NULL);
+
+  fd = memfd_create ("gvfs-shared-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fd == -1)
+    {
+      errsv = errno;
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                   "memfd_create: %s", g_strerror (errsv));
+      return NULL;
+    }
+
+  /* The consumer must not be able to shrink the file under our mapping */
+  if (ftruncate (fd, SHARED_RING_HEADER_SIZE + size) == -1 ||
+      fcntl (fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == -1)
+    {
+      errsv = errno;
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                   "%s", g_strerror (errsv));
+      close (fd);
+      return NULL;
+    }
+
+  ring = shared_ring_map (fd, SHARED_RING_HEADER_SIZE + size, error);
+  if (ring == NULL)
+    {
+      close (fd);
+      return NULL;
+    }
+
+  ring->size = size;
+  ring->header->magic = SHARED_RING_MAGIC;
+  ring->header->size = size;
+  g_atomic_int_set (&ring->header->released, 0);
+
+  return ring;
+#else
+  g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                       _("Operation not supported"));
+  return NULL;
+#endif
+}
+
+/**
+ * g_vfs_shared_ring_new_from_fd:
+ * @fd: a file descriptor received from the producer
+ * @error: return location for a #GError
+ *
+ * Maps a ring created by g_vfs_shared_ring_new() on the other side.
+ * Takes ownership of @fd, also on failure.
+ *
+ * Returns: the ring, or %NULL if @fd doesn't hold a valid ring.
+ **/
+GVfsSharedRing *
+g_vfs_shared_ring_new_from_fd (int fd,
+                               GError **error)
+{
+  GVfsSharedRing *ring;
+  struct stat statbuf;
+  guint32 size;
+
+#ifdef F_GET_SEALS
+  const int expected_seals = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL;
+  int seals;
+
+  /* Without the seals the producer could truncate the file under our
+   * mapping and make us crash with SIGBUS */
+  seals = fcntl (fd, F_GET_SEALS);
+  if (seals == -1 || (seals & expected_seals) != expected_seals)
+    goto invalid;
+#else
+  goto invalid;
+#endif
+
+  if (fstat (fd, &statbuf) == -1 ||
+      statbuf.st_size <= SHARED_RING_HEADER_SIZE)
+    goto invalid;
+
+  ring = shared_ring_map (fd, statbuf.st_size, error);
+  if (ring == NULL)
+    {
+      close (fd);
+      return NULL;
+    }
+
+  size = ring->header->size;
+  if (ring->header->magic != SHARED_RING_MAGIC ||
+      size == 0 || (size & (size - 1)) != 0 ||
+      SHARED_RING_HEADER_SIZE + (gsize) size > ring->map_size)
+    {
+      g_vfs_shared_ring_free (ring);
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                           _("Invalid shared memory ring"));
+      return NULL;
+    }
+
+  ring->size = size;
+
+  return ring;
+
+ invalid:
+  close (fd);
+  g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                       _("Invalid shared memory ring"));
+  return NULL;
+}
+
+void
+g_vfs_shared_ring_free (GVfsSharedRing *ring)
+{
+  munmap (ring->map, ring->map_size);
+  close (ring->fd);
+  g_free (ring);
+}
+
+/* The fd stays owned by the ring */
+int
+g_vfs_shared_ring_get_fd (GVfsSharedRing *ring)
+{
+  return ring->fd;
+}
+
+/**
+ * g_vfs_shared_ring_reserve:
+ * @ring: a #GVfsSharedRing
+ * @len: the number of bytes needed
+ * @position: return location for the position of the block
+ *
+ * Reserves a block for the producer to fill in place. Only one block
+ * can be reserved at a time, it is handed out to the consumer with
+ * g_vfs_shared_ring_commit(), or dropped by not committing it.
+ *
+ * Returns: a pointer to the block, or %NULL if the ring is full.
+ **/
+char *
+g_vfs_shared_ring_reserve (GVfsSharedRing *ring,
+                           gsize len,
+                           guint32 *position)
+{
+  guint32 released;
+  guint32 offset;
+  guint32 start;
+
+  if (len == 0 || len > ring->size)
+    return NULL;
+
+  released = (guint32) g_atomic_int_get (&ring->header->released);
+
+  /* Blocks don't wrap, skip the end of the ring if needed */
+  start = ring->head;
+  offset = start & (ring->size - 1);
+  if (offset + len > ring->size)
+    start += ring->size - offset;
+
+  if ((guint32)(start + len - released) > ring->size)
+    return NULL;
+
+  *position = start;
+
+  return ring->data + (start & (ring->size - 1));
+}
+
+/* Hands the first @len bytes of the reserved block to the consumer,
+ * @len may be less than what was reserved */
+void
+g_vfs_shared_ring_commit (GVfsSharedRing *ring,
+                          guint32 position,
+                          gsize len)
+{
+  ring->head = position + len;
+}
+
+/**
+ * g_vfs_shared_ring_peek:
+ * @ring: a #GVfsSharedRing
+ * @position: the position announced by the producer
+ * @len: the length of the block
+ *
+ * Returns: a pointer to the block, or %NULL if it doesn't fit in
+ *   the ring.
+ **/
+const char *
+g_vfs_shared_ring_peek (GVfsSharedRing *ring,
+                        guint32 position,
+                        gsize len)
+{
+  guint32 offset;
+
+  offset = position & (ring->size - 1);
+  if (len > ring->size || offset + len > ring->size)
+    return NULL;
+
+  return ring->data + offset;
+}
+
+/* Hands everything before @position back to the producer */
+void
+g_vfs_shared_ring_release (GVfsSharedRing *ring,
+                           guint32 position)
+{
+  g_atomic_int_set (&ring->header->released, (gint) position);
+}
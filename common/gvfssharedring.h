@@ -0,0 +1,54 @@
+/* GIO - GLib Input, Output and Streaming Library
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __G_VFS_SHARED_RING_H__
+#define __G_VFS_SHARED_RING_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Size of the data area of the rings handed out by the daemons */
+#define G_VFS_SHARED_RING_SIZE (8*1024*1024)
+
+typedef struct _GVfsSharedRing GVfsSharedRing;
+
+GVfsSharedRing *g_vfs_shared_ring_new         (gsize            size,
+                                               GError         **error);
+GVfsSharedRing *g_vfs_shared_ring_new_from_fd (int              fd,
+                                               GError         **error);
+void            g_vfs_shared_ring_free        (GVfsSharedRing  *ring);
+int             g_vfs_shared_ring_get_fd      (GVfsSharedRing  *ring);
+
+/* Producer side */
+char *          g_vfs_shared_ring_reserve     (GVfsSharedRing  *ring,
+                                               gsize            len,
+                                               guint32         *position);
+void            g_vfs_shared_ring_commit      (GVfsSharedRing  *ring,
+                                               guint32          position,
+                                               gsize            len);
+
+/* Consumer side */
+const char *    g_vfs_shared_ring_peek        (GVfsSharedRing  *ring,
+                                               guint32          position,
+                                               gsize            len);
+void            g_vfs_shared_ring_release     (GVfsSharedRing  *ring,
+                                               guint32          position);
+
+G_END_DECLS
+
+#endif /* __G_VFS_SHARED_RING_H__ */
@@ -88,6 +88,9 @@ struct _GVfsBackendPrivate
 
   GSettings *lockdown_settings;
   gboolean readonly_lockdown;
+
+  GHashTable *job_concurrency; /* GType -> GVfsJobConcurrency */
+  gboolean shared_read_memory;
 };
 
 
@@ -169,6 +172,7 @@ g_vfs_backend_finalize (GObject *object)
   g_clear_handle_id (&backend->priv->idle_id, g_source_remove);
 
   g_clear_object (&backend->priv->lockdown_settings);
+  g_hash_table_destroy (backend->priv->job_concurrency);
 
   if (G_OBJECT_CLASS (g_vfs_backend_parent_class)->finalize)
     (*G_OBJECT_CLASS (g_vfs_backend_parent_class)->finalize) (object);
@@ -218,6 +222,12 @@ g_vfs_backend_init (GVfsBackend *backend)
   backend->priv->stable_name = g_strdup ("");
   backend->priv->user_visible = TRUE;
   backend->priv->default_location = g_strdup ("");
+  backend->priv->job_concurrency = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  /* Unmounting tears down state that every other job relies on */
+  g_vfs_backend_set_job_concurrency (backend,
+                                     G_VFS_TYPE_JOB_UNMOUNT,
+                                     G_VFS_JOB_CONCURRENCY_EXCLUSIVE);
 }
 
 static void
@@ -292,6 +302,7 @@ register_path_cb (GDBusConnection *conn,
   g_signal_connect (skeleton, "handle-mount-mountable", G_CALLBACK (g_vfs_job_mount_mountable_new_handle), data);
   g_signal_connect (skeleton, "handle-unmount", G_CALLBACK (g_vfs_job_unmount_new_handle), data);
   g_signal_connect (skeleton, "handle-open-for-read", G_CALLBACK (g_vfs_job_open_for_read_new_handle), data);
+  g_signal_connect (skeleton, "handle-open-for-read-flags", G_CALLBACK (g_vfs_job_open_for_read_new_handle_with_flags), data);
   g_signal_connect (skeleton, "handle-open-for-write", G_CALLBACK (g_vfs_job_open_for_write_new_handle), data);
   g_signal_connect (skeleton, "handle-open-for-write-flags", G_CALLBACK (g_vfs_job_open_for_write_new_handle_with_flags), data);
   g_signal_connect (skeleton, "handle-copy", G_CALLBACK (g_vfs_job_copy_new_handle), data);
@@ -623,6 +634,19 @@ g_vfs_backend_add_auto_fs_info (GVfsBackend *backend,
 
   if (backend->priv->readonly_lockdown)
     g_file_info_set_attribute_boolean (info, G_FILE_ATTRIBUTE_FILESYSTEM_READONLY, TRUE);
+
+  if (g_file_attribute_matcher_matches (matcher, G_VFS_ATTRIBUTE_DEBUG_JOB_QUEUE_DEPTH))
+    {
+      GVfsDaemonJobStats stats;
+
+      g_vfs_daemon_get_job_stats (backend->priv->daemon, &stats);
+      g_file_info_set_attribute_uint32 (info, G_VFS_ATTRIBUTE_DEBUG_JOB_QUEUE_DEPTH, stats.queue_depth);
+      g_file_info_set_attribute_uint32 (info, G_VFS_ATTRIBUTE_DEBUG_JOB_RUNNING, stats.running);
+      g_file_info_set_attribute_uint32 (info, G_VFS_ATTRIBUTE_DEBUG_JOB_THREAD_LIMIT, stats.thread_limit);
+      g_file_info_set_attribute_uint64 (info, G_VFS_ATTRIBUTE_DEBUG_JOB_AVG_WAIT,
+                                        stats.jobs_run > 0 ? stats.total_wait_usecs / stats.jobs_run : 0);
+      g_file_info_set_attribute_uint64 (info, G_VFS_ATTRIBUTE_DEBUG_JOB_MAX_WAIT, stats.max_wait_usecs);
+    }
 }
 
 void
@@ -1141,6 +1165,75 @@ g_vfs_backend_set_autounmount (GVfsBackend *backend,
     backend_check_idle (backend);
 }
 
+/**
+ * g_vfs_backend_set_job_concurrency:
+ * @backend: a #GVfsBackend
+ * @job_type: a #GVfsJob type, e.g. %G_VFS_TYPE_JOB_READ
+ * @concurrency: how jobs of @job_type may be scheduled
+ *
+ * Declares how jobs of @job_type (and its subtypes) that end up on a worker
+ * thread may run concurrently with other jobs of @backend. Passing
+ * %G_VFS_TYPE_JOB changes the default for all job types that have no more
+ * specific declaration. Jobs are %G_VFS_JOB_CONCURRENCY_PARALLEL unless
+ * declared otherwise, bounded by the number of job threads of the daemon.
+ *
+ * This should be called from the backend init function, before any jobs
+ * are queued.
+ */
+void
+g_vfs_backend_set_job_concurrency (GVfsBackend        *backend,
+                                   GType               job_type,
+                                   GVfsJobConcurrency  concurrency)
+{
+  g_return_if_fail (g_type_is_a (job_type, G_VFS_TYPE_JOB));
+
+  g_hash_table_insert (backend->priv->job_concurrency,
+                       GSIZE_TO_POINTER (job_type),
+                       GINT_TO_POINTER (concurrency));
+}
+
+GVfsJobConcurrency
+g_vfs_backend_get_job_concurrency (GVfsBackend *backend,
+                                   GVfsJob     *job)
+{
+  GType type;
+  gpointer value;
+
+  for (type = G_TYPE_FROM_INSTANCE (job); type != 0; type = g_type_parent (type))
+    {
+      if (g_hash_table_lookup_extended (backend->priv->job_concurrency,
+                                        GSIZE_TO_POINTER (type),
+                                        NULL, &value))
+        return GPOINTER_TO_INT (value);
+    }
+
+  return G_VFS_JOB_CONCURRENCY_PARALLEL;
+}
+
+/**
+ * g_vfs_backend_set_shared_read_memory:
+ * @backend: a #GVfsBackend
+ * @shared_read_memory: whether read streams may use shared memory
+ *
+ * Lets read streams of @backend pass data to clients that ask for it
+ * through a shared memory ring instead of the stream socket. Every such
+ * stream costs a %G_VFS_SHARED_RING_SIZE mapping in both processes, so
+ * this is only worth it for backends that move large files at high
+ * throughput. It is off by default.
+ */
+void
+g_vfs_backend_set_shared_read_memory (GVfsBackend *backend,
+                                      gboolean     shared_read_memory)
+{
+  backend->priv->shared_read_memory = shared_read_memory;
+}
+
+gboolean
+g_vfs_backend_get_shared_read_memory (GVfsBackend *backend)
+{
+  return backend->priv->shared_read_memory;
+}
+
 static gboolean
 activity_check_main (gpointer user_data)
 {
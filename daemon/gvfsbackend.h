@@ -78,6 +78,14 @@ typedef struct _GVfsJobQueryAttributes  GVfsJobQueryAttributes;
 typedef struct _GVfsJobCreateMonitor    GVfsJobCreateMonitor;
 typedef struct _GVfsJobError            GVfsJobError;
 
+/* How jobs of a given type may be scheduled against other jobs of the
+ * same backend when they have to run on a worker thread. */
+typedef enum {
+  G_VFS_JOB_CONCURRENCY_PARALLEL,   /* may run alongside any other job */
+  G_VFS_JOB_CONCURRENCY_PER_HANDLE, /* serialized with jobs on the same handle */
+  G_VFS_JOB_CONCURRENCY_EXCLUSIVE   /* runs alone on the backend */
+} GVfsJobConcurrency;
+
 typedef gpointer GVfsBackendHandle;
 
 struct _GVfsBackend
@@ -553,6 +561,16 @@ gboolean    g_vfs_backend_get_readonly_lockdown          (GVfsBackend *backend);
 void        g_vfs_backend_set_autounmount               (GVfsBackend           *backend,
                                                          gboolean               autounmount);
 
+void        g_vfs_backend_set_job_concurrency           (GVfsBackend           *backend,
+                                                         GType                  job_type,
+                                                         GVfsJobConcurrency     concurrency);
+GVfsJobConcurrency g_vfs_backend_get_job_concurrency    (GVfsBackend           *backend,
+                                                         GVfsJob               *job);
+
+void        g_vfs_backend_set_shared_read_memory        (GVfsBackend           *backend,
+                                                         gboolean               shared_read_memory);
+gboolean    g_vfs_backend_get_shared_read_memory        (GVfsBackend           *backend);
+
 void        g_vfs_backend_activity_started              (GVfsBackend           *backend);
 void        g_vfs_backend_activity_finished             (GVfsBackend           *backend);
 
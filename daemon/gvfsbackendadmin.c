@@ -1064,6 +1064,7 @@ g_vfs_backend_admin_init (GVfsBackendAdmin *self)
 
   g_mutex_init (&self->polkit_mutex);
   g_vfs_backend_set_user_visible (backend, FALSE);
+  g_vfs_backend_set_shared_read_memory (backend, TRUE);
 
   icon = g_content_type_get_icon (content_type);
   g_vfs_backend_set_icon (backend, icon);
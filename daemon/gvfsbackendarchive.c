@@ -54,6 +54,8 @@ struct _ArchiveFile {
   char *	name;			/* name of the file inside the archive */
   GFileInfo *	info;			/* file info created from archive_entry */
   GSList *	children;		/* (unordered) list of child files */
+  gint64	header_offset;		/* offset of the entry header or -1 */
+  gint64	data_offset;		/* offset of stored data or -1 */
 };
 
 struct _GVfsBackendArchive
@@ -63,6 +65,8 @@ struct _GVfsBackendArchive
   GFile *		file;
   ArchiveFile *		files;		/* the tree of files */
   gsize                 size;
+  int			format;		/* archive_format () of the archive */
+  gboolean		indexed;	/* entries can be read from their header_offset */
 };
 
 G_DEFINE_TYPE (GVfsBackendArchive, g_vfs_backend_archive, G_VFS_TYPE_BACKEND)
@@ -79,6 +83,13 @@ typedef struct {
   GVfsBackendArchive *backend;
   GError *	    error;
   guchar	    data[4096];
+  /* for reading an entry */
+  ArchiveFile *     entry;
+  char *	    path;		/* path of entry inside the archive */
+  gint64	    start;		/* offset to start reading the archive at */
+  gint64	    pos;		/* read position inside the entry */
+  gint64	    decoded;		/* position libarchive decoded up to */
+  gboolean	    direct;		/* read entry data from stream, not libarchive */
 } GVfsArchive;
 
 #define gvfs_archive_return(d) ((d)->error ? ARCHIVE_FATAL : ARCHIVE_OK)
@@ -94,6 +105,12 @@ gvfs_archive_open (struct archive *archive,
   d->stream = g_file_read (d->file,
 			   d->job->cancellable,
 			   &d->error);
+  if (d->stream && d->start > 0)
+    g_seekable_seek (G_SEEKABLE (d->stream),
+		     d->start,
+		     G_SEEK_SET,
+		     d->job->cancellable,
+		     &d->error);
   return gvfs_archive_return (d);
 }
 
@@ -201,10 +218,32 @@ gvfs_archive_finish (GVfsArchive *archive)
   gvfs_archive_pop_job (archive);
 
   g_object_unref (archive->backend);
-  archive_read_free (archive->archive);
+  if (archive->archive)
+    archive_read_free (archive->archive);
+  g_clear_object (&archive->stream);
+  g_free (archive->path);
   g_slice_free (GVfsArchive, archive);
 }
 
+static void
+gvfs_archive_setup (GVfsArchive *d)
+{
+  d->archive = archive_read_new ();
+  archive_read_support_format_all (d->archive);
+  /* Reading from the middle of an indexed archive, there is no signature
+   * to detect the format from, and no compression. */
+  if (d->start > 0)
+    archive_read_set_format (d->archive, d->backend->format);
+  else
+    archive_read_support_filter_all (d->archive);
+  archive_read_open2 (d->archive,
+		      d,
+		      gvfs_archive_open,
+		      gvfs_archive_read,
+		      gvfs_archive_skip,
+		      gvfs_archive_close);
+}
+
 /* NB: assumes an GVfsArchive initialized with ARCHIVE_DATA_INIT */
 static GVfsArchive *
 gvfs_archive_new (GVfsBackendArchive *ba, GVfsJob *job)
@@ -217,15 +256,7 @@ gvfs_archive_new (GVfsBackendArchive *ba, GVfsJob *job)
   d->file = ba->file;
   gvfs_archive_push_job (d, job);
 
-  d->archive = archive_read_new ();
-  archive_read_support_filter_all (d->archive);
-  archive_read_support_format_all (d->archive);
-  archive_read_open2 (d->archive,
-		      d,
-		      gvfs_archive_open,
-		      gvfs_archive_read,
-		      gvfs_archive_skip,
-		      gvfs_archive_close);
+  gvfs_archive_setup (d);
 
   return d;
 }
@@ -246,6 +277,7 @@ g_vfs_backend_archive_finalize (GObject *object)
 static void
 g_vfs_backend_archive_init (GVfsBackendArchive *archive)
 {
+  g_vfs_backend_set_shared_read_memory (G_VFS_BACKEND (archive), TRUE);
 }
 
 /*** FILE TREE HANDLING ***/
@@ -315,6 +347,8 @@ archive_file_get_from_path (ArchiveFile *file, const char *filename, gboolean ad
           g_debug ("adding node %s to %s\n", names[i], file->name);
           cur = g_slice_new0 (ArchiveFile);
           cur->name = g_strdup (names[i]);
+          cur->header_offset = -1;
+          cur->data_offset = -1;
           file->children = g_slist_prepend (file->children, cur);
 	}
       file = cur;
@@ -335,6 +369,8 @@ create_root_file (GVfsBackendArchive *ba)
 
   root = g_slice_new0 (ArchiveFile);
   root->name = g_strdup ("/");
+  root->header_offset = -1;
+  root->data_offset = -1;
   ba->files = root;
 
   info = g_file_info_new ();
@@ -546,6 +582,39 @@ fixup_dirs (ArchiveFile *file)
     fixup_dirs (l->data);
 }
 
+/* Entries of uncompressed tar and zip archives start with a header that
+ * can be parsed on its own, so they can be opened without reading all
+ * the preceding entries. */
+static gboolean
+archive_is_indexable (GVfsArchive *archive)
+{
+  int format = archive_format (archive->archive) & ARCHIVE_FORMAT_BASE_MASK;
+
+  return (format == ARCHIVE_FORMAT_TAR || format == ARCHIVE_FORMAT_ZIP) &&
+         archive_filter_count (archive->archive) == 1 &&
+         archive_filter_code (archive->archive, 0) == ARCHIVE_FILTER_NONE &&
+         archive->stream != NULL &&
+         g_seekable_can_seek (G_SEEKABLE (archive->stream));
+}
+
+static void
+archive_file_set_offsets_from_entry (GVfsArchive *         archive,
+				     ArchiveFile *         file,
+				     struct archive_entry *entry)
+{
+  file->header_offset = archive_read_header_position (archive->archive);
+  file->data_offset = -1;
+
+  /* Regular tar members are stored as is right after their header, so
+   * they can be read and seeked without libarchive. */
+  if ((archive->backend->format & ARCHIVE_FORMAT_BASE_MASK) == ARCHIVE_FORMAT_TAR &&
+      archive_entry_filetype (entry) == AE_IFREG &&
+      archive_entry_hardlink (entry) == NULL &&
+      archive_entry_sparse_count (entry) == 0 &&
+      archive_entry_size_is_set (entry))
+    file->data_offset = archive_filter_bytes (archive->archive, 0);
+}
+
 static void
 create_file_tree (GVfsBackendArchive *ba, GVfsJob *job)
 {
@@ -574,12 +643,21 @@ create_file_tree (GVfsBackendArchive *ba, GVfsJob *job)
               continue;
 	  }
   
+          if (entry_index == 0)
+            {
+              ba->format = archive_format (archive->archive);
+              ba->indexed = archive_is_indexable (archive);
+              g_debug ("archive format %x, indexed: %d\n", ba->format, ba->indexed);
+            }
+
           path = fixup_path (archive_entry_pathname (entry));
           file = archive_file_get_from_path (ba->files, path, TRUE);
           g_free (path);
           /* Don't set info for root */
           if (file != ba->files)
 	    {
+	      if (ba->indexed)
+	        archive_file_set_offsets_from_entry (archive, file, entry);
 	      archive_file_set_info_from_entry (archive, file, entry, entry_index);
 	      ba->size += g_file_info_get_size (file->info);
             }
@@ -717,45 +795,22 @@ do_unmount (GVfsBackend *backend,
   g_vfs_job_succeeded (G_VFS_JOB (job));
 }
 
-static void
-do_open_for_read (GVfsBackend *       backend,
-		  GVfsJobOpenForRead *job,
-		  const char *        filename)
+/* Moves the reader to the data of archive->entry, reading headers from
+ * the start of the archive or from the indexed header offset. */
+static gboolean
+gvfs_archive_find_entry (GVfsArchive *archive)
 {
-  GVfsBackendArchive *ba = G_VFS_BACKEND_ARCHIVE (backend);
-  GVfsArchive *archive;
   struct archive_entry *entry;
   int result;
-  ArchiveFile *file;
   char *entry_pathname;
 
-  file = archive_file_find (ba, filename);
-  if (file == NULL)
-    {
-      g_vfs_job_failed (G_VFS_JOB (job),
-		        G_IO_ERROR,
-			G_IO_ERROR_NOT_FOUND,
-			_("File doesn’t exist"));
-      return;
-    }
-
-  if (g_file_info_get_file_type (file->info) == G_FILE_TYPE_DIRECTORY)
-    {
-      g_vfs_job_failed (G_VFS_JOB (job), G_IO_ERROR,
-			G_IO_ERROR_IS_DIRECTORY,
-			_("Can’t open directory"));
-      return;
-    }
-  
-  archive = gvfs_archive_new (ba, G_VFS_JOB (job));
-
   do
     {
       result = archive_read_next_header (archive->archive, &entry);
       if (result >= ARCHIVE_WARN && result <= ARCHIVE_OK)
         {
 	  if (result < ARCHIVE_OK) {
-            g_debug ("do_open_for_read: result = %d, error = '%s'\n", result, archive_error_string (archive->archive));
+            g_debug ("gvfs_archive_find_entry: result = %d, error = '%s'\n", result, archive_error_string (archive->archive));
 	    archive_set_error (archive->archive, ARCHIVE_OK, "No error");
 	    archive_clear_error (archive->archive);
             if (result == ARCHIVE_RETRY)
@@ -764,15 +819,10 @@ do_open_for_read (GVfsBackend *       backend,
 
           entry_pathname = fixup_path (archive_entry_pathname (entry));
 
-          if (g_str_equal (entry_pathname, filename + 1))
+          if (g_str_equal (entry_pathname, archive->path))
             {
               g_free (entry_pathname);
-
-              /* SUCCESS */
-              g_vfs_job_open_for_read_set_handle (job, archive);
-              g_vfs_job_open_for_read_set_can_seek (job, FALSE);
-              gvfs_archive_pop_job (archive);
-              return;
+              return TRUE;
             }
           else
             archive_read_data_skip (archive->archive);
@@ -792,7 +842,116 @@ do_open_for_read (GVfsBackend *       backend,
 			   G_IO_ERROR_NOT_FOUND,
 			   _("File doesn’t exist"));
     }
-  gvfs_archive_finish (archive);
+  return FALSE;
+}
+
+static GVfsArchive *
+gvfs_archive_new_for_entry (GVfsBackendArchive *ba,
+			    GVfsJob *           job,
+			    ArchiveFile *       file,
+			    const char *        path)
+{
+  GVfsArchive *d;
+
+  d = g_slice_new0 (GVfsArchive);
+
+  d->backend = g_object_ref (ba);
+  d->file = ba->file;
+  d->entry = file;
+  d->path = g_strdup (path);
+  gvfs_archive_push_job (d, job);
+
+  if (file->data_offset >= 0)
+    {
+      d->direct = TRUE;
+      d->stream = g_file_read (d->file, job->cancellable, &d->error);
+      return d;
+    }
+
+  d->start = MAX (file->header_offset, 0);
+  gvfs_archive_setup (d);
+  gvfs_archive_find_entry (d);
+
+  return d;
+}
+
+/* Starts reading the entry over, for seeking backwards in data that has
+ * to go through libarchive. */
+static gboolean
+gvfs_archive_rewind (GVfsArchive *archive)
+{
+  archive_read_free (archive->archive);
+  archive->archive = NULL;
+  archive->pos = 0;
+  archive->decoded = 0;
+
+  gvfs_archive_setup (archive);
+  return gvfs_archive_find_entry (archive);
+}
+
+static gssize
+gvfs_archive_read_direct (GVfsArchive *archive,
+			  char *       buffer,
+			  gsize        count)
+{
+  GSeekable *seekable = G_SEEKABLE (archive->stream);
+  goffset size = g_file_info_get_size (archive->entry->info);
+  goffset offset = archive->entry->data_offset + archive->pos;
+
+  if (archive->pos >= size)
+    return 0;
+  count = MIN (count, size - archive->pos);
+
+  if (g_seekable_tell (seekable) != offset &&
+      !g_seekable_seek (seekable, offset, G_SEEK_SET,
+                        archive->job->cancellable, &archive->error))
+    return -1;
+
+  return g_input_stream_read (G_INPUT_STREAM (archive->stream),
+			      buffer,
+			      count,
+			      archive->job->cancellable,
+			      &archive->error);
+}
+
+static void
+do_open_for_read (GVfsBackend *       backend,
+		  GVfsJobOpenForRead *job,
+		  const char *        filename)
+{
+  GVfsBackendArchive *ba = G_VFS_BACKEND_ARCHIVE (backend);
+  GVfsArchive *archive;
+  ArchiveFile *file;
+
+  file = archive_file_find (ba, filename);
+  if (file == NULL)
+    {
+      g_vfs_job_failed (G_VFS_JOB (job),
+		        G_IO_ERROR,
+			G_IO_ERROR_NOT_FOUND,
+			_("File doesn’t exist"));
+      return;
+    }
+
+  if (g_file_info_get_file_type (file->info) == G_FILE_TYPE_DIRECTORY)
+    {
+      g_vfs_job_failed (G_VFS_JOB (job), G_IO_ERROR,
+			G_IO_ERROR_IS_DIRECTORY,
+			_("Can’t open directory"));
+      return;
+    }
+  
+  archive = gvfs_archive_new_for_entry (ba, G_VFS_JOB (job), file, filename + 1);
+  if (gvfs_archive_in_error (archive))
+    {
+      gvfs_archive_finish (archive);
+      return;
+    }
+
+  /* SUCCESS */
+  g_vfs_job_open_for_read_set_handle (job, archive);
+  g_vfs_job_open_for_read_set_can_seek (job, TRUE);
+  gvfs_archive_pop_job (archive);
 }
 
 static void
@@ -817,14 +976,111 @@ do_read (GVfsBackend *backend,
   gssize bytes_read;
 
   gvfs_archive_push_job (archive, G_VFS_JOB (job));
-  bytes_read = archive_read_data (archive->archive, buffer, bytes_requested);
-  if (bytes_read >= 0)
-    g_vfs_job_read_set_size (job, bytes_read);
+  if (archive->direct)
+    bytes_read = gvfs_archive_read_direct (archive, buffer, bytes_requested);
+  else if (archive->pos > archive->decoded)
+    bytes_read = 0;	/* seeked past the end of the entry */
   else
+    {
+      bytes_read = archive_read_data (archive->archive, buffer, bytes_requested);
+      if (bytes_read > 0)
+        archive->decoded += bytes_read;
+    }
+  if (bytes_read >= 0)
+    {
+      archive->pos += bytes_read;
+      g_vfs_job_read_set_size (job, bytes_read);
+    }
+  else if (!archive->direct)
     gvfs_archive_set_error_from_errno (archive);
   gvfs_archive_pop_job (archive);
 }
 
+static void
+do_seek_on_read (GVfsBackend *backend,
+		 GVfsJobSeekRead *job,
+		 GVfsBackendHandle handle,
+		 goffset offset,
+		 GSeekType type)
+{
+  GVfsArchive *archive = handle;
+  GFileInfo *info = archive->entry->info;
+  char buffer[4096];
+  gssize bytes_read;
+
+  switch (type)
+    {
+    case G_SEEK_SET:
+      break;
+    case G_SEEK_CUR:
+      offset += archive->pos;
+      break;
+    case G_SEEK_END:
+      if (!g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_STANDARD_SIZE))
+        {
+          g_vfs_job_failed_literal (G_VFS_JOB (job),
+                                    G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                                    _("Unsupported seek type"));
+          return;
+        }
+      offset += g_file_info_get_size (info);
+      break;
+    default:
+      g_vfs_job_failed_literal (G_VFS_JOB (job),
+                                G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                                _("Unsupported seek type"));
+      return;
+    }
+
+  if (offset < 0)
+    {
+      g_vfs_job_failed_literal (G_VFS_JOB (job),
+                                G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                                _("Invalid seek offset"));
+      return;
+    }
+
+  gvfs_archive_push_job (archive, G_VFS_JOB (job));
+
+  if (archive->direct)
+    archive->pos = offset;
+  else
+    {
+      /* Compressed data can only be decoded forward, so seeking means
+       * decoding up to the offset, from the start of the entry if needed.
+       * For indexed archives that start is just the entry header. Like
+       * for direct reads, seeking past the end succeeds and reads there
+       * return nothing. */
+      if (offset < archive->decoded && !gvfs_archive_rewind (archive))
+        {
+          gvfs_archive_pop_job (archive);
+          return;
+        }
+
+      while (archive->decoded < offset)
+        {
+          bytes_read = archive_read_data (archive->archive,
+                                          buffer,
+                                          MIN ((goffset) sizeof (buffer), offset - archive->decoded));
+          if (bytes_read < 0)
+            {
+              gvfs_archive_set_error_from_errno (archive);
+              gvfs_archive_pop_job (archive);
+              return;
+            }
+          if (bytes_read == 0)
+            break;
+
+          archive->decoded += bytes_read;
+        }
+
+      archive->pos = offset;
+    }
+
+  g_vfs_job_seek_read_set_offset (job, archive->pos);
+  gvfs_archive_pop_job (archive);
+}
+
 static void
 do_query_info (GVfsBackend *backend,
 	       GVfsJobQueryInfo *job,
@@ -931,6 +1187,7 @@ g_vfs_backend_archive_class_init (GVfsBackendArchiveClass *klass)
   backend_class->open_for_read = do_open_for_read;
   backend_class->close_read = do_close_read;
   backend_class->read = do_read;
+  backend_class->seek_on_read = do_seek_on_read;
   backend_class->enumerate = do_enumerate;
   backend_class->query_info = do_query_info;
   backend_class->try_query_fs_info = try_query_fs_info;
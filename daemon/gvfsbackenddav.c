@@ -120,6 +120,14 @@ struct _GVfsBackendDav
   /* only set if we're handling a [dav|davs]+sd:// mounts */
   GVfsDnsSdResolver *resolver;
 #endif
+
+  /* PROPFIND results, see "Property cache" below */
+  GHashTable *cache;              /* path => DavCacheEntry */
+  gint64      cache_ttl;          /* microseconds an entry stays fresh, 0 disables */
+  guint       cache_generation;   /* incremented on every invalidation */
+  guint       cache_changes;      /* modifying jobs in flight */
+  guint64     cache_hits;
+  guint64     cache_misses;
 };
 
 G_DEFINE_TYPE (GVfsBackendDav, g_vfs_backend_dav, G_VFS_TYPE_BACKEND_HTTP);
@@ -143,14 +151,58 @@ g_vfs_backend_dav_finalize (GObject *object)
 
   g_clear_object (&dav_backend->certificate);
 
+  g_debug ("property cache: %" G_GUINT64_FORMAT " hits, %" G_GUINT64_FORMAT " misses\n",
+           dav_backend->cache_hits, dav_backend->cache_misses);
+  g_hash_table_destroy (dav_backend->cache);
+
   if (G_OBJECT_CLASS (g_vfs_backend_dav_parent_class)->finalize)
     (*G_OBJECT_CLASS (g_vfs_backend_dav_parent_class)->finalize) (object);
 }
 
+/* Entries are considered fresh for this many seconds, unless overridden
+ * with GVFS_DAV_CACHE_TTL. Listings can be revalidated after that. */
+#define DEFAULT_CACHE_TTL 5
+#define CACHE_MAX_ENTRIES 4096
+
+typedef struct {
+  GFileInfo  *info;             /* info from the last PROPFIND or NULL */
+  GPtrArray  *children;         /* GFileInfos of the members or NULL if not listed */
+  char       *children_etag;    /* ETag of the collection when it was listed */
+  gint64      expires;          /* monotonic time the entry goes stale */
+  gboolean    nofollow;         /* fetched without following redirect refs */
+} DavCacheEntry;
+
+static void
+dav_cache_entry_free (gpointer data)
+{
+  DavCacheEntry *entry = data;
+
+  g_clear_object (&entry->info);
+  g_clear_pointer (&entry->children, g_ptr_array_unref);
+  g_free (entry->children_etag);
+  g_slice_free (DavCacheEntry, entry);
+}
+
+static gint64
+get_cache_ttl (void)
+{
+  const char *str;
+
+  str = g_getenv ("GVFS_DAV_CACHE_TTL");
+  if (str == NULL)
+    return DEFAULT_CACHE_TTL * G_TIME_SPAN_SECOND;
+
+  return MAX (g_ascii_strtoll (str, NULL, 10), 0) * G_TIME_SPAN_SECOND;
+}
+
 static void
 g_vfs_backend_dav_init (GVfsBackendDav *backend)
 {
   g_vfs_backend_set_user_visible (G_VFS_BACKEND (backend), TRUE);
+
+  backend->cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                          g_free, dav_cache_entry_free);
+  backend->cache_ttl = get_cache_ttl ();
 }
 
 /* ************************************************************************* */
@@ -2493,6 +2545,243 @@ try_mount (GVfsBackend  *backend,
   return TRUE;
 }
 
+/* ************************************************************************* */
+/* Property cache */
+
+/* Results of PROPFIND requests are kept for a short time, so that a
+ * Depth: 1 listing answers the queries for its members that usually
+ * follow it. Listings of collections with an ETag are revalidated with
+ * a Depth: 1 request for the ETags, sizes and modification times of the
+ * members once they went stale. Modifying jobs
+ * invalidate the paths they touch when they start and again right
+ * before they reply. */
+
+static char *
+dav_cache_key (const char *path)
+{
+  gsize len = strlen (path);
+
+  while (len > 1 && path[len - 1] == '/')
+    len--;
+
+  return g_strndup (path, len);
+}
+
+static DavCacheEntry *
+dav_cache_lookup (GVfsBackendDav *dav, const char *path)
+{
+  DavCacheEntry *entry;
+  char *key;
+
+  if (dav->cache_ttl == 0)
+    return NULL;
+
+  key = dav_cache_key (path);
+  entry = g_hash_table_lookup (dav->cache, key);
+  g_free (key);
+
+  return entry;
+}
+
+static gboolean
+dav_cache_entry_is_fresh (DavCacheEntry *entry)
+{
+  return entry != NULL && g_get_monotonic_time () < entry->expires;
+}
+
+/* Redirect refs are only followed without NOFOLLOW_SYMLINKS, so an entry
+ * only answers requests made the same way as the one that filled it. */
+static gboolean
+dav_cache_entry_matches (DavCacheEntry *entry, GFileQueryInfoFlags flags)
+{
+  return entry->nofollow == ((flags & G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS) != 0);
+}
+
+/* Remembers the generation a request started in, so its result is only
+ * cached if nothing was invalidated while it was running. */
+static void
+dav_cache_tag_message (GVfsBackendDav *dav, SoupMessage *msg)
+{
+  g_object_set_data (G_OBJECT (msg), "-gvfs-cache-generation",
+                     GUINT_TO_POINTER (dav->cache_generation));
+}
+
+static gboolean
+dav_cache_can_fill (GVfsBackendDav *dav, SoupMessage *msg)
+{
+  return dav->cache_ttl > 0 &&
+         dav->cache_changes == 0 &&
+         GPOINTER_TO_UINT (g_object_get_data (G_OBJECT (msg), "-gvfs-cache-generation")) == dav->cache_generation;
+}
+
+static DavCacheEntry *
+dav_cache_insert (GVfsBackendDav      *dav,
+                  const char          *path,
+                  GFileInfo           *info,
+                  GFileQueryInfoFlags  flags)
+{
+  DavCacheEntry *entry;
+  char *key;
+
+  key = dav_cache_key (path);
+  entry = g_hash_table_lookup (dav->cache, key);
+  if (entry == NULL)
+    {
+      if (g_hash_table_size (dav->cache) >= CACHE_MAX_ENTRIES)
+        g_hash_table_remove_all (dav->cache);
+
+      entry = g_slice_new0 (DavCacheEntry);
+      g_hash_table_insert (dav->cache, key, entry);
+    }
+  else
+    {
+      g_free (key);
+
+      /* a listing fetched the other way does not go with this info */
+      if (!dav_cache_entry_matches (entry, flags))
+        {
+          g_clear_pointer (&entry->children, g_ptr_array_unref);
+          g_clear_pointer (&entry->children_etag, g_free);
+        }
+    }
+
+  g_clear_object (&entry->info);
+  entry->info = g_file_info_dup (info);
+  entry->nofollow = (flags & G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS) != 0;
+  entry->expires = g_get_monotonic_time () + dav->cache_ttl;
+
+  return entry;
+}
+
+static void
+dav_cache_insert_listing (GVfsBackendDav      *dav,
+                          const char          *path,
+                          GFileInfo           *info,
+                          GPtrArray           *children,
+                          GFileQueryInfoFlags  flags)
+{
+  DavCacheEntry *entry;
+  guint i;
+
+  entry = dav_cache_insert (dav, path, info, flags);
+  g_clear_pointer (&entry->children, g_ptr_array_unref);
+  g_clear_pointer (&entry->children_etag, g_free);
+  entry->children = g_ptr_array_ref (children);
+  entry->children_etag = g_strdup (g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ETAG_VALUE));
+
+  for (i = 0; i < children->len; i++)
+    {
+      GFileInfo *child = g_ptr_array_index (children, i);
+      char *child_path = g_build_path ("/", path, g_file_info_get_name (child), NULL);
+
+      dav_cache_insert (dav, child_path, child, flags);
+      g_free (child_path);
+    }
+}
+
+static gboolean
+dav_cache_is_affected (gpointer key, gpointer value, gpointer user_data)
+{
+  const char *path = key;
+  const char *changed = user_data;
+  gsize len = strlen (changed);
+
+  if (len == 1)
+    return TRUE;
+
+  return strncmp (path, changed, len) == 0 &&
+         (path[len] == '\0' || path[len] == '/');
+}
+
+/* Drops path, everything below it and its parent, whose listing and
+ * modification time change with it. */
+static void
+dav_cache_invalidate (GVfsBackendDav *dav, const char *path)
+{
+  char *key, *parent;
+
+  dav->cache_generation++;
+
+  key = dav_cache_key (path);
+  g_hash_table_foreach_remove (dav->cache, dav_cache_is_affected, key);
+
+  parent = path_get_parent_dir (key);
+  g_free (key);
+  key = dav_cache_key (parent);
+  g_hash_table_remove (dav->cache, key);
+  g_free (key);
+  g_free (parent);
+}
+
+typedef struct {
+  GVfsBackendDav *dav;
+  char *path;
+  char *other_path;
+  gboolean done;
+} DavCacheChange;
+
+static void
+dav_cache_change_apply (DavCacheChange *change)
+{
+  dav_cache_invalidate (change->dav, change->path);
+  if (change->other_path)
+    dav_cache_invalidate (change->dav, change->other_path);
+}
+
+/* A job may send more than one reply, or none at all if it is dropped,
+ * so each change is only counted as done once */
+static void
+dav_cache_change_done (GVfsJob *job, gpointer user_data)
+{
+  DavCacheChange *change = user_data;
+
+  if (!change->done)
+    {
+      change->done = TRUE;
+      change->dav->cache_changes--;
+    }
+  dav_cache_change_apply (change);
+}
+
+static void
+dav_cache_change_free (gpointer data, GClosure *closure)
+{
+  DavCacheChange *change = data;
+
+  if (!change->done)
+    dav_cache_change_done (NULL, change);
+
+  g_free (change->path);
+  g_free (change->other_path);
+  g_slice_free (DavCacheChange, change);
+}
+
+static void
+dav_cache_track_change (GVfsBackend *backend,
+                        GVfsJob     *job,
+                        const char  *path,
+                        const char  *other_path)
+{
+  GVfsBackendDav *dav = G_VFS_BACKEND_DAV (backend);
+  DavCacheChange *change;
+
+  if (dav->cache_ttl == 0 || path == NULL)
+    return;
+
+  change = g_slice_new0 (DavCacheChange);
+  change->dav = dav;
+  change->path = g_strdup (path);
+  change->other_path = g_strdup (other_path);
+
+  dav_cache_change_apply (change);
+  dav->cache_changes++;
+
+  /* Runs before the reply goes out */
+  g_signal_connect_data (job, "send-reply",
+                         G_CALLBACK (dav_cache_change_done),
+                         change, dav_cache_change_free, 0);
+}
+
 static PropName ls_propnames[] = {
     {"creationdate",     NULL},
     {"displayname",      NULL},
@@ -2548,6 +2837,9 @@ try_query_info_cb (GObject *source, GAsyncResult *result, gpointer user_data)
     }
 
   multistatus_free (&ms);
+
+  if (res && dav_cache_can_fill (G_VFS_BACKEND_DAV (backend), msg))
+    dav_cache_insert (G_VFS_BACKEND_DAV (backend), job->filename, job->file_info, job->flags);
   g_object_unref (msg);
 
   if (res)
@@ -2572,10 +2864,23 @@ try_query_info (GVfsBackend *backend,
                 GFileInfo *info,
                 GFileAttributeMatcher *matcher)
 {
+  GVfsBackendDav *dav = G_VFS_BACKEND_DAV (backend);
+  DavCacheEntry *entry;
   SoupMessage *msg;
 
   g_debug ("Query info %s\n", filename);
 
+  entry = dav_cache_lookup (dav, filename);
+  if (dav_cache_entry_is_fresh (entry) && entry->info &&
+      dav_cache_entry_matches (entry, flags))
+    {
+      dav->cache_hits++;
+      g_file_info_copy_into (entry->info, info);
+      g_vfs_job_succeeded (G_VFS_JOB (job));
+      return TRUE;
+    }
+  dav->cache_misses++;
+
   msg = propfind_request_new (backend, filename, 0, ls_propnames);
   if (msg == NULL)
     {
@@ -2585,6 +2890,7 @@ try_query_info (GVfsBackend *backend,
       return TRUE;
     }
 
+  dav_cache_tag_message (dav, msg);
   message_add_redirect_header (msg, flags);
 
   dav_message_connect_signals (msg, backend);
@@ -2707,10 +3013,33 @@ try_query_fs_info (GVfsBackend *backend,
 
 /* *** enumerate *** */
 
+static void
+try_enumerate_send (GVfsBackend *backend, GVfsJobEnumerate *job);
+
+static void
+try_enumerate_from_cache (GVfsJobEnumerate *job, GPtrArray *children)
+{
+  guint i;
+
+  g_vfs_job_succeeded (G_VFS_JOB (job));
+
+  for (i = 0; i < children->len; i++)
+    {
+      /* adding the info applies the job's attribute mask to it */
+      GFileInfo *info = g_file_info_dup (g_ptr_array_index (children, i));
+
+      g_vfs_job_enumerate_add_info (job, info);
+      g_object_unref (info);
+    }
+
+  g_vfs_job_enumerate_done (job);
+}
+
 static void
 try_enumerate_cb (GObject *source, GAsyncResult *result, gpointer user_data)
 {
   GVfsBackend *backend = G_VFS_BACKEND (source);
+  GVfsBackendDav *dav = G_VFS_BACKEND_DAV (backend);
   SoupMessage *msg = g_vfs_backend_dav_get_async_result_message (backend, result);
   GVfsJobEnumerate *job = user_data;
   GInputStream *body;
@@ -2718,6 +3047,8 @@ try_enumerate_cb (GObject *source, GAsyncResult *result, gpointer user_data)
   Multistatus ms;
   xmlNodeIter iter;
   gboolean res;
+  GFileInfo *target_info = NULL;
+  GPtrArray *children;
 
   body = g_vfs_backend_dav_send_finish (backend, result, &error);
 
@@ -2732,6 +3063,7 @@ try_enumerate_cb (GObject *source, GAsyncResult *result, gpointer user_data)
 
   g_vfs_job_succeeded (G_VFS_JOB (job));
 
+  children = g_ptr_array_new_with_free_func (g_object_unref);
   multistatus_get_response_iter (&ms, &iter);
 
   while (xml_node_iter_next (&iter))
@@ -2746,14 +3078,25 @@ try_enumerate_cb (GObject *source, GAsyncResult *result, gpointer user_data)
 	{
 	  info = g_file_info_new ();
 	  ms_response_to_file_info (&response, info);
+          g_ptr_array_add (children, g_file_info_dup (info));
 	  g_vfs_job_enumerate_add_info (job, info);
           g_object_unref (info);
 	}
+      else if (target_info == NULL)
+        {
+          target_info = g_file_info_new ();
+          ms_response_to_file_info (&response, target_info);
+        }
 
       ms_response_clear (&response);
     }
 
   multistatus_free (&ms);
+
+  if (target_info && dav_cache_can_fill (dav, msg))
+    dav_cache_insert_listing (dav, job->filename, target_info, children, job->flags);
+  g_clear_object (&target_info);
+  g_ptr_array_unref (children);
   g_object_unref (msg);
 
   g_vfs_job_enumerate_done (G_VFS_JOB_ENUMERATE (job));
@@ -2765,30 +3108,200 @@ try_enumerate_cb (GObject *source, GAsyncResult *result, gpointer user_data)
   g_object_unref (msg);
 }
 
+/* Enough to tell whether a member changed since it was listed */
+static PropName revalidate_propnames[] = {
+    {"getcontentlength", NULL},
+    {"getetag",          NULL},
+    {"getlastmodified",  NULL},
+    {"resourcetype",     NULL},
+    {NULL,               NULL}
+};
+
 static gboolean
-try_enumerate (GVfsBackend *backend,
-               GVfsJobEnumerate *job,
-               const char *filename,
-               GFileAttributeMatcher *matcher,
-               GFileQueryInfoFlags flags)
+dav_cache_member_is_unchanged (GHashTable *cached, GFileInfo *info)
 {
-  SoupMessage *msg;
+  GFileInfo *old;
 
-  g_debug ("+ try_enumerate: %s\n", filename);
+  old = g_hash_table_lookup (cached, g_file_info_get_name (info));
+  if (old == NULL)
+    return FALSE;
+
+  return g_file_info_get_file_type (old) == g_file_info_get_file_type (info) &&
+         g_strcmp0 (g_file_info_get_attribute_string (old, G_FILE_ATTRIBUTE_ETAG_VALUE),
+                    g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ETAG_VALUE)) == 0 &&
+         g_file_info_get_attribute_uint64 (old, G_FILE_ATTRIBUTE_TIME_MODIFIED) ==
+         g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED) &&
+         g_file_info_get_attribute_uint64 (old, G_FILE_ATTRIBUTE_STANDARD_SIZE) ==
+         g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_STANDARD_SIZE);
+}
+
+/* Compares a Depth: 1 response with the cached listing. Servers don't
+ * have to change the ETag of a collection when one of its members is
+ * modified, so each member is checked as well, not only the collection. */
+static gboolean
+dav_cache_listing_is_unchanged (DavCacheEntry *entry, Multistatus *ms)
+{
+  GHashTable *cached;
+  xmlNodeIter iter;
+  gboolean unchanged = TRUE;
+  gboolean have_target = FALSE;
+  guint n_members = 0;
+  guint i;
+
+  cached = g_hash_table_new (g_str_hash, g_str_equal);
+  for (i = 0; i < entry->children->len; i++)
+    {
+      GFileInfo *child = g_ptr_array_index (entry->children, i);
+
+      g_hash_table_insert (cached, (gpointer) g_file_info_get_name (child), child);
+    }
+
+  multistatus_get_response_iter (ms, &iter);
+  while (unchanged && xml_node_iter_next (&iter))
+    {
+      MsResponse response;
+      GFileInfo *info;
+
+      if (! multistatus_get_response (&iter, &response))
+        continue;
+
+      info = g_file_info_new ();
+      ms_response_to_file_info (&response, info);
+
+      if (response.is_target)
+        {
+          have_target = TRUE;
+          unchanged = g_strcmp0 (g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ETAG_VALUE),
+                                 entry->children_etag) == 0;
+        }
+      else
+        {
+          n_members++;
+          unchanged = dav_cache_member_is_unchanged (cached, info);
+        }
+
+      g_object_unref (info);
+      ms_response_clear (&response);
+    }
+
+  g_hash_table_unref (cached);
+
+  return unchanged && have_target && n_members == entry->children->len;
+}
 
-  msg = propfind_request_new (backend, filename, 1, ls_propnames);
+/* Called with the current ETags of the collection and its members. If
+ * they all still match the cached listing, the listing is used,
+ * otherwise it is fetched again. */
+static void
+try_enumerate_revalidate_cb (GObject *source, GAsyncResult *result, gpointer user_data)
+{
+  GVfsBackend *backend = G_VFS_BACKEND (source);
+  GVfsBackendDav *dav = G_VFS_BACKEND_DAV (backend);
+  SoupMessage *msg = g_vfs_backend_dav_get_async_result_message (backend, result);
+  GVfsJobEnumerate *job = user_data;
+  DavCacheEntry *entry;
+  GInputStream *body;
+  Multistatus ms;
+  gboolean unchanged = FALSE;
+
+  body = g_vfs_backend_dav_send_finish (backend, result, NULL);
+  if (body)
+    {
+      if (multistatus_parse (msg, body, &ms, NULL))
+        {
+          /* the entry may have been invalidated in the meantime */
+          entry = dav_cache_lookup (dav, job->filename);
+          unchanged = entry && entry->children &&
+                      dav_cache_entry_matches (entry, job->flags) &&
+                      dav_cache_can_fill (dav, msg) &&
+                      dav_cache_listing_is_unchanged (entry, &ms);
+          multistatus_free (&ms);
+        }
+      g_object_unref (body);
+    }
+
+  if (unchanged)
+    {
+      GFileInfo *info = g_object_ref (entry->info);
+      GPtrArray *children = g_ptr_array_ref (entry->children);
+
+      g_debug ("+ try_enumerate: %s unchanged\n", job->filename);
+      dav->cache_hits++;
+      /* all members were just checked, refresh them, too */
+      dav_cache_insert_listing (dav, job->filename, info, children, job->flags);
+      try_enumerate_from_cache (job, children);
+      g_object_unref (info);
+      g_ptr_array_unref (children);
+    }
+  else
+    {
+      dav->cache_misses++;
+      try_enumerate_send (backend, job);
+    }
+
+  g_object_unref (msg);
+}
+
+static void
+try_enumerate_send (GVfsBackend *backend, GVfsJobEnumerate *job)
+{
+  SoupMessage *msg;
+
+  msg = propfind_request_new (backend, job->filename, 1, ls_propnames);
   if (msg == NULL)
     {
       g_vfs_job_failed (G_VFS_JOB (job),
                         G_IO_ERROR, G_IO_ERROR_FAILED,
                         _("Could not create request"));
-      return TRUE;
+      return;
     }
 
-  message_add_redirect_header (msg, flags);
+  dav_cache_tag_message (G_VFS_BACKEND_DAV (backend), msg);
+  message_add_redirect_header (msg, job->flags);
   dav_message_connect_signals (msg, backend);
 
   g_vfs_backend_dav_send_async (backend, msg, try_enumerate_cb, job);
+}
+
+static gboolean
+try_enumerate (GVfsBackend *backend,
+               GVfsJobEnumerate *job,
+               const char *filename,
+               GFileAttributeMatcher *matcher,
+               GFileQueryInfoFlags flags)
+{
+  GVfsBackendDav *dav = G_VFS_BACKEND_DAV (backend);
+  DavCacheEntry *entry;
+  SoupMessage *msg;
+
+  g_debug ("+ try_enumerate: %s\n", filename);
+
+  entry = dav_cache_lookup (dav, filename);
+  if (entry && entry->children && dav_cache_entry_matches (entry, flags))
+    {
+      if (dav_cache_entry_is_fresh (entry))
+        {
+          dav->cache_hits++;
+          try_enumerate_from_cache (job, entry->children);
+          return TRUE;
+        }
+
+      if (entry->children_etag)
+        {
+          msg = propfind_request_new (backend, filename, 1, revalidate_propnames);
+          if (msg != NULL)
+            {
+              dav_cache_tag_message (dav, msg);
+              message_add_redirect_header (msg, flags);
+              dav_message_connect_signals (msg, backend);
+              g_vfs_backend_dav_send_async (backend, msg, try_enumerate_revalidate_cb, job);
+              return TRUE;
+            }
+        }
+    }
+
+  dav->cache_misses++;
+  try_enumerate_send (backend, job);
 
   return TRUE;
 }
@@ -2929,6 +3442,8 @@ try_create_tested_existence (GObject *source,
    */
   stream = g_memory_output_stream_new (NULL, 0, g_try_realloc, g_free);
   g_object_set_data_full (G_OBJECT (stream), "-gvfs-stream-msg", put_msg, g_object_unref);
+  g_object_set_data_full (G_OBJECT (stream), "-gvfs-stream-filename",
+                          g_strdup (G_VFS_JOB_OPEN_FOR_WRITE (job)->filename), g_free);
 
   g_vfs_job_open_for_write_set_handle (G_VFS_JOB_OPEN_FOR_WRITE (job), stream);
   g_vfs_job_open_for_write_set_can_seek (G_VFS_JOB_OPEN_FOR_WRITE (job),
@@ -2984,6 +3499,8 @@ open_for_replace_succeeded (GVfsBackendHttp *op_backend,
 
   stream = g_memory_output_stream_new (NULL, 0, g_try_realloc, g_free);
   g_object_set_data_full (G_OBJECT (stream), "-gvfs-stream-msg", put_msg, g_object_unref);
+  g_object_set_data_full (G_OBJECT (stream), "-gvfs-stream-filename",
+                          g_strdup (G_VFS_JOB_OPEN_FOR_WRITE (job)->filename), g_free);
 
   g_vfs_job_open_for_write_set_handle (G_VFS_JOB_OPEN_FOR_WRITE (job), stream);
   g_vfs_job_open_for_write_set_can_seek (G_VFS_JOB_OPEN_FOR_WRITE (job),
@@ -3227,6 +3744,10 @@ try_close_write (GVfsBackend *backend,
   g_object_ref (msg);
   g_object_set_data (G_OBJECT (stream), "-gvfs-stream-msg", NULL);
 
+  dav_cache_track_change (backend, G_VFS_JOB (job),
+                          g_object_get_data (G_OBJECT (stream), "-gvfs-stream-filename"),
+                          NULL);
+
   dav_message_connect_signals (msg, backend);
 
   g_output_stream_close (stream, NULL, NULL);
@@ -3289,6 +3810,8 @@ try_make_directory (GVfsBackend *backend,
   SoupMessage *msg;
   GUri *uri;
 
+  dav_cache_track_change (backend, G_VFS_JOB (job), filename, NULL);
+
   uri = g_vfs_backend_dav_uri_for_path (backend, filename, TRUE);
   msg = soup_message_new_from_uri (SOUP_METHOD_MKCOL, uri);
   g_uri_unref (uri);
@@ -3370,6 +3893,8 @@ try_delete (GVfsBackend *backend, GVfsJobDelete *job, const char *filename)
 {
   GUri *uri;
 
+  dav_cache_track_change (backend, G_VFS_JOB (job), filename, NULL);
+
   uri = g_vfs_backend_dav_uri_for_path (backend, filename, FALSE);
   stat_location_async (backend, uri, TRUE, try_delete_cb, job);
   return TRUE;
@@ -3459,6 +3984,8 @@ try_set_display_name (GVfsBackend *backend,
   data->target_path = g_build_filename (dirname, display_name, NULL);
   target = g_vfs_backend_dav_uri_for_path (backend, data->target_path, FALSE);
 
+  dav_cache_track_change (backend, G_VFS_JOB (job), filename, data->target_path);
+
   message_add_destination_header (msg, target);
   message_add_overwrite_header (msg, FALSE);
 
@@ -3724,6 +4251,8 @@ try_move (GVfsBackend *backend,
       return TRUE;
     }
 
+  dav_cache_track_change (backend, G_VFS_JOB (job), source, destination);
+
   data->source_uri = g_vfs_backend_dav_uri_for_path (backend, source, FALSE);
   data->msg = soup_message_new_from_uri (SOUP_METHOD_MOVE, data->source_uri);
   data->target_uri = g_vfs_backend_dav_uri_for_path (backend, destination, FALSE);
@@ -3902,6 +4431,8 @@ try_copy (GVfsBackend *backend,
       return TRUE;
     }
 
+  dav_cache_track_change (backend, G_VFS_JOB (job), destination, NULL);
+
   data->source_uri = g_vfs_backend_dav_uri_for_path (backend, source, FALSE);
   data->target_uri = g_vfs_backend_dav_uri_for_path (backend, destination, FALSE);
 
@@ -4214,6 +4745,8 @@ try_push (GVfsBackend *backend,
       return TRUE;
     }
 
+  dav_cache_track_change (backend, G_VFS_JOB (job), destination, NULL);
+
   handle = g_slice_new0 (PushHandle);
   handle->backend = g_object_ref (backend);
   handle->job = g_object_ref (G_VFS_JOB (job));
@@ -90,6 +90,15 @@
 
 /** CODE ***/
 
+/* Connection pool counters, reported by query_fs_info when asked for */
+#define FTP_ATTRIBUTE_DEBUG_CONNECTIONS      "gvfs-debug::ftp-connections"
+#define FTP_ATTRIBUTE_DEBUG_IDLE_CONNECTIONS "gvfs-debug::ftp-idle-connections"
+#define FTP_ATTRIBUTE_DEBUG_CONNECTS         "gvfs-debug::ftp-connects"
+#define FTP_ATTRIBUTE_DEBUG_ACQUIRES         "gvfs-debug::ftp-acquires"
+#define FTP_ATTRIBUTE_DEBUG_AVG_WAIT         "gvfs-debug::ftp-avg-wait-usecs"
+#define FTP_ATTRIBUTE_DEBUG_MAX_WAIT         "gvfs-debug::ftp-max-wait-usecs"
+#define FTP_ATTRIBUTE_DEBUG_AVG_HOLD         "gvfs-debug::ftp-avg-hold-usecs"
+
 G_DEFINE_TYPE (GVfsBackendFtp, g_vfs_backend_ftp, G_VFS_TYPE_BACKEND)
 
 static gboolean
@@ -108,6 +117,7 @@ gvfs_backend_ftp_determine_features (GVfsFtpTask *task)
     { "AUTH TLS", G_VFS_FTP_FEATURE_AUTH_TLS },
     { "AUTH SSL", G_VFS_FTP_FEATURE_AUTH_SSL },
     { "MFMT", G_VFS_FTP_FEATURE_MFMT },
+    { "REST STREAM", G_VFS_FTP_FEATURE_REST },
   };
   guint i, j;
   char **reply;
@@ -138,6 +148,14 @@ gvfs_backend_ftp_determine_features (GVfsFtpTask *task)
               task->backend->features |= 1 << features[j].enable;
             }
         }
+
+      /* MLST is followed by the list of facts, RFC 3659 section 7.8 */
+      if (g_ascii_strncasecmp (feature, "MLST", 4) == 0 &&
+          (feature[4] == '\0' || feature[4] == ' '))
+        {
+          g_debug ("# feature MLST supported\n");
+          task->backend->features |= 1 << G_VFS_FTP_FEATURE_MLST;
+        }
     }
 
   g_strfreev (reply);
@@ -244,7 +262,9 @@ gvfs_backend_ftp_determine_system (GVfsFtpTask *task)
 static void
 gvfs_backend_ftp_setup_directory_cache (GVfsBackendFtp *ftp)
 {
-  if (ftp->system == G_VFS_FTP_SYSTEM_UNIX)
+  if (g_vfs_backend_ftp_has_feature (ftp, G_VFS_FTP_FEATURE_MLST))
+    ftp->dir_funcs = &g_vfs_ftp_dir_cache_funcs_mlsd;
+  else if (ftp->system == G_VFS_FTP_SYSTEM_UNIX)
     ftp->dir_funcs = &g_vfs_ftp_dir_cache_funcs_unix;
   else
     ftp->dir_funcs = &g_vfs_ftp_dir_cache_funcs_default;
@@ -381,12 +401,23 @@ g_vfs_backend_ftp_finalize (GObject *object)
 {
   GVfsBackendFtp *ftp = G_VFS_BACKEND_FTP (object);
 
+  /* The pool may still run if the backend goes away without an unmount */
+  g_vfs_ftp_task_stop_pool (ftp);
+
   if (ftp->addr)
     g_object_unref (ftp->addr);
 
   /* has been cleared on unmount, however it has to be cleared when mount fails */
   if (ftp->queue)
-    g_queue_free (ftp->queue);
+    g_queue_free_full (ftp->queue, (GDestroyNotify) g_vfs_ftp_connection_free);
+
+  g_debug ("# %u connections opened, %u acquired, waited %" G_GINT64_FORMAT " us on average (%" G_GINT64_FORMAT " us max), held %" G_GINT64_FORMAT " us on average\n",
+           ftp->stat_connects,
+           ftp->stat_acquires,
+           ftp->stat_acquires ? ftp->stat_acquire_time / ftp->stat_acquires : 0,
+           ftp->stat_acquire_time_max,
+           ftp->stat_acquires ? ftp->stat_hold_time / ftp->stat_acquires : 0);
+  g_weak_ref_clear (&ftp->tls_session);
 
   g_cond_clear (&ftp->cond);
   g_mutex_clear (&ftp->mutex);
@@ -406,6 +437,7 @@ g_vfs_backend_ftp_init (GVfsBackendFtp *ftp)
 {
   g_mutex_init (&ftp->mutex);
   g_cond_init (&ftp->cond);
+  g_weak_ref_init (&ftp->tls_session, NULL);
 }
 
 static guint
@@ -693,6 +725,7 @@ try_login:
   ftp->max_connections = G_MAXUINT;
   ftp->queue = g_queue_new ();
   ftp->root = g_vfs_ftp_file_new_from_ftp (ftp, "/", NULL);
+  g_vfs_ftp_task_start_pool (ftp);
 
   g_object_unref (addr);
   g_vfs_ftp_task_done (&task);
@@ -772,6 +805,7 @@ do_unmount (GVfsBackend *   backend,
   ftp->queue = NULL;
   g_cond_broadcast (&ftp->cond);
   g_mutex_unlock (&ftp->mutex);
+  g_vfs_ftp_task_stop_pool (ftp);
   g_vfs_job_succeeded (G_VFS_JOB (job));
 }
 
@@ -860,6 +894,64 @@ error_550_parent_not_found (GVfsFtpTask *task, gpointer file)
   g_vfs_ftp_file_free (dir);
 }
 
+typedef struct _GVfsFtpReadHandle GVfsFtpReadHandle;
+struct _GVfsFtpReadHandle {
+  GVfsFtpConnection *   conn;           /* connection with a running RETR or NULL */
+  GVfsFtpFile *         file;           /* file being read */
+  goffset               offset;         /* offset the next read should start at */
+  goffset               stream_offset;  /* offset of the next byte on conn's data stream */
+};
+
+static void
+g_vfs_ftp_read_handle_free (GVfsFtpReadHandle *handle)
+{
+  g_vfs_ftp_file_free (handle->file);
+  g_slice_free (GVfsFtpReadHandle, handle);
+}
+
+/* Stops the transfer currently running on handle and keeps the control
+ * connection in the task, so the next command can reuse it. */
+static void
+g_vfs_ftp_read_handle_abort (GVfsFtpTask *task, GVfsFtpReadHandle *handle)
+{
+  if (handle->conn == NULL)
+    return;
+
+  g_vfs_ftp_task_give_connection (task, handle->conn);
+  handle->conn = NULL;
+  g_vfs_ftp_task_close_data_connection (task);
+  /* the server answers the aborted transfer with 426 or 226 */
+  g_vfs_ftp_task_receive (task, 0, NULL);
+}
+
+static void
+g_vfs_ftp_read_handle_start (GVfsFtpTask *task, GVfsFtpReadHandle *handle)
+{
+  static const GVfsFtpErrorFunc open_read_handlers[] = { error_550_is_directory, 
+                                                         error_550_permission_or_not_found, 
+                                                         NULL };
+
+  g_vfs_ftp_task_setup_data_connection (task);
+  if (handle->offset > 0)
+    g_vfs_ftp_task_send (task,
+                         G_VFS_FTP_PASS_300,
+                         "REST %" G_GOFFSET_FORMAT, handle->offset);
+  g_vfs_ftp_task_send_and_check (task,
+                                 G_VFS_FTP_PASS_100 | G_VFS_FTP_FAIL_200,
+                                 open_read_handlers,
+                                 handle->file,
+                                 NULL,
+                                 "RETR %s", g_vfs_ftp_file_get_ftp_path (handle->file));
+  g_vfs_ftp_task_open_data_connection (task);
+
+  if (!g_vfs_ftp_task_is_in_error (task))
+    {
+      /* don't push the connection back, it's our handle now */
+      handle->conn = g_vfs_ftp_task_take_connection (task);
+      handle->stream_offset = handle->offset;
+    }
+}
+
 static void
 do_open_for_read (GVfsBackend *backend,
                   GVfsJobOpenForRead *job,
@@ -867,10 +959,8 @@ do_open_for_read (GVfsBackend *backend,
 {
   GVfsBackendFtp *ftp = G_VFS_BACKEND_FTP (backend);
   GVfsFtpTask task = G_VFS_FTP_TASK_INIT (ftp, G_VFS_JOB (job));
+  GVfsFtpReadHandle *handle;
   GVfsFtpFile *file;
-  static const GVfsFtpErrorFunc open_read_handlers[] = { error_550_is_directory, 
-                                                         error_550_permission_or_not_found, 
-                                                         NULL };
 
   file = g_vfs_ftp_file_new_from_gvfs (ftp, filename, &task.error);
   if (file == NULL)
@@ -879,25 +969,17 @@ do_open_for_read (GVfsBackend *backend,
       return;
     }
 
-  g_vfs_ftp_task_setup_data_connection (&task);
-  g_vfs_ftp_task_send_and_check (&task,
-                                 G_VFS_FTP_PASS_100 | G_VFS_FTP_FAIL_200,
-                                 open_read_handlers,
-                                 file,
-                                 NULL,
-                                 "RETR %s", g_vfs_ftp_file_get_ftp_path (file));
-  g_vfs_ftp_file_free (file);
-
-  g_vfs_ftp_task_open_data_connection (&task);
+  handle = g_slice_new0 (GVfsFtpReadHandle);
+  handle->file = file;
+  g_vfs_ftp_read_handle_start (&task, handle);
 
   if (!g_vfs_ftp_task_is_in_error (&task))
     {
-      /* don't push the connection back, it's our handle now */
-      GVfsFtpConnection *conn = g_vfs_ftp_task_take_connection (&task);
-
-      g_vfs_job_open_for_read_set_handle (job, conn);
-      g_vfs_job_open_for_read_set_can_seek (job, FALSE);
+      g_vfs_job_open_for_read_set_handle (job, handle);
+      g_vfs_job_open_for_read_set_can_seek (job, g_vfs_backend_ftp_has_feature (ftp, G_VFS_FTP_FEATURE_REST));
     }
+  else
+    g_vfs_ftp_read_handle_free (handle);
 
   g_vfs_ftp_task_done (&task);
 }
@@ -909,11 +991,10 @@ do_close_read (GVfsBackend *     backend,
 {
   GVfsBackendFtp *ftp = G_VFS_BACKEND_FTP (backend);
   GVfsFtpTask task = G_VFS_FTP_TASK_INIT (ftp, G_VFS_JOB (job));
-  GVfsFtpConnection *conn = handle;
+  GVfsFtpReadHandle *read_handle = handle;
 
-  g_vfs_ftp_task_give_connection (&task, conn);
-  g_vfs_ftp_task_close_data_connection (&task);
-  g_vfs_ftp_task_receive (&task, 0, NULL);
+  g_vfs_ftp_read_handle_abort (&task, read_handle);
+  g_vfs_ftp_read_handle_free (read_handle);
 
   g_vfs_ftp_task_done (&task);
 }
@@ -927,11 +1008,29 @@ do_read (GVfsBackend *     backend,
 {
   GVfsBackendFtp *ftp = G_VFS_BACKEND_FTP (backend);
   GVfsFtpTask task = G_VFS_FTP_TASK_INIT (ftp, G_VFS_JOB (job));
-  GVfsFtpConnection *conn = handle;
+  GVfsFtpReadHandle *read_handle = handle;
   GInputStream *input;
   gssize n_bytes;
 
-  input = g_io_stream_get_input_stream (g_vfs_ftp_connection_get_data_stream (conn));
+  /* Seeking only records the new offset, the transfer is restarted with
+   * REST here, so multiple seeks in a row cost a single round trip. */
+  if (read_handle->conn == NULL ||
+      read_handle->offset != read_handle->stream_offset)
+    {
+      g_vfs_ftp_read_handle_abort (&task, read_handle);
+      g_vfs_ftp_task_clear_error (&task);
+      if (task.conn && !g_vfs_ftp_connection_is_usable (task.conn))
+        g_vfs_ftp_task_release_connection (&task);
+
+      g_vfs_ftp_read_handle_start (&task, read_handle);
+      if (g_vfs_ftp_task_is_in_error (&task))
+        {
+          g_vfs_ftp_task_done (&task);
+          return;
+        }
+    }
+
+  input = g_io_stream_get_input_stream (g_vfs_ftp_connection_get_data_stream (read_handle->conn));
   n_bytes = g_input_stream_read (input,
                                  buffer,
                                  bytes_requested,
@@ -939,11 +1038,75 @@ do_read (GVfsBackend *     backend,
                                  &task.error);
 
   if (n_bytes >= 0)
-    g_vfs_job_read_set_size (job, n_bytes);
+    {
+      read_handle->offset += n_bytes;
+      read_handle->stream_offset += n_bytes;
+      g_vfs_job_read_set_size (job, n_bytes);
+    }
 
   g_vfs_ftp_task_done (&task);
 }
 
+static void
+do_seek_on_read (GVfsBackend *     backend,
+                 GVfsJobSeekRead * job,
+                 GVfsBackendHandle handle,
+                 goffset           offset,
+                 GSeekType         type)
+{
+  GVfsBackendFtp *ftp = G_VFS_BACKEND_FTP (backend);
+  GVfsFtpTask task = G_VFS_FTP_TASK_INIT (ftp, G_VFS_JOB (job));
+  GVfsFtpReadHandle *read_handle = handle;
+  GFileInfo *info;
+
+  if (!g_vfs_backend_ftp_has_feature (ftp, G_VFS_FTP_FEATURE_REST))
+    {
+      g_set_error_literal (&task.error,
+                           G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                           _("Operation not supported"));
+      g_vfs_ftp_task_done (&task);
+      return;
+    }
+
+  switch (type)
+    {
+    case G_SEEK_SET:
+      break;
+    case G_SEEK_CUR:
+      offset += read_handle->offset;
+      break;
+    case G_SEEK_END:
+      info = g_vfs_ftp_dir_cache_lookup_file (ftp->dir_cache, &task, read_handle->file, TRUE);
+      if (info == NULL)
+        {
+          g_vfs_ftp_task_done (&task);
+          return;
+        }
+      offset += g_file_info_get_size (info);
+      g_object_unref (info);
+      break;
+    default:
+      g_set_error_literal (&task.error,
+                           G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                           _("Unsupported seek type"));
+      g_vfs_ftp_task_done (&task);
+      return;
+    }
+
+  if (offset < 0)
+    {
+      g_set_error_literal (&task.error,
+                           G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                           _("Invalid seek offset"));
+      g_vfs_ftp_task_done (&task);
+      return;
+    }
+
+  read_handle->offset = offset;
+  g_vfs_job_seek_read_set_offset (job, offset);
+  g_vfs_ftp_task_done (&task);
+}
+
 static void
 do_start_write (GVfsFtpTask *task,
                 GFileCreateFlags flags,
@@ -1724,6 +1887,61 @@ do_pull_improve_error_message (GVfsFtpTask *task,
     }
 }
 
+/* number of times an interrupted download is resumed with REST before giving up */
+#define PULL_MAX_RESUME_ATTEMPTS 3
+
+typedef struct {
+  GFileProgressCallback callback;
+  gpointer              callback_data;
+  goffset               offset;         /* bytes written before the current RETR */
+} PullProgress;
+
+static void
+do_pull_progress (goffset current_num_bytes,
+                  goffset total_num_bytes,
+                  gpointer user_data)
+{
+  PullProgress *progress = user_data;
+
+  progress->callback (progress->offset + current_num_bytes,
+                      total_num_bytes,
+                      progress->callback_data);
+}
+
+/* Checks if the download failed because the connection went away or the
+ * server aborted the transfer (426, 451), and the server lets us continue
+ * where it stopped. On success, offset is set to the size of the data
+ * already written. */
+static gboolean
+do_pull_can_resume (GVfsFtpTask   *task,
+                    guint          response,
+                    GOutputStream *output,
+                    goffset       *offset)
+{
+  goffset written;
+
+  if (!g_vfs_backend_ftp_has_feature (task->backend, G_VFS_FTP_FEATURE_REST))
+    return FALSE;
+
+  if (response != 426 && response != 451 &&
+      !g_vfs_ftp_task_error_matches (task, G_IO_ERROR, G_IO_ERROR_CLOSED) &&
+      !g_vfs_ftp_task_error_matches (task, G_IO_ERROR, G_IO_ERROR_CONNECTION_CLOSED) &&
+      !g_vfs_ftp_task_error_matches (task, G_IO_ERROR, G_IO_ERROR_BROKEN_PIPE) &&
+      !g_vfs_ftp_task_error_matches (task, G_IO_ERROR, G_IO_ERROR_TIMED_OUT))
+    return FALSE;
+
+  if (!G_IS_SEEKABLE (output))
+    return FALSE;
+
+  /* only retry if the last attempt made progress */
+  written = g_seekable_tell (G_SEEKABLE (output));
+  if (written <= *offset)
+    return FALSE;
+
+  *offset = written;
+  return TRUE;
+}
+
 static void
 do_pull (GVfsBackend *         backend,
          GVfsJobPull *         job,
@@ -1743,8 +1961,13 @@ do_pull (GVfsBackend *         backend,
   GFile *dest;
   GInputStream *input;
   GOutputStream *output;
+  GFileInfo *src_info;
   goffset total_size = 0;
   guint64 mtime = 0;
+  PullProgress progress;
+  guint attempt;
+  guint response;
+  gssize spliced;
 
   src = g_vfs_ftp_file_new_from_gvfs (ftp, source, &task.error);
   if (src == NULL)
@@ -1789,15 +2012,18 @@ do_pull (GVfsBackend *         backend,
       g_object_unref (info);
     }
 
-  if (progress_callback)
+  /* The size is also needed to notice transfers that ended early */
+  src_info = g_vfs_ftp_dir_cache_lookup_file (ftp->dir_cache, &task, src, TRUE);
+  if (src_info)
     {
-      GFileInfo *info = g_vfs_ftp_dir_cache_lookup_file (ftp->dir_cache, &task, src, TRUE);
-      if (info)
-        {
-          total_size = g_file_info_get_size (info);
-          mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
-          g_object_unref (info);
-        }
+      total_size = g_file_info_get_size (src_info);
+      mtime = g_file_info_get_attribute_uint64 (src_info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+      g_object_unref (src_info);
+    }
+  else
+    {
+      /* Not being able to list the file doesn't mean it can't be read */
+      g_vfs_ftp_task_clear_error (&task);
     }
 
   g_vfs_ftp_task_setup_data_connection (&task);
@@ -1833,17 +2059,72 @@ do_pull (GVfsBackend *         backend,
       goto out;
     }
 
-  input = g_io_stream_get_input_stream (g_vfs_ftp_connection_get_data_stream (task.conn));
-  gvfs_output_stream_splice (output,
-                             input,
-                             G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET,
-                             total_size,
-                             progress_callback,
-                             progress_callback_data,
-                             task.cancellable,
-                             &task.error);
-  g_vfs_ftp_task_close_data_connection (&task);
-  g_vfs_ftp_task_receive (&task, 0, NULL);
+  progress.callback = progress_callback;
+  progress.callback_data = progress_callback_data;
+  progress.offset = 0;
+
+  for (attempt = 0; ; attempt++)
+    {
+      input = g_io_stream_get_input_stream (g_vfs_ftp_connection_get_data_stream (task.conn));
+      spliced = gvfs_output_stream_splice (output,
+                                           input,
+                                           0,
+                                           total_size,
+                                           progress_callback ? do_pull_progress : NULL,
+                                           &progress,
+                                           task.cancellable,
+                                           &task.error);
+      g_vfs_ftp_task_close_data_connection (&task);
+      response = g_vfs_ftp_task_receive (&task, G_VFS_FTP_PASS_400, NULL);
+      if (G_VFS_FTP_RESPONSE_GROUP (response) == 4)
+        g_vfs_ftp_task_set_error_from_response (&task, response);
+
+      /* A server may report success although the data connection broke
+       * before the whole file was sent. If resuming doesn't bring any more
+       * data, the file got shorter since it was listed. */
+      if (!g_vfs_ftp_task_is_in_error (&task) &&
+          G_IS_SEEKABLE (output) &&
+          g_seekable_tell (G_SEEKABLE (output)) < total_size &&
+          g_seekable_tell (G_SEEKABLE (output)) > progress.offset)
+        g_set_error_literal (&task.error, G_IO_ERROR, G_IO_ERROR_CLOSED,
+                             _("Data connection closed"));
+
+      if (!g_vfs_ftp_task_is_in_error (&task) ||
+          attempt >= PULL_MAX_RESUME_ATTEMPTS ||
+          !do_pull_can_resume (&task, response, output, &progress.offset))
+        break;
+
+      g_debug ("# resuming download of %s at %" G_GOFFSET_FORMAT ": %s\n",
+               g_vfs_ftp_file_get_ftp_path (src), progress.offset, task.error->message);
+      g_vfs_ftp_task_clear_error (&task);
+      /* collect the server's reply to the broken transfer, if we didn't
+       * already, and drop the control connection if it went down, too */
+      if (spliced < 0)
+        {
+          g_vfs_ftp_task_receive (&task, 0, NULL);
+          g_vfs_ftp_task_clear_error (&task);
+        }
+      if (!g_vfs_ftp_connection_is_usable (task.conn))
+        g_vfs_ftp_task_release_connection (&task);
+
+      g_vfs_ftp_task_setup_data_connection (&task);
+      g_vfs_ftp_task_send (&task,
+                           G_VFS_FTP_PASS_300,
+                           "REST %" G_GOFFSET_FORMAT, progress.offset);
+      g_vfs_ftp_task_send_and_check (&task,
+                                     G_VFS_FTP_PASS_100 | G_VFS_FTP_FAIL_200,
+                                     open_read_handlers,
+                                     src,
+                                     NULL,
+                                     "RETR %s", g_vfs_ftp_file_get_ftp_path (src));
+      g_vfs_ftp_task_open_data_connection (&task);
+      if (g_vfs_ftp_task_is_in_error (&task))
+        break;
+    }
+
+  g_output_stream_close (output,
+                         task.cancellable,
+                         g_vfs_ftp_task_is_in_error (&task) ? NULL : &task.error);
   g_object_unref (output);
 
   /* Ignore errors here. Failure to copy metadata is not a hard error */
@@ -1878,6 +2159,25 @@ try_query_fs_info (GVfsBackend *backend,
   g_file_info_set_attribute_string (info, G_FILE_ATTRIBUTE_FILESYSTEM_TYPE, "ftp");
   g_file_info_set_attribute_boolean (info, G_FILE_ATTRIBUTE_FILESYSTEM_REMOTE, TRUE);
   g_file_info_set_attribute_uint32 (info, G_FILE_ATTRIBUTE_FILESYSTEM_USE_PREVIEW, G_FILESYSTEM_PREVIEW_TYPE_IF_ALWAYS);
+
+  if (g_file_attribute_matcher_matches (matcher, FTP_ATTRIBUTE_DEBUG_CONNECTIONS))
+    {
+      GVfsBackendFtp *ftp = G_VFS_BACKEND_FTP (backend);
+
+      g_mutex_lock (&ftp->mutex);
+      g_file_info_set_attribute_uint32 (info, FTP_ATTRIBUTE_DEBUG_CONNECTIONS, ftp->connections);
+      g_file_info_set_attribute_uint32 (info, FTP_ATTRIBUTE_DEBUG_IDLE_CONNECTIONS,
+                                        ftp->queue ? g_queue_get_length (ftp->queue) : 0);
+      g_file_info_set_attribute_uint32 (info, FTP_ATTRIBUTE_DEBUG_CONNECTS, ftp->stat_connects);
+      g_file_info_set_attribute_uint32 (info, FTP_ATTRIBUTE_DEBUG_ACQUIRES, ftp->stat_acquires);
+      g_file_info_set_attribute_uint64 (info, FTP_ATTRIBUTE_DEBUG_AVG_WAIT,
+                                        ftp->stat_acquires ? ftp->stat_acquire_time / ftp->stat_acquires : 0);
+      g_file_info_set_attribute_uint64 (info, FTP_ATTRIBUTE_DEBUG_MAX_WAIT, ftp->stat_acquire_time_max);
+      g_file_info_set_attribute_uint64 (info, FTP_ATTRIBUTE_DEBUG_AVG_HOLD,
+                                        ftp->stat_acquires ? ftp->stat_hold_time / ftp->stat_acquires : 0);
+      g_mutex_unlock (&ftp->mutex);
+    }
+
   g_vfs_job_succeeded (G_VFS_JOB (job));
   return TRUE;
 }
@@ -1896,6 +2196,7 @@ g_vfs_backend_ftp_class_init (GVfsBackendFtpClass *klass)
   backend_class->open_for_read = do_open_for_read;
   backend_class->close_read = do_close_read;
   backend_class->read = do_read;
+  backend_class->seek_on_read = do_seek_on_read;
   backend_class->create = do_create;
   backend_class->append_to = do_append;
   backend_class->replace = do_replace;
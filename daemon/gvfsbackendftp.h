@@ -48,7 +48,9 @@ typedef enum {
   G_VFS_FTP_FEATURE_AUTH_SSL,
   G_VFS_FTP_FEATURE_CHMOD,
   G_VFS_FTP_FEATURE_CHGRP,
-  G_VFS_FTP_FEATURE_MFMT
+  G_VFS_FTP_FEATURE_MFMT,
+  G_VFS_FTP_FEATURE_MLST,
+  G_VFS_FTP_FEATURE_REST
 } GVfsFtpFeature;
 #define G_VFS_FTP_FEATURES_DEFAULT (0)
 
@@ -122,6 +124,22 @@ struct _GVfsBackendFtp
   guint                	connections;            /* current number of connections */
   guint                 busy_connections;       /* current number of connections being used for reads/writes */
   guint                	max_connections;        /* upper server limit for number of connections - dynamically generated */
+  GWeakRef              tls_session;            /* GTlsClientConnection whose TLS session new connections resume, not kept open for that */
+
+  /* pool maintenance - accessed from gvfsftptask.c */
+  guint                 pool_size;              /* connections to keep open while idle */
+  guint                 keepalive_interval;     /* seconds between NOOPs on idle connections, 0 to disable */
+  guint                 keepalive_id;           /* source id of the keepalive timeout or 0 */
+  GThread *             pool_thread;            /* thread opening or refreshing connections or NULL */
+  gboolean              pool_thread_running;    /* TRUE until pool_thread is about to exit */
+  GCancellable *        pool_cancellable;       /* cancels pool_thread on unmount */
+
+  /* connection statistics, protected by mutex */
+  guint                 stat_acquires;          /* connections handed out to tasks */
+  guint                 stat_connects;          /* control connections opened */
+  gint64                stat_acquire_time;      /* total microseconds spent waiting for a connection */
+  gint64                stat_acquire_time_max;  /* longest wait for a connection */
+  gint64                stat_hold_time;         /* total microseconds connections were held by tasks */
 };
 
 struct _GVfsBackendFtpClass
@@ -189,6 +189,8 @@ g_vfs_backend_localtest_init (GVfsBackendLocalTest *backend)
 	/*  env var conversion */
 	backend->errorneous = -1;
 	backend->inject_op_types = -1;
+
+	g_vfs_backend_set_shared_read_memory (G_VFS_BACKEND (backend), TRUE);
 	
 	c = g_getenv("GVFS_ERRORNEOUS");
 	if (c) {
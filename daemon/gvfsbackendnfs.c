@@ -52,6 +52,7 @@
 #include "gvfsjobsetattribute.h"
 #include "gvfsjobenumerate.h"
 #include "gvfsjobmove.h"
+#include "gvfsjobpull.h"
 #include "gvfsdaemonprotocol.h"
 #include "gvfsdaemonutils.h"
 #include "gvfsutils.h"
@@ -67,6 +68,18 @@ struct _GVfsBackendNfs
   struct nfs_context *ctx;
   GSource *source;
   mode_t umask;               /* cached umask of process */
+  uid_t uid;                  /* credentials libnfs sends to the server */
+  gid_t gid;
+  gid_t *groups;              /* supplementary groups */
+  int n_groups;
+  gboolean local_access;      /* derive access bits from the mode */
+
+  /* Bulk transfers run in job threads on contexts of their own, so they
+   * neither stall nor get stalled by the main loop context. */
+  char *host;
+  char *export;
+  GMutex bulk_lock;
+  GSList *bulk_contexts;      /* idle struct nfs_context */
 };
 
 typedef struct
@@ -84,6 +97,8 @@ G_DEFINE_TYPE (GVfsBackendNfs, g_vfs_backend_nfs, G_VFS_TYPE_BACKEND)
 static void
 g_vfs_backend_nfs_init (GVfsBackendNfs *backend)
 {
+  g_mutex_init (&backend->bulk_lock);
+  g_vfs_backend_set_shared_read_memory (G_VFS_BACKEND (backend), TRUE);
 }
 
 static void
@@ -110,6 +125,13 @@ g_vfs_backend_nfs_finalize (GObject *object)
 
   g_vfs_backend_nfs_destroy_context (backend);
 
+  g_slist_free_full (backend->bulk_contexts,
+                     (GDestroyNotify) nfs_destroy_context);
+  g_mutex_clear (&backend->bulk_lock);
+  g_free (backend->host);
+  g_free (backend->export);
+  g_free (backend->groups);
+
   if (G_OBJECT_CLASS (g_vfs_backend_nfs_parent_class)->finalize)
     (*G_OBJECT_CLASS (g_vfs_backend_nfs_parent_class)->finalize) (object);
 }
@@ -307,7 +329,30 @@ do_mount (GVfsBackend *backend,
   g_mount_spec_set_mount_prefix (nfs_mount_spec, export);
   g_vfs_backend_set_mount_spec (backend, nfs_mount_spec);
   g_mount_spec_unref (nfs_mount_spec);
-  g_free (export);
+
+  op_backend->host = g_steal_pointer (&libnfs_host);
+  op_backend->export = export;
+
+  /* libnfs authenticates with the process credentials unless told
+   * otherwise. The server may still map them (root_squash, all_squash),
+   * export read-only or apply ACLs, none of which the mode bits show, so
+   * deriving access from them is only done when asked for. Root is
+   * usually squashed, so never for root. */
+  op_backend->uid = getuid ();
+  op_backend->gid = getgid ();
+  op_backend->local_access = op_backend->uid != 0 &&
+                             g_getenv ("GVFS_NFS_LOCAL_ACCESS") != NULL;
+  if (op_backend->local_access)
+    {
+      int n_groups = getgroups (0, NULL);
+
+      if (n_groups > 0)
+        {
+          op_backend->groups = g_new (gid_t, n_groups);
+          n_groups = getgroups (n_groups, op_backend->groups);
+          op_backend->n_groups = MAX (n_groups, 0);
+        }
+    }
 
   /* cache the process's umask for later */
   op_backend->umask = umask (0);
@@ -340,6 +385,184 @@ create_etag (uint64_t mtime, uint32_t nsec)
                           (long unsigned int)nsec);
 }
 
+/* Sequential reads keep this many preads in flight, each as large as the
+ * server allows (rtmax). A random read only fetches what was asked for. */
+#define READ_AHEAD_CHUNKS 4
+#define READ_CHUNK_SIZE_DEFAULT (64 * 1024)
+
+typedef struct _ReadHandle ReadHandle;
+
+typedef struct
+{
+  ReadHandle *handle;
+  uint64_t offset;
+  size_t size;                /* bytes requested */
+  char *data;
+  ssize_t length;             /* bytes read or -errno, valid when done */
+  size_t pos;                 /* bytes already handed out */
+  gboolean done;
+  gboolean dropped;           /* free it once the pread completes */
+} ReadChunk;
+
+struct _ReadHandle
+{
+  struct nfsfh *fh;
+  uint64_t offset;            /* position of the client's stream */
+  uint64_t next_offset;       /* where the next pread starts */
+  size_t chunk_size;
+  gboolean started;           /* a read happened since open or seek */
+  gboolean eof;
+  GQueue chunks;              /* ReadChunk, ordered by offset */
+  guint n_inflight;
+  GVfsJobRead *job;           /* read waiting for the first chunk */
+  GVfsJobCloseRead *close_job; /* close waiting for n_inflight to drop */
+};
+
+static void
+read_chunk_free (ReadChunk *chunk)
+{
+  g_free (chunk->data);
+  g_slice_free (ReadChunk, chunk);
+}
+
+static void
+read_handle_drop_chunks (ReadHandle *handle)
+{
+  ReadChunk *chunk;
+
+  while ((chunk = g_queue_pop_head (&handle->chunks)) != NULL)
+    {
+      /* Preads still in flight free their chunk when they complete */
+      if (chunk->done)
+        read_chunk_free (chunk);
+      else
+        chunk->dropped = TRUE;
+    }
+}
+
+static void
+read_handle_free (ReadHandle *handle)
+{
+  read_handle_drop_chunks (handle);
+  g_slice_free (ReadHandle, handle);
+}
+
+static void read_chunk_cb (int err,
+                           struct nfs_context *ctx,
+                           void *data, void *private_data);
+
+static void
+read_handle_queue_chunk (struct nfs_context *ctx,
+                         ReadHandle *handle,
+                         size_t size)
+{
+  ReadChunk *chunk;
+
+  chunk = g_slice_new0 (ReadChunk);
+  chunk->handle = handle;
+  chunk->offset = handle->next_offset;
+  chunk->size = size;
+  chunk->data = g_malloc (size);
+  g_queue_push_tail (&handle->chunks, chunk);
+  handle->next_offset += size;
+  handle->n_inflight++;
+
+#ifdef LIBNFS_API_V2
+  nfs_pread_async (ctx, handle->fh, chunk->data, size, chunk->offset,
+                   read_chunk_cb, chunk);
+#else
+  nfs_pread_async (ctx, handle->fh, chunk->offset, size,
+                   read_chunk_cb, chunk);
+#endif
+}
+
+static void
+read_handle_read_ahead (struct nfs_context *ctx, ReadHandle *handle)
+{
+  while (!handle->eof &&
+         g_queue_get_length (&handle->chunks) < READ_AHEAD_CHUNKS)
+    read_handle_queue_chunk (ctx, handle, handle->chunk_size);
+}
+
+/* Completes the pending read from the first chunk, which must be done */
+static void
+read_handle_complete (struct nfs_context *ctx, ReadHandle *handle)
+{
+  GVfsJobRead *job = handle->job;
+  ReadChunk *chunk;
+  size_t n;
+
+  handle->job = NULL;
+  chunk = g_queue_peek_head (&handle->chunks);
+
+  if (chunk->length < 0)
+    {
+      g_vfs_job_failed_from_errno (G_VFS_JOB (job), -chunk->length);
+      read_handle_drop_chunks (handle);
+      handle->started = FALSE;
+      return;
+    }
+
+  n = MIN (job->bytes_requested, chunk->length - chunk->pos);
+  memcpy (job->buffer, chunk->data + chunk->pos, n);
+  chunk->pos += n;
+  handle->offset += n;
+
+  if (chunk->length == 0)
+    handle->eof = TRUE;
+
+  if (chunk->pos == (size_t) chunk->length)
+    {
+      g_queue_pop_head (&handle->chunks);
+
+      /* After a short read the rest of the window starts at the wrong
+       * offset, realign it */
+      if ((size_t) chunk->length < chunk->size)
+        {
+          read_handle_drop_chunks (handle);
+          handle->next_offset = handle->offset;
+        }
+      read_chunk_free (chunk);
+    }
+
+  g_vfs_job_read_set_size (job, n);
+  g_vfs_job_succeeded (G_VFS_JOB (job));
+
+  if (!g_queue_is_empty (&handle->chunks))
+    read_handle_read_ahead (ctx, handle);
+}
+
+static void
+read_chunk_cb (int err, struct nfs_context *ctx, void *data, void *private_data)
+{
+  ReadChunk *chunk = private_data;
+  ReadHandle *handle = chunk->handle;
+
+  handle->n_inflight--;
+  if (chunk->dropped)
+    {
+      read_chunk_free (chunk);
+
+      /* The file handle is only closed once no pread uses it any more */
+      if (handle->close_job != NULL && handle->n_inflight == 0)
+        {
+          nfs_close_async (ctx, handle->fh, generic_cb, handle->close_job);
+          read_handle_free (handle);
+        }
+      return;
+    }
+
+#ifndef LIBNFS_API_V2
+  if (err > 0)
+    memcpy (chunk->data, data, err);
+#endif
+  chunk->length = err;
+  chunk->done = TRUE;
+
+  if (handle->job != NULL && chunk == g_queue_peek_head (&handle->chunks))
+    read_handle_complete (ctx, handle);
+}
+
 static void
 open_for_read_fstat_cb (int err,
                         struct nfs_context *ctx,
@@ -354,9 +577,11 @@ open_for_read_fstat_cb (int err,
 
       if (S_ISDIR (st->st_mode))
         {
-          struct nfsfh *fh = op_job->backend_handle;
+          ReadHandle *handle = op_job->backend_handle;
 
-          nfs_close_async (ctx, fh, null_cb, NULL);
+          nfs_close_async (ctx, handle->fh, null_cb, NULL);
+          read_handle_free (handle);
+          g_vfs_job_open_for_read_set_handle (op_job, NULL);
           g_vfs_job_failed_literal (job,
                                     G_IO_ERROR,
                                     G_IO_ERROR_IS_DIRECTORY,
@@ -375,8 +600,16 @@ open_for_read_cb (int err,
   if (err == 0)
     {
       GVfsJobOpenForRead *op_job = G_VFS_JOB_OPEN_FOR_READ (private_data);
+      ReadHandle *handle;
+
+      handle = g_slice_new0 (ReadHandle);
+      handle->fh = data;
+      handle->chunk_size = nfs_get_readmax (ctx);
+      if (handle->chunk_size == 0)
+        handle->chunk_size = READ_CHUNK_SIZE_DEFAULT;
+      g_queue_init (&handle->chunks);
 
-      g_vfs_job_open_for_read_set_handle (op_job, data);
+      g_vfs_job_open_for_read_set_handle (op_job, handle);
       g_vfs_job_open_for_read_set_can_seek (op_job, TRUE);
 
       nfs_fstat_async (ctx, data, open_for_read_fstat_cb, private_data);
@@ -398,27 +631,6 @@ try_open_for_read (GVfsBackend *backend,
   return TRUE;
 }
 
-static void
-read_cb (int err, struct nfs_context *ctx, void *data, void *private_data)
-{
-  GVfsJob *job = G_VFS_JOB (private_data);
-
-  if (err >= 0)
-    {
-      GVfsJobRead *op_job = G_VFS_JOB_READ (job);
-
-#ifndef LIBNFS_API_V2
-      memcpy (op_job->buffer, data, err);
-#endif
-      g_vfs_job_read_set_size (op_job, err);
-      g_vfs_job_succeeded (job);
-    }
-  else
-    {
-      g_vfs_job_failed_from_errno (job, -err);
-    }
-}
-
 static gboolean
 try_read (GVfsBackend *backend,
           GVfsJobRead *job,
@@ -427,13 +639,36 @@ try_read (GVfsBackend *backend,
           gsize bytes_requested)
 {
   GVfsBackendNfs *op_backend = G_VFS_BACKEND_NFS (backend);
-  struct nfsfh *fh = _handle;
+  ReadHandle *handle = _handle;
+  ReadChunk *chunk;
+
+  chunk = g_queue_peek_head (&handle->chunks);
+  if (chunk == NULL || chunk->offset + chunk->pos != handle->offset)
+    {
+      read_handle_drop_chunks (handle);
+
+      /* Only start reading ahead once the client reads on from where
+       * the previous read ended */
+      if (handle->started && !handle->eof &&
+          handle->next_offset == handle->offset)
+        {
+          read_handle_read_ahead (op_backend->ctx, handle);
+        }
+      else
+        {
+          handle->next_offset = handle->offset;
+          handle->eof = FALSE;
+          read_handle_queue_chunk (op_backend->ctx, handle,
+                                   MIN (bytes_requested, handle->chunk_size));
+        }
+      handle->started = TRUE;
+      chunk = g_queue_peek_head (&handle->chunks);
+    }
+
+  handle->job = job;
+  if (chunk->done)
+    read_handle_complete (op_backend->ctx, handle);
 
-#ifdef LIBNFS_API_V2
-  nfs_read_async (op_backend->ctx, fh, buffer, bytes_requested, read_cb, job);
-#else
-  nfs_read_async (op_backend->ctx, fh, bytes_requested, read_cb, job);
-#endif
   return TRUE;
 }
 
@@ -600,9 +835,9 @@ try_query_info_on_read (GVfsBackend *backend,
                         GFileAttributeMatcher *attribute_matcher)
 {
   GVfsBackendNfs *op_backend = G_VFS_BACKEND_NFS (backend);
-  struct nfsfh *nfsfh = _handle;
+  ReadHandle *handle = _handle;
 
-  nfs_fstat64_async (op_backend->ctx, nfsfh, query_info_on_read_cb, job);
+  nfs_fstat64_async (op_backend->ctx, handle->fh, query_info_on_read_cb, job);
   return TRUE;
 }
 
@@ -616,8 +851,14 @@ seek_on_read_cb (int err,
   if (err >= 0)
     {
       GVfsJobSeekRead *op_job = G_VFS_JOB_SEEK_READ (job);
+      ReadHandle *handle = op_job->handle;
       uint64_t *pos = data;
 
+      read_handle_drop_chunks (handle);
+      handle->offset = *pos;
+      handle->started = FALSE;
+      handle->eof = FALSE;
+
       g_vfs_job_seek_read_set_offset (op_job, *pos);
       g_vfs_job_succeeded (job);
     }
@@ -635,10 +876,19 @@ try_seek_on_read (GVfsBackend *backend,
                   GSeekType type)
 {
   GVfsBackendNfs *op_backend = G_VFS_BACKEND_NFS (backend);
-  struct nfsfh *fh = _handle;
+  ReadHandle *handle = _handle;
+  int whence;
+
+  /* Reads use pread, so the position libnfs keeps for the file is stale */
+  whence = gvfs_seek_type_to_lseek (type);
+  if (whence == SEEK_CUR)
+    {
+      offset += handle->offset;
+      whence = SEEK_SET;
+    }
 
   nfs_lseek_async (op_backend->ctx,
-                   fh, offset, gvfs_seek_type_to_lseek (type),
+                   handle->fh, offset, whence,
                    seek_on_read_cb, job);
   return TRUE;
 }
@@ -649,9 +899,17 @@ try_close_read (GVfsBackend *backend,
                 GVfsBackendHandle _handle)
 {
   GVfsBackendNfs *op_backend = G_VFS_BACKEND_NFS (backend);
-  struct nfsfh *fh = _handle;
+  ReadHandle *handle = _handle;
+
+  read_handle_drop_chunks (handle);
+  if (handle->n_inflight > 0)
+    {
+      handle->close_job = job;
+      return TRUE;
+    }
 
-  nfs_close_async (op_backend->ctx, fh, generic_cb, job);
+  nfs_close_async (op_backend->ctx, handle->fh, generic_cb, job);
+  read_handle_free (handle);
   return TRUE;
 }
 
@@ -1759,41 +2017,128 @@ try_query_fs_info (GVfsBackend *backend,
   return TRUE;
 }
 
+/* Number of per-entry RPCs an enumeration keeps in flight */
+#define ENUMERATE_WINDOW 32
+
 typedef struct
 {
-  GSList *readlink_list;
-  GSList *symlink_list;
-  GSList *access_list;
+  GVfsBackendNfs *backend;
+  GQueue pending;             /* EnumerateEntry waiting for an RPC slot */
+  guint n_inflight;
   gboolean requires_access;
   int access_parent;
   GVfsJobEnumerate *op_job;
 } EnumerateHandle;
 
-static void enumerate_continue (EnumerateHandle *handle,
-                                struct nfs_context *ctx);
+typedef struct
+{
+  EnumerateHandle *handle;
+  GFileInfo *info;
+  gboolean needs_readlink;
+  gboolean needs_stat;
+  gboolean needs_access;
+} EnumerateEntry;
+
+static void enumerate_pump (EnumerateHandle *handle, struct nfs_context *ctx);
+
+static gboolean
+backend_in_group (GVfsBackendNfs *backend, gid_t gid)
+{
+  int i;
+
+  if (gid == backend->gid)
+    return TRUE;
+
+  for (i = 0; i < backend->n_groups; i++)
+    if (backend->groups[i] == gid)
+      return TRUE;
+
+  return FALSE;
+}
+
+/* Derives the result of an ACCESS call from the mode bits, as the server
+ * would for the AUTH_UNIX credentials libnfs sends. Returns -1 if that is
+ * not reliable: local derivation is off, or a symlink could not be resolved
+ * and has no meaningful mode. */
+static int
+access_from_info (EnumerateHandle *handle, GFileInfo *info)
+{
+  GVfsBackendNfs *backend = handle->backend;
+  guint32 mode;
+
+  if (!backend->local_access ||
+      g_file_info_get_file_type (info) == G_FILE_TYPE_SYMBOLIC_LINK)
+    return -1;
+
+  mode = g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_MODE);
+
+  if (g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_UID) == backend->uid)
+    mode >>= 6;
+  else if (backend_in_group (backend,
+                             g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_GID)))
+    mode >>= 3;
+
+  return mode & (R_OK | W_OK | X_OK);
+}
+
+static void
+set_access_info (GFileInfo *info, int access)
+{
+  g_file_info_set_attribute_boolean (info, G_FILE_ATTRIBUTE_ACCESS_CAN_READ, access & R_OK);
+  g_file_info_set_attribute_boolean (info, G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE, access & W_OK);
+  g_file_info_set_attribute_boolean (info, G_FILE_ATTRIBUTE_ACCESS_CAN_EXECUTE, access & X_OK);
+}
+
+static void
+enumerate_entry_done (EnumerateEntry *entry)
+{
+  g_vfs_job_enumerate_add_info (entry->handle->op_job, entry->info);
+  g_object_unref (entry->info);
+  g_slice_free (EnumerateEntry, entry);
+}
+
+/* Finishes the entry if it needs no further RPCs. Returns FALSE if the
+ * entry was consumed. */
+static gboolean
+enumerate_entry_advance (EnumerateEntry *entry)
+{
+  EnumerateHandle *handle = entry->handle;
+
+  if (entry->needs_access && !entry->needs_readlink && !entry->needs_stat)
+    {
+      int access = access_from_info (handle, entry->info);
+
+      if (access >= 0)
+        {
+          set_access_info (entry->info, access);
+          entry->needs_access = FALSE;
+        }
+    }
+
+  if (entry->needs_readlink || entry->needs_stat || entry->needs_access)
+    return TRUE;
+
+  enumerate_entry_done (entry);
+  return FALSE;
+}
 
 static void
 enumerate_access_cb (int err,
                      struct nfs_context *ctx,
                      void *data, void *private_data)
 {
-  EnumerateHandle *handle = private_data;
-  GFileInfo *info = handle->access_list->data;
+  EnumerateEntry *entry = private_data;
+  EnumerateHandle *handle = entry->handle;
 
-  if (err >= 0)
-    {
-      g_file_info_set_attribute_boolean (info, G_FILE_ATTRIBUTE_ACCESS_CAN_READ, err & R_OK);
-      g_file_info_set_attribute_boolean (info, G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE, err & W_OK);
-      g_file_info_set_attribute_boolean (info, G_FILE_ATTRIBUTE_ACCESS_CAN_EXECUTE, err & X_OK);
-    }
+  handle->n_inflight--;
 
-  g_vfs_job_enumerate_add_info (handle->op_job, info);
-  g_object_unref (info);
+  if (err >= 0)
+    set_access_info (entry->info, err);
 
-  handle->access_list = g_slist_delete_link (handle->access_list,
-                                             handle->access_list);
+  entry->needs_access = FALSE;
+  enumerate_entry_done (entry);
 
-  enumerate_continue (handle, ctx);
+  enumerate_pump (handle, ctx);
 }
 
 static void
@@ -1801,8 +2146,11 @@ enumerate_stat_cb (int err,
                    struct nfs_context *ctx,
                    void *data, void *private_data)
 {
-  EnumerateHandle *handle = private_data;
-  GFileInfo *info = handle->symlink_list->data;
+  EnumerateEntry *entry = private_data;
+  EnumerateHandle *handle = entry->handle;
+  GFileInfo *info = entry->info;
+
+  handle->n_inflight--;
 
   if (err == 0)
     {
@@ -1835,21 +2183,15 @@ enumerate_stat_cb (int err,
         }
 
       g_object_unref (info);
-      info = new_info;
+      entry->info = new_info;
     }
 
-  if (handle->requires_access)
-    handle->access_list = g_slist_prepend (handle->access_list, info);
-  else
-    {
-      g_vfs_job_enumerate_add_info (handle->op_job, info);
-      g_object_unref (info);
-    }
+  entry->needs_stat = FALSE;
+  /* Entries already underway go first so their infos are not held back */
+  if (enumerate_entry_advance (entry))
+    g_queue_push_head (&handle->pending, entry);
 
-  handle->symlink_list = g_slist_delete_link (handle->symlink_list,
-                                              handle->symlink_list);
-
-  enumerate_continue (handle, ctx);
+  enumerate_pump (handle, ctx);
 }
 
 static void
@@ -1857,57 +2199,49 @@ enumerate_readlink_cb (int err,
                        struct nfs_context *ctx,
                        void *data, void *private_data)
 {
-  EnumerateHandle *handle = private_data;
-  GFileInfo *info = handle->readlink_list->data;
+  EnumerateEntry *entry = private_data;
+  EnumerateHandle *handle = entry->handle;
 
-  if (err == 0)
-    g_file_info_set_symlink_target (info, data);
+  handle->n_inflight--;
 
-  if (!(handle->op_job->flags & G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS))
-    handle->symlink_list = g_slist_prepend (handle->symlink_list, info);
-  else if (handle->requires_access)
-    handle->access_list = g_slist_prepend (handle->access_list, info);
-  else
-    {
-      g_vfs_job_enumerate_add_info (handle->op_job, info);
-      g_object_unref (info);
-    }
+  if (err == 0)
+    g_file_info_set_symlink_target (entry->info, data);
 
-  handle->readlink_list = g_slist_delete_link (handle->readlink_list,
-                                              handle->readlink_list);
+  entry->needs_readlink = FALSE;
+  if (enumerate_entry_advance (entry))
+    g_queue_push_head (&handle->pending, entry);
 
-  enumerate_continue (handle, ctx);
+  enumerate_pump (handle, ctx);
 }
 
+/* Issues the next RPC of queued entries until the window is full, and
+ * completes the job once nothing is queued or in flight. */
 static void
-enumerate_continue (EnumerateHandle *handle, struct nfs_context *ctx)
+enumerate_pump (EnumerateHandle *handle, struct nfs_context *ctx)
 {
-  if (handle->readlink_list || handle->symlink_list || handle->access_list)
+  EnumerateEntry *entry;
+
+  while (handle->n_inflight < ENUMERATE_WINDOW &&
+         (entry = g_queue_pop_head (&handle->pending)))
     {
       char *path;
 
-      if (handle->readlink_list)
-        {
-          const char *filename = g_file_info_get_name (handle->readlink_list->data);
-          path = g_build_filename (handle->op_job->filename, filename, NULL);
-          nfs_readlink_async (ctx, path, enumerate_readlink_cb, handle);
-        }
-      else if (handle->symlink_list)
-        {
-          const char *filename = g_file_info_get_name (handle->symlink_list->data);
-          path = g_build_filename (handle->op_job->filename, filename, NULL);
-          nfs_stat64_async (ctx, path, enumerate_stat_cb, handle);
-        }
-      else if (handle->access_list)
-        {
-          const char *filename = g_file_info_get_name (handle->access_list->data);
-          path = g_build_filename (handle->op_job->filename, filename, NULL);
-          nfs_access2_async (ctx, path, enumerate_access_cb, handle);
-        }
+      path = g_build_filename (handle->op_job->filename,
+                               g_file_info_get_name (entry->info),
+                               NULL);
+
+      if (entry->needs_readlink)
+        nfs_readlink_async (ctx, path, enumerate_readlink_cb, entry);
+      else if (entry->needs_stat)
+        nfs_stat64_async (ctx, path, enumerate_stat_cb, entry);
+      else
+        nfs_access2_async (ctx, path, enumerate_access_cb, entry);
 
+      handle->n_inflight++;
       g_free (path);
     }
-  else
+
+  if (handle->n_inflight == 0 && g_queue_is_empty (&handle->pending))
     {
       GVfsJobEnumerate *op_job = handle->op_job;
       g_slice_free (EnumerateHandle, handle);
@@ -1929,16 +2263,9 @@ enumerate_cb (int err, struct nfs_context *ctx, void *data, void *private_data)
 
       g_vfs_job_succeeded (job);
 
-      handle->requires_access =
-          g_file_attribute_matcher_matches (op_job->attribute_matcher,
-                                            G_FILE_ATTRIBUTE_ACCESS_CAN_READ) ||
-          g_file_attribute_matcher_matches (op_job->attribute_matcher,
-                                            G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE) ||
-          g_file_attribute_matcher_matches (op_job->attribute_matcher,
-                                            G_FILE_ATTRIBUTE_ACCESS_CAN_EXECUTE);
-
       while ((d = nfs_readdir (ctx, dir)))
         {
+          EnumerateEntry *entry;
           GFileInfo *info;
           GFileType type = G_FILE_TYPE_UNKNOWN;
           char *etag, *mimetype = NULL;
@@ -2018,36 +2345,24 @@ enumerate_cb (int err, struct nfs_context *ctx, void *data, void *private_data)
               g_file_info_set_attribute_boolean (info, G_FILE_ATTRIBUTE_ACCESS_CAN_RENAME, handle->access_parent & W_OK);
             }
 
-          if (d->type == NF3LNK &&
+          entry = g_slice_new0 (EnumerateEntry);
+          entry->handle = handle;
+          entry->info = info;
+          entry->needs_readlink =
+              d->type == NF3LNK &&
               g_file_attribute_matcher_matches (op_job->attribute_matcher,
-                                                G_FILE_ATTRIBUTE_STANDARD_SYMLINK_TARGET))
-            {
-              handle->readlink_list = g_slist_prepend (handle->readlink_list,
-                                                       info);
-              continue;
-            }
-
-          if (d->type == NF3LNK &&
-              !(op_job->flags & G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS))
-            {
-              handle->symlink_list = g_slist_prepend (handle->symlink_list,
-                                                      info);
-              continue;
-            }
-
-          if (handle->requires_access)
-            {
-              handle->access_list = g_slist_prepend (handle->access_list,
-                                                     info);
-              continue;
-            }
-
-          g_vfs_job_enumerate_add_info (op_job, info);
-          g_object_unref (info);
+                                                G_FILE_ATTRIBUTE_STANDARD_SYMLINK_TARGET);
+          entry->needs_stat =
+              d->type == NF3LNK &&
+              !(op_job->flags & G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS);
+          entry->needs_access = handle->requires_access;
+
+          if (enumerate_entry_advance (entry))
+            g_queue_push_tail (&handle->pending, entry);
         }
 
       nfs_closedir (ctx, dir);
-      enumerate_continue (handle, ctx);
+      enumerate_pump (handle, ctx);
     }
   else
     {
@@ -2080,8 +2395,16 @@ try_enumerate (GVfsBackend *backend,
   EnumerateHandle *handle;
 
   handle = g_slice_new0 (EnumerateHandle);
+  handle->backend = op_backend;
   handle->op_job = job;
   handle->access_parent = -1;
+  handle->requires_access =
+      g_file_attribute_matcher_matches (attribute_matcher,
+                                        G_FILE_ATTRIBUTE_ACCESS_CAN_READ) ||
+      g_file_attribute_matcher_matches (attribute_matcher,
+                                        G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE) ||
+      g_file_attribute_matcher_matches (attribute_matcher,
+                                        G_FILE_ATTRIBUTE_ACCESS_CAN_EXECUTE);
 
   if (g_file_attribute_matcher_matches (attribute_matcher,
                                         G_FILE_ATTRIBUTE_ACCESS_CAN_DELETE) ||
@@ -2683,6 +3006,353 @@ try_move (GVfsBackend *backend,
   return TRUE;
 }
 
+static struct nfs_context *
+bulk_context_get (GVfsBackendNfs *backend, GError **error)
+{
+  struct nfs_context *ctx = NULL;
+  const char *debug;
+  int err;
+
+  g_mutex_lock (&backend->bulk_lock);
+  if (backend->bulk_contexts)
+    {
+      ctx = backend->bulk_contexts->data;
+      backend->bulk_contexts = g_slist_delete_link (backend->bulk_contexts,
+                                                    backend->bulk_contexts);
+    }
+  g_mutex_unlock (&backend->bulk_lock);
+
+  if (ctx)
+    return ctx;
+
+  ctx = nfs_init_context ();
+  if (ctx == NULL)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                   _("Internal Error (%s)"), "Failed to allocate nfs context");
+      return NULL;
+    }
+
+  debug = g_getenv ("GVFS_NFS_DEBUG");
+  nfs_set_debug (ctx, debug ? atoi (debug) : 0);
+
+  err = nfs_mount (ctx, backend->host, backend->export);
+  if (err)
+    {
+      g_set_error_literal (error, G_IO_ERROR,
+                           g_io_error_from_errno (-err),
+                           g_strerror (-err));
+      nfs_destroy_context (ctx);
+      return NULL;
+    }
+
+  return ctx;
+}
+
+static void
+bulk_context_put (GVfsBackendNfs *backend, struct nfs_context *ctx)
+{
+  g_mutex_lock (&backend->bulk_lock);
+  backend->bulk_contexts = g_slist_prepend (backend->bulk_contexts, ctx);
+  g_mutex_unlock (&backend->bulk_lock);
+}
+
+typedef struct
+{
+  struct nfsfh *fh;
+  int fd;
+  uint64_t size;
+  uint64_t next_offset;       /* where the next pread starts */
+  uint64_t transferred;
+  size_t chunk_size;
+  guint n_inflight;
+  int err;                    /* first error as -errno */
+  GVfsJob *job;
+  GFileProgressCallback progress_callback;
+  gpointer progress_callback_data;
+} PullHandle;
+
+typedef struct
+{
+  PullHandle *handle;
+  uint64_t offset;
+  size_t size;
+#ifdef LIBNFS_API_V2
+  char *buffer;
+#endif
+} PullChunk;
+
+static void pull_chunk_cb (int err,
+                           struct nfs_context *ctx,
+                           void *data, void *private_data);
+
+static void
+pull_queue_chunk (struct nfs_context *ctx,
+                  PullHandle *handle,
+                  uint64_t offset,
+                  size_t size)
+{
+  PullChunk *chunk;
+
+  chunk = g_slice_new0 (PullChunk);
+  chunk->handle = handle;
+  chunk->offset = offset;
+  chunk->size = size;
+  handle->n_inflight++;
+
+#ifdef LIBNFS_API_V2
+  chunk->buffer = g_malloc (size);
+  nfs_pread_async (ctx, handle->fh, chunk->buffer, size, offset,
+                   pull_chunk_cb, chunk);
+#else
+  nfs_pread_async (ctx, handle->fh, offset, size, pull_chunk_cb, chunk);
+#endif
+}
+
+static void
+pull_chunk_cb (int err, struct nfs_context *ctx, void *data, void *private_data)
+{
+  PullChunk *chunk = private_data;
+  PullHandle *handle = chunk->handle;
+  const char *p;
+  ssize_t written;
+  int n;
+
+#ifdef LIBNFS_API_V2
+  p = chunk->buffer;
+#else
+  p = data;
+#endif
+
+  handle->n_inflight--;
+
+  if (err < 0 && handle->err == 0)
+    handle->err = err;
+
+  /* Every chunk starts before the size the file had when it was opened,
+   * so nothing to read means it was truncated in the meantime */
+  if (err == 0 && handle->err == 0)
+    handle->err = -EIO;
+
+  /* Chunks complete out of order, so write each one at its own offset */
+  for (n = 0; err > 0 && n < err && handle->err == 0; n += written)
+    {
+      written = pwrite (handle->fd, p + n, err - n, chunk->offset + n);
+      if (written < 0)
+        {
+          if (errno == EINTR)
+            written = 0;
+          else
+            handle->err = -errno;
+        }
+    }
+
+  if (err > 0 && handle->err == 0)
+    {
+      handle->transferred += err;
+      if (handle->progress_callback)
+        handle->progress_callback (handle->transferred, handle->size,
+                                   handle->progress_callback_data);
+
+      /* Servers may return less than asked for before the end of file */
+      if ((size_t) err < chunk->size && chunk->offset + err < handle->size)
+        pull_queue_chunk (ctx, handle, chunk->offset + err, chunk->size - err);
+    }
+
+  if (handle->err == 0 && g_vfs_job_is_cancelled (handle->job))
+    handle->err = -ECANCELED;
+
+  if (handle->err == 0 && handle->next_offset < handle->size)
+    {
+      pull_queue_chunk (ctx, handle, handle->next_offset, handle->chunk_size);
+      handle->next_offset += handle->chunk_size;
+    }
+
+#ifdef LIBNFS_API_V2
+  g_free (chunk->buffer);
+#endif
+  g_slice_free (PullChunk, chunk);
+}
+
+/* Runs the private context until all preads completed */
+static int
+pull_run (struct nfs_context *ctx, PullHandle *handle)
+{
+  struct pollfd pfd;
+  int i;
+
+  for (i = 0; i < READ_AHEAD_CHUNKS && handle->next_offset < handle->size; i++)
+    {
+      pull_queue_chunk (ctx, handle, handle->next_offset, handle->chunk_size);
+      handle->next_offset += handle->chunk_size;
+    }
+
+  while (handle->n_inflight > 0)
+    {
+      pfd.fd = nfs_get_fd (ctx);
+      pfd.events = nfs_which_events (ctx);
+      pfd.revents = 0;
+
+      /* Wake up regularly to notice cancellation */
+      if (poll (&pfd, 1, 500) < 0 && errno != EINTR)
+        return -errno;
+
+      if (handle->err == 0 && g_vfs_job_is_cancelled (handle->job))
+        handle->err = -ECANCELED;
+
+      if (nfs_service (ctx, pfd.revents) < 0)
+        return -EIO;
+    }
+
+  if (handle->err == 0 && handle->transferred < handle->size)
+    return -EIO;
+
+  return handle->err;
+}
+
+static void
+do_pull (GVfsBackend *backend,
+         GVfsJobPull *job,
+         const char *source,
+         const char *local_path,
+         GFileCopyFlags flags,
+         gboolean remove_source,
+         GFileProgressCallback progress_callback,
+         gpointer progress_callback_data)
+{
+  GVfsBackendNfs *op_backend = G_VFS_BACKEND_NFS (backend);
+  struct nfs_context *ctx;
+  struct nfs_stat_64 st;
+  struct timespec times[2];
+  GStatBuf local_st;
+  PullHandle handle = { 0, };
+  GError *error = NULL;
+  char *dirname, *tmp_path;
+  int err;
+
+  ctx = bulk_context_get (op_backend, &error);
+  if (ctx == NULL)
+    {
+      g_vfs_job_failed_from_error (G_VFS_JOB (job), error);
+      g_error_free (error);
+      return;
+    }
+
+  if (flags & G_FILE_COPY_NOFOLLOW_SYMLINKS)
+    err = nfs_lstat64 (ctx, source, &st);
+  else
+    err = nfs_stat64 (ctx, source, &st);
+  if (err)
+    {
+      g_vfs_job_failed_from_errno (G_VFS_JOB (job), -err);
+      goto out;
+    }
+
+  /* Directories, symlinks, special files and backups are left to the
+   * generic fallback */
+  if (!S_ISREG (st.nfs_mode))
+    {
+      g_vfs_job_failed_literal (G_VFS_JOB (job),
+                                G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                                _("Operation not supported"));
+      goto out;
+    }
+
+  if (g_lstat (local_path, &local_st) == 0)
+    {
+      if (!(flags & G_FILE_COPY_OVERWRITE))
+        {
+          g_vfs_job_failed_literal (G_VFS_JOB (job),
+                                    G_IO_ERROR, G_IO_ERROR_EXISTS,
+                                    _("Target file already exists"));
+          goto out;
+        }
+
+      if (S_ISDIR (local_st.st_mode) || (flags & G_FILE_COPY_BACKUP))
+        {
+          g_vfs_job_failed_literal (G_VFS_JOB (job),
+                                    G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                                    _("Operation not supported"));
+          goto out;
+        }
+    }
+
+  err = nfs_open (ctx, source, O_RDONLY, &handle.fh);
+  if (err)
+    {
+      g_vfs_job_failed_from_errno (G_VFS_JOB (job), -err);
+      goto out;
+    }
+
+  /* Write next to the target and rename it over only once all data is
+   * there, so a failed or cancelled pull leaves an existing file alone */
+  dirname = g_path_get_dirname (local_path);
+  tmp_path = g_build_filename (dirname, ".gvfs-nfs-pull-XXXXXX", NULL);
+  g_free (dirname);
+
+  handle.fd = g_mkstemp_full (tmp_path, O_WRONLY | O_CLOEXEC,
+                              st.nfs_mode & 0777);
+  if (handle.fd < 0)
+    {
+      g_vfs_job_failed_from_errno (G_VFS_JOB (job), errno);
+      nfs_close (ctx, handle.fh);
+      g_free (tmp_path);
+      goto out;
+    }
+
+  handle.size = st.nfs_size;
+  handle.chunk_size = nfs_get_readmax (ctx);
+  if (handle.chunk_size == 0)
+    handle.chunk_size = READ_CHUNK_SIZE_DEFAULT;
+  handle.job = G_VFS_JOB (job);
+  handle.progress_callback = progress_callback;
+  handle.progress_callback_data = progress_callback_data;
+
+  err = pull_run (ctx, &handle);
+  nfs_close (ctx, handle.fh);
+
+  if (err == 0 && !(flags & G_FILE_COPY_TARGET_DEFAULT_MODIFIED_TIME))
+    {
+      /* Failure to copy metadata is not a hard error */
+      times[0].tv_sec = 0;
+      times[0].tv_nsec = UTIME_OMIT;
+      times[1].tv_sec = st.nfs_mtime;
+      times[1].tv_nsec = st.nfs_mtime_nsec;
+      futimens (handle.fd, times);
+    }
+
+  if (close (handle.fd) < 0 && err == 0)
+    err = -errno;
+
+  if (err == 0 && g_rename (tmp_path, local_path) < 0)
+    err = -errno;
+
+  if (err)
+    g_unlink (tmp_path);
+  g_free (tmp_path);
+
+  if (err == 0 && remove_source)
+    err = nfs_unlink (ctx, source);
+
+  if (err)
+    {
+      g_vfs_job_failed_from_errno (G_VFS_JOB (job), -err);
+
+      /* The connection may be what broke, don't keep it around */
+      if (err != -ECANCELED)
+        {
+          nfs_destroy_context (ctx);
+          return;
+        }
+      goto out;
+    }
+
+  g_vfs_job_succeeded (G_VFS_JOB (job));
+
+ out:
+  bulk_context_put (op_backend, ctx);
+}
+
 static void
 g_vfs_backend_nfs_class_init (GVfsBackendNfsClass *klass)
 {
@@ -2717,4 +3387,5 @@ g_vfs_backend_nfs_class_init (GVfsBackendNfsClass *klass)
   backend_class->try_set_attribute = try_set_attribute;
   backend_class->try_unmount = try_unmount;
   backend_class->try_move = try_move;
+  backend_class->pull = do_pull;
 }
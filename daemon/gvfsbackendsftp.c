@@ -57,6 +57,7 @@
 #include "gvfsjobqueryinforead.h"
 #include "gvfsjobqueryinfowrite.h"
 #include "gvfsjobmove.h"
+#include "gvfsjobcopy.h"
 #include "gvfsjobdelete.h"
 #include "gvfsjobqueryfsinfo.h"
 #include "gvfsjobqueryattributes.h"
@@ -93,6 +94,10 @@
  */
 #define MAX_BUFFER_SIZE 32768
 
+/* Room for the headers of a READ reply or WRITE request around the data,
+ * the same slack OpenSSH leaves in limits@openssh.com */
+#define PACKET_OVERHEAD 1024
+
 /* Limit on SFTP reply packet size to prevent OOM from buggy servers.
  * Matches MAX_PACKET_LEN used by OpenSSH and libssh2.  Note that SSH
  * transport already caps individual packets, but an SFTP message can
@@ -100,10 +105,34 @@
  */
 #define MAX_REPLY_SIZE (256 * 1024)
 
+/* Push, pull and copy keep about twice the bandwidth-delay product of
+ * the connection in flight, within these bounds. */
+#define WINDOW_MIN_REQUESTS 8
+#define WINDOW_MAX_REQUESTS 256
+
+/* Bulk transfers are spread over a pool of data connections, sized by
+ * GVFS_SFTP_DATA_CONNECTIONS. The first one shares the ssh control
+ * master with the command connection, the others are separate ssh
+ * processes so they don't share its TCP connection and cipher. */
+#define DEFAULT_DATA_CONNECTIONS 1
+#define MAX_DATA_CONNECTIONS 8
+
+/* Attributes of recently seen files are reused for GVFS_SFTP_CACHE_TTL
+ * seconds, or until this mount changes them */
+#define DEFAULT_STAT_CACHE_TTL 5.0
+#define STAT_CACHE_MAX_ENTRIES 4096
+
+/* Stat cache counters, reported by query_fs_info when asked for */
+#define SFTP_ATTRIBUTE_DEBUG_STAT_CACHE_HITS    "gvfs-debug::sftp-stat-cache-hits"
+#define SFTP_ATTRIBUTE_DEBUG_STAT_CACHE_MISSES  "gvfs-debug::sftp-stat-cache-misses"
+#define SFTP_ATTRIBUTE_DEBUG_STAT_CACHE_ENTRIES "gvfs-debug::sftp-stat-cache-entries"
+
 static GQuark id_q;
 
 typedef enum {
   SFTP_EXT_OPENSSH_STATVFS,
+  SFTP_EXT_OPENSSH_COPY_DATA,
+  SFTP_EXT_OPENSSH_LIMITS,
 } SFTPServerExtensions;
 
 typedef enum {
@@ -168,6 +197,27 @@ typedef struct {
   gpointer user_data;
 } ExpectedReply;
 
+typedef struct {
+  gint64 start_time;
+  gint64 min_rtt;
+  goffset n_bytes;
+  int max_requests;
+} TransferWindow;
+
+/* The ATTRS of the replies are kept as they came, so any attribute
+ * matcher can be answered from them */
+typedef struct {
+  char *path;
+  GList link;
+  gint64 stamp;
+  gboolean exists;
+  GBytes *lstat_attrs;
+  GBytes *stat_attrs;   /* NULL for a broken symlink */
+  gboolean stat_known;
+  char *symlink_target;
+  gboolean symlink_target_known;
+} StatCacheEntry;
+
 typedef struct {
   GVfsBackendSftp *op_backend;
 
@@ -208,10 +258,24 @@ struct _GVfsBackendSftp
   int protocol_version;
   SFTPServerExtensions extensions;
 
+  /* Largest data size of a single READ and WRITE */
+  guint32 max_read_size;
+  guint32 max_write_size;
+
   guint32 current_id;
 
   Connection command_connection;
-  Connection data_connection;
+  Connection data_connections[MAX_DATA_CONNECTIONS];
+  int n_data_connections;
+
+  /* Path -> StatCacheEntry, most recently used first in the queue */
+  GHashTable *stat_cache;
+  GQueue stat_cache_lru;
+  gint64 stat_cache_ttl;
+  guint stat_cache_generation;
+  guint stat_cache_changes;
+  guint64 stat_cache_hits;
+  guint64 stat_cache_misses;
 
   gboolean force_unmounted;
 };
@@ -302,14 +366,262 @@ connection_is_usable (Connection *conn)
   return conn->command_stream != NULL;
 }
 
+/* Returns the usable data connection with the fewest requests in
+ * flight, or NULL if there is none */
+static Connection *
+get_data_connection (GVfsBackendSftp *backend)
+{
+  Connection *best = NULL;
+  int i;
+
+  for (i = 0; i < backend->n_data_connections; i++)
+    {
+      Connection *conn = &backend->data_connections[i];
+
+      if (!connection_is_usable (conn))
+        continue;
+
+      if (best == NULL ||
+          g_hash_table_size (conn->expected_replies) <
+          g_hash_table_size (best->expected_replies))
+        best = conn;
+    }
+
+  return best;
+}
+
+static void
+stat_cache_entry_free (StatCacheEntry *entry)
+{
+  g_free (entry->path);
+  if (entry->lstat_attrs)
+    g_bytes_unref (entry->lstat_attrs);
+  if (entry->stat_attrs)
+    g_bytes_unref (entry->stat_attrs);
+  g_free (entry->symlink_target);
+  g_slice_free (StatCacheEntry, entry);
+}
+
+static gint64
+get_stat_cache_ttl (void)
+{
+  const char *str;
+  gdouble ttl;
+
+  ttl = DEFAULT_STAT_CACHE_TTL;
+  str = g_getenv ("GVFS_SFTP_CACHE_TTL");
+  if (str != NULL)
+    ttl = g_ascii_strtod (str, NULL);
+
+  return MAX (ttl, 0) * G_USEC_PER_SEC;
+}
+
+static void
+stat_cache_remove (GVfsBackendSftp *backend,
+                   StatCacheEntry *entry)
+{
+  g_queue_unlink (&backend->stat_cache_lru, &entry->link);
+  g_hash_table_remove (backend->stat_cache, entry->path);
+}
+
+/* Returns the entry for path if it hasn't expired yet */
+static StatCacheEntry *
+stat_cache_lookup (GVfsBackendSftp *backend,
+                   const char *path)
+{
+  StatCacheEntry *entry;
+
+  if (backend->stat_cache_ttl == 0)
+    return NULL;
+
+  entry = g_hash_table_lookup (backend->stat_cache, path);
+  if (entry == NULL)
+    return NULL;
+
+  if (g_get_monotonic_time () - entry->stamp > backend->stat_cache_ttl)
+    {
+      stat_cache_remove (backend, entry);
+      return NULL;
+    }
+
+  g_queue_unlink (&backend->stat_cache_lru, &entry->link);
+  g_queue_push_head_link (&backend->stat_cache_lru, &entry->link);
+
+  return entry;
+}
+
+/* Replies to requests sent before the last change, or while a change
+ * is in flight, may describe the file from before the change */
+static gboolean
+stat_cache_can_fill (GVfsBackendSftp *backend,
+                     guint generation)
+{
+  return backend->stat_cache_ttl > 0 &&
+    backend->stat_cache_changes == 0 &&
+    generation == backend->stat_cache_generation;
+}
+
+/* Returns a new empty entry for path, replacing any old one */
+static StatCacheEntry *
+stat_cache_insert (GVfsBackendSftp *backend,
+                   const char *path)
+{
+  StatCacheEntry *entry;
+
+  entry = g_hash_table_lookup (backend->stat_cache, path);
+  if (entry != NULL)
+    stat_cache_remove (backend, entry);
+  else if (g_queue_get_length (&backend->stat_cache_lru) >= STAT_CACHE_MAX_ENTRIES)
+    stat_cache_remove (backend, g_queue_peek_tail (&backend->stat_cache_lru));
+
+  entry = g_slice_new0 (StatCacheEntry);
+  entry->path = g_strdup (path);
+  entry->link.data = entry;
+  entry->stamp = g_get_monotonic_time ();
+
+  g_hash_table_insert (backend->stat_cache, entry->path, entry);
+  g_queue_push_head_link (&backend->stat_cache_lru, &entry->link);
+
+  return entry;
+}
+
+/* Drops path, its parent directory and everything below it */
+static void
+stat_cache_invalidate (GVfsBackendSftp *backend,
+                       const char *path)
+{
+  GList *l, *next;
+  char *parent;
+  gsize len;
+
+  backend->stat_cache_generation++;
+
+  parent = g_path_get_dirname (path);
+  len = strlen (path);
+
+  for (l = backend->stat_cache_lru.head; l != NULL; l = next)
+    {
+      StatCacheEntry *entry = l->data;
+
+      next = l->next;
+
+      if (strcmp (entry->path, parent) == 0 ||
+          (strncmp (entry->path, path, len) == 0 &&
+           (entry->path[len] == 0 || entry->path[len] == '/' ||
+            path[len - 1] == '/')))
+        stat_cache_remove (backend, entry);
+    }
+
+  g_free (parent);
+}
+
+/* Drops only path, for changes to the contents of a file */
+static void
+stat_cache_invalidate_file (GVfsBackendSftp *backend,
+                            const char *path)
+{
+  StatCacheEntry *entry;
+
+  backend->stat_cache_generation++;
+
+  entry = g_hash_table_lookup (backend->stat_cache, path);
+  if (entry != NULL)
+    stat_cache_remove (backend, entry);
+}
+
+typedef struct {
+  GVfsBackendSftp *backend;
+  char *path;
+  char *other_path;
+  gboolean file_only;
+  gboolean done;
+} StatCacheChange;
+
+static void
+stat_cache_change_apply (StatCacheChange *change)
+{
+  if (change->file_only)
+    stat_cache_invalidate_file (change->backend, change->path);
+  else
+    stat_cache_invalidate (change->backend, change->path);
+
+  if (change->other_path)
+    stat_cache_invalidate (change->backend, change->other_path);
+}
+
+/* A job may send more than one reply, or none at all if it is dropped,
+ * so each change is only counted as done once */
+static void
+stat_cache_change_done (GVfsJob *job,
+                        StatCacheChange *change)
+{
+  if (!change->done)
+    {
+      change->done = TRUE;
+      change->backend->stat_cache_changes--;
+    }
+  stat_cache_change_apply (change);
+}
+
+static void
+stat_cache_change_free (gpointer data,
+                        GClosure *closure)
+{
+  StatCacheChange *change = data;
+
+  if (!change->done)
+    stat_cache_change_done (NULL, change);
+
+  g_free (change->path);
+  g_free (change->other_path);
+  g_slice_free (StatCacheChange, change);
+}
+
+/* Called before job sends the requests that change path (and
+ * other_path). They are dropped from the cache right away and again
+ * once the job replies, and nothing is cached in between. */
+static void
+stat_cache_track_change (GVfsBackendSftp *backend,
+                         GVfsJob *job,
+                         const char *path,
+                         const char *other_path,
+                         gboolean file_only)
+{
+  StatCacheChange *change;
+
+  if (backend->stat_cache_ttl == 0 || path == NULL)
+    return;
+
+  change = g_slice_new0 (StatCacheChange);
+  change->backend = backend;
+  change->path = g_strdup (path);
+  change->other_path = g_strdup (other_path);
+  change->file_only = file_only;
+
+  stat_cache_change_apply (change);
+  backend->stat_cache_changes++;
+
+  /* Runs before the reply goes out */
+  g_signal_connect_data (job, "send-reply",
+                         G_CALLBACK (stat_cache_change_done),
+                         change, stat_cache_change_free, 0);
+}
+
 static void
 g_vfs_backend_sftp_finalize (GObject *object)
 {
   GVfsBackendSftp *backend;
+  int i;
 
   backend = G_VFS_BACKEND_SFTP (object);
   destroy_connection (&backend->command_connection);
-  destroy_connection (&backend->data_connection);
+  for (i = 0; i < backend->n_data_connections; i++)
+    destroy_connection (&backend->data_connections[i]);
+
+  g_debug ("stat cache: %" G_GUINT64_FORMAT " hits, %" G_GUINT64_FORMAT " misses\n",
+           backend->stat_cache_hits, backend->stat_cache_misses);
+  /* The queue links are part of the entries */
+  g_hash_table_destroy (backend->stat_cache);
 
   if (G_OBJECT_CLASS (g_vfs_backend_sftp_parent_class)->finalize)
     (*G_OBJECT_CLASS (g_vfs_backend_sftp_parent_class)->finalize) (object);
@@ -325,6 +637,51 @@ expected_reply_free (ExpectedReply *reply)
 static void
 g_vfs_backend_sftp_init (GVfsBackendSftp *backend)
 {
+  backend->max_read_size = MAX_BUFFER_SIZE;
+  backend->max_write_size = MAX_BUFFER_SIZE;
+
+  backend->stat_cache = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                                               (GDestroyNotify)stat_cache_entry_free);
+  g_queue_init (&backend->stat_cache_lru);
+  backend->stat_cache_ttl = get_stat_cache_ttl ();
+
+  g_vfs_backend_set_shared_read_memory (G_VFS_BACKEND (backend), TRUE);
+}
+
+static void
+transfer_window_init (TransferWindow *window)
+{
+  window->start_time = g_get_monotonic_time ();
+  window->min_rtt = G_MAXINT64;
+  window->n_bytes = 0;
+  window->max_requests = WINDOW_MIN_REQUESTS;
+}
+
+/* Called for every completed request. The bandwidth-delay product is
+ * estimated from the throughput so far and the smallest round trip time
+ * seen. While the link isn't saturated the requests come back after
+ * about the smallest round trip time and the window can double, once it
+ * is the throughput stops growing and so does the window. */
+static void
+transfer_window_update (TransferWindow *window,
+                        gint64 sent_time,
+                        gsize n_bytes,
+                        gsize request_size)
+{
+  gint64 now = g_get_monotonic_time ();
+  gint64 elapsed;
+  gdouble bdp;
+
+  window->min_rtt = MIN (window->min_rtt, MAX (now - sent_time, 1));
+  window->n_bytes += n_bytes;
+
+  elapsed = now - window->start_time;
+  if (elapsed <= 0)
+    return;
+
+  bdp = (gdouble) window->n_bytes / elapsed * window->min_rtt;
+  window->max_requests = CLAMP (2 * bdp / request_size + 1,
+                                WINDOW_MIN_REQUESTS, WINDOW_MAX_REQUESTS);
 }
 
 static void
@@ -495,8 +852,16 @@ setup_ssh_commandline (GVfsBackend *backend, const gchar *control_path)
 #ifndef USE_PTY
       args[last_arg++] = g_strdup ("-oBatchMode yes");
 #endif
-      args[last_arg++] = g_strdup ("-oControlMaster auto");
-      args[last_arg++] = g_strdup_printf ("-oControlPath=%s/%%C", control_path);
+      if (control_path != NULL)
+        {
+          args[last_arg++] = g_strdup ("-oControlMaster auto");
+          args[last_arg++] = g_strdup_printf ("-oControlPath=%s/%%C", control_path);
+        }
+      else
+        {
+          args[last_arg++] = g_strdup ("-oControlMaster no");
+          args[last_arg++] = g_strdup ("-oControlPath none");
+        }
     }
   else if (op_backend->client_vendor == SFTP_VENDOR_SSH)
     args[last_arg++] = g_strdup ("-x");
@@ -1416,6 +1781,13 @@ handle_login (GVfsBackend *backend,
       op_backend->tmp_password = new_password;
       new_password = NULL;
     }
+  else if (ret_val && new_password)
+    {
+      /* Hand it on to the next data connection */
+      gvfs_free_password (op_backend->tmp_password);
+      op_backend->tmp_password = new_password;
+      new_password = NULL;
+    }
 
   g_debug ("handle_login #%d - ret_val: %d\n", i, ret_val);
 
@@ -1446,13 +1818,16 @@ fail_jobs (Connection *conn, GError *error)
 static void
 fail_jobs_and_unmount (GVfsBackendSftp *backend, GError *error)
 {
+  int i;
+
   if (backend->force_unmounted)
     return;
 
   backend->force_unmounted = TRUE;
 
   fail_jobs (&backend->command_connection, error);
-  fail_jobs (&backend->data_connection, error);
+  for (i = 0; i < backend->n_data_connections; i++)
+    fail_jobs (&backend->data_connections[i], error);
 
   g_error_free (error);
 
@@ -1855,6 +2230,62 @@ get_uid_sync (GVfsBackendSftp *backend)
   return TRUE;
 }
 
+/* Reads and writes stay at MAX_BUFFER_SIZE if this fails */
+static void
+get_limits_sync (GVfsBackendSftp *backend)
+{
+  GDataOutputStream *command;
+  GDataInputStream *reply;
+  guint64 max_packet, max_read, max_write;
+  int type;
+
+  command = new_command_stream (backend, SSH_FXP_EXTENDED);
+  put_string (command, "limits@openssh.com");
+  send_command_sync_and_unref_command (&backend->command_connection,
+                                       command,
+                                       NULL, NULL);
+
+  reply = read_reply_sync (&backend->command_connection, NULL, NULL);
+  if (reply == NULL)
+    return;
+
+  type = g_data_input_stream_read_byte (reply, NULL, NULL);
+  /*id =*/ (void) g_data_input_stream_read_uint32 (reply, NULL, NULL);
+
+  if (type == SSH_FXP_EXTENDED_REPLY)
+    {
+      max_packet = g_data_input_stream_read_uint64 (reply, NULL, NULL);
+      max_read = g_data_input_stream_read_uint64 (reply, NULL, NULL);
+      max_write = g_data_input_stream_read_uint64 (reply, NULL, NULL);
+      /* max-open-handles isn't used */
+
+      /* 0 means no limit. Replies are capped on our side as well. */
+      if (max_packet == 0 || max_packet > MAX_REPLY_SIZE)
+        max_packet = MAX_REPLY_SIZE;
+      if (max_packet <= PACKET_OVERHEAD)
+        {
+          g_debug ("sftp: ignoring bogus max packet size %" G_GUINT64_FORMAT "\n", max_packet);
+          g_object_unref (reply);
+          return;
+        }
+
+      /* The advertised sizes are what the server handles, even if they are
+       * below what we used to send. Unknown sizes keep the default. */
+      if (max_read == 0)
+        max_read = MAX_BUFFER_SIZE;
+      if (max_write == 0)
+        max_write = MAX_BUFFER_SIZE;
+
+      backend->max_read_size = MIN (max_read, max_packet - PACKET_OVERHEAD);
+      backend->max_write_size = MIN (max_write, max_packet - PACKET_OVERHEAD);
+
+      g_debug ("sftp: max read size %u, max write size %u\n",
+               backend->max_read_size, backend->max_write_size);
+    }
+
+  g_object_unref (reply);
+}
+
 static gboolean
 get_home_sync (GVfsBackendSftp *backend)
 {
@@ -1906,6 +2337,7 @@ setup_connection (GVfsBackend *backend,
                   gboolean is_automount,
                   Connection *connection,
                   gboolean initial_connection,
+                  gboolean multiplex,
                   GError **error)
 {
   const struct {
@@ -1914,6 +2346,8 @@ setup_connection (GVfsBackend *backend,
     SFTPServerExtensions enable;    /* flag to enable this extension */
   } extensions[] = {
     { "statvfs@openssh.com", "2", SFTP_EXT_OPENSSH_STATVFS },
+    { "copy-data", "1", SFTP_EXT_OPENSSH_COPY_DATA },
+    { "limits@openssh.com", "1", SFTP_EXT_OPENSSH_LIMITS },
   };
 
   GVfsBackendSftp *op_backend = G_VFS_BACKEND_SFTP (backend);
@@ -1928,8 +2362,11 @@ setup_connection (GVfsBackend *backend,
   int i;
   gchar *control_path = NULL;
 
-  control_path = g_build_filename (g_get_user_runtime_dir (), "gvfsd-sftp", NULL);
-  g_mkdir (control_path, 0700);
+  if (multiplex)
+    {
+      control_path = g_build_filename (g_get_user_runtime_dir (), "gvfsd-sftp", NULL);
+      g_mkdir (control_path, 0700);
+    }
 
   args = setup_ssh_commandline (backend, control_path);
   g_free (control_path);
@@ -2029,12 +2466,31 @@ setup_connection (GVfsBackend *backend,
       return FALSE;
     }
 
+  if (initial_connection &&
+      has_extension (op_backend, SFTP_EXT_OPENSSH_LIMITS))
+    get_limits_sync (op_backend);
+
   g_object_ref (op_backend);
   read_reply_async (connection);
 
   return TRUE;
 }
 
+static int
+get_n_data_connections (void)
+{
+  const char *str;
+  gint64 n;
+
+  str = g_getenv ("GVFS_SFTP_DATA_CONNECTIONS");
+  if (str == NULL)
+    return DEFAULT_DATA_CONNECTIONS;
+
+  n = g_ascii_strtoll (str, NULL, 10);
+
+  return CLAMP (n, 1, MAX_DATA_CONNECTIONS);
+}
+
 static void
 do_mount (GVfsBackend *backend,
           GVfsJobMount *job,
@@ -2046,6 +2502,7 @@ do_mount (GVfsBackend *backend,
   GError *error = NULL;
   GMountSpec *sftp_mount_spec;
   char *display_name;
+  int i;
 
   if (!setup_connection (backend,
                          job,
@@ -2054,6 +2511,7 @@ do_mount (GVfsBackend *backend,
                          is_automount,
                          &op_backend->command_connection,
                          TRUE,
+                         TRUE,
                          &error))
     {
       if (error)
@@ -2066,17 +2524,22 @@ do_mount (GVfsBackend *backend,
       return;
     }
 
-  if (!setup_connection (backend,
-                         job,
-                         mount_spec,
-                         mount_source,
-                         is_automount,
-                         &op_backend->data_connection,
-                         FALSE,
-                         NULL))
+  op_backend->n_data_connections = get_n_data_connections ();
+  for (i = 0; i < op_backend->n_data_connections; i++)
     {
-      g_warning ("Setting up data connection failed\n");
-      destroy_connection (&op_backend->data_connection);
+      if (!setup_connection (backend,
+                             job,
+                             mount_spec,
+                             mount_source,
+                             is_automount,
+                             &op_backend->data_connections[i],
+                             FALSE,
+                             i == 0,
+                             NULL))
+        {
+          g_warning ("Setting up data connection %d failed\n", i);
+          destroy_connection (&op_backend->data_connections[i]);
+        }
     }
 
   g_clear_pointer (&op_backend->tmp_password, gvfs_free_password);
@@ -2184,13 +2647,18 @@ try_unmount (GVfsBackend *backend,
              GMountSource *mount_source)
 {
   GVfsBackendSftp *op_backend = G_VFS_BACKEND_SFTP (backend);
+  int i;
 
   if (op_backend->command_connection.reply_stream &&
       op_backend->command_connection.reply_stream_cancellable)
     g_cancellable_cancel (op_backend->command_connection.reply_stream_cancellable);
-  if (op_backend->data_connection.reply_stream &&
-      op_backend->data_connection.reply_stream_cancellable)
-    g_cancellable_cancel (op_backend->data_connection.reply_stream_cancellable);
+  for (i = 0; i < op_backend->n_data_connections; i++)
+    {
+      Connection *conn = &op_backend->data_connections[i];
+
+      if (conn->reply_stream && conn->reply_stream_cancellable)
+        g_cancellable_cancel (conn->reply_stream_cancellable);
+    }
   g_vfs_job_succeeded (G_VFS_JOB (job));
 
   return TRUE;
@@ -2708,6 +3176,107 @@ parse_attributes (GVfsBackendSftp *backend,
     }
 }
 
+static gboolean
+copy_attributes_data (GDataInputStream *reply,
+                      GByteArray *array,
+                      gsize size)
+{
+  gsize offset = array->len;
+  gsize bytes_read;
+
+  g_byte_array_set_size (array, offset + size);
+
+  return g_input_stream_read_all (G_INPUT_STREAM (reply),
+                                  array->data + offset, size,
+                                  &bytes_read, NULL, NULL) &&
+    bytes_read == size;
+}
+
+static gboolean
+copy_attributes_uint32 (GDataInputStream *reply,
+                        GByteArray *array,
+                        guint32 *value)
+{
+  guint32 be_value;
+
+  if (!copy_attributes_data (reply, array, 4))
+    return FALSE;
+
+  memcpy (&be_value, array->data + array->len - 4, 4);
+  *value = GUINT32_FROM_BE (be_value);
+
+  return TRUE;
+}
+
+/* Reads an ATTRS structure without parsing it, for
+ * parse_attributes_bytes(). Returns NULL if the reply is truncated. */
+static GBytes *
+read_attributes_bytes (GDataInputStream *reply)
+{
+  GByteArray *array;
+  guint32 flags, count, len, i, j;
+  gsize size;
+
+  array = g_byte_array_new ();
+
+  if (!copy_attributes_uint32 (reply, array, &flags))
+    goto out;
+
+  size = 0;
+  if (flags & SSH_FILEXFER_ATTR_SIZE)
+    size += 8;
+  if (flags & SSH_FILEXFER_ATTR_UIDGID)
+    size += 8;
+  if (flags & SSH_FILEXFER_ATTR_PERMISSIONS)
+    size += 4;
+  if (flags & SSH_FILEXFER_ATTR_ACMODTIME)
+    size += 8;
+
+  if (!copy_attributes_data (reply, array, size))
+    goto out;
+
+  if (flags & SSH_FILEXFER_ATTR_EXTENDED)
+    {
+      if (!copy_attributes_uint32 (reply, array, &count))
+        goto out;
+
+      /* Name and value of each extended attribute */
+      for (i = 0; i < count; i++)
+        for (j = 0; j < 2; j++)
+          {
+            if (!copy_attributes_uint32 (reply, array, &len) ||
+                len > MAX_REPLY_SIZE ||
+                !copy_attributes_data (reply, array, len))
+              goto out;
+          }
+    }
+
+  return g_byte_array_free_to_bytes (array);
+
+ out:
+  g_byte_array_unref (array);
+  return NULL;
+}
+
+static void
+parse_attributes_bytes (GVfsBackendSftp *backend,
+                        GFileInfo *info,
+                        const char *basename,
+                        GBytes *attrs,
+                        GFileAttributeMatcher *matcher)
+{
+  GInputStream *mem_stream;
+  GDataInputStream *data_stream;
+
+  mem_stream = g_memory_input_stream_new_from_bytes (attrs);
+  data_stream = g_data_input_stream_new (mem_stream);
+  g_object_unref (mem_stream);
+
+  parse_attributes (backend, info, basename, data_stream, matcher);
+
+  g_object_unref (data_stream);
+}
+
 static SftpHandle *
 sftp_handle_new (GDataInputStream *reply)
 {
@@ -2930,7 +3499,9 @@ try_read (GVfsBackend *backend,
                                 SSH_FXP_READ);
   put_data_buffer (command, handle->raw_handle);
   g_data_output_stream_put_uint64 (command, handle->offset, NULL, NULL);
-  g_data_output_stream_put_uint32 (command, bytes_requested, NULL, NULL);
+  g_data_output_stream_put_uint32 (command,
+                                   MIN (bytes_requested, op_backend->max_read_size),
+                                   NULL, NULL);
   
   queue_command_stream_and_free (&op_backend->command_connection, command,
                                  read_reply,
@@ -3332,6 +3903,8 @@ try_close_write (GVfsBackend *backend,
   GVfsBackendSftp *op_backend = G_VFS_BACKEND_SFTP (backend);
   GDataOutputStream *command;
 
+  stat_cache_track_change (op_backend, G_VFS_JOB (job), handle->filename, NULL, FALSE);
+
   command = new_command_stream (op_backend, SSH_FXP_FSTAT);
   put_data_buffer (command, handle->raw_handle);
 
@@ -3524,6 +4097,7 @@ open_for_write_reply (GVfsBackendSftp *backend,
     }
 
   handle = sftp_handle_new (reply);
+  handle->filename = g_strdup (op_job->filename);
   
   g_vfs_job_open_for_write_set_handle (G_VFS_JOB_OPEN_FOR_WRITE (job), handle);
   g_vfs_job_open_for_write_set_can_seek (G_VFS_JOB_OPEN_FOR_WRITE (job), TRUE);
@@ -3541,6 +4115,8 @@ open_for_write (GVfsBackend *backend,
   GVfsBackendSftp *op_backend = G_VFS_BACKEND_SFTP (backend);
   GDataOutputStream *command;
 
+  stat_cache_track_change (op_backend, G_VFS_JOB (job), filename, NULL, FALSE);
+
   command = new_command_stream (op_backend,
                                 SSH_FXP_OPEN);
   put_string (command, filename);
@@ -4100,6 +4676,7 @@ replace_exclusive_reply (GVfsBackendSftp *backend,
     }
   
   handle = sftp_handle_new (reply);
+  handle->filename = g_strdup (op_job->filename);
   
   g_vfs_job_open_for_write_set_handle (op_job, handle);
   g_vfs_job_open_for_write_set_can_seek (op_job, TRUE);
@@ -4119,6 +4696,8 @@ try_replace (GVfsBackend *backend,
   GVfsBackendSftp *op_backend = G_VFS_BACKEND_SFTP (backend);
   GDataOutputStream *command;
 
+  stat_cache_track_change (op_backend, G_VFS_JOB (job), filename, NULL, FALSE);
+
   command = new_command_stream (op_backend,
                                 SSH_FXP_OPEN);
   put_string (command, filename);
@@ -4168,7 +4747,9 @@ try_write (GVfsBackend *backend,
   GDataOutputStream *command;
   gsize size;
 
-  size = MIN (buffer_size, MAX_BUFFER_SIZE);
+  size = MIN (buffer_size, op_backend->max_write_size);
+
+  stat_cache_track_change (op_backend, G_VFS_JOB (job), handle->filename, NULL, TRUE);
 
   command = new_command_stream (op_backend,
                                 SSH_FXP_WRITE);
@@ -4299,6 +4880,8 @@ try_truncate (GVfsBackend *backend,
   GVfsBackendSftp *op_backend = G_VFS_BACKEND_SFTP (backend);
   GDataOutputStream *command;
 
+  stat_cache_track_change (op_backend, G_VFS_JOB (job), handle->filename, NULL, TRUE);
+
   command = new_command_stream (op_backend, SSH_FXP_FSETSTAT);
   put_data_buffer (command, handle->raw_handle);
   g_data_output_stream_put_uint32 (command, SSH_FILEXFER_ATTR_SIZE, NULL, NULL);
@@ -4310,9 +4893,15 @@ try_truncate (GVfsBackend *backend,
   return TRUE;
 }
 
+/* Number of READDIR requests kept in flight on a directory handle */
+#define READDIR_PIPELINE 4
+
 typedef struct {
   DataBuffer *handle;
   int outstanding_requests;
+  int outstanding_readdirs;
+  gboolean eof;
+  guint stat_cache_generation;
 } ReadDirData;
 
 static
@@ -4324,106 +4913,175 @@ read_dir_data_free (ReadDirData *data)
 }
 
 static void
-read_dir_readlink_reply (GVfsBackendSftp *backend,
-                         int reply_type,
-                         GDataInputStream *reply,
-                         guint32 len,
-                         GVfsJob *job,
-                         gpointer user_data)
+read_dir_request_done (GVfsJob *job)
 {
-  ReadDirData *data;
-  GFileInfo *info = user_data;
-  char *target;
-
-  data = job->backend_data;
-
-  if (reply_type == SSH_FXP_NAME)
-    {
-      /* count = */ (void) g_data_input_stream_read_uint32 (reply, NULL, NULL);
-      
-      target = read_string (reply, NULL);
-      if (target)
-        {
-          g_file_info_set_symlink_target (info, target);
-          g_free (target);
-        }
-    }
+  ReadDirData *data = job->backend_data;
 
-  g_vfs_job_enumerate_add_info (G_VFS_JOB_ENUMERATE (job), info);
-  g_object_unref (info);
-  
   if (--data->outstanding_requests == 0)
     g_vfs_job_enumerate_done (G_VFS_JOB_ENUMERATE (job));
 }
 
 static void
-read_dir_got_stat_info (GVfsBackendSftp *backend,
-                        GVfsJob *job,
-                        GFileInfo *info)
+read_dir_set_symlink_target (GFileInfo *info,
+                             MultiReply *reply)
 {
-  GVfsJobEnumerate *enum_job;
-  GDataOutputStream *command;
-  ReadDirData *data;
-  char *abs_name;
-  
-  data = job->backend_data;
-  
-  enum_job = G_VFS_JOB_ENUMERATE (job);
+  char *target;
 
-  if (g_file_attribute_matcher_matches (enum_job->attribute_matcher,
-                                        G_FILE_ATTRIBUTE_STANDARD_SYMLINK_TARGET))
+  if (reply->type != SSH_FXP_NAME)
+    return;
+
+  /* count = */ (void) g_data_input_stream_read_uint32 (reply->data, NULL, NULL);
+
+  target = read_string (reply->data, NULL);
+  if (target)
     {
-      data->outstanding_requests++;
-      command = new_command_stream (backend,
-                                    SSH_FXP_READLINK);
-      abs_name = g_build_filename (enum_job->filename, g_file_info_get_name (info), NULL);
-      put_string (command, abs_name);
-      g_free (abs_name);
-      queue_command_stream_and_free (&backend->command_connection, command,
-                                     read_dir_readlink_reply,
-                                     G_VFS_JOB (job), g_object_ref (info));
+      g_file_info_set_symlink_target (info, target);
+      g_free (target);
     }
-  else
-    g_vfs_job_enumerate_add_info (enum_job, info);
 }
 
-
+/* Replies to the STAT and/or READLINK sent together for a symlink. The
+ * first reply is the STAT if the link is followed. */
 static void
 read_dir_symlink_reply (GVfsBackendSftp *backend,
-                        int reply_type,
-                        GDataInputStream *reply,
-                        guint32 len,
+                        MultiReply *replies,
+                        int n_replies,
                         GVfsJob *job,
                         gpointer user_data)
 {
-  const char *name;
+  GVfsJobEnumerate *enum_job = G_VFS_JOB_ENUMERATE (job);
+  GFileInfo *lstat_info = user_data;
   GFileInfo *info;
-  GFileInfo *lstat_info;
-  ReadDirData *data;
+  const char *name;
+  gboolean follow;
 
-  lstat_info = user_data;
   name = g_file_info_get_name (lstat_info);
-  data = job->backend_data;
-  
-  if (reply_type == SSH_FXP_ATTRS)
+  follow = !(enum_job->flags & G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS);
+
+  if (follow && replies[0].type == SSH_FXP_ATTRS)
     {
       info = g_file_info_new ();
       g_file_info_set_name (info, name);
       g_file_info_set_is_symlink (info, TRUE);
-      
-      parse_attributes (backend, info, name, reply, G_VFS_JOB_ENUMERATE (job)->attribute_matcher);
 
-      read_dir_got_stat_info (backend, job, info);
-      
-      g_object_unref (info);
+      parse_attributes (backend, info, name, replies[0].data, enum_job->attribute_matcher);
     }
   else
-    read_dir_got_stat_info (backend, job, lstat_info);
+    info = g_object_ref (lstat_info);
 
+  if (n_replies > (follow ? 1 : 0))
+    read_dir_set_symlink_target (info, &replies[n_replies - 1]);
+
+  g_vfs_job_enumerate_add_info (enum_job, info);
+
+  g_object_unref (info);
   g_object_unref (lstat_info);
-  
-  if (--data->outstanding_requests == 0)
-    g_vfs_job_enumerate_done (G_VFS_JOB_ENUMERATE (job));
+
+  read_dir_request_done (job);
+}
+
+/* Follows the symlink and reads its target at the same time instead of
+ * one after the other, all the links of a READDIR batch are resolved in
+ * parallel */
+static void
+read_dir_resolve_symlink (GVfsBackendSftp *backend,
+                          GVfsJob *job,
+                          GFileInfo *info)
+{
+  GVfsJobEnumerate *enum_job = G_VFS_JOB_ENUMERATE (job);
+  ReadDirData *data = job->backend_data;
+  Command commands[2];
+  char *abs_name;
+  int n_commands = 0;
+
+  abs_name = g_build_filename (enum_job->filename, g_file_info_get_name (info), NULL);
+
+  if (!(enum_job->flags & G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS))
+    {
+      /* Default (at least for openssh) is for readdir to not follow symlinks.
+         This was a symlink, and follow links was requested, so we need to manually follow it */
+      commands[n_commands].connection = &backend->command_connection;
+      commands[n_commands].cmd = new_command_stream (backend, SSH_FXP_STAT);
+      put_string (commands[n_commands].cmd, abs_name);
+      n_commands++;
+    }
+
+  if (g_file_attribute_matcher_matches (enum_job->attribute_matcher,
+                                        G_FILE_ATTRIBUTE_STANDARD_SYMLINK_TARGET))
+    {
+      commands[n_commands].connection = &backend->command_connection;
+      commands[n_commands].cmd = new_command_stream (backend, SSH_FXP_READLINK);
+      put_string (commands[n_commands].cmd, abs_name);
+      n_commands++;
+    }
+
+  g_free (abs_name);
+
+  if (n_commands == 0)
+    {
+      g_vfs_job_enumerate_add_info (enum_job, info);
+      return;
+    }
+
+  data->outstanding_requests++;
+  queue_command_streams_and_free (commands, n_commands,
+                                  read_dir_symlink_reply,
+                                  job, g_object_ref (info));
+}
+
+/* Only the lstat data is known for symlinks */
+static void
+read_dir_cache_attributes (GVfsBackendSftp *backend,
+                           GVfsJob *job,
+                           const char *name,
+                           GBytes *attrs,
+                           GFileType type)
+{
+  ReadDirData *data = job->backend_data;
+  StatCacheEntry *entry;
+  char *path;
+
+  if (!stat_cache_can_fill (backend, data->stat_cache_generation))
+    return;
+
+  path = g_build_filename (G_VFS_JOB_ENUMERATE (job)->filename, name, NULL);
+  entry = stat_cache_insert (backend, path);
+  g_free (path);
+
+  entry->exists = TRUE;
+  entry->lstat_attrs = g_bytes_ref (attrs);
+
+  if (type != G_FILE_TYPE_SYMBOLIC_LINK && type != G_FILE_TYPE_UNKNOWN)
+    {
+      entry->stat_attrs = g_bytes_ref (attrs);
+      entry->stat_known = TRUE;
+      entry->symlink_target_known = TRUE;
+    }
+}
+
+static void read_dir_reply (GVfsBackendSftp *backend,
+                            int reply_type,
+                            GDataInputStream *reply,
+                            guint32 len,
+                            GVfsJob *job,
+                            gpointer user_data);
+
+static void
+read_dir_send_readdir (GVfsBackendSftp *backend,
+                       GVfsJob *job)
+{
+  ReadDirData *data = job->backend_data;
+  GDataOutputStream *command;
+
+  command = new_command_stream (backend,
+                                SSH_FXP_READDIR);
+  put_data_buffer (command, data->handle);
+  queue_command_stream_and_free (&backend->command_connection, command,
+                                 read_dir_reply,
+                                 job, NULL);
+
+  data->outstanding_requests++;
+  data->outstanding_readdirs++;
 }
 
 static void
@@ -4443,73 +5101,75 @@ read_dir_reply (GVfsBackendSftp *backend,
   data = job->backend_data;
   enum_job = G_VFS_JOB_ENUMERATE (job);
 
+  data->outstanding_readdirs--;
+
   if (reply_type != SSH_FXP_NAME)
     {
       /* Ignore all error, including the expected END OF FILE.
        * Real errors are expected in open_dir anyway */
+      data->eof = TRUE;
+    }
+  else
+    {
+      count = g_data_input_stream_read_uint32 (reply, NULL, NULL);
+      for (i = 0; i < count; i++)
+        {
+          GFileInfo *info;
+          GBytes *attrs;
+          char *name;
+          char *longname;
+
+          name = read_string (reply, NULL);
+          longname = read_string (reply, NULL);
+          g_free (longname);
 
-      /* Close handle */
+          attrs = read_attributes_bytes (reply);
+          if (name == NULL || attrs == NULL)
+            {
+              g_free (name);
+              break;
+            }
+
+          info = g_file_info_new ();
+          g_file_info_set_name (info, name);
+          parse_attributes_bytes (backend, info, name, attrs, enum_job->attribute_matcher);
+
+          if (strcmp (".", name) == 0 ||
+              strcmp ("..", name) == 0)
+            ;
+          else
+            {
+              read_dir_cache_attributes (backend, job, name, attrs,
+                                         g_file_info_get_file_type (info));
+
+              if (g_file_info_get_file_type (info) == G_FILE_TYPE_SYMBOLIC_LINK)
+                read_dir_resolve_symlink (backend, job, info);
+              else
+                g_vfs_job_enumerate_add_info (enum_job, info);
+            }
+
+          g_object_unref (info);
+          g_bytes_unref (attrs);
+          g_free (name);
+        }
+
+      /* Replaces the request that just came back */
+      if (!data->eof)
+        read_dir_send_readdir (backend, job);
+    }
 
+  /* Close handle once the last READDIR is back */
+  if (data->eof && data->outstanding_readdirs == 0)
+    {
       command = new_command_stream (backend,
                                     SSH_FXP_CLOSE);
       put_data_buffer (command, data->handle);
       queue_command_stream_and_free (&backend->command_connection, command,
                                      NULL,
                                      G_VFS_JOB (job), NULL);
-  
-      if (--data->outstanding_requests == 0)
-        g_vfs_job_enumerate_done (enum_job);
-      
-      return;
-    }
-
-  count = g_data_input_stream_read_uint32 (reply, NULL, NULL);
-  for (i = 0; i < count; i++)
-    {
-      GFileInfo *info;
-      char *name;
-      char *longname;
-      char *abs_name;
-
-      info = g_file_info_new ();
-      name = read_string (reply, NULL);
-      g_file_info_set_name (info, name);
-      
-      longname = read_string (reply, NULL);
-      g_free (longname);
-      
-      parse_attributes (backend, info, name, reply, enum_job->attribute_matcher);
-      
-      if (g_file_info_get_file_type (info) == G_FILE_TYPE_SYMBOLIC_LINK &&
-          ! (enum_job->flags & G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS))
-        {
-          /* Default (at least for openssh) is for readdir to not follow symlinks.
-             This was a symlink, and follow links was requested, so we need to manually follow it */
-          command = new_command_stream (backend,
-                                        SSH_FXP_STAT);
-          abs_name = g_build_filename (enum_job->filename, name, NULL);
-          put_string (command, abs_name);
-          g_free (abs_name);
-          
-          queue_command_stream_and_free (&backend->command_connection, command,
-                                         read_dir_symlink_reply,
-                                         G_VFS_JOB (job), g_object_ref (info));
-          data->outstanding_requests ++;
-        }
-      else if (strcmp (".", name) != 0 &&
-               strcmp ("..", name) != 0)
-        read_dir_got_stat_info (backend, job, info);
-        
-      g_object_unref (info);
-      g_free (name);
     }
 
-  command = new_command_stream (backend,
-                                SSH_FXP_READDIR);
-  put_data_buffer (command, data->handle);
-  queue_command_stream_and_free (&backend->command_connection, command,
-                                 read_dir_reply,
-                                 G_VFS_JOB (job), NULL);
+  read_dir_request_done (job);
 }
 
 static void
@@ -4544,8 +5204,8 @@ open_dir_reply (GVfsBackendSftp *backend,
                 gpointer user_data)
 {
   GVfsBackendSftp *op_backend = G_VFS_BACKEND_SFTP (backend);
-  GDataOutputStream *command;
   ReadDirData *data;
+  int i;
 
   data = job->backend_data;
   
@@ -4568,16 +5228,9 @@ open_dir_reply (GVfsBackendSftp *backend,
   g_vfs_job_succeeded (G_VFS_JOB (job));
   
   data->handle = read_data_buffer (reply);
-  
-  command = new_command_stream (op_backend,
-                                SSH_FXP_READDIR);
-  put_data_buffer (command, data->handle);
 
-  data->outstanding_requests = 1;
-  
-  queue_command_stream_and_free (&op_backend->command_connection, command,
-                                 read_dir_reply,
-                                 G_VFS_JOB (job), NULL);
+  for (i = 0; i < READDIR_PIPELINE; i++)
+    read_dir_send_readdir (op_backend, job);
 }
 
 static gboolean
@@ -4592,6 +5245,7 @@ try_enumerate (GVfsBackend *backend,
   ReadDirData *data;
 
   data = g_slice_new0 (ReadDirData);
+  data->stat_cache_generation = op_backend->stat_cache_generation;
 
   g_vfs_job_set_backend_data (G_VFS_JOB (job), data, (GDestroyNotify)read_dir_data_free);
   command = new_command_stream (op_backend,
@@ -4605,6 +5259,52 @@ try_enumerate (GVfsBackend *backend,
   return TRUE;
 }
 
+static void
+query_info_from_attributes (GVfsBackendSftp *backend,
+                            GVfsJobQueryInfo *op_job,
+                            GBytes *lstat_attrs,
+                            GBytes *stat_attrs,
+                            const char *symlink_target)
+{
+  char *basename;
+  GFileInfo *lstat_info;
+
+  basename = NULL;
+  if (strcmp (op_job->filename, "/") != 0)
+    basename = g_path_get_basename (op_job->filename);
+
+  if (op_job->flags & G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS)
+    {
+      parse_attributes_bytes (backend, op_job->file_info, basename,
+                              lstat_attrs, op_job->attribute_matcher);
+    }
+  else if (stat_attrs != NULL)
+    {
+      parse_attributes_bytes (backend, op_job->file_info, basename,
+                              stat_attrs, op_job->attribute_matcher);
+
+      lstat_info = g_file_info_new ();
+      parse_attributes_bytes (backend, lstat_info, basename,
+                              lstat_attrs, op_job->attribute_matcher);
+      if (g_file_info_get_is_symlink (lstat_info))
+        g_file_info_set_is_symlink (op_job->file_info, TRUE);
+      g_object_unref (lstat_info);
+    }
+  else
+    {
+      /* Broken symlink, use lstat data */
+      parse_attributes_bytes (backend, op_job->file_info, basename,
+                              lstat_attrs, op_job->attribute_matcher);
+    }
+
+  g_free (basename);
+
+  if (symlink_target != NULL &&
+      g_file_attribute_matcher_matches (op_job->attribute_matcher,
+                                        G_FILE_ATTRIBUTE_STANDARD_SYMLINK_TARGET))
+    g_file_info_set_symlink_target (op_job->file_info, symlink_target);
+}
+
 static void
 query_info_reply (GVfsBackendSftp *backend,
                   MultiReply *replies,
@@ -4612,11 +5312,15 @@ query_info_reply (GVfsBackendSftp *backend,
                   GVfsJob *job,
                   gpointer user_data)
 {
-  char *basename;
+  guint generation = GPOINTER_TO_UINT (user_data);
   int i;
   MultiReply *lstat_reply, *reply;
-  GFileInfo *lstat_info;
+  GBytes *lstat_attrs, *stat_attrs;
+  char *symlink_target;
+  gboolean want_symlink_target;
   GVfsJobQueryInfo *op_job;
+  StatCacheEntry *entry;
+  guint32 code;
 
   op_job = G_VFS_JOB_QUERY_INFO (job);
   
@@ -4625,7 +5329,16 @@ query_info_reply (GVfsBackendSftp *backend,
 
   if (lstat_reply->type == SSH_FXP_STATUS)
     {
-      result_from_status (job, lstat_reply->data, -1, -1);
+      code = read_status_code (lstat_reply->data);
+
+      if (code == SSH_FX_NO_SUCH_FILE &&
+          stat_cache_can_fill (backend, generation))
+        {
+          entry = stat_cache_insert (backend, op_job->filename);
+          entry->exists = FALSE;
+        }
+
+      result_from_status_code (job, code, -1, -1);
       return;
     }
   else if (lstat_reply->type != SSH_FXP_ATTRS)
@@ -4636,63 +5349,102 @@ query_info_reply (GVfsBackendSftp *backend,
       return;
     }
 
-  basename = NULL;
-  if (strcmp (op_job->filename, "/") != 0)
-    basename = g_path_get_basename (op_job->filename);
-
-  if (op_job->flags & G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS)
+  lstat_attrs = read_attributes_bytes (lstat_reply->data);
+  if (lstat_attrs == NULL)
     {
-      parse_attributes (backend, op_job->file_info, basename,
-                        lstat_reply->data, op_job->attribute_matcher);
+      g_vfs_job_failed (job,
+                        G_IO_ERROR, G_IO_ERROR_FAILED,
+                        "%s", _("Invalid reply received"));
+      return;
     }
-  else
+
+  stat_attrs = NULL;
+  if (!(op_job->flags & G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS))
     {
-      /* Look at stat results */
+      /* Look at stat results, a broken symlink has none */
       reply = &replies[i++];
 
       if (reply->type == SSH_FXP_ATTRS)
-        {
-          parse_attributes (backend, op_job->file_info, basename,
-                            reply->data, op_job->attribute_matcher);
-
-          
-          lstat_info = g_file_info_new ();
-          parse_attributes (backend, lstat_info, basename,
-                            lstat_reply->data, op_job->attribute_matcher);
-          if (g_file_info_get_is_symlink (lstat_info))
-            g_file_info_set_is_symlink (op_job->file_info, TRUE);
-          g_object_unref (lstat_info);
-        }
-      else
-        {
-          /* Broken symlink, use lstat data */
-          parse_attributes (backend, op_job->file_info, basename,
-                            lstat_reply->data, op_job->attribute_matcher);
-        }
-      
+        stat_attrs = read_attributes_bytes (reply->data);
     }
-    
-  g_free (basename);
 
-  if (g_file_attribute_matcher_matches (op_job->attribute_matcher,
-                                        G_FILE_ATTRIBUTE_STANDARD_SYMLINK_TARGET))
+  symlink_target = NULL;
+  want_symlink_target =
+    g_file_attribute_matcher_matches (op_job->attribute_matcher,
+                                      G_FILE_ATTRIBUTE_STANDARD_SYMLINK_TARGET);
+  if (want_symlink_target)
     {
       /* Look at readlink results */
       reply = &replies[i++];
 
       if (reply->type == SSH_FXP_NAME)
         {
-          char *symlink_target;
-          
           /* Skip count (always 1 for replies to SSH_FXP_READLINK) */
           g_data_input_stream_read_uint32 (reply->data, NULL, NULL);
           symlink_target = read_string (reply->data, NULL);
-          g_file_info_set_symlink_target (op_job->file_info, symlink_target);
-          g_free (symlink_target);
         }
     }
 
+  query_info_from_attributes (backend, op_job,
+                              lstat_attrs, stat_attrs, symlink_target);
+
+  if (stat_cache_can_fill (backend, generation))
+    {
+      entry = stat_cache_insert (backend, op_job->filename);
+      entry->exists = TRUE;
+      entry->lstat_attrs = g_bytes_ref (lstat_attrs);
+      if (!(op_job->flags & G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS))
+        {
+          entry->stat_attrs = stat_attrs ? g_bytes_ref (stat_attrs) : NULL;
+          entry->stat_known = TRUE;
+        }
+      if (want_symlink_target)
+        {
+          entry->symlink_target = g_strdup (symlink_target);
+          entry->symlink_target_known = TRUE;
+        }
+    }
+
+  g_bytes_unref (lstat_attrs);
+  if (stat_attrs)
+    g_bytes_unref (stat_attrs);
+  g_free (symlink_target);
+
+  g_vfs_job_succeeded (G_VFS_JOB (job));
+}
+
+/* Answers the job from the cache if it has everything needed */
+static gboolean
+query_info_from_cache (GVfsBackendSftp *backend,
+                       GVfsJobQueryInfo *job)
+{
+  StatCacheEntry *entry;
+
+  entry = stat_cache_lookup (backend, job->filename);
+  if (entry == NULL)
+    return FALSE;
+
+  if (!entry->exists)
+    {
+      result_from_status_code (G_VFS_JOB (job), SSH_FX_NO_SUCH_FILE, -1, -1);
+      return TRUE;
+    }
+
+  if (!(job->flags & G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS) &&
+      !entry->stat_known)
+    return FALSE;
+
+  if (g_file_attribute_matcher_matches (job->attribute_matcher,
+                                        G_FILE_ATTRIBUTE_STANDARD_SYMLINK_TARGET) &&
+      !entry->symlink_target_known)
+    return FALSE;
+
+  query_info_from_attributes (backend, job,
+                              entry->lstat_attrs, entry->stat_attrs,
+                              entry->symlink_target);
   g_vfs_job_succeeded (G_VFS_JOB (job));
+
+  return TRUE;
 }
 
 static gboolean
@@ -4708,6 +5460,17 @@ try_query_info (GVfsBackend *backend,
   GDataOutputStream *command;
   int n_commands;
 
+  if (op_backend->stat_cache_ttl > 0)
+    {
+      if (query_info_from_cache (op_backend, job))
+        {
+          op_backend->stat_cache_hits++;
+          return TRUE;
+        }
+
+      op_backend->stat_cache_misses++;
+    }
+
   n_commands = 0;
   
   commands[n_commands].connection = &op_backend->command_connection;
@@ -4737,7 +5500,8 @@ try_query_info (GVfsBackend *backend,
 
   queue_command_streams_and_free (commands, n_commands,
                                   query_info_reply,
-                                  G_VFS_JOB (job), NULL);
+                                  G_VFS_JOB (job),
+                                  GUINT_TO_POINTER (op_backend->stat_cache_generation));
   
   return TRUE;
 }
@@ -4826,7 +5590,17 @@ try_query_fs_info (GVfsBackend *backend,
                                     G_FILE_ATTRIBUTE_FILESYSTEM_USE_PREVIEW,
                                     G_FILESYSTEM_PREVIEW_TYPE_IF_ALWAYS);
 
-  if (has_extension (op_backend, SFTP_EXT_OPENSSH_STATVFS) &&
+  if (g_file_attribute_matcher_matches (matcher, SFTP_ATTRIBUTE_DEBUG_STAT_CACHE_HITS))
+    {
+      g_file_info_set_attribute_uint64 (info, SFTP_ATTRIBUTE_DEBUG_STAT_CACHE_HITS,
+                                        op_backend->stat_cache_hits);
+      g_file_info_set_attribute_uint64 (info, SFTP_ATTRIBUTE_DEBUG_STAT_CACHE_MISSES,
+                                        op_backend->stat_cache_misses);
+      g_file_info_set_attribute_uint32 (info, SFTP_ATTRIBUTE_DEBUG_STAT_CACHE_ENTRIES,
+                                        g_hash_table_size (op_backend->stat_cache));
+    }
+
+  if (has_extension (op_backend, SFTP_EXT_OPENSSH_STATVFS) &&
       (g_file_attribute_matcher_matches (matcher,
                                          G_FILE_ATTRIBUTE_FILESYSTEM_SIZE) ||
        g_file_attribute_matcher_matches (matcher,
@@ -5090,6 +5864,8 @@ try_move (GVfsBackend *backend,
   GDataOutputStream *command;
   Command commands[2];
 
+  stat_cache_track_change (op_backend, G_VFS_JOB (job), source, destination, FALSE);
+
   commands[0].connection = &op_backend->command_connection;
   command = commands[0].cmd =
     new_command_stream (op_backend,
@@ -5147,6 +5923,8 @@ try_set_display_name (GVfsBackend *backend,
   g_free (dirname);
   g_free (basename);
 
+  stat_cache_track_change (op_backend, G_VFS_JOB (job), filename, new_name, FALSE);
+
   g_vfs_job_set_display_name_set_new_path (job,
                                            new_name);
   
@@ -5189,6 +5967,8 @@ try_make_symlink (GVfsBackend *backend,
   GVfsBackendSftp *op_backend = G_VFS_BACKEND_SFTP (backend);
   GDataOutputStream *command;
   
+  stat_cache_track_change (op_backend, G_VFS_JOB (job), filename, NULL, FALSE);
+
   command = new_command_stream (op_backend,
                                 SSH_FXP_SYMLINK);
   /* Note: This is the reverse order of how this is documented in
@@ -5265,6 +6045,8 @@ try_make_directory (GVfsBackend *backend,
   GVfsBackendSftp *op_backend = G_VFS_BACKEND_SFTP (backend);
   GDataOutputStream *command;
 
+  stat_cache_track_change (op_backend, G_VFS_JOB (job), filename, NULL, FALSE);
+
   command = new_command_stream (op_backend,
                                 SSH_FXP_MKDIR);
   put_string (command, filename);
@@ -5360,6 +6142,8 @@ try_delete (GVfsBackend *backend,
   GVfsBackendSftp *op_backend = G_VFS_BACKEND_SFTP (backend);
   GDataOutputStream *command;
   
+  stat_cache_track_change (op_backend, G_VFS_JOB (job), filename, NULL, FALSE);
+
   command = new_command_stream (op_backend,
                                 SSH_FXP_LSTAT);
   put_string (command, filename);
@@ -5498,6 +6282,8 @@ try_set_attribute (GVfsBackend *backend,
   GVfsBackendSftp *op_backend = G_VFS_BACKEND_SFTP (backend);
   GDataOutputStream *command;
 
+  stat_cache_track_change (op_backend, G_VFS_JOB (job), filename, NULL, TRUE);
+
   if (g_strcmp0 (attribute, G_FILE_ATTRIBUTE_UNIX_MODE) == 0)
     {
       if (type != G_FILE_ATTRIBUTE_TYPE_UINT32)
@@ -5567,13 +6353,12 @@ check_finished_or_cancelled_job (GVfsJob *job)
 /* The push sliding window mechanism is based on the one in the OpenSSH sftp
  * client. */
 
-#define PUSH_MAX_REQUESTS 64
-
 typedef struct {
   /* Job context */
   GVfsBackendSftp *backend;
   GVfsJobPush *op_job;
   GVfsJob *job;
+  Connection *connection;
 
   /* Open files */
   DataBuffer *raw_handle;
@@ -5589,17 +6374,19 @@ typedef struct {
   goffset offset;
   goffset n_written;
   int num_req;
+  TransferWindow window;
 
   /* replace data */
   char *tempname;
   int temp_count;
 
-  char buffer[MAX_BUFFER_SIZE];
+  char *buffer;
 } SftpPushHandle;
 
 typedef struct {
   SftpPushHandle *handle;
   gssize count;
+  gint64 sent_time;
 } PushWriteRequest;
 
 static void
@@ -5623,7 +6410,7 @@ sftp_push_handle_free (SftpPushHandle *handle)
         {
           command = new_command_stream (handle->backend, SSH_FXP_CLOSE);
           put_data_buffer (command, handle->raw_handle);
-          queue_command_stream_and_free (&handle->backend->data_connection,
+          queue_command_stream_and_free (handle->connection,
                                          command,
                                          NULL,
                                          handle->job, NULL);
@@ -5644,6 +6431,7 @@ sftp_push_handle_free (SftpPushHandle *handle)
           g_free (handle->tempname);
         }
 
+      g_free (handle->buffer);
       g_object_unref (handle->backend);
       g_object_unref (handle->job);
       g_slice_free (SftpPushHandle, handle);
@@ -5658,7 +6446,7 @@ push_enqueue_request (SftpPushHandle *handle)
 {
   g_input_stream_read_async (handle->in,
                              handle->buffer,
-                             MAX_BUFFER_SIZE,
+                             handle->backend->max_write_size,
                              G_PRIORITY_DEFAULT,
                              NULL,
                              push_read_cb, handle);
@@ -5855,7 +6643,7 @@ push_finish (SftpPushHandle *handle)
 {
   GDataOutputStream *command = new_command_stream (handle->backend, SSH_FXP_CLOSE);
   put_data_buffer (command, handle->raw_handle);
-  queue_command_stream_and_free (&handle->backend->data_connection, command,
+  queue_command_stream_and_free (handle->connection, command,
                                  push_close_write_reply,
                                  handle->job, handle);
 
@@ -5893,6 +6681,7 @@ push_write_reply (GVfsBackendSftp *backend,
   PushWriteRequest *request = user_data;
   SftpPushHandle *handle = request->handle;
   gssize count = request->count;
+  gint64 sent_time = request->sent_time;
 
   g_slice_free (PushWriteRequest, request);
 
@@ -5912,6 +6701,8 @@ push_write_reply (GVfsBackendSftp *backend,
         {
           handle->n_written += count;
           g_vfs_job_progress_callback (handle->n_written, handle->size, job);
+          transfer_window_update (&handle->window, sent_time, count,
+                                  backend->max_write_size);
 
           /* Enqueue a read op if the file is still open, and there isn't
            * already one pending. */
@@ -5977,6 +6768,7 @@ push_read_cb (GObject *source, GAsyncResult *res, gpointer user_data)
   request = g_slice_new (PushWriteRequest);
   request->handle = handle;
   request->count = count;
+  request->sent_time = g_get_monotonic_time ();
 
   command = new_command_stream (handle->backend, SSH_FXP_WRITE);
   put_data_buffer (command, handle->raw_handle);
@@ -5985,12 +6777,12 @@ push_read_cb (GObject *source, GAsyncResult *res, gpointer user_data)
   g_output_stream_write_all (G_OUTPUT_STREAM (command),
                              handle->buffer, count,
                              NULL, NULL, NULL);
-  queue_command_stream_and_free (&handle->backend->data_connection, command,
+  queue_command_stream_and_free (handle->connection, command,
                                  push_write_reply,
                                  handle->job, request);
   handle->offset += count;
 
-  if (handle->num_req < PUSH_MAX_REQUESTS)
+  if (handle->num_req < handle->window.max_requests)
     push_enqueue_request (handle);
 }
 
@@ -6045,7 +6837,7 @@ push_create_temp_reply (GVfsBackendSftp *backend,
           put_string (command, handle->op_job->destination);
           g_data_output_stream_put_uint32 (command, SSH_FXF_WRITE|SSH_FXF_CREAT|SSH_FXF_TRUNC,  NULL, NULL);
           g_data_output_stream_put_uint32 (command, 0, NULL, NULL);
-          queue_command_stream_and_free (&backend->data_connection, command,
+          queue_command_stream_and_free (handle->connection, command,
                                          push_truncate_original_reply,
                                          job, handle);
 
@@ -6101,7 +6893,7 @@ push_create_temp (SftpPushHandle *handle)
   put_string (command, handle->tempname);
   g_data_output_stream_put_uint32 (command, SSH_FXF_WRITE|SSH_FXF_CREAT|SSH_FXF_EXCL,  NULL, NULL);
   g_data_output_stream_put_uint32 (command, 0, NULL, NULL);
-  queue_command_stream_and_free (&handle->backend->data_connection, command,
+  queue_command_stream_and_free (handle->connection, command,
                                  push_create_temp_reply,
                                  handle->job, handle);
 }
@@ -6214,7 +7006,7 @@ push_source_fstat_cb (GObject *source, GAsyncResult *res, gpointer user_data)
       put_string (command, handle->op_job->destination);
       g_data_output_stream_put_uint32 (command, SSH_FXF_WRITE|SSH_FXF_CREAT|SSH_FXF_EXCL, NULL, NULL);
       g_data_output_stream_put_uint32 (command, 0, NULL, NULL);
-      queue_command_stream_and_free (&handle->backend->data_connection, command,
+      queue_command_stream_and_free (handle->connection, command,
                                      push_open_reply,
                                      handle->job, handle);
     }
@@ -6306,6 +7098,7 @@ try_push (GVfsBackend *backend,
   GVfsBackendSftp *op_backend = G_VFS_BACKEND_SFTP (backend);
   GFile *source;
   SftpPushHandle *handle;
+  Connection *connection;
 
   if (remove_source && (flags & G_FILE_COPY_NO_FALLBACK_FOR_MOVE))
     {
@@ -6315,7 +7108,8 @@ try_push (GVfsBackend *backend,
       return TRUE;
     }
 
-  if (!connection_is_usable (&op_backend->data_connection))
+  connection = get_data_connection (op_backend);
+  if (connection == NULL)
     {
       g_vfs_job_failed (G_VFS_JOB (op_job),
                         G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
@@ -6323,10 +7117,15 @@ try_push (GVfsBackend *backend,
       return TRUE;
     }
 
+  stat_cache_track_change (op_backend, G_VFS_JOB (op_job), destination, NULL, FALSE);
+
   handle = g_slice_new0 (SftpPushHandle);
   handle->backend = g_object_ref (op_backend);
   handle->job = g_object_ref (G_VFS_JOB (op_job));
   handle->op_job = op_job;
+  handle->connection = connection;
+  handle->buffer = g_malloc (op_backend->max_write_size);
+  transfer_window_init (&handle->window);
 
   source = g_file_new_for_path (local_path);
   g_file_query_info_async (source,
@@ -6342,10 +7141,14 @@ try_push (GVfsBackend *backend,
 /* The pull sliding window mechanism is based on the one from the OpenSSH sftp
  * client. It is complicated because requests can be returned out of order. */
 
-#define PULL_MAX_REQUESTS 64  /* Never have more than this many requests outstanding */
 #define PULL_SIZE_INCOMPLETE -1  /* Indicates an incomplete fstat() request */
 #define PULL_SIZE_INVALID -2  /* Indicates that no fstat() request is in progress */
 
+typedef struct {
+  Connection *connection;
+  DataBuffer *raw_handle;
+} PullStripe;
+
 typedef struct {
   /* initial job information */
   GVfsBackendSftp *backend;
@@ -6353,8 +7156,11 @@ typedef struct {
   GVfsJobPull *op_job;
   GFile *dest;
 
-  /* Open files */
-  DataBuffer *raw_handle;
+  /* Open files, the source is opened on every data connection and the
+   * reads are spread over them */
+  PullStripe stripes[MAX_DATA_CONNECTIONS];
+  int n_stripes;
+  int next_stripe;
   GOutputStream *output;
 
   /* fstat information */
@@ -6368,6 +7174,7 @@ typedef struct {
   goffset n_written;
   int num_req; /* Number of outstanding read requests */
   int max_req; /* Current maximum number of outstanding read requests */
+  TransferWindow window;
   GList *queued_writes;
 } SftpPullHandle;
 
@@ -6377,6 +7184,7 @@ typedef struct {
   guint64 request_offset; /* offset of requested bytes */
   gssize response_len;     /* number of bytes returned */
   gssize write_offset;     /* offset in buffer of bytes written so far */
+  gint64 sent_time;
   char *buffer;
 } PullRequest;
 
@@ -6404,14 +7212,16 @@ sftp_pull_handle_free (SftpPullHandle *handle)
       (!handle->output || !g_output_stream_has_pending (handle->output)) && /* no writes outstanding */
       handle->num_req == 0) /* no reads oustanding */
     {
-      if (handle->raw_handle)
+      int i;
+
+      for (i = 0; i < handle->n_stripes; i++)
         {
           GDataOutputStream *command = new_command_stream (handle->backend, SSH_FXP_CLOSE);
-          put_data_buffer (command, handle->raw_handle);
-          queue_command_stream_and_free (&handle->backend->data_connection, command,
+          put_data_buffer (command, handle->stripes[i].raw_handle);
+          queue_command_stream_and_free (handle->stripes[i].connection, command,
                                          NULL,
                                          handle->job, NULL);
-          data_buffer_free (handle->raw_handle);
+          data_buffer_free (handle->stripes[i].raw_handle);
         }
       g_clear_object (&handle->output);
       g_object_unref(handle->backend);
@@ -6582,7 +7392,7 @@ pull_write_cb (GObject *source, GAsyncResult *res, gpointer user_data)
        * time.  Otherwise try increase the number of concurrent requests. */
       if (handle->offset > handle->size)
         handle->max_req = 1;
-      else if (handle->max_req < PULL_MAX_REQUESTS)
+      else if (handle->max_req < handle->window.max_requests)
         handle->max_req++;
 
       while (handle->num_req < handle->max_req)
@@ -6665,6 +7475,9 @@ pull_read_reply (GVfsBackendSftp *backend,
 
       request->response_len = g_data_input_stream_read_uint32 (reply, NULL, NULL);
       request->buffer = g_slice_alloc (request->response_len);
+      transfer_window_update (&handle->window, request->sent_time,
+                              request->response_len,
+                              backend->max_read_size);
 
       if (g_input_stream_read_all (G_INPUT_STREAM (reply),
                                    request->buffer, request->response_len,
@@ -6689,17 +7502,22 @@ pull_enqueue_request (SftpPullHandle *handle, guint64 offset, guint32 len)
 {
   PullRequest *request;
   GDataOutputStream *command;
+  PullStripe *stripe;
+
+  stripe = &handle->stripes[handle->next_stripe];
+  handle->next_stripe = (handle->next_stripe + 1) % handle->n_stripes;
 
   request = g_slice_new0 (PullRequest);
   request->handle = handle;
   request->request_len = len;
   request->request_offset = offset;
+  request->sent_time = g_get_monotonic_time ();
 
   command = new_command_stream (handle->backend, SSH_FXP_READ);
-  put_data_buffer (command, handle->raw_handle);
+  put_data_buffer (command, stripe->raw_handle);
   g_data_output_stream_put_uint64 (command, offset, NULL, NULL);
   g_data_output_stream_put_uint32 (command, len, NULL, NULL);
-  queue_command_stream_and_free (&handle->backend->data_connection, command,
+  queue_command_stream_and_free (stripe->connection, command,
                                  pull_read_reply,
                                  handle->job, request);
 
@@ -6709,8 +7527,10 @@ pull_enqueue_request (SftpPullHandle *handle, guint64 offset, guint32 len)
 static void
 pull_enqueue_next_request (SftpPullHandle *handle)
 {
-  pull_enqueue_request (handle, handle->offset, MAX_BUFFER_SIZE);
-  handle->offset += MAX_BUFFER_SIZE;
+  guint32 len = handle->backend->max_read_size;
+
+  pull_enqueue_request (handle, handle->offset, len);
+  handle->offset += len;
 }
 
 static void
@@ -6768,8 +7588,8 @@ pull_dest_open_cb (GObject *source, GAsyncResult *res, gpointer user_data)
       /* Do an fstat() to find out the size and mode of the file. */
       GDataOutputStream *command = new_command_stream (handle->backend,
                                                        SSH_FXP_FSTAT);
-      put_data_buffer (command, handle->raw_handle);
-      queue_command_stream_and_free (&handle->backend->data_connection,
+      put_data_buffer (command, handle->stripes[0].raw_handle);
+      queue_command_stream_and_free (handle->stripes[0].connection,
                                      command,
                                      pull_fstat_reply,
                                      handle->job,
@@ -6795,6 +7615,35 @@ pull_open_reply (GVfsBackendSftp *backend,
                  gpointer user_data)
 {
   SftpPullHandle *handle = user_data;
+  int i;
+
+  /* Store the file handles we got, they will be closed when the
+   * SftpPullHandle is freed. Failing to open the file on one of the
+   * extra connections just leaves it out. */
+  for (i = 1; i < n_replies; i++)
+    {
+      Connection *connection = handle->stripes[i - 1].connection;
+
+      if (replies[i].type == SSH_FXP_HANDLE &&
+          (i == 1 || handle->n_stripes > 0))
+        {
+          handle->stripes[handle->n_stripes].connection = connection;
+          handle->stripes[handle->n_stripes].raw_handle = read_data_buffer (replies[i].data);
+          handle->n_stripes++;
+        }
+      else if (replies[i].type == SSH_FXP_HANDLE)
+        {
+          /* Close it right away, the primary open failed */
+          GDataOutputStream *command = new_command_stream (backend, SSH_FXP_CLOSE);
+          DataBuffer *raw_handle = read_data_buffer (replies[i].data);
+
+          put_data_buffer (command, raw_handle);
+          queue_command_stream_and_free (connection, command,
+                                         NULL,
+                                         job, NULL);
+          data_buffer_free (raw_handle);
+        }
+    }
 
   if (replies[0].type == SSH_FXP_ATTRS)
     {
@@ -6819,8 +7668,6 @@ pull_open_reply (GVfsBackendSftp *backend,
       else
         {
           /* We got a valid file handle. */
-          handle->raw_handle = read_data_buffer (replies[1].data);
-
           if (handle->op_job->flags & G_FILE_COPY_OVERWRITE)
             g_file_replace_async (handle->dest,
                                   NULL,
@@ -6845,11 +7692,6 @@ pull_open_reply (GVfsBackendSftp *backend,
                       G_IO_ERROR, G_IO_ERROR_FAILED,
                       "%s", _("Invalid reply received"));
 
-  /* If we got a file handle, store it.  It will be closed when the
-   * SftpPushHandle is freed. */
-  if (replies[1].type == SSH_FXP_HANDLE && !handle->raw_handle)
-    handle->raw_handle = read_data_buffer (replies[1].data);
-
   sftp_pull_handle_free (handle);
 }
 
@@ -6865,7 +7707,9 @@ try_pull (GVfsBackend *backend,
 {
   GVfsBackendSftp *op_backend = G_VFS_BACKEND_SFTP (backend);
   SftpPullHandle *handle;
-  Command commands[2];
+  Command commands[MAX_DATA_CONNECTIONS + 1];
+  Connection *connection;
+  int n_stripes, n_commands, i;
 
   if (remove_source && (flags & G_FILE_COPY_NO_FALLBACK_FOR_MOVE))
     {
@@ -6875,7 +7719,8 @@ try_pull (GVfsBackend *backend,
       return TRUE;
     }
 
-  if (!connection_is_usable (&op_backend->data_connection))
+  connection = get_data_connection (op_backend);
+  if (connection == NULL)
     {
       g_vfs_job_failed (G_VFS_JOB (job),
                         G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
@@ -6883,6 +7728,9 @@ try_pull (GVfsBackend *backend,
       return TRUE;
     }
 
+  if (remove_source)
+    stat_cache_track_change (op_backend, G_VFS_JOB (job), source, NULL, FALSE);
+
   handle = g_slice_new0 (SftpPullHandle);
   handle->backend = g_object_ref (op_backend);
   handle->op_job = g_object_ref (job);
@@ -6890,19 +7738,37 @@ try_pull (GVfsBackend *backend,
   handle->dest = g_file_new_for_path (local_path);
   handle->size = PULL_SIZE_INVALID;
   handle->max_req = 1;
+  transfer_window_init (&handle->window);
 
   commands[0].connection = &op_backend->command_connection;
   commands[0].cmd = new_command_stream (op_backend,
                                         flags & G_FILE_COPY_NOFOLLOW_SYMLINKS ? SSH_FXP_LSTAT : SSH_FXP_STAT);
   put_string (commands[0].cmd, source);
 
-  commands[1].connection = &op_backend->data_connection;
-  commands[1].cmd = new_command_stream (op_backend, SSH_FXP_OPEN);
-  put_string (commands[1].cmd, source);
-  g_data_output_stream_put_uint32 (commands[1].cmd, SSH_FXF_READ, NULL, NULL);
-  g_data_output_stream_put_uint32 (commands[1].cmd, 0, NULL, NULL);
+  /* Open the file on the least busy data connection first, then on the
+   * other usable ones. The order is kept in stripes until the replies
+   * come in. */
+  n_stripes = 1;
+  handle->stripes[0].connection = connection;
+  for (i = 0; i < op_backend->n_data_connections; i++)
+    {
+      Connection *conn = &op_backend->data_connections[i];
 
-  queue_command_streams_and_free (commands, 2,
+      if (conn != connection && connection_is_usable (conn))
+        handle->stripes[n_stripes++].connection = conn;
+    }
+
+  n_commands = n_stripes + 1;
+  for (i = 1; i < n_commands; i++)
+    {
+      commands[i].connection = handle->stripes[i - 1].connection;
+      commands[i].cmd = new_command_stream (op_backend, SSH_FXP_OPEN);
+      put_string (commands[i].cmd, source);
+      g_data_output_stream_put_uint32 (commands[i].cmd, SSH_FXF_READ, NULL, NULL);
+      g_data_output_stream_put_uint32 (commands[i].cmd, 0, NULL, NULL);
+    }
+
+  queue_command_streams_and_free (commands, n_commands,
                                   pull_open_reply,
                                   G_VFS_JOB(job),
                                   handle);
@@ -6910,6 +7776,756 @@ try_pull (GVfsBackend *backend,
   return TRUE;
 }
 
+/* Copies within the mount are done on the server with the copy-data
+ * extension if it is available, otherwise the data is piped through the
+ * daemon with a sliding window of reads and writes on the data
+ * connection, so it never has to go through the client. An existing
+ * destination is replaced through a temp file, so that copying a file
+ * over itself or one of its hard links doesn't truncate the source. */
+
+#define COPY_DATA_CHUNK_SIZE (64 * 1024 * 1024)
+
+typedef struct {
+  /* Job context */
+  GVfsBackendSftp *backend;
+  GVfsJobCopy *op_job;
+  GVfsJob *job;
+  Connection *connection;
+
+  /* Open files */
+  DataBuffer *source_handle;
+  DataBuffer *dest_handle;
+
+  /* stat information of the source */
+  goffset size;
+  guint32 permissions;
+  guint64 mtime;
+  guint64 atime;
+
+  /* state */
+  goffset offset;
+  goffset n_written;
+  int num_reads;
+  int num_writes;
+  int max_req;
+  guint32 request_size;
+  TransferWindow window;
+  gboolean eof;
+
+  /* replace data */
+  char *tempname;
+} SftpCopyHandle;
+
+typedef struct {
+  SftpCopyHandle *handle;
+  guint64 offset;
+  guint32 len;
+  gint64 sent_time;
+} CopyRequest;
+
+static void
+sftp_copy_handle_free (SftpCopyHandle *handle)
+{
+  GDataOutputStream *command;
+
+  /* Only free the handle if there are no requests outstanding. */
+  if (handle->num_reads > 0 || handle->num_writes > 0)
+    return;
+
+  if (handle->source_handle)
+    {
+      command = new_command_stream (handle->backend, SSH_FXP_CLOSE);
+      put_data_buffer (command, handle->source_handle);
+      queue_command_stream_and_free (handle->connection, command,
+                                     NULL,
+                                     handle->job, NULL);
+      data_buffer_free (handle->source_handle);
+    }
+
+  if (handle->dest_handle)
+    {
+      command = new_command_stream (handle->backend, SSH_FXP_CLOSE);
+      put_data_buffer (command, handle->dest_handle);
+      queue_command_stream_and_free (handle->connection, command,
+                                     NULL,
+                                     handle->job, NULL);
+      data_buffer_free (handle->dest_handle);
+    }
+
+  /* If tempname is non-NULL, it means we failed and should delete the temp
+   * file. It is removed after the close above on the same connection. */
+  if (handle->tempname)
+    {
+      command = new_command_stream (handle->backend, SSH_FXP_REMOVE);
+      put_string (command, handle->tempname);
+      queue_command_stream_and_free (handle->connection, command,
+                                     NULL,
+                                     handle->job, NULL);
+      g_free (handle->tempname);
+    }
+
+  g_object_unref (handle->backend);
+  g_object_unref (handle->job);
+  g_slice_free (SftpCopyHandle, handle);
+}
+
+static void
+copy_moved_file_reply (GVfsBackendSftp *backend,
+                       int reply_type,
+                       GDataInputStream *reply,
+                       guint32 len,
+                       GVfsJob *job,
+                       gpointer user_data)
+{
+  SftpCopyHandle *handle = user_data;
+
+  if (reply_type == SSH_FXP_STATUS)
+    result_from_status (job, reply, -1, -1);
+  else
+    g_vfs_job_failed (job, G_IO_ERROR, G_IO_ERROR_FAILED,
+                      _("Invalid reply received"));
+
+  sftp_copy_handle_free (handle);
+}
+
+static void
+copy_deleted_file_reply (GVfsBackendSftp *backend,
+                         int reply_type,
+                         GDataInputStream *reply,
+                         guint32 len,
+                         GVfsJob *job,
+                         gpointer user_data)
+{
+  SftpCopyHandle *handle = user_data;
+
+  if (reply_type == SSH_FXP_STATUS)
+    {
+      guint32 code = read_status_code (reply);
+      if (code == SSH_FX_OK)
+        {
+          GDataOutputStream *command = new_command_stream (backend, SSH_FXP_RENAME);
+          put_string (command, handle->tempname);
+          put_string (command, handle->op_job->destination);
+          queue_command_stream_and_free (&backend->command_connection, command,
+                                         copy_moved_file_reply,
+                                         job, handle);
+
+          g_free (handle->tempname);
+          handle->tempname = NULL;
+          return;
+        }
+      else
+        result_from_status_code (job, code, -1, -1);
+    }
+  else
+    g_vfs_job_failed (job, G_IO_ERROR, G_IO_ERROR_FAILED,
+                      _("Invalid reply received"));
+
+  sftp_copy_handle_free (handle);
+}
+
+static void
+copy_close_write_reply (GVfsBackendSftp *backend,
+                        int reply_type,
+                        GDataInputStream *reply,
+                        guint32 len,
+                        GVfsJob *job,
+                        gpointer user_data)
+{
+  SftpCopyHandle *handle = user_data;
+
+  if (reply_type == SSH_FXP_STATUS)
+    {
+      guint32 code = read_status_code (reply);
+      if (code == SSH_FX_OK)
+        {
+          g_vfs_job_progress_callback (handle->n_written, handle->n_written, job);
+
+          if (handle->tempname)
+            {
+              /* If we wrote to a temp file, do delete then rename. */
+              GDataOutputStream *command = new_command_stream (backend, SSH_FXP_REMOVE);
+              put_string (command, handle->op_job->destination);
+              queue_command_stream_and_free (&backend->command_connection, command,
+                                             copy_deleted_file_reply,
+                                             job, handle);
+              return;
+            }
+
+          g_vfs_job_succeeded (job);
+        }
+      else
+        result_from_status_code (job, code, -1, -1);
+    }
+  else
+    g_vfs_job_failed (job, G_IO_ERROR, G_IO_ERROR_FAILED,
+                      _("Invalid reply received"));
+
+  sftp_copy_handle_free (handle);
+}
+
+static void
+copy_finish (SftpCopyHandle *handle)
+{
+  gboolean default_perms = (handle->op_job->flags & G_FILE_COPY_TARGET_DEFAULT_PERMS);
+  guint32 flags = SSH_FILEXFER_ATTR_ACMODTIME;
+  guint64 atime;
+  GDataOutputStream *command;
+
+  if (!default_perms)
+    flags |= SSH_FILEXFER_ATTR_PERMISSIONS;
+
+  /* Atime is COPY_WHEN_MOVED, but not COPY_WITH_FILE. */
+  if (handle->op_job->flags & G_FILE_COPY_ALL_METADATA)
+    atime = handle->atime;
+  else
+    atime = g_get_real_time () / G_USEC_PER_SEC;
+
+  /* Failing to restore the permissions and timestamps doesn't fail the
+   * copy, like for pull. */
+  command = new_command_stream (handle->backend, SSH_FXP_FSETSTAT);
+  put_data_buffer (command, handle->dest_handle);
+  g_data_output_stream_put_uint32 (command, flags, NULL, NULL);
+  if (!default_perms)
+    g_data_output_stream_put_uint32 (command, handle->permissions, NULL, NULL);
+  g_data_output_stream_put_uint32 (command, atime, NULL, NULL);
+  g_data_output_stream_put_uint32 (command, handle->mtime, NULL, NULL);
+  queue_command_stream_and_free (handle->connection, command,
+                                 NULL,
+                                 handle->job, NULL);
+
+  command = new_command_stream (handle->backend, SSH_FXP_CLOSE);
+  put_data_buffer (command, handle->dest_handle);
+  queue_command_stream_and_free (handle->connection, command,
+                                 copy_close_write_reply,
+                                 handle->job, handle);
+
+  data_buffer_free (handle->dest_handle);
+  handle->dest_handle = NULL;
+}
+
+static void
+copy_try_finish (SftpCopyHandle *handle)
+{
+  if (handle->eof && handle->num_reads == 0 && handle->num_writes == 0)
+    copy_finish (handle);
+}
+
+static void copy_enqueue_read (SftpCopyHandle *handle, guint64 offset, guint32 len);
+
+static void
+copy_enqueue_next_reads (SftpCopyHandle *handle)
+{
+  while (!handle->eof && handle->num_reads + handle->num_writes < handle->max_req)
+    {
+      copy_enqueue_read (handle, handle->offset, handle->request_size);
+      handle->offset += handle->request_size;
+    }
+}
+
+static void
+copy_write_reply (GVfsBackendSftp *backend,
+                  int reply_type,
+                  GDataInputStream *reply,
+                  guint32 len,
+                  GVfsJob *job,
+                  gpointer user_data)
+{
+  CopyRequest *request = user_data;
+  SftpCopyHandle *handle = request->handle;
+  guint32 count = request->len;
+
+  g_slice_free (CopyRequest, request);
+
+  handle->num_writes--;
+
+  if (check_finished_or_cancelled_job (job))
+    {
+      sftp_copy_handle_free (handle);
+      return;
+    }
+
+  if (reply_type == SSH_FXP_STATUS)
+    {
+      guint32 code = read_status_code (reply);
+      if (code == SSH_FX_OK)
+        {
+          handle->n_written += count;
+          g_vfs_job_progress_callback (handle->n_written, handle->size, job);
+
+          /* Once we have requested past the expected EOF, request one at a
+           * time. Otherwise try to increase the number of concurrent
+           * requests. */
+          if (handle->offset > handle->size)
+            handle->max_req = 1;
+          else if (handle->max_req < handle->window.max_requests)
+            handle->max_req++;
+
+          copy_enqueue_next_reads (handle);
+          copy_try_finish (handle);
+          return;
+        }
+      else
+        result_from_status_code (job, code, -1, -1);
+    }
+  else
+    g_vfs_job_failed (job, G_IO_ERROR, G_IO_ERROR_FAILED,
+                      _("Invalid reply received"));
+
+  sftp_copy_handle_free (handle);
+}
+
+static void
+copy_read_reply (GVfsBackendSftp *backend,
+                 int reply_type,
+                 GDataInputStream *reply,
+                 guint32 len,
+                 GVfsJob *job,
+                 gpointer user_data)
+{
+  CopyRequest *request = user_data;
+  SftpCopyHandle *handle = request->handle;
+  GDataOutputStream *command;
+  guint32 data_len;
+  gsize bytes_read;
+  char *buffer;
+
+  handle->num_reads--;
+
+  if (check_finished_or_cancelled_job (job))
+    {
+    }
+  else if (reply_type == SSH_FXP_STATUS)
+    {
+      guint32 code = read_status_code (reply);
+      if (code == SSH_FX_EOF)
+        {
+          g_slice_free (CopyRequest, request);
+          handle->eof = TRUE;
+          copy_try_finish (handle);
+          return;
+        }
+      else
+        result_from_status_code (job, code, -1, -1);
+    }
+  else if (reply_type != SSH_FXP_DATA)
+    {
+      g_vfs_job_failed (job, G_IO_ERROR, G_IO_ERROR_FAILED,
+                        _("Invalid reply received"));
+    }
+  else
+    {
+      data_len = g_data_input_stream_read_uint32 (reply, NULL, NULL);
+      buffer = g_malloc (MAX (data_len, 1));
+
+      if (data_len <= request->len &&
+          g_input_stream_read_all (G_INPUT_STREAM (reply),
+                                   buffer, data_len,
+                                   &bytes_read, NULL, NULL) &&
+          bytes_read == data_len)
+        {
+          transfer_window_update (&handle->window, request->sent_time,
+                                  data_len, handle->request_size);
+
+          if (data_len == 0)
+            handle->eof = TRUE;
+          else
+            {
+              command = new_command_stream (backend, SSH_FXP_WRITE);
+              put_data_buffer (command, handle->dest_handle);
+              g_data_output_stream_put_uint64 (command, request->offset, NULL, NULL);
+              g_data_output_stream_put_uint32 (command, data_len, NULL, NULL);
+              g_output_stream_write_all (G_OUTPUT_STREAM (command),
+                                         buffer, data_len,
+                                         NULL, NULL, NULL);
+
+              /* If we read short, issue another request for the rest. */
+              if (data_len < request->len)
+                copy_enqueue_read (handle,
+                                   request->offset + data_len,
+                                   request->len - data_len);
+
+              request->len = data_len;
+              queue_command_stream_and_free (handle->connection, command,
+                                             copy_write_reply,
+                                             job, request);
+              handle->num_writes++;
+              request = NULL;
+            }
+
+          g_free (buffer);
+          if (request)
+            g_slice_free (CopyRequest, request);
+          copy_try_finish (handle);
+          return;
+        }
+      else
+        g_vfs_job_failed (job, G_IO_ERROR, G_IO_ERROR_FAILED,
+                          _("Invalid reply received"));
+
+      g_free (buffer);
+    }
+
+  g_slice_free (CopyRequest, request);
+  sftp_copy_handle_free (handle);
+}
+
+static void
+copy_enqueue_read (SftpCopyHandle *handle, guint64 offset, guint32 len)
+{
+  CopyRequest *request;
+  GDataOutputStream *command;
+
+  request = g_slice_new0 (CopyRequest);
+  request->handle = handle;
+  request->offset = offset;
+  request->len = len;
+  request->sent_time = g_get_monotonic_time ();
+
+  command = new_command_stream (handle->backend, SSH_FXP_READ);
+  put_data_buffer (command, handle->source_handle);
+  g_data_output_stream_put_uint64 (command, offset, NULL, NULL);
+  g_data_output_stream_put_uint32 (command, len, NULL, NULL);
+  queue_command_stream_and_free (handle->connection, command,
+                                 copy_read_reply,
+                                 handle->job, request);
+
+  handle->num_reads++;
+}
+
+static void copy_data_chunk (SftpCopyHandle *handle);
+
+static void
+copy_data_reply (GVfsBackendSftp *backend,
+                 int reply_type,
+                 GDataInputStream *reply,
+                 guint32 len,
+                 GVfsJob *job,
+                 gpointer user_data)
+{
+  SftpCopyHandle *handle = user_data;
+
+  if (check_finished_or_cancelled_job (job))
+    {
+    }
+  else if (reply_type == SSH_FXP_STATUS)
+    {
+      guint32 code = read_status_code (reply);
+      if (code == SSH_FX_OK)
+        {
+          if (handle->eof)
+            {
+              handle->n_written = handle->size;
+              copy_finish (handle);
+            }
+          else
+            {
+              handle->n_written = handle->offset;
+              g_vfs_job_progress_callback (handle->n_written, handle->size, job);
+              copy_data_chunk (handle);
+            }
+          return;
+        }
+      else if (code == SSH_FX_OP_UNSUPPORTED && handle->n_written == 0)
+        {
+          /* Copy through the daemon instead */
+          handle->offset = 0;
+          handle->eof = FALSE;
+          handle->max_req = 1;
+          copy_enqueue_next_reads (handle);
+          return;
+        }
+      else
+        result_from_status_code (job, code, -1, -1);
+    }
+  else
+    g_vfs_job_failed (job, G_IO_ERROR, G_IO_ERROR_FAILED,
+                      _("Invalid reply received"));
+
+  sftp_copy_handle_free (handle);
+}
+
+/* The server copies until EOF if the length is 0. The file is copied
+ * in chunks to report progress and to be able to cancel the copy, the
+ * last chunk goes to EOF in case the file grew in the meantime. */
+static void
+copy_data_chunk (SftpCopyHandle *handle)
+{
+  GDataOutputStream *command;
+  guint64 offset = handle->offset;
+  guint64 len;
+
+  if (handle->size - offset > COPY_DATA_CHUNK_SIZE)
+    len = COPY_DATA_CHUNK_SIZE;
+  else
+    {
+      len = 0;
+      handle->eof = TRUE;
+    }
+
+  command = new_command_stream (handle->backend, SSH_FXP_EXTENDED);
+  put_string (command, "copy-data");
+  put_data_buffer (command, handle->source_handle);
+  g_data_output_stream_put_uint64 (command, offset, NULL, NULL);
+  g_data_output_stream_put_uint64 (command, len, NULL, NULL);
+  put_data_buffer (command, handle->dest_handle);
+  g_data_output_stream_put_uint64 (command, offset, NULL, NULL);
+  queue_command_stream_and_free (handle->connection, command,
+                                 copy_data_reply,
+                                 handle->job, handle);
+
+  handle->offset += len;
+}
+
+static void
+copy_open_dest_reply (GVfsBackendSftp *backend,
+                      int reply_type,
+                      GDataInputStream *reply,
+                      guint32 len,
+                      GVfsJob *job,
+                      gpointer user_data)
+{
+  SftpCopyHandle *handle = user_data;
+
+  if (reply_type == SSH_FXP_HANDLE)
+    handle->dest_handle = read_data_buffer (reply);
+  else
+    {
+      /* Nothing to clean up */
+      g_free (handle->tempname);
+      handle->tempname = NULL;
+    }
+
+  if (check_finished_or_cancelled_job (job))
+    {
+    }
+  else if (reply_type == SSH_FXP_STATUS)
+    {
+      guint32 code = read_status_code (reply);
+
+      if (code == SSH_FX_NO_SUCH_FILE)
+        not_dir_or_not_exist_error (backend, job, handle->op_job->destination);
+      else if (handle->op_job->flags & G_FILE_COPY_OVERWRITE)
+        {
+          /* Couldn't create the temp file, let the generic copy
+           * implementation deal with it */
+          g_vfs_job_failed (job, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                            _("Operation not supported"));
+        }
+      else
+        result_from_status_code (job, code, G_IO_ERROR_EXISTS, -1);
+    }
+  else if (reply_type != SSH_FXP_HANDLE)
+    g_vfs_job_failed (job, G_IO_ERROR, G_IO_ERROR_FAILED,
+                      _("Invalid reply received"));
+  else if (has_extension (backend, SFTP_EXT_OPENSSH_COPY_DATA))
+    {
+      copy_data_chunk (handle);
+      return;
+    }
+  else
+    {
+      handle->max_req = 1;
+      copy_enqueue_next_reads (handle);
+      return;
+    }
+
+  sftp_copy_handle_free (handle);
+}
+
+/* The destination is only created once the source could be opened */
+static void
+copy_open_source_reply (GVfsBackendSftp *backend,
+                        int reply_type,
+                        GDataInputStream *reply,
+                        guint32 len,
+                        GVfsJob *job,
+                        gpointer user_data)
+{
+  SftpCopyHandle *handle = user_data;
+  GDataOutputStream *command;
+
+  if (reply_type == SSH_FXP_HANDLE)
+    handle->source_handle = read_data_buffer (reply);
+
+  if (check_finished_or_cancelled_job (job))
+    {
+    }
+  else if (reply_type == SSH_FXP_STATUS)
+    result_from_status (job, reply, -1, -1);
+  else if (reply_type != SSH_FXP_HANDLE)
+    g_vfs_job_failed (job, G_IO_ERROR, G_IO_ERROR_FAILED,
+                      _("Invalid reply received"));
+  else
+    {
+      command = new_command_stream (backend, SSH_FXP_OPEN);
+      put_string (command,
+                  handle->tempname ? handle->tempname : handle->op_job->destination);
+      g_data_output_stream_put_uint32 (command,
+                                       SSH_FXF_WRITE|SSH_FXF_CREAT|SSH_FXF_EXCL,
+                                       NULL, NULL);
+      g_data_output_stream_put_uint32 (command, 0, NULL, NULL);
+      queue_command_stream_and_free (handle->connection, command,
+                                     copy_open_dest_reply,
+                                     job, handle);
+      return;
+    }
+
+  /* The temp file wasn't created yet */
+  g_free (handle->tempname);
+  handle->tempname = NULL;
+
+  sftp_copy_handle_free (handle);
+}
+
+static void
+copy_open (SftpCopyHandle *handle,
+           gboolean dest_exists)
+{
+  GDataOutputStream *command;
+  char *dirname;
+  char basename[] = ".giosaveXXXXXX";
+
+  if (dest_exists)
+    {
+      dirname = g_path_get_dirname (handle->op_job->destination);
+      gvfs_randomize_string (basename + 8, 6);
+      handle->tempname = g_build_filename (dirname, basename, NULL);
+      g_free (dirname);
+    }
+
+  command = new_command_stream (handle->backend, SSH_FXP_OPEN);
+  put_string (command, handle->op_job->source);
+  g_data_output_stream_put_uint32 (command, SSH_FXF_READ, NULL, NULL);
+  g_data_output_stream_put_uint32 (command, 0, NULL, NULL);
+  queue_command_stream_and_free (handle->connection, command,
+                                 copy_open_source_reply,
+                                 handle->job, handle);
+}
+
+static void
+copy_stat_reply (GVfsBackendSftp *backend,
+                 MultiReply *replies,
+                 int n_replies,
+                 GVfsJob *job,
+                 gpointer user_data)
+{
+  SftpCopyHandle *handle = user_data;
+  GFileInfo *info;
+  GFileType type;
+
+  if (replies[0].type == SSH_FXP_STATUS)
+    {
+      result_from_status (job, replies[0].data, -1, -1);
+      sftp_copy_handle_free (handle);
+      return;
+    }
+  else if (replies[0].type != SSH_FXP_ATTRS)
+    {
+      g_vfs_job_failed (job, G_IO_ERROR, G_IO_ERROR_FAILED,
+                        _("Invalid reply received"));
+      sftp_copy_handle_free (handle);
+      return;
+    }
+
+  info = g_file_info_new ();
+  parse_attributes (backend, info, NULL, replies[0].data, NULL);
+  type = g_file_info_get_file_type (info);
+  handle->size = g_file_info_get_size (info);
+  handle->permissions = g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_MODE) & 0777;
+  handle->mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+  handle->atime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_ACCESS);
+  g_object_unref (info);
+
+  if (type != G_FILE_TYPE_REGULAR)
+    {
+      /* Fall back to default implementation to copy non-regular files and
+       * to get the right errors for directories */
+      g_vfs_job_failed (job, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                        _("Operation not supported"));
+      sftp_copy_handle_free (handle);
+      return;
+    }
+
+  if (replies[1].type == SSH_FXP_ATTRS)
+    {
+      info = g_file_info_new ();
+      parse_attributes (backend, info, NULL, replies[1].data, NULL);
+      type = g_file_info_get_file_type (info);
+      g_object_unref (info);
+
+      if (!(handle->op_job->flags & G_FILE_COPY_OVERWRITE))
+        g_vfs_job_failed (job, G_IO_ERROR, G_IO_ERROR_EXISTS,
+                          _("Target file already exists"));
+      else if (type == G_FILE_TYPE_DIRECTORY)
+        g_vfs_job_failed (job, G_IO_ERROR, G_IO_ERROR_IS_DIRECTORY,
+                          _("File is directory"));
+      else if (handle->op_job->flags & G_FILE_COPY_BACKUP)
+        g_vfs_job_failed (job, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                          _("Operation not supported"));
+      else
+        {
+          copy_open (handle, TRUE);
+          return;
+        }
+
+      sftp_copy_handle_free (handle);
+      return;
+    }
+
+  copy_open (handle, FALSE);
+}
+
+static gboolean
+try_copy (GVfsBackend *backend,
+          GVfsJobCopy *job,
+          const char *source,
+          const char *destination,
+          GFileCopyFlags flags,
+          GFileProgressCallback progress_callback,
+          gpointer progress_callback_data)
+{
+  GVfsBackendSftp *op_backend = G_VFS_BACKEND_SFTP (backend);
+  SftpCopyHandle *handle;
+  Command commands[2];
+  Connection *connection;
+
+  connection = get_data_connection (op_backend);
+  if (connection == NULL)
+    {
+      g_vfs_job_failed (G_VFS_JOB (job),
+                        G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                        _("Operation not supported"));
+      return TRUE;
+    }
+
+  stat_cache_track_change (op_backend, G_VFS_JOB (job), destination, NULL, FALSE);
+
+  handle = g_slice_new0 (SftpCopyHandle);
+  handle->backend = g_object_ref (op_backend);
+  handle->job = g_object_ref (G_VFS_JOB (job));
+  handle->op_job = job;
+  handle->connection = connection;
+  handle->request_size = MIN (op_backend->max_read_size, op_backend->max_write_size);
+  transfer_window_init (&handle->window);
+
+  commands[0].connection = &op_backend->command_connection;
+  commands[0].cmd = new_command_stream (op_backend,
+                                        flags & G_FILE_COPY_NOFOLLOW_SYMLINKS ? SSH_FXP_LSTAT : SSH_FXP_STAT);
+  put_string (commands[0].cmd, source);
+
+  commands[1].connection = &op_backend->command_connection;
+  commands[1].cmd = new_command_stream (op_backend, SSH_FXP_LSTAT);
+  put_string (commands[1].cmd, destination);
+
+  queue_command_streams_and_free (commands, 2,
+                                  copy_stat_reply,
+                                  G_VFS_JOB (job),
+                                  handle);
+
+  return TRUE;
+}
+
 static void
 g_vfs_backend_sftp_class_init (GVfsBackendSftpClass *klass)
 {
@@ -6949,4 +8565,5 @@ g_vfs_backend_sftp_class_init (GVfsBackendSftpClass *klass)
   backend_class->try_set_attribute = try_set_attribute;
   backend_class->try_push = try_push;
   backend_class->try_pull = try_pull;
+  backend_class->try_copy = try_copy;
 }
@@ -50,6 +50,9 @@
 #include "gvfsjobqueryattributes.h"
 #include "gvfsjobenumerate.h"
 #include "gvfsjobmove.h"
+#include "gvfsjobcopy.h"
+#include "gvfsjobpush.h"
+#include "gvfsjobpull.h"
 #include "gvfsdaemonprotocol.h"
 #include "gvfsdaemonutils.h"
 #include "gvfsutils.h"
@@ -57,6 +60,20 @@
 
 #include <libsmbclient.h>
 
+/* Each libsmbclient context serializes everything it does, so a share
+ * gets one context per job thread. Jobs on paths take whichever context
+ * is idle, jobs on handles go to the context the handle was opened on.
+ */
+#ifdef MAX_JOB_THREADS
+#define MAX_SMB_CONTEXTS MAX_JOB_THREADS
+#else
+#define MAX_SMB_CONTEXTS 1
+#endif
+
+typedef struct {
+  SMBCCTX *context;
+  GMutex lock;
+} SmbContext;
 
 struct _GVfsBackendSmb
 {
@@ -70,7 +87,10 @@ struct _GVfsBackendSmb
   char *default_workgroup;
   int port;
   
-  SMBCCTX *smb_context;
+  SMBCCTX *smb_context; /* The context used for mounting, contexts[0] */
+  SmbContext *contexts;
+  guint n_contexts;
+  gint next_context;
 
   char *last_user;
   char *last_domain;
@@ -99,9 +119,14 @@ static void
 g_vfs_backend_smb_finalize (GObject *object)
 {
   GVfsBackendSmb *backend;
+  guint i;
 
   backend = G_VFS_BACKEND_SMB (object);
 
+  for (i = 0; i < backend->n_contexts; i++)
+    g_mutex_clear (&backend->contexts[i].lock);
+  g_free (backend->contexts);
+
   g_free (backend->share);
   g_free (backend->server);
   g_free (backend->user);
@@ -133,6 +158,13 @@ g_vfs_backend_smb_init (GVfsBackendSmb *backend)
 
   g_object_unref (settings);
 
+  /* Jobs on one handle share its context and file offset, so they must
+   * not overlap. Jobs without a handle pick a context of their own. */
+  g_vfs_backend_set_job_concurrency (G_VFS_BACKEND (backend),
+                                     G_VFS_TYPE_JOB,
+                                     G_VFS_JOB_CONCURRENCY_PER_HANDLE);
+  g_vfs_backend_set_shared_read_memory (G_VFS_BACKEND (backend), TRUE);
+
   g_debug ("g_vfs_backend_smb_init: default workgroup = '%s'\n", backend->default_workgroup ? backend->default_workgroup : "NULL");
 }
 
@@ -387,6 +419,129 @@ create_smb_uri (const char *server,
   return g_string_free (uri, FALSE);
 }
 
+static SMBCCTX *
+create_smb_context (GVfsBackendSmb *backend,
+                    GError **error)
+{
+  SMBCCTX *smb_context;
+  const char *debug;
+  int debug_val;
+
+  smb_context = smbc_new_context ();
+  if (smb_context == NULL)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                   _("Internal Error (%s)"), "Failed to allocate smb context");
+      return NULL;
+    }
+  smbc_setOptionUserData (smb_context, backend);
+
+  debug = g_getenv ("GVFS_SMB_DEBUG");
+  if (debug)
+    debug_val = atoi (debug);
+  else
+    debug_val = 0;
+
+  smbc_setDebug (smb_context, debug_val);
+  smbc_setFunctionAuthDataWithContext (smb_context, auth_callback);
+
+  if (backend->default_workgroup != NULL)
+    smbc_setWorkgroup (smb_context, backend->default_workgroup);
+
+  smbc_setOptionUseKerberos (smb_context, 1);
+  smbc_setOptionFallbackAfterKerberos (smb_context,
+                                       backend->user != NULL);
+  smbc_setOptionNoAutoAnonymousLogin (smb_context, TRUE);
+  smbc_setOptionUseCCache (smb_context, 1);
+
+  if (!smbc_init_context (smb_context))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                   _("Internal Error (%s)"), "Failed to initialize smb context");
+      smbc_free_context (smb_context, FALSE);
+      return NULL;
+    }
+
+  return smb_context;
+}
+
+/* Called once the mount succeeded, so the extra contexts can simply
+ * authenticate the way the mount loop ended up doing it; auth_callback
+ * hands them the last used credentials.
+ */
+static void
+setup_smb_contexts (GVfsBackendSmb *backend)
+{
+  SMBCCTX *smb_context;
+  GError *error = NULL;
+  guint i;
+
+  backend->contexts = g_new0 (SmbContext, MAX_SMB_CONTEXTS);
+  backend->contexts[0].context = backend->smb_context;
+  g_mutex_init (&backend->contexts[0].lock);
+  backend->n_contexts = 1;
+
+  for (i = 1; i < MAX_SMB_CONTEXTS; i++)
+    {
+      smb_context = create_smb_context (backend, &error);
+      if (smb_context == NULL)
+        {
+          g_debug ("setup_smb_contexts - %s\n", error->message);
+          g_clear_error (&error);
+          break;
+        }
+
+      smbc_setOptionFallbackAfterKerberos (smb_context,
+                                           smbc_getOptionFallbackAfterKerberos (backend->smb_context));
+      smbc_setOptionUseCCache (smb_context,
+                               smbc_getOptionUseCCache (backend->smb_context));
+      smbc_setOptionNoAutoAnonymousLogin (smb_context,
+                                          smbc_getOptionNoAutoAnonymousLogin (backend->smb_context));
+
+      backend->contexts[i].context = smb_context;
+      g_mutex_init (&backend->contexts[i].lock);
+      backend->n_contexts++;
+    }
+
+  g_debug ("setup_smb_contexts - using %u contexts\n", backend->n_contexts);
+}
+
+/* Returns a locked context for a job that works on paths only. An idle
+ * context is preferred, otherwise the job queues up on the next one in turn.
+ */
+static SmbContext *
+smb_context_acquire (GVfsBackendSmb *backend)
+{
+  SmbContext *ctx;
+  guint start, i;
+
+  start = (guint) g_atomic_int_add (&backend->next_context, 1);
+  for (i = 0; i < backend->n_contexts; i++)
+    {
+      ctx = &backend->contexts[(start + i) % backend->n_contexts];
+      if (g_mutex_trylock (&ctx->lock))
+        return ctx;
+    }
+
+  ctx = &backend->contexts[start % backend->n_contexts];
+  g_mutex_lock (&ctx->lock);
+
+  return ctx;
+}
+
+/* Handles are only valid on the context they were opened on */
+static void
+smb_context_lock (SmbContext *ctx)
+{
+  g_mutex_lock (&ctx->lock);
+}
+
+static void
+smb_context_release (SmbContext *ctx)
+{
+  g_mutex_unlock (&ctx->lock);
+}
+
 static void
 set_default_location_to_topmost_dir (GVfsBackend  *backend,
                                      const char   *mount_path)
@@ -433,47 +588,17 @@ do_mount (GVfsBackend *backend,
   char *uri;
   int res;
   char *display_name;
-  const char *debug;
-  int debug_val;
   gchar *port_str;
   GMountSpec *smb_mount_spec;
   smbc_stat_fn smbc_stat;
   int errsv;
+  GError *error = NULL;
 
-  smb_context = smbc_new_context ();
+  smb_context = create_smb_context (op_backend, &error);
   if (smb_context == NULL)
     {
-      g_vfs_job_failed (G_VFS_JOB (job),
-			G_IO_ERROR, G_IO_ERROR_FAILED,
-			_("Internal Error (%s)"), "Failed to allocate smb context");
-      return;
-    }
-  smbc_setOptionUserData (smb_context, backend);
-
-  debug = g_getenv ("GVFS_SMB_DEBUG");
-  if (debug)
-    debug_val = atoi (debug);
-  else
-    debug_val = 0;
-
-  smbc_setDebug (smb_context, debug_val);
-  smbc_setFunctionAuthDataWithContext (smb_context, auth_callback);
-
-  if (op_backend->default_workgroup != NULL)
-    smbc_setWorkgroup (smb_context, op_backend->default_workgroup);
-
-  smbc_setOptionUseKerberos (smb_context, 1);
-  smbc_setOptionFallbackAfterKerberos (smb_context,
-                                       op_backend->user != NULL);
-  smbc_setOptionNoAutoAnonymousLogin (smb_context, TRUE);
-  smbc_setOptionUseCCache (smb_context, 1);
-
-  if (!smbc_init_context (smb_context))
-    {
-      g_vfs_job_failed (G_VFS_JOB (job),
-			G_IO_ERROR, G_IO_ERROR_FAILED,
-			_("Internal Error (%s)"), "Failed to initialize smb context");
-      smbc_free_context (smb_context, FALSE);
+      g_vfs_job_failed_from_error (G_VFS_JOB (job), error);
+      g_error_free (error);
       return;
     }
 
@@ -609,6 +734,7 @@ do_mount (GVfsBackend *backend,
   g_debug ("do_mount - login successful\n");
 
   set_default_location_to_topmost_dir (backend, op_backend->path);
+  setup_smb_contexts (op_backend);
   g_vfs_keyring_save_password (op_backend->last_user,
 			       op_backend->server,
 			       op_backend->last_domain,
@@ -670,7 +796,9 @@ do_unmount (GVfsBackend *backend,
 	    GMountSource *mount_source)
 {
   GVfsBackendSmb *op_backend = G_VFS_BACKEND_SMB (backend);
-  int res;
+  SmbContext *ctx;
+  int errsv;
+  guint i;
 
   if (op_backend->smb_context == NULL)
     {
@@ -680,12 +808,22 @@ do_unmount (GVfsBackend *backend,
       return;
     }
 
-  /* shutdown_ctx = TRUE, "all connections and files will be closed even if they are busy" */
-  res = smbc_free_context (op_backend->smb_context, TRUE);
+  errsv = 0;
+  for (i = 0; i < op_backend->n_contexts; i++)
+    {
+      ctx = &op_backend->contexts[i];
+
+      /* shutdown_ctx = TRUE, "all connections and files will be closed even if they are busy" */
+      smb_context_lock (ctx);
+      if (smbc_free_context (ctx->context, TRUE) != 0 && errsv == 0)
+        errsv = errno;
+      ctx->context = NULL;
+      smb_context_release (ctx);
+    }
   op_backend->smb_context = NULL;
-  if (res != 0)
+  if (errsv != 0)
     {
-      g_vfs_job_failed_from_errno (G_VFS_JOB (job), errno);
+      g_vfs_job_failed_from_errno (G_VFS_JOB (job), errsv);
       return;
     }
 
@@ -701,12 +839,19 @@ fixup_open_errno (int err)
   return err;
 }
 
+typedef struct {
+  SmbContext *ctx;
+  SMBCFILE *file;
+} SmbReadHandle;
+
 static void 
 do_open_for_read (GVfsBackend *backend,
 		  GVfsJobOpenForRead *job,
 		  const char *filename)
 {
   GVfsBackendSmb *op_backend = G_VFS_BACKEND_SMB (backend);
+  SmbContext *ctx;
+  SmbReadHandle *handle;
   char *uri;
   SMBCFILE *file;
   struct stat st;
@@ -717,16 +862,17 @@ do_open_for_read (GVfsBackend *backend,
 
 
   uri = create_smb_uri (op_backend->server, op_backend->port, op_backend->share, filename);
-  smbc_open = smbc_getFunctionOpen (op_backend->smb_context);
+  ctx = smb_context_acquire (op_backend);
+  smbc_open = smbc_getFunctionOpen (ctx->context);
   errno = 0;
-  file = smbc_open (op_backend->smb_context, uri, O_RDONLY, 0);
+  file = smbc_open (ctx->context, uri, O_RDONLY, 0);
 
   if (file == NULL)
     {
       olderr = fixup_open_errno (errno);
       
-      smbc_stat = smbc_getFunctionStat (op_backend->smb_context);
-      res = smbc_stat (op_backend->smb_context, uri, &st);
+      smbc_stat = smbc_getFunctionStat (ctx->context);
+      res = smbc_stat (ctx->context, uri, &st);
       if ((res == 0) && (S_ISDIR (st.st_mode)))
             g_vfs_job_failed (G_VFS_JOB (job),
                               G_IO_ERROR, G_IO_ERROR_IS_DIRECTORY,
@@ -736,30 +882,39 @@ do_open_for_read (GVfsBackend *backend,
   }
   else
     {
-      
+      handle = g_new (SmbReadHandle, 1);
+      handle->ctx = ctx;
+      handle->file = file;
+
       g_vfs_job_open_for_read_set_can_seek (job, TRUE);
-      g_vfs_job_open_for_read_set_handle (job, file);
+      g_vfs_job_open_for_read_set_handle (job, handle);
       g_vfs_job_succeeded (G_VFS_JOB (job));
     }
+  smb_context_release (ctx);
   g_free (uri);
 }
 
 static void
 do_read (GVfsBackend *backend,
 	 GVfsJobRead *job,
-	 GVfsBackendHandle handle,
+	 GVfsBackendHandle _handle,
 	 char *buffer,
 	 gsize bytes_requested)
 {
-  GVfsBackendSmb *op_backend = G_VFS_BACKEND_SMB (backend);
+  SmbReadHandle *handle = _handle;
+  SmbContext *ctx = handle->ctx;
   ssize_t res;
+  int errsv;
   smbc_read_fn smbc_read;
 
-  smbc_read = smbc_getFunctionRead (op_backend->smb_context);
-  res = smbc_read (op_backend->smb_context, (SMBCFILE *)handle, buffer, bytes_requested);
+  smb_context_lock (ctx);
+  smbc_read = smbc_getFunctionRead (ctx->context);
+  res = smbc_read (ctx->context, handle->file, buffer, bytes_requested);
+  errsv = errno;
+  smb_context_release (ctx);
 
   if (res == -1)
-    g_vfs_job_failed_from_errno (G_VFS_JOB (job), errno);
+    g_vfs_job_failed_from_errno (G_VFS_JOB (job), errsv);
   else
     {
       g_vfs_job_read_set_size (job, res);
@@ -770,12 +925,13 @@ do_read (GVfsBackend *backend,
 static void
 do_seek_on_read (GVfsBackend *backend,
 		 GVfsJobSeekRead *job,
-		 GVfsBackendHandle handle,
+		 GVfsBackendHandle _handle,
 		 goffset    offset,
 		 GSeekType  type)
 {
-  GVfsBackendSmb *op_backend = G_VFS_BACKEND_SMB (backend);
-  int whence;
+  SmbReadHandle *handle = _handle;
+  SmbContext *ctx = handle->ctx;
+  int whence, errsv;
   off_t res;
   smbc_lseek_fn smbc_lseek;
 
@@ -787,11 +943,14 @@ do_seek_on_read (GVfsBackend *backend,
       return;
     }
 
-  smbc_lseek = smbc_getFunctionLseek (op_backend->smb_context);
-  res = smbc_lseek (op_backend->smb_context, (SMBCFILE *)handle, offset, whence);
+  smb_context_lock (ctx);
+  smbc_lseek = smbc_getFunctionLseek (ctx->context);
+  res = smbc_lseek (ctx->context, handle->file, offset, whence);
+  errsv = errno;
+  smb_context_release (ctx);
 
   if (res == (off_t)-1)
-    g_vfs_job_failed_from_errno (G_VFS_JOB (job), errno);
+    g_vfs_job_failed_from_errno (G_VFS_JOB (job), errsv);
   else
     {
       g_vfs_job_seek_read_set_offset (job, res);
@@ -804,18 +963,22 @@ do_seek_on_read (GVfsBackend *backend,
 static void
 do_query_info_on_read (GVfsBackend *backend,
 		       GVfsJobQueryInfoRead *job,
-		       GVfsBackendHandle handle,
+		       GVfsBackendHandle _handle,
 		       GFileInfo *info,
 		       GFileAttributeMatcher *matcher)
 {
   GVfsBackendSmb *op_backend = G_VFS_BACKEND_SMB (backend);
+  SmbReadHandle *handle = _handle;
+  SmbContext *ctx = handle->ctx;
   struct stat st = {0};
   int res, saved_errno;
   smbc_fstat_fn smbc_fstat;
 
-  smbc_fstat = smbc_getFunctionFstat (op_backend->smb_context);
-  res = smbc_fstat (op_backend->smb_context, (SMBCFILE *)handle, &st);
+  smb_context_lock (ctx);
+  smbc_fstat = smbc_getFunctionFstat (ctx->context);
+  res = smbc_fstat (ctx->context, handle->file, &st);
   saved_errno = errno;
+  smb_context_release (ctx);
 
   if (res == 0)
     {
@@ -831,21 +994,29 @@ do_query_info_on_read (GVfsBackend *backend,
 static void
 do_close_read (GVfsBackend *backend,
 	       GVfsJobCloseRead *job,
-	       GVfsBackendHandle handle)
+	       GVfsBackendHandle _handle)
 {
-  GVfsBackendSmb *op_backend = G_VFS_BACKEND_SMB (backend);
+  SmbReadHandle *handle = _handle;
+  SmbContext *ctx = handle->ctx;
   ssize_t res;
+  int errsv;
   smbc_close_fn smbc_close;
 
-  smbc_close = smbc_getFunctionClose (op_backend->smb_context);
-  res = smbc_close (op_backend->smb_context, (SMBCFILE *)handle);
+  smb_context_lock (ctx);
+  smbc_close = smbc_getFunctionClose (ctx->context);
+  res = smbc_close (ctx->context, handle->file);
+  errsv = errno;
+  smb_context_release (ctx);
+  g_free (handle);
+
   if (res == -1)
-    g_vfs_job_failed_from_errno (G_VFS_JOB (job), errno);
+    g_vfs_job_failed_from_errno (G_VFS_JOB (job), errsv);
   else
     g_vfs_job_succeeded (G_VFS_JOB (job));
 }
 
 typedef struct {
+  SmbContext *ctx;
   SMBCFILE *file;
   char *uri;
   char *tmp_uri;
@@ -870,6 +1041,7 @@ open_for_write (GVfsBackend *backend,
                 int open_flags)
 {
   GVfsBackendSmb *op_backend = G_VFS_BACKEND_SMB (backend);
+  SmbContext *ctx;
   char *uri;
   SMBCFILE *file;
   SmbWriteHandle *handle;
@@ -878,9 +1050,10 @@ open_for_write (GVfsBackend *backend,
   off_t initial_offset = 0;
 
   uri = create_smb_uri (op_backend->server, op_backend->port, op_backend->share, filename);
-  smbc_open = smbc_getFunctionOpen (op_backend->smb_context);
+  ctx = smb_context_acquire (op_backend);
+  smbc_open = smbc_getFunctionOpen (ctx->context);
   errno = 0;
-  file = smbc_open (op_backend->smb_context, uri, open_flags, 0666);
+  file = smbc_open (ctx->context, uri, open_flags, 0666);
   g_free (uri);
 
   if (file == NULL)
@@ -890,6 +1063,7 @@ open_for_write (GVfsBackend *backend,
       /* We guarantee EEXIST on create on existing dir */
       if (job->mode == OPEN_FOR_WRITE_CREATE && errsv == EISDIR)
 	errsv = EEXIST;
+      smb_context_release (ctx);
       g_vfs_job_failed_from_errno (G_VFS_JOB (job), errsv);
       return;
     }
@@ -898,18 +1072,21 @@ open_for_write (GVfsBackend *backend,
     {
       smbc_lseek_fn smbc_lseek;
 
-      smbc_lseek = smbc_getFunctionLseek (op_backend->smb_context);
-      initial_offset = smbc_lseek (op_backend->smb_context, file,
+      smbc_lseek = smbc_getFunctionLseek (ctx->context);
+      initial_offset = smbc_lseek (ctx->context, file,
 						       0, SEEK_CUR);
       if (initial_offset == (off_t) -1)
         {
-          g_vfs_job_failed_from_errno (G_VFS_JOB (job),
-                                       fixup_open_errno (errno));
+          errsv = fixup_open_errno (errno);
+          smb_context_release (ctx);
+          g_vfs_job_failed_from_errno (G_VFS_JOB (job), errsv);
           return;
         }
     }
+  smb_context_release (ctx);
 
   handle = g_new0 (SmbWriteHandle, 1);
+  handle->ctx = ctx;
   handle->file = file;
   handle->mode = job->mode;
 
@@ -974,7 +1151,7 @@ get_dir_from_uri (const char *uri)
 }
 
 static SMBCFILE *
-open_tmpfile (GVfsBackendSmb *backend,
+open_tmpfile (SMBCCTX *context,
 	      const char *uri,
 	      char **tmp_uri_out)
 {
@@ -989,9 +1166,9 @@ open_tmpfile (GVfsBackendSmb *backend,
     gvfs_randomize_string (filename + 4, 4);
     tmp_uri = g_strconcat (dir_uri, filename, NULL);
 
-    smbc_open = smbc_getFunctionOpen (backend->smb_context);
+    smbc_open = smbc_getFunctionOpen (context);
     errno = 0;
-    file = smbc_open (backend->smb_context, tmp_uri,
+    file = smbc_open (context, tmp_uri,
                       O_CREAT|O_RDWR|O_EXCL, 0666);
   } while (file == NULL && errno == EEXIST);
 
@@ -1010,7 +1187,7 @@ open_tmpfile (GVfsBackendSmb *backend,
 }
 
 static gboolean
-copy_file (GVfsBackendSmb *backend,
+copy_file (SMBCCTX *context,
 	   GVfsJob *job,
 	   const char *from_uri,
 	   const char *to_uri)
@@ -1032,17 +1209,17 @@ copy_file (GVfsBackendSmb *backend,
 
   succeeded = FALSE;
 
-  smbc_open = smbc_getFunctionOpen (backend->smb_context);
-  smbc_read = smbc_getFunctionRead (backend->smb_context);
-  smbc_write = smbc_getFunctionWrite (backend->smb_context);
-  smbc_close = smbc_getFunctionClose (backend->smb_context);
+  smbc_open = smbc_getFunctionOpen (context);
+  smbc_read = smbc_getFunctionRead (context);
+  smbc_write = smbc_getFunctionWrite (context);
+  smbc_close = smbc_getFunctionClose (context);
 
-  from_file = smbc_open (backend->smb_context, from_uri,
+  from_file = smbc_open (context, from_uri,
 			 O_RDONLY, 0666);
   if (from_file == NULL || g_vfs_job_is_cancelled (job))
     goto out;
   
-  to_file = smbc_open (backend->smb_context, to_uri,
+  to_file = smbc_open (context, to_uri,
 		       O_CREAT|O_WRONLY|O_TRUNC, 0666);
   
   if (from_file == NULL || g_vfs_job_is_cancelled (job))
@@ -1051,7 +1228,7 @@ copy_file (GVfsBackendSmb *backend,
   while (1)
     {
       
-      res = smbc_read (backend->smb_context, from_file,
+      res = smbc_read (context, from_file,
 					buffer, sizeof(buffer));
       if (res < 0 || g_vfs_job_is_cancelled (job))
 	goto out;
@@ -1062,7 +1239,7 @@ copy_file (GVfsBackendSmb *backend,
       p = buffer;
       while (buffer_size > 0)
 	{
-	  res = smbc_write (backend->smb_context, to_file,
+	  res = smbc_write (context, to_file,
 					     p, buffer_size);
 	  if (res < 0 || g_vfs_job_is_cancelled (job))
 	    goto out;
@@ -1074,9 +1251,9 @@ copy_file (GVfsBackendSmb *backend,
  
  out: 
   if (to_file)
-	  smbc_close (backend->smb_context, to_file);
+	  smbc_close (context, to_file);
   if (from_file)
-	  smbc_close (backend->smb_context, from_file);
+	  smbc_close (context, from_file);
   return succeeded;
 }
 
@@ -1095,6 +1272,7 @@ do_replace (GVfsBackend *backend,
 	    GFileCreateFlags flags)
 {
   GVfsBackendSmb *op_backend = G_VFS_BACKEND_SMB (backend);
+  SmbContext *ctx;
   struct stat original_stat;
   int res;
   char *uri, *tmp_uri, *backup_uri, *current_etag;
@@ -1111,11 +1289,12 @@ do_replace (GVfsBackend *backend,
   else
     backup_uri = NULL;
 
-  smbc_open = smbc_getFunctionOpen (op_backend->smb_context);
-  smbc_stat = smbc_getFunctionStat (op_backend->smb_context);
+  ctx = smb_context_acquire (op_backend);
+  smbc_open = smbc_getFunctionOpen (ctx->context);
+  smbc_stat = smbc_getFunctionStat (ctx->context);
   
   errno = 0;
-  file = smbc_open (op_backend->smb_context, uri,
+  file = smbc_open (ctx->context, uri,
                     O_CREAT|O_RDWR|O_EXCL, 0);
   if (file == NULL && errno != EEXIST)
     {
@@ -1130,7 +1309,7 @@ do_replace (GVfsBackend *backend,
     {
       if (etag != NULL)
 	{
-	  res = smbc_stat (op_backend->smb_context, uri, &original_stat);
+	  res = smbc_stat (ctx->context, uri, &original_stat);
 	  
 	  if (res == 0)
 	    {
@@ -1161,12 +1340,12 @@ do_replace (GVfsBackend *backend,
        * copied directly to the backup filename.
        */
 
-      file = open_tmpfile (op_backend, uri, &tmp_uri);
+      file = open_tmpfile (ctx->context, uri, &tmp_uri);
       if (file == NULL)
 	{
 	  if (make_backup)
 	    {
-	      if (!copy_file (op_backend, G_VFS_JOB (job), uri, backup_uri))
+	      if (!copy_file (ctx->context, G_VFS_JOB (job), uri, backup_uri))
 		{
 		  if (g_vfs_job_is_cancelled (G_VFS_JOB (job)))
 		    g_set_error_literal (&error,
@@ -1185,7 +1364,7 @@ do_replace (GVfsBackend *backend,
 	    }
 	  
 	  errno = 0;
-	  file = smbc_open (op_backend->smb_context, uri,
+	  file = smbc_open (ctx->context, uri,
                             O_CREAT|O_RDWR|O_TRUNC, 0);
 	  if (file == NULL)
 	    {
@@ -1204,8 +1383,10 @@ do_replace (GVfsBackend *backend,
       g_free (backup_uri);
       backup_uri = NULL;
     }
+  smb_context_release (ctx);
 
   handle = g_new (SmbWriteHandle, 1);
+  handle->ctx = ctx;
   handle->file = file;
   handle->uri = uri;
   handle->tmp_uri = tmp_uri;
@@ -1220,6 +1401,7 @@ do_replace (GVfsBackend *backend,
   return;
   
  error:
+  smb_context_release (ctx);
   g_vfs_job_failed_from_error (G_VFS_JOB (job), error);
   g_error_free (error);
   g_free (backup_uri);
@@ -1235,16 +1417,20 @@ do_write (GVfsBackend *backend,
 	  char *buffer,
 	  gsize buffer_size)
 {
-  GVfsBackendSmb *op_backend = G_VFS_BACKEND_SMB (backend);
   SmbWriteHandle *handle = _handle;
+  SmbContext *ctx = handle->ctx;
   ssize_t res;
+  int errsv;
   smbc_write_fn smbc_write;
 
-  smbc_write = smbc_getFunctionWrite (op_backend->smb_context);
-  res = smbc_write (op_backend->smb_context, handle->file,
+  smb_context_lock (ctx);
+  smbc_write = smbc_getFunctionWrite (ctx->context);
+  res = smbc_write (ctx->context, handle->file,
 					buffer, buffer_size);
+  errsv = errno;
+  smb_context_release (ctx);
   if (res == -1)
-    g_vfs_job_failed_from_errno (G_VFS_JOB (job), errno);
+    g_vfs_job_failed_from_errno (G_VFS_JOB (job), errsv);
   else
     {
       g_vfs_job_write_set_written_size (job, res);
@@ -1259,9 +1445,9 @@ do_seek_on_write (GVfsBackend *backend,
 		  goffset    offset,
 		  GSeekType  type)
 {
-  GVfsBackendSmb *op_backend = G_VFS_BACKEND_SMB (backend);
   SmbWriteHandle *handle = _handle;
-  int whence;
+  SmbContext *ctx = handle->ctx;
+  int whence, errsv;
   off_t res;
   smbc_lseek_fn smbc_lseek;
 
@@ -1273,11 +1459,14 @@ do_seek_on_write (GVfsBackend *backend,
       return;
     }
 
-  smbc_lseek = smbc_getFunctionLseek (op_backend->smb_context);
-  res = smbc_lseek (op_backend->smb_context, handle->file, offset, whence);
+  smb_context_lock (ctx);
+  smbc_lseek = smbc_getFunctionLseek (ctx->context);
+  res = smbc_lseek (ctx->context, handle->file, offset, whence);
+  errsv = errno;
+  smb_context_release (ctx);
 
   if (res == (off_t)-1)
-    g_vfs_job_failed_from_errno (G_VFS_JOB (job), errno);
+    g_vfs_job_failed_from_errno (G_VFS_JOB (job), errsv);
   else
     {
       g_vfs_job_seek_write_set_offset (job, res);
@@ -1293,14 +1482,16 @@ do_truncate (GVfsBackend *backend,
              GVfsBackendHandle _handle,
 	     goffset size)
 {
-  GVfsBackendSmb *op_backend = G_VFS_BACKEND_SMB (backend);
   SmbWriteHandle *handle = _handle;
+  SmbContext *ctx = handle->ctx;
   smbc_ftruncate_fn smbc_ftruncate;
 
-  smbc_ftruncate = smbc_getFunctionFtruncate (op_backend->smb_context);
-  if (smbc_ftruncate (op_backend->smb_context, handle->file, size) == -1)
+  smb_context_lock (ctx);
+  smbc_ftruncate = smbc_getFunctionFtruncate (ctx->context);
+  if (smbc_ftruncate (ctx->context, handle->file, size) == -1)
     {
       g_vfs_job_failed_from_errno (G_VFS_JOB (job), errno);
+      smb_context_release (ctx);
       return;
     }
 
@@ -1309,14 +1500,16 @@ do_truncate (GVfsBackend *backend,
       smbc_lseek_fn smbc_lseek;
       off_t res;
 
-      smbc_lseek = smbc_getFunctionLseek (op_backend->smb_context);
-      res = smbc_lseek (op_backend->smb_context, handle->file, size, SEEK_SET);
+      smbc_lseek = smbc_getFunctionLseek (ctx->context);
+      res = smbc_lseek (ctx->context, handle->file, size, SEEK_SET);
       if (res == (off_t)-1)
         {
           g_vfs_job_failed_from_errno (G_VFS_JOB (job), errno);
+          smb_context_release (ctx);
           return;
         }
     }
+  smb_context_release (ctx);
 
   g_vfs_job_succeeded (G_VFS_JOB (job));
 }
@@ -1331,12 +1524,15 @@ do_query_info_on_write (GVfsBackend *backend,
   GVfsBackendSmb *op_backend = G_VFS_BACKEND_SMB (backend);
   struct stat st = {0};
   SmbWriteHandle *handle = _handle;
+  SmbContext *ctx = handle->ctx;
   int res, saved_errno;
   smbc_fstat_fn smbc_fstat;
 
-  smbc_fstat = smbc_getFunctionFstat (op_backend->smb_context);
-  res = smbc_fstat (op_backend->smb_context, handle->file, &st);
+  smb_context_lock (ctx);
+  smbc_fstat = smbc_getFunctionFstat (ctx->context);
+  res = smbc_fstat (ctx->context, handle->file, &st);
   saved_errno = errno;
+  smb_context_release (ctx);
 
   if (res == 0)
     {
@@ -1354,8 +1550,8 @@ do_close_write (GVfsBackend *backend,
 		GVfsJobCloseWrite *job,
 		GVfsBackendHandle _handle)
 {
-  GVfsBackendSmb *op_backend = G_VFS_BACKEND_SMB (backend);
   SmbWriteHandle *handle = _handle;
+  SmbContext *ctx = handle->ctx;
   struct stat stat_at_close;
   int stat_res, errsv;
   ssize_t res;
@@ -1364,20 +1560,21 @@ do_close_write (GVfsBackend *backend,
   smbc_unlink_fn smbc_unlink;
   smbc_rename_fn smbc_rename;
 
-  smbc_fstat = smbc_getFunctionFstat (op_backend->smb_context);
-  smbc_close = smbc_getFunctionClose (op_backend->smb_context);
-  smbc_unlink = smbc_getFunctionUnlink (op_backend->smb_context);
-  smbc_rename = smbc_getFunctionRename (op_backend->smb_context);
+  smb_context_lock (ctx);
+  smbc_fstat = smbc_getFunctionFstat (ctx->context);
+  smbc_close = smbc_getFunctionClose (ctx->context);
+  smbc_unlink = smbc_getFunctionUnlink (ctx->context);
+  smbc_rename = smbc_getFunctionRename (ctx->context);
   
-  stat_res = smbc_fstat (op_backend->smb_context, handle->file, &stat_at_close);
+  stat_res = smbc_fstat (ctx->context, handle->file, &stat_at_close);
   
-  res = smbc_close (op_backend->smb_context, handle->file);
+  res = smbc_close (ctx->context, handle->file);
 
   if (res == -1)
     {
       errsv = errno;
       if (handle->tmp_uri)
-    	  smbc_unlink (op_backend->smb_context, handle->tmp_uri);
+    	  smbc_unlink (ctx->context, handle->tmp_uri);
       g_vfs_job_failed_from_errno (G_VFS_JOB (job), errsv);
       goto out;
     }
@@ -1386,12 +1583,12 @@ do_close_write (GVfsBackend *backend,
     {
       if (handle->backup_uri)
 	{
-	  res = smbc_rename (op_backend->smb_context, handle->uri,
-						 op_backend->smb_context, handle->backup_uri);
+	  res = smbc_rename (ctx->context, handle->uri,
+						 ctx->context, handle->backup_uri);
 	  if (res ==  -1)
 	    {
               errsv = errno;
-              smbc_unlink (op_backend->smb_context, handle->tmp_uri);
+              smbc_unlink (ctx->context, handle->tmp_uri);
 	      g_vfs_job_failed (G_VFS_JOB (job),
 				G_IO_ERROR, G_IO_ERROR_CANT_CREATE_BACKUP,
 				_("Backup file creation failed: %s"), g_strerror (errsv));
@@ -1400,22 +1597,22 @@ do_close_write (GVfsBackend *backend,
 	}
       else
         {
-	  res = smbc_unlink (op_backend->smb_context, handle->uri);
+	  res = smbc_unlink (ctx->context, handle->uri);
 	  if (res ==  -1)
 	    {
 	      errsv = errno;
-	      smbc_unlink (op_backend->smb_context, handle->tmp_uri);
+	      smbc_unlink (ctx->context, handle->tmp_uri);
 	      g_vfs_job_failed_from_errno (G_VFS_JOB (job), errsv);
 	      goto out;
 	    }
 	}
       
-      res = smbc_rename (op_backend->smb_context, handle->tmp_uri,
-					     op_backend->smb_context, handle->uri);
+      res = smbc_rename (ctx->context, handle->tmp_uri,
+					     ctx->context, handle->uri);
       if (res ==  -1)
 	{
 	  errsv = errno;
-	  smbc_unlink (op_backend->smb_context, handle->tmp_uri);
+	  smbc_unlink (ctx->context, handle->tmp_uri);
 	  g_vfs_job_failed_from_errno (G_VFS_JOB (job), errsv);
 	  goto out;
 	}
@@ -1432,6 +1629,7 @@ do_close_write (GVfsBackend *backend,
   g_vfs_job_succeeded (G_VFS_JOB (job));
 
  out:
+  smb_context_release (ctx);
   smb_write_handle_free (handle);  
 }
 
@@ -1631,6 +1829,7 @@ do_query_info (GVfsBackend *backend,
 	       GFileAttributeMatcher *matcher)
 {
   GVfsBackendSmb *op_backend = G_VFS_BACKEND_SMB (backend);
+  SmbContext *ctx;
   struct stat st = {0};
   char *uri;
   int res, saved_errno;
@@ -1638,9 +1837,11 @@ do_query_info (GVfsBackend *backend,
   smbc_stat_fn smbc_stat;
 
   uri = create_smb_uri (op_backend->server, op_backend->port, op_backend->share, filename);
-  smbc_stat = smbc_getFunctionStat (op_backend->smb_context);
-  res = smbc_stat (op_backend->smb_context, uri, &st);
+  ctx = smb_context_acquire (op_backend);
+  smbc_stat = smbc_getFunctionStat (ctx->context);
+  res = smbc_stat (ctx->context, uri, &st);
   saved_errno = errno;
+  smb_context_release (ctx);
   g_free (uri);
 
   /* Create dummy stat for root dir where access is denied */
@@ -1678,6 +1879,7 @@ do_query_fs_info (GVfsBackend *backend,
 		  GFileAttributeMatcher *attribute_matcher)
 {
   GVfsBackendSmb *op_backend = G_VFS_BACKEND_SMB (backend);
+  SmbContext *ctx;
   smbc_statvfs_fn smbc_statvfs;
   struct statvfs st = {0};
   char *uri;
@@ -1697,9 +1899,11 @@ do_query_fs_info (GVfsBackend *backend,
 					G_FILE_ATTRIBUTE_FILESYSTEM_READONLY))
     {
       uri = create_smb_uri (op_backend->server, op_backend->port, op_backend->share, filename);
-      smbc_statvfs = smbc_getFunctionStatVFS (op_backend->smb_context);
-      res = smbc_statvfs (op_backend->smb_context, uri, &st);
+      ctx = smb_context_acquire (op_backend);
+      smbc_statvfs = smbc_getFunctionStatVFS (ctx->context);
+      res = smbc_statvfs (ctx->context, uri, &st);
       saved_errno = errno;
+      smb_context_release (ctx);
       g_free (uri);
 
       if (res == 0)
@@ -1777,6 +1981,7 @@ do_set_attribute (GVfsBackend *backend,
                   GFileQueryInfoFlags flags)
 {
   GVfsBackendSmb *op_backend;
+  SmbContext *ctx;
   char *uri;
   int res, errsv;
   struct timeval tbuf[2];
@@ -1802,18 +2007,19 @@ do_set_attribute (GVfsBackend *backend,
 
   uri = create_smb_uri (op_backend->server, op_backend->port, op_backend->share, filename);
   res = -1;
+  ctx = smb_context_acquire (op_backend);
 
   if (strcmp (attribute, G_FILE_ATTRIBUTE_TIME_MODIFIED) == 0)
     {
       if (type == G_FILE_ATTRIBUTE_TYPE_UINT64)
         {
-	  smbc_utimes = smbc_getFunctionUtimes (op_backend->smb_context);
+	  smbc_utimes = smbc_getFunctionUtimes (ctx->context);
 	  tbuf[1].tv_sec = (*(guint64 *)value_p);  /* mtime */
 	  tbuf[1].tv_usec = 0;
 	  /* atime = mtime (atimes are usually disabled on desktop systems) */
 	  tbuf[0].tv_sec = tbuf[1].tv_sec;
 	  tbuf[0].tv_usec = 0;
-	  res = smbc_utimes (op_backend->smb_context, uri, &tbuf[0]);
+	  res = smbc_utimes (ctx->context, uri, &tbuf[0]);
 	}
       else
         {
@@ -1828,12 +2034,13 @@ do_set_attribute (GVfsBackend *backend,
   else
   if (strcmp (attribute, G_FILE_ATTRIBUTE_UNIX_MODE) == 0)
     {
-      smbc_chmod = smbc_getFunctionChmod (op_backend->smb_context);
-      res = smbc_chmod (op_backend->smb_context, uri, (*(guint32 *)value_p) & 0777);
+      smbc_chmod = smbc_getFunctionChmod (ctx->context);
+      res = smbc_chmod (ctx->context, uri, (*(guint32 *)value_p) & 0777);
     }
 #endif    
 
   errsv = errno;
+  smb_context_release (ctx);
   g_free (uri);
 
   if (res != 0)
@@ -1850,6 +2057,7 @@ do_enumerate (GVfsBackend *backend,
 	      GFileQueryInfoFlags flags)
 {
   GVfsBackendSmb *op_backend = G_VFS_BACKEND_SMB (backend);
+  SmbContext *ctx;
   struct stat st = { 0 };
   GError *error;
   SMBCFILE *dir;
@@ -1871,16 +2079,17 @@ do_enumerate (GVfsBackend *backend,
 
   uri = create_smb_uri_string (op_backend->server, op_backend->port, op_backend->share, filename);
   
-  smbc_opendir = smbc_getFunctionOpendir (op_backend->smb_context);
+  ctx = smb_context_acquire (op_backend);
+  smbc_opendir = smbc_getFunctionOpendir (ctx->context);
 #ifndef HAVE_SMBC_READDIRPLUS2
-  smbc_getdents = smbc_getFunctionGetdents (op_backend->smb_context);
-  smbc_stat = smbc_getFunctionStat (op_backend->smb_context);
+  smbc_getdents = smbc_getFunctionGetdents (ctx->context);
+  smbc_stat = smbc_getFunctionStat (ctx->context);
 #else
-  smbc_readdirplus2 = smbc_getFunctionReaddirPlus2 (op_backend->smb_context);
+  smbc_readdirplus2 = smbc_getFunctionReaddirPlus2 (ctx->context);
 #endif
-  smbc_closedir = smbc_getFunctionClosedir (op_backend->smb_context);
+  smbc_closedir = smbc_getFunctionClosedir (ctx->context);
   
-  dir = smbc_opendir (op_backend->smb_context, uri->str);
+  dir = smbc_opendir (ctx->context, uri->str);
 
   if (dir == NULL)
     {
@@ -1903,7 +2112,7 @@ do_enumerate (GVfsBackend *backend,
 
   while (TRUE)
     {
-      res = smbc_getdents (op_backend->smb_context, dir, (struct smbc_dirent *)dirents, sizeof (dirents));
+      res = smbc_getdents (ctx->context, dir, (struct smbc_dirent *)dirents, sizeof (dirents));
       if (res <= 0)
 	break;
       
@@ -1934,7 +2143,7 @@ do_enumerate (GVfsBackend *backend,
 		}
 	      else
 		{
-		  stat_res = smbc_stat (op_backend->smb_context,
+		  stat_res = smbc_stat (ctx->context,
 							    uri->str, &st);
 		  if (stat_res == 0)
 		    {
@@ -1954,7 +2163,7 @@ do_enumerate (GVfsBackend *backend,
 	}
    }
 #else
-  while ((exstat = smbc_readdirplus2 (op_backend->smb_context, dir, &st)) != NULL)
+  while ((exstat = smbc_readdirplus2 (ctx->context, dir, &st)) != NULL)
     {
       if ((S_ISREG (st.st_mode) ||
            S_ISDIR (st.st_mode) ||
@@ -1972,7 +2181,8 @@ do_enumerate (GVfsBackend *backend,
     }
 #endif
 
-  smbc_closedir (op_backend->smb_context, dir);
+  smbc_closedir (ctx->context, dir);
+  smb_context_release (ctx);
 
   g_vfs_job_enumerate_done (job);
 
@@ -1980,6 +2190,7 @@ do_enumerate (GVfsBackend *backend,
   return;
   
  error:
+  smb_context_release (ctx);
   g_vfs_job_failed_from_error (G_VFS_JOB (job), error);
   g_error_free (error);
   g_string_free (uri, TRUE);
@@ -1992,6 +2203,7 @@ do_set_display_name (GVfsBackend *backend,
 		     const char *display_name)
 {
   GVfsBackendSmb *op_backend = G_VFS_BACKEND_SMB (backend);
+  SmbContext *ctx;
   char *from_uri, *to_uri;
   g_autofree char *basename = NULL;
   g_autofree char *old_name_case = NULL;
@@ -2020,13 +2232,14 @@ do_set_display_name (GVfsBackend *backend,
    */
   old_name_case = g_utf8_casefold (basename, -1);
   new_name_case = g_utf8_casefold (display_name, -1);
+  ctx = smb_context_acquire (op_backend);
   if (g_strcmp0 (old_name_case, new_name_case) != 0)
     {
       /* We can't rely on libsmbclient reporting EEXIST, let's always stat first.
        * https://bugzilla.gnome.org/show_bug.cgi?id=616645
        */
-      smbc_stat = smbc_getFunctionStat (op_backend->smb_context);
-      res = smbc_stat (op_backend->smb_context, to_uri, &st);
+      smbc_stat = smbc_getFunctionStat (ctx->context);
+      res = smbc_stat (ctx->context, to_uri, &st);
       if (res == 0)
         {
           g_vfs_job_failed (G_VFS_JOB (job),
@@ -2036,9 +2249,9 @@ do_set_display_name (GVfsBackend *backend,
         }
     }
 
-  smbc_rename = smbc_getFunctionRename (op_backend->smb_context);
-  res = smbc_rename (op_backend->smb_context, from_uri,
-                     op_backend->smb_context, to_uri);
+  smbc_rename = smbc_getFunctionRename (ctx->context);
+  res = smbc_rename (ctx->context, from_uri,
+                     ctx->context, to_uri);
   errsv = errno;
 
   if (res != 0)
@@ -2050,6 +2263,7 @@ do_set_display_name (GVfsBackend *backend,
     }
 
  out:
+  smb_context_release (ctx);
   g_free (from_uri);
   g_free (to_uri);
   g_free (new_path);
@@ -2061,6 +2275,7 @@ do_delete (GVfsBackend *backend,
 	   const char *filename)
 {
   GVfsBackendSmb *op_backend = G_VFS_BACKEND_SMB (backend);
+  SmbContext *ctx;
   struct stat statbuf;
   char *uri;
   int errsv, res;
@@ -2071,14 +2286,16 @@ do_delete (GVfsBackend *backend,
 
   uri = create_smb_uri (op_backend->server, op_backend->port, op_backend->share, filename);
 
-  smbc_stat = smbc_getFunctionStat (op_backend->smb_context);
-  smbc_rmdir = smbc_getFunctionRmdir (op_backend->smb_context);
-  smbc_unlink = smbc_getFunctionUnlink (op_backend->smb_context);
+  ctx = smb_context_acquire (op_backend);
+  smbc_stat = smbc_getFunctionStat (ctx->context);
+  smbc_rmdir = smbc_getFunctionRmdir (ctx->context);
+  smbc_unlink = smbc_getFunctionUnlink (ctx->context);
 
-  res = smbc_stat (op_backend->smb_context, uri, &statbuf);
+  res = smbc_stat (ctx->context, uri, &statbuf);
   if (res == -1)
     {
       errsv = errno;
+      smb_context_release (ctx);
 
       g_vfs_job_failed (G_VFS_JOB (job),
 			G_IO_ERROR,
@@ -2091,21 +2308,22 @@ do_delete (GVfsBackend *backend,
 
   if (S_ISDIR (statbuf.st_mode))
     {
-      res = smbc_rmdir (op_backend->smb_context, uri);
+      res = smbc_rmdir (ctx->context, uri);
 
       /* We can't rely on libsmbclient reporting ENOTEMPTY, let's verify that
        * the dir has been really removed:
        * https://bugzilla.samba.org/show_bug.cgi?id=13204
        */
-      if (res == 0 && smbc_stat (op_backend->smb_context, uri, &statbuf) == 0)
+      if (res == 0 && smbc_stat (ctx->context, uri, &statbuf) == 0)
         {
           res = -1;
           errno = ENOTEMPTY;
         }
     }
   else
-    res = smbc_unlink (op_backend->smb_context, uri);
+    res = smbc_unlink (ctx->context, uri);
   errsv = errno;
+  smb_context_release (ctx);
   g_free (uri);
 
   if (res != 0)
@@ -2120,14 +2338,17 @@ do_make_directory (GVfsBackend *backend,
 		   const char *filename)
 {
   GVfsBackendSmb *op_backend = G_VFS_BACKEND_SMB (backend);
+  SmbContext *ctx;
   char *uri;
   int errsv, res;
   smbc_mkdir_fn smbc_mkdir;
 
   uri = create_smb_uri (op_backend->server, op_backend->port, op_backend->share, filename);
-  smbc_mkdir = smbc_getFunctionMkdir (op_backend->smb_context);
-  res = smbc_mkdir (op_backend->smb_context, uri, 0666);
+  ctx = smb_context_acquire (op_backend);
+  smbc_mkdir = smbc_getFunctionMkdir (ctx->context);
+  res = smbc_mkdir (ctx->context, uri, 0666);
   errsv = errno;
+  smb_context_release (ctx);
   g_free (uri);
 
   if (res != 0)
@@ -2146,6 +2367,7 @@ do_move (GVfsBackend *backend,
 	 gpointer progress_callback_data)
 {
   GVfsBackendSmb *op_backend = G_VFS_BACKEND_SMB (backend);
+  SmbContext *ctx;
   char *source_uri, *dest_uri, *backup_uri;
   gboolean destination_exist, source_is_dir;
   struct stat statbuf;
@@ -2158,15 +2380,17 @@ do_move (GVfsBackend *backend,
   
   source_uri = create_smb_uri (op_backend->server, op_backend->port, op_backend->share, source);
 
-  smbc_stat = smbc_getFunctionStat (op_backend->smb_context);
-  smbc_rename = smbc_getFunctionRename (op_backend->smb_context);
-  smbc_unlink = smbc_getFunctionUnlink (op_backend->smb_context);
+  ctx = smb_context_acquire (op_backend);
+  smbc_stat = smbc_getFunctionStat (ctx->context);
+  smbc_rename = smbc_getFunctionRename (ctx->context);
+  smbc_unlink = smbc_getFunctionUnlink (ctx->context);
 
-  res = smbc_stat (op_backend->smb_context, source_uri, &statbuf);
+  res = smbc_stat (ctx->context, source_uri, &statbuf);
   if (res == -1)
     {
       errsv = errno;
 
+      smb_context_release (ctx);
       g_vfs_job_failed (G_VFS_JOB (job),
 			G_IO_ERROR,
 			g_io_error_from_errno (errsv),
@@ -2182,7 +2406,7 @@ do_move (GVfsBackend *backend,
   dest_uri = create_smb_uri (op_backend->server, op_backend->port, op_backend->share, destination);
   
   destination_exist = FALSE;
-  res = smbc_stat (op_backend->smb_context, dest_uri, &statbuf);
+  res = smbc_stat (ctx->context, dest_uri, &statbuf);
   if (res == 0)
     {
       destination_exist = TRUE; /* Target file exists */
@@ -2192,6 +2416,7 @@ do_move (GVfsBackend *backend,
 	  /* Always fail on dirs, even with overwrite */
 	  if (S_ISDIR (statbuf.st_mode))
 	    {
+	      smb_context_release (ctx);
 	      g_vfs_job_failed (G_VFS_JOB (job),
 				G_IO_ERROR,
 				G_IO_ERROR_WOULD_MERGE,
@@ -2203,6 +2428,7 @@ do_move (GVfsBackend *backend,
 	}
       else
 	{
+	  smb_context_release (ctx);
 	  g_vfs_job_failed (G_VFS_JOB (job),
 			    G_IO_ERROR,
 			    G_IO_ERROR_EXISTS,
@@ -2216,10 +2442,11 @@ do_move (GVfsBackend *backend,
   if (flags & G_FILE_COPY_BACKUP && destination_exist)
     {
       backup_uri = g_strconcat (dest_uri, "~", NULL);
-      res = smbc_rename (op_backend->smb_context, dest_uri,
-					     op_backend->smb_context, backup_uri);
+      res = smbc_rename (ctx->context, dest_uri,
+					     ctx->context, backup_uri);
       if (res == -1)
 	{
+	  smb_context_release (ctx);
 	  g_vfs_job_failed (G_VFS_JOB (job),
 			    G_IO_ERROR,
 			    G_IO_ERROR_CANT_CREATE_BACKUP,
@@ -2237,10 +2464,11 @@ do_move (GVfsBackend *backend,
     {
       /* Source is a dir, destination exists (and is not a dir, because that would have failed
 	 earlier), and we're overwriting. Manually remove the target so we can do the rename. */
-      res = smbc_unlink (op_backend->smb_context, dest_uri);
+      res = smbc_unlink (ctx->context, dest_uri);
       errsv = errno;
       if (res == -1)
 	{
+	  smb_context_release (ctx);
 	  g_vfs_job_failed (G_VFS_JOB (job), G_IO_ERROR,
 			    g_io_error_from_errno (errsv),
 			    _("Error removing target file: %s"),
@@ -2252,9 +2480,10 @@ do_move (GVfsBackend *backend,
     }
 
   
-  res = smbc_rename (op_backend->smb_context, source_uri,
-					 op_backend->smb_context, dest_uri);
+  res = smbc_rename (ctx->context, source_uri,
+					 ctx->context, dest_uri);
   errsv = errno;
+  smb_context_release (ctx);
   g_free (source_uri);
   g_free (dest_uri);
 
@@ -2291,6 +2520,665 @@ do_move (GVfsBackend *backend,
     }
 }
 
+/* libsmbclient splits large reads and writes into several SMB2 requests
+ * that are kept in flight at the same time, so big buffers pay off. */
+#define TRANSFER_BUFFER_SIZE (1024 * 1024)
+
+/* Directories are refused here with the same errors the generic
+ * fallback would end up with (G_IO_ERROR_WOULD_RECURSE and
+ * G_IO_ERROR_WOULD_MERGE), so callers recurse on their own as usual.
+ * Only the cases the fallback can actually handle differently, like
+ * backups, symlinks, special files and copying a file onto itself, are
+ * failed with G_IO_ERROR_NOT_SUPPORTED. */
+static gboolean
+validate_copy (GVfsJob *job,
+               gboolean source_is_dir,
+               gboolean dest_exists,
+               gboolean dest_is_dir,
+               GFileCopyFlags flags)
+{
+  if (dest_exists)
+    {
+      if (!(flags & G_FILE_COPY_OVERWRITE))
+        {
+          g_vfs_job_failed_literal (job,
+                                    G_IO_ERROR, G_IO_ERROR_EXISTS,
+                                    _("Target file already exists"));
+          return FALSE;
+        }
+
+      if (dest_is_dir)
+        {
+          if (source_is_dir)
+            g_vfs_job_failed_literal (job,
+                                      G_IO_ERROR, G_IO_ERROR_WOULD_MERGE,
+                                      _("Can’t copy directory over directory"));
+          else
+            g_vfs_job_failed_literal (job,
+                                      G_IO_ERROR, G_IO_ERROR_IS_DIRECTORY,
+                                      _("Target is a directory"));
+          return FALSE;
+        }
+    }
+
+  if (source_is_dir)
+    {
+      g_vfs_job_failed_literal (job,
+                                G_IO_ERROR, G_IO_ERROR_WOULD_RECURSE,
+                                _("Can’t recursively copy directory"));
+      return FALSE;
+    }
+
+  /* Let the generic fallback handle backups, it does them via replace */
+  if (dest_exists && (flags & G_FILE_COPY_BACKUP))
+    {
+      g_vfs_job_failed_literal (job,
+                                G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                                _("Operation not supported"));
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static void
+set_error_from_errno (GError **error,
+                      int errsv)
+{
+  g_set_error_literal (error, G_IO_ERROR,
+                       g_io_error_from_errno (errsv),
+                       g_strerror (errsv));
+}
+
+/* Push and copy write to a temporary file next to the destination, so
+ * that a failed or cancelled transfer leaves an existing file alone.
+ * Without one, the fallback has to deal with the destination. */
+static SMBCFILE *
+open_transfer_tmpfile (SMBCCTX *context,
+                       const char *uri,
+                       char **tmp_uri_out,
+                       GError **error)
+{
+  SMBCFILE *file;
+
+  file = open_tmpfile (context, uri, tmp_uri_out);
+  if (file == NULL)
+    {
+      g_debug ("open_transfer_tmpfile - can't create temporary file: %s\n",
+               g_strerror (errno));
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                           _("Operation not supported"));
+    }
+
+  return file;
+}
+
+/* Moves the completely written temporary file over the destination */
+static gboolean
+commit_transfer_tmpfile (SMBCCTX *context,
+                         const char *tmp_uri,
+                         const char *uri,
+                         gboolean dest_exists,
+                         GError **error)
+{
+  smbc_rename_fn smbc_rename;
+  smbc_unlink_fn smbc_unlink;
+
+  smbc_rename = smbc_getFunctionRename (context);
+  smbc_unlink = smbc_getFunctionUnlink (context);
+
+  if (smbc_rename (context, tmp_uri, context, uri) == 0)
+    return TRUE;
+
+  /* Not every server replaces an existing file on rename */
+  if (dest_exists &&
+      smbc_unlink (context, uri) == 0 &&
+      smbc_rename (context, tmp_uri, context, uri) == 0)
+    return TRUE;
+
+  set_error_from_errno (error, errno);
+  return FALSE;
+}
+
+static void
+do_pull (GVfsBackend *backend,
+         GVfsJobPull *job,
+         const char *source,
+         const char *local_path,
+         GFileCopyFlags flags,
+         gboolean remove_source,
+         GFileProgressCallback progress_callback,
+         gpointer progress_callback_data)
+{
+  GVfsBackendSmb *op_backend = G_VFS_BACKEND_SMB (backend);
+  GCancellable *cancellable = G_VFS_JOB (job)->cancellable;
+  SmbContext *ctx;
+  GFile *local_file;
+  GFileInfo *local_info;
+  GFileOutputStream *stream = NULL;
+  GError *error = NULL;
+  SMBCFILE *file = NULL;
+  struct stat st;
+  char *uri, *buffer = NULL;
+  gboolean dest_exists, dest_is_dir;
+  goffset transferred = 0;
+  ssize_t res;
+  smbc_stat_fn smbc_stat;
+  smbc_open_fn smbc_open;
+  smbc_read_fn smbc_read;
+  smbc_close_fn smbc_close;
+  smbc_unlink_fn smbc_unlink;
+
+  uri = create_smb_uri (op_backend->server, op_backend->port, op_backend->share, source);
+  local_file = g_file_new_for_path (local_path);
+
+  ctx = smb_context_acquire (op_backend);
+  smbc_stat = smbc_getFunctionStat (ctx->context);
+  smbc_open = smbc_getFunctionOpen (ctx->context);
+  smbc_read = smbc_getFunctionRead (ctx->context);
+  smbc_close = smbc_getFunctionClose (ctx->context);
+  smbc_unlink = smbc_getFunctionUnlink (ctx->context);
+
+  if (smbc_stat (ctx->context, uri, &st) != 0)
+    {
+      set_error_from_errno (&error, errno);
+      goto out;
+    }
+
+  local_info = g_file_query_info (local_file,
+                                  G_FILE_ATTRIBUTE_STANDARD_TYPE,
+                                  G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                  cancellable, &error);
+  if (local_info == NULL && !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+    goto out;
+  g_clear_error (&error);
+
+  dest_exists = local_info != NULL;
+  dest_is_dir = dest_exists &&
+    g_file_info_get_file_type (local_info) == G_FILE_TYPE_DIRECTORY;
+  g_clear_object (&local_info);
+
+  if (!validate_copy (G_VFS_JOB (job), S_ISDIR (st.st_mode),
+                      dest_exists, dest_is_dir, flags))
+    goto out;
+
+  errno = 0;
+  file = smbc_open (ctx->context, uri, O_RDONLY, 0);
+  if (file == NULL)
+    {
+      set_error_from_errno (&error, fixup_open_errno (errno));
+      goto out;
+    }
+
+  stream = g_file_replace (local_file, NULL, FALSE, G_FILE_CREATE_NONE,
+                           cancellable, &error);
+  if (stream == NULL)
+    goto out;
+
+  buffer = g_malloc (TRANSFER_BUFFER_SIZE);
+  while (!g_cancellable_set_error_if_cancelled (cancellable, &error))
+    {
+      res = smbc_read (ctx->context, file, buffer, TRANSFER_BUFFER_SIZE);
+      if (res < 0)
+        {
+          set_error_from_errno (&error, errno);
+          break;
+        }
+      if (res == 0)
+        break;
+
+      if (!g_output_stream_write_all (G_OUTPUT_STREAM (stream), buffer, res,
+                                      NULL, cancellable, &error))
+        break;
+
+      transferred += res;
+      if (progress_callback)
+        progress_callback (transferred, st.st_size, progress_callback_data);
+    }
+
+  if (error == NULL)
+    g_output_stream_close (G_OUTPUT_STREAM (stream), cancellable, &error);
+  else
+    {
+      GCancellable *abort_cancellable;
+
+      /* Closing a cancelled replace throws the temporary file away
+       * instead of moving it over the destination */
+      abort_cancellable = g_cancellable_new ();
+      g_cancellable_cancel (abort_cancellable);
+      g_output_stream_close (G_OUTPUT_STREAM (stream), abort_cancellable, NULL);
+      g_object_unref (abort_cancellable);
+    }
+  if (error != NULL)
+    goto out;
+
+  /* Failure to copy metadata is not a hard error */
+  if (!(flags & G_FILE_COPY_TARGET_DEFAULT_MODIFIED_TIME))
+    g_file_set_attribute_uint64 (local_file,
+                                 G_FILE_ATTRIBUTE_TIME_MODIFIED, st.st_mtime,
+                                 G_FILE_QUERY_INFO_NONE, cancellable, NULL);
+
+  if (remove_source)
+    {
+      smbc_close (ctx->context, file);
+      file = NULL;
+
+      if (smbc_unlink (ctx->context, uri) != 0)
+        set_error_from_errno (&error, errno);
+    }
+
+ out:
+  if (file != NULL)
+    smbc_close (ctx->context, file);
+  smb_context_release (ctx);
+
+  if (error != NULL)
+    {
+      g_vfs_job_failed_from_error (G_VFS_JOB (job), error);
+      g_error_free (error);
+    }
+  else if (!G_VFS_JOB (job)->failed)
+    g_vfs_job_succeeded (G_VFS_JOB (job));
+
+  g_clear_object (&stream);
+  g_object_unref (local_file);
+  g_free (buffer);
+  g_free (uri);
+}
+
+static void
+do_push (GVfsBackend *backend,
+         GVfsJobPush *job,
+         const char *destination,
+         const char *local_path,
+         GFileCopyFlags flags,
+         gboolean remove_source,
+         GFileProgressCallback progress_callback,
+         gpointer progress_callback_data)
+{
+  GVfsBackendSmb *op_backend = G_VFS_BACKEND_SMB (backend);
+  GCancellable *cancellable = G_VFS_JOB (job)->cancellable;
+  SmbContext *ctx;
+  GFile *local_file;
+  GFileInfo *local_info;
+  GFileInputStream *stream = NULL;
+  GFileType type;
+  GError *error = NULL;
+  SMBCFILE *file = NULL;
+  struct stat st;
+  struct timeval tbuf[2];
+  char *uri, *tmp_uri = NULL, *buffer = NULL, *p;
+  gboolean dest_exists;
+  goffset size, mtime, transferred = 0;
+  gssize n_read;
+  ssize_t res;
+  smbc_stat_fn smbc_stat;
+  smbc_write_fn smbc_write;
+  smbc_close_fn smbc_close;
+  smbc_unlink_fn smbc_unlink;
+  smbc_utimes_fn smbc_utimes;
+
+  uri = create_smb_uri (op_backend->server, op_backend->port, op_backend->share, destination);
+  local_file = g_file_new_for_path (local_path);
+
+  ctx = smb_context_acquire (op_backend);
+  smbc_stat = smbc_getFunctionStat (ctx->context);
+  smbc_write = smbc_getFunctionWrite (ctx->context);
+  smbc_close = smbc_getFunctionClose (ctx->context);
+  smbc_unlink = smbc_getFunctionUnlink (ctx->context);
+  smbc_utimes = smbc_getFunctionUtimes (ctx->context);
+
+  local_info = g_file_query_info (local_file,
+                                  G_FILE_ATTRIBUTE_STANDARD_TYPE ","
+                                  G_FILE_ATTRIBUTE_STANDARD_SIZE ","
+                                  G_FILE_ATTRIBUTE_TIME_MODIFIED,
+                                  (flags & G_FILE_COPY_NOFOLLOW_SYMLINKS) ?
+                                  G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS : 0,
+                                  cancellable, &error);
+  if (local_info == NULL)
+    goto out;
+
+  type = g_file_info_get_file_type (local_info);
+  size = g_file_info_get_size (local_info);
+  mtime = g_file_info_get_attribute_uint64 (local_info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+  g_object_unref (local_info);
+
+  /* Symlinks and special files are left to the generic fallback */
+  if (type != G_FILE_TYPE_REGULAR && type != G_FILE_TYPE_DIRECTORY)
+    {
+      g_set_error_literal (&error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                           _("Operation not supported"));
+      goto out;
+    }
+
+  dest_exists = smbc_stat (ctx->context, uri, &st) == 0;
+  if (!validate_copy (G_VFS_JOB (job), type == G_FILE_TYPE_DIRECTORY,
+                      dest_exists, dest_exists && S_ISDIR (st.st_mode), flags))
+    goto out;
+
+  stream = g_file_read (local_file, cancellable, &error);
+  if (stream == NULL)
+    goto out;
+
+  file = open_transfer_tmpfile (ctx->context, uri, &tmp_uri, &error);
+  if (file == NULL)
+    goto out;
+
+  buffer = g_malloc (TRANSFER_BUFFER_SIZE);
+  while (TRUE)
+    {
+      n_read = g_input_stream_read (G_INPUT_STREAM (stream), buffer,
+                                    TRANSFER_BUFFER_SIZE, cancellable, &error);
+      if (n_read <= 0)
+        break;
+
+      p = buffer;
+      while (n_read > 0)
+        {
+          res = smbc_write (ctx->context, file, p, n_read);
+          if (res < 0)
+            {
+              set_error_from_errno (&error, errno);
+              goto out;
+            }
+          n_read -= res;
+          p += res;
+          transferred += res;
+        }
+
+      if (progress_callback)
+        progress_callback (transferred, size, progress_callback_data);
+    }
+  if (error != NULL)
+    goto out;
+
+  /* Errors from delayed writes show up when closing */
+  res = smbc_close (ctx->context, file);
+  file = NULL;
+  if (res != 0)
+    {
+      set_error_from_errno (&error, errno);
+      goto out;
+    }
+
+  if (!commit_transfer_tmpfile (ctx->context, tmp_uri, uri, dest_exists, &error))
+    goto out;
+  g_clear_pointer (&tmp_uri, g_free);
+
+  /* Failure to copy metadata is not a hard error */
+  if (!(flags & G_FILE_COPY_TARGET_DEFAULT_MODIFIED_TIME))
+    {
+      tbuf[1].tv_sec = mtime;
+      tbuf[1].tv_usec = 0;
+      tbuf[0] = tbuf[1];
+      smbc_utimes (ctx->context, uri, &tbuf[0]);
+    }
+
+  if (remove_source)
+    {
+      g_clear_object (&stream);
+      g_file_delete (local_file, cancellable, &error);
+    }
+
+ out:
+  if (file != NULL)
+    smbc_close (ctx->context, file);
+  if (tmp_uri != NULL)
+    smbc_unlink (ctx->context, tmp_uri);
+  smb_context_release (ctx);
+
+  if (error != NULL)
+    {
+      g_vfs_job_failed_from_error (G_VFS_JOB (job), error);
+      g_error_free (error);
+    }
+  else if (!G_VFS_JOB (job)->failed)
+    g_vfs_job_succeeded (G_VFS_JOB (job));
+
+  g_clear_object (&stream);
+  g_object_unref (local_file);
+  g_free (buffer);
+  g_free (tmp_uri);
+  g_free (uri);
+}
+
+typedef struct {
+  GVfsJob *job;
+  goffset total;
+  GFileProgressCallback progress_callback;
+  gpointer progress_callback_data;
+} CopyProgress;
+
+#ifdef HAVE_SMBC_SPLICE
+static int
+copy_splice_cb (off_t n,
+                void *priv)
+{
+  CopyProgress *progress = priv;
+
+  if (progress->progress_callback)
+    progress->progress_callback (n, progress->total,
+                                 progress->progress_callback_data);
+
+  /* Non-zero keeps the server-side copy going */
+  return !g_vfs_job_is_cancelled (progress->job);
+}
+#endif
+
+static gboolean
+copy_data (SMBCCTX *context,
+           SMBCFILE *from_file,
+           SMBCFILE *to_file,
+           CopyProgress *progress,
+           GError **error)
+{
+  smbc_read_fn smbc_read;
+  smbc_write_fn smbc_write;
+  goffset transferred = 0;
+  char *buffer, *p;
+  ssize_t res, n_read;
+  gboolean succeeded = FALSE;
+
+  smbc_read = smbc_getFunctionRead (context);
+  smbc_write = smbc_getFunctionWrite (context);
+
+  buffer = g_malloc (TRANSFER_BUFFER_SIZE);
+  while (!g_cancellable_set_error_if_cancelled (progress->job->cancellable, error))
+    {
+      n_read = smbc_read (context, from_file, buffer, TRANSFER_BUFFER_SIZE);
+      if (n_read < 0)
+        {
+          set_error_from_errno (error, errno);
+          break;
+        }
+      if (n_read == 0)
+        {
+          succeeded = TRUE;
+          break;
+        }
+
+      p = buffer;
+      while (n_read > 0)
+        {
+          res = smbc_write (context, to_file, p, n_read);
+          if (res < 0)
+            {
+              set_error_from_errno (error, errno);
+              goto out;
+            }
+          n_read -= res;
+          p += res;
+          transferred += res;
+        }
+
+      if (progress->progress_callback)
+        progress->progress_callback (transferred, progress->total,
+                                     progress->progress_callback_data);
+    }
+
+ out:
+  g_free (buffer);
+  return succeeded;
+}
+
+static void
+do_copy (GVfsBackend *backend,
+         GVfsJobCopy *job,
+         const char *source,
+         const char *destination,
+         GFileCopyFlags flags,
+         GFileProgressCallback progress_callback,
+         gpointer progress_callback_data)
+{
+  GVfsBackendSmb *op_backend = G_VFS_BACKEND_SMB (backend);
+  SmbContext *ctx;
+  CopyProgress progress;
+  GError *error = NULL;
+  SMBCFILE *from_file = NULL, *to_file = NULL;
+  struct stat source_st, dest_st;
+  struct timeval tbuf[2];
+  char *source_uri, *dest_uri, *tmp_uri = NULL;
+  gboolean dest_exists, copied;
+  int res;
+  smbc_stat_fn smbc_stat;
+  smbc_open_fn smbc_open;
+  smbc_close_fn smbc_close;
+  smbc_unlink_fn smbc_unlink;
+  smbc_utimes_fn smbc_utimes;
+#ifdef HAVE_SMBC_SPLICE
+  smbc_splice_fn smbc_splice;
+  smbc_lseek_fn smbc_lseek;
+#endif
+
+  source_uri = create_smb_uri (op_backend->server, op_backend->port, op_backend->share, source);
+  dest_uri = create_smb_uri (op_backend->server, op_backend->port, op_backend->share, destination);
+
+  ctx = smb_context_acquire (op_backend);
+  smbc_stat = smbc_getFunctionStat (ctx->context);
+  smbc_open = smbc_getFunctionOpen (ctx->context);
+  smbc_close = smbc_getFunctionClose (ctx->context);
+  smbc_unlink = smbc_getFunctionUnlink (ctx->context);
+  smbc_utimes = smbc_getFunctionUtimes (ctx->context);
+
+  if (smbc_stat (ctx->context, source_uri, &source_st) != 0)
+    {
+      set_error_from_errno (&error, errno);
+      goto out;
+    }
+
+  dest_exists = smbc_stat (ctx->context, dest_uri, &dest_st) == 0;
+  if (!validate_copy (G_VFS_JOB (job), S_ISDIR (source_st.st_mode),
+                      dest_exists, dest_exists && S_ISDIR (dest_st.st_mode), flags))
+    goto out;
+
+  /* Replacing the destination would remove the source, leave this to
+   * the fallback */
+  if (dest_exists &&
+      source_st.st_dev == dest_st.st_dev &&
+      source_st.st_ino == dest_st.st_ino)
+    {
+      g_set_error_literal (&error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                           _("Operation not supported"));
+      goto out;
+    }
+
+  errno = 0;
+  from_file = smbc_open (ctx->context, source_uri, O_RDONLY, 0);
+  if (from_file == NULL)
+    {
+      set_error_from_errno (&error, fixup_open_errno (errno));
+      goto out;
+    }
+
+  to_file = open_transfer_tmpfile (ctx->context, dest_uri, &tmp_uri, &error);
+  if (to_file == NULL)
+    goto out;
+
+  progress.job = G_VFS_JOB (job);
+  progress.total = source_st.st_size;
+  progress.progress_callback = progress_callback;
+  progress.progress_callback_data = progress_callback_data;
+
+  copied = FALSE;
+#ifdef HAVE_SMBC_SPLICE
+  /* Both files live on the same share, so let the server copy the data
+   * (FSCTL_SRV_COPYCHUNK) instead of moving it through this process.
+   */
+  smbc_splice = smbc_getFunctionSplice (ctx->context);
+  if (smbc_splice (ctx->context, from_file, to_file, source_st.st_size,
+                   copy_splice_cb, &progress) == source_st.st_size)
+    copied = TRUE;
+  else if (g_vfs_job_is_cancelled (G_VFS_JOB (job)))
+    {
+      g_set_error_literal (&error, G_IO_ERROR, G_IO_ERROR_CANCELLED,
+                           _("Operation was cancelled"));
+      goto out;
+    }
+  else
+    {
+      g_debug ("do_copy - server-side copy failed (%s), copying locally\n",
+               g_strerror (errno));
+
+      smbc_lseek = smbc_getFunctionLseek (ctx->context);
+      if (smbc_lseek (ctx->context, from_file, 0, SEEK_SET) == (off_t) -1 ||
+          smbc_lseek (ctx->context, to_file, 0, SEEK_SET) == (off_t) -1)
+        {
+          set_error_from_errno (&error, errno);
+          goto out;
+        }
+    }
+#endif
+
+  if (!copied && !copy_data (ctx->context, from_file, to_file, &progress, &error))
+    goto out;
+
+  res = smbc_close (ctx->context, to_file);
+  to_file = NULL;
+  if (res != 0)
+    {
+      set_error_from_errno (&error, errno);
+      goto out;
+    }
+
+  if (!commit_transfer_tmpfile (ctx->context, tmp_uri, dest_uri, dest_exists, &error))
+    goto out;
+  g_clear_pointer (&tmp_uri, g_free);
+
+  /* Failure to copy metadata is not a hard error */
+  if (!(flags & G_FILE_COPY_TARGET_DEFAULT_MODIFIED_TIME))
+    {
+      tbuf[1].tv_sec = source_st.st_mtime;
+      tbuf[1].tv_usec = 0;
+      tbuf[0] = tbuf[1];
+      smbc_utimes (ctx->context, dest_uri, &tbuf[0]);
+    }
+
+  if (progress_callback)
+    progress_callback (source_st.st_size, source_st.st_size,
+                       progress_callback_data);
+
+ out:
+  if (to_file != NULL)
+    smbc_close (ctx->context, to_file);
+  if (tmp_uri != NULL)
+    smbc_unlink (ctx->context, tmp_uri);
+  if (from_file != NULL)
+    smbc_close (ctx->context, from_file);
+  smb_context_release (ctx);
+
+  if (error != NULL)
+    {
+      g_vfs_job_failed_from_error (G_VFS_JOB (job), error);
+      g_error_free (error);
+    }
+  else if (!G_VFS_JOB (job)->failed)
+    g_vfs_job_succeeded (G_VFS_JOB (job));
+
+  g_free (source_uri);
+  g_free (dest_uri);
+  g_free (tmp_uri);
+}
+
 static void
 g_vfs_backend_smb_class_init (GVfsBackendSmbClass *klass)
 {
@@ -2323,6 +3211,9 @@ g_vfs_backend_smb_class_init (GVfsBackendSmbClass *klass)
   backend_class->delete = do_delete;
   backend_class->make_directory = do_make_directory;
   backend_class->move = do_move;
+  backend_class->copy = do_copy;
+  backend_class->push = do_push;
+  backend_class->pull = do_pull;
   backend_class->try_query_settable_attributes = try_query_settable_attributes;
   backend_class->set_attribute = do_set_attribute;
 }
@@ -2331,4 +3222,9 @@ void
 g_vfs_smb_daemon_init (void)
 {
   g_set_application_name (_("Windows Shares File System Service"));
+
+#if MAX_SMB_CONTEXTS > 1
+  /* The contexts are used from several job threads at once */
+  smbc_thread_posix ();
+#endif
 }
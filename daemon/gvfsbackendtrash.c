@@ -1037,6 +1037,7 @@ g_vfs_backend_trash_init (GVfsBackendTrash *backend)
   g_vfs_backend_set_icon_name (vfs_backend, "user-trash");
   g_vfs_backend_set_symbolic_icon_name (vfs_backend, "user-trash-symbolic");
   g_vfs_backend_set_user_visible (vfs_backend, FALSE);
+  g_vfs_backend_set_shared_read_memory (vfs_backend, TRUE);
 
   mount_spec = g_mount_spec_new ("trash");
   g_vfs_backend_set_mount_spec (vfs_backend, mount_spec);
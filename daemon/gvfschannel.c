@@ -54,13 +54,19 @@ enum {
   PROP_ACTUAL_CONSUMER
 };
 
+/* Requests are read in chunks of this size, so that all the requests
+ * queued up by the client are picked up with one read. Payloads that
+ * don't fit are read directly into their own buffer.
+ */
+#define REQUEST_READ_BUFFER_SIZE (64*1024)
+
 typedef struct
 {
   GVfsChannel *channel;
   GInputStream *command_stream;
   GCancellable *cancellable;
-  char buffer[G_VFS_DAEMON_SOCKET_PROTOCOL_REQUEST_SIZE];
-  int buffer_size;
+  char buffer[REQUEST_READ_BUFFER_SIZE];
+  gsize buffer_size;
   char *data;
   gsize data_len;
   gsize data_pos;
@@ -89,12 +95,16 @@ struct _GVfsChannelPrivate
   
   GVfsBackendHandle backend_handle;
   GVfsJob *current_job;
+  /* The current job answers the requests from first_seq_nr to
+   * current_job_seq_nr, more than one if requests were merged */
   guint32 current_job_seq_nr;
+  guint32 current_job_first_seq_nr;
 
   GList *queued_requests;
   
   char reply_buffer[G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_SIZE];
   int reply_buffer_pos;
+  GOutputVector reply_vectors[2];
   
   /* output_data is owned by the channel if output_data_free is set,
    * otherwise it is owned by the job. */
@@ -102,6 +112,12 @@ struct _GVfsChannelPrivate
   char *output_data_free;
   gsize output_data_size;
   gsize output_data_pos;
+
+  /* Statistics, to see how well socket i/o is batched */
+  guint64 n_requests;
+  guint64 n_request_reads;
+  guint64 n_replies;
+  guint64 n_reply_writes;
 };
 
 G_DEFINE_TYPE_WITH_CODE (GVfsChannel, g_vfs_channel, G_TYPE_OBJECT,
@@ -127,6 +143,12 @@ g_vfs_channel_finalize (GObject *object)
 
   channel = G_VFS_CHANNEL (object);
 
+  g_debug ("channel %p: %" G_GUINT64_FORMAT " requests in %" G_GUINT64_FORMAT " reads, "
+           "%" G_GUINT64_FORMAT " replies in %" G_GUINT64_FORMAT " writes\n",
+           channel,
+           channel->priv->n_requests, channel->priv->n_request_reads,
+           channel->priv->n_replies, channel->priv->n_reply_writes);
+
   if (channel->priv->current_job)
     g_object_unref (channel->priv->current_job);
   channel->priv->current_job = NULL;
@@ -282,6 +304,7 @@ g_vfs_channel_connection_closed (GVfsChannel *channel)
       
       channel->priv->current_job = class->close (channel);
       channel->priv->current_job_seq_nr = 0;
+      channel->priv->current_job_first_seq_nr = 0;
       g_vfs_job_source_new_job (G_VFS_JOB_SOURCE (channel), channel->priv->current_job);
     }
   /* Otherwise we'll close when current_job is finished */
@@ -319,6 +342,10 @@ start_queued_request (GVfsChannel *channel)
 	g_list_delete_link (channel->priv->queued_requests,
 			    channel->priv->queued_requests);
 
+      /* Set early, handle_request may take over later requests */
+      channel->priv->current_job_seq_nr = req->seq_nr;
+      channel->priv->current_job_first_seq_nr = req->seq_nr;
+
       error = NULL;
       if (!g_vfs_backend_get_block_requests (channel->priv->backend))
         {
@@ -354,7 +381,6 @@ start_queued_request (GVfsChannel *channel)
 	}
 
       channel->priv->current_job = job;
-      channel->priv->current_job_seq_nr = req->seq_nr;
       g_vfs_job_source_new_job (G_VFS_JOB_SOURCE (channel), channel->priv->current_job);
       started_job = TRUE;
 
@@ -364,6 +390,43 @@ start_queued_request (GVfsChannel *channel)
   return started_job;
 }
 
+/* Called from handle_request to merge the next queued request into the
+ * job being created. Only takes a request for the given command that
+ * carries at most max_data_len bytes. The reply of the current job
+ * then answers the taken request (and all earlier ones).
+ */
+gboolean
+g_vfs_channel_take_queued_request (GVfsChannel *channel,
+				   guint32 command,
+				   gsize max_data_len,
+				   gpointer *data,
+				   gsize *data_len)
+{
+  Request *req;
+
+  if (channel->priv->queued_requests == NULL ||
+      g_vfs_backend_get_block_requests (channel->priv->backend))
+    return FALSE;
+
+  req = channel->priv->queued_requests->data;
+  if (req->command != command ||
+      req->cancelled ||
+      req->data_len > max_data_len)
+    return FALSE;
+
+  channel->priv->queued_requests =
+    g_list_delete_link (channel->priv->queued_requests,
+			channel->priv->queued_requests);
+  channel->priv->current_job_seq_nr = req->seq_nr;
+
+  /* Pass on ownership of the data */
+  *data = req->data;
+  *data_len = req->data_len;
+  g_free (req);
+
+  return TRUE;
+}
+
 
 /* Ownership of data is passed here to avoid copying it */
 static void
@@ -371,17 +434,22 @@ got_request (GVfsChannel *channel,
 	     GVfsDaemonSocketProtocolRequest *request,
 	     gpointer data, gsize data_len)
 {
+  GVfsChannelClass *class;
   Request *req;
   guint32 command, arg1;
   GList *l;
 
+  channel->priv->n_requests++;
+
   command = g_ntohl (request->command);
   arg1 = g_ntohl (request->arg1);
 
   if (command == G_VFS_DAEMON_SOCKET_PROTOCOL_REQUEST_CANCEL)
     {
-      if (arg1 == channel->priv->current_job_seq_nr &&
-	  channel->priv->current_job != NULL)
+      /* Sequence numbers only grow, the subtraction handles wrapping */
+      if (channel->priv->current_job != NULL &&
+	  arg1 - channel->priv->current_job_first_seq_nr <=
+	  channel->priv->current_job_seq_nr - channel->priv->current_job_first_seq_nr)
 	g_vfs_job_cancel (channel->priv->current_job);
       else
 	{
@@ -406,6 +474,15 @@ got_request (GVfsChannel *channel,
       g_free (data);
       return;
     }
+
+  class = G_VFS_CHANNEL_GET_CLASS (channel);
+  if (class->handle_hint != NULL &&
+      class->handle_hint (channel, command, arg1, g_ntohl (request->arg2)))
+    {
+      /* Neither do hints */
+      g_free (data);
+      return;
+    }
   
   req = g_new0 (Request, 1);
   req->command = command;
@@ -425,28 +502,80 @@ got_request (GVfsChannel *channel,
 static void command_read_cb (GObject *source_object,
 			     GAsyncResult *res,
 			     gpointer user_data);
-
+static void data_read_cb    (GObject *source_object,
+			     GAsyncResult *res,
+			     gpointer user_data);
 
 static void
-finish_request (RequestReader *reader)
+read_more_requests (RequestReader *reader)
 {
-  /* Ownership of reader->data passed here */
-  got_request (reader->channel, (GVfsDaemonSocketProtocolRequest *)reader->buffer,
-	       reader->data, reader->data_len);
-  reader->data = NULL;
-  
-  /* Request more commands immediately, so can get cancel requests */
-
-  reader->buffer_size = 0;
-  reader->data_len = 0;
   g_input_stream_read_async (reader->command_stream,
 			     reader->buffer + reader->buffer_size,
-			     G_VFS_DAEMON_SOCKET_PROTOCOL_REQUEST_SIZE - reader->buffer_size,
+			     REQUEST_READ_BUFFER_SIZE - reader->buffer_size,
 			     0, reader->cancellable,
 			     command_read_cb,
 			     reader);
 }
 
+/* Handles all complete requests in the buffer, then reads more */
+static void
+process_requests (RequestReader *reader)
+{
+  GVfsDaemonSocketProtocolRequest request;
+  gsize pos, available;
+  guint32 data_len;
+  char *data;
+
+  pos = 0;
+  while (reader->buffer_size - pos >= G_VFS_DAEMON_SOCKET_PROTOCOL_REQUEST_SIZE)
+    {
+      memcpy (&request, reader->buffer + pos, G_VFS_DAEMON_SOCKET_PROTOCOL_REQUEST_SIZE);
+      data_len = g_ntohl (request.data_len);
+      available = reader->buffer_size - pos - G_VFS_DAEMON_SOCKET_PROTOCOL_REQUEST_SIZE;
+
+      if (data_len > available)
+	{
+	  if (G_VFS_DAEMON_SOCKET_PROTOCOL_REQUEST_SIZE + (gsize) data_len <= REQUEST_READ_BUFFER_SIZE)
+	    break;
+
+	  /* Too large for the buffer, keep the header and read the
+	     rest of the data into its own block */
+	  reader->data = g_malloc (data_len);
+	  reader->data_len = data_len;
+	  reader->data_pos = available;
+	  memcpy (reader->data,
+		  reader->buffer + pos + G_VFS_DAEMON_SOCKET_PROTOCOL_REQUEST_SIZE,
+		  available);
+	  memmove (reader->buffer, reader->buffer + pos,
+		   G_VFS_DAEMON_SOCKET_PROTOCOL_REQUEST_SIZE);
+	  reader->buffer_size = G_VFS_DAEMON_SOCKET_PROTOCOL_REQUEST_SIZE;
+
+	  g_input_stream_read_async (reader->command_stream,
+				     reader->data + reader->data_pos,
+				     reader->data_len - reader->data_pos,
+				     0, reader->cancellable,
+				     data_read_cb, reader);
+	  return;
+	}
+
+      data = NULL;
+      if (data_len > 0)
+	data = g_memdup2 (reader->buffer + pos + G_VFS_DAEMON_SOCKET_PROTOCOL_REQUEST_SIZE,
+			  data_len);
+      pos += G_VFS_DAEMON_SOCKET_PROTOCOL_REQUEST_SIZE + data_len;
+
+      /* Ownership of data passed here */
+      got_request (reader->channel, &request, data, data_len);
+    }
+
+  /* Keep the partial request, and request more commands immediately
+     so we can get cancel requests */
+  memmove (reader->buffer, reader->buffer + pos, reader->buffer_size - pos);
+  reader->buffer_size -= pos;
+
+  read_more_requests (reader);
+}
+
 static void
 data_read_cb (GObject *source_object,
 	      GAsyncResult *res,
@@ -454,6 +583,7 @@ data_read_cb (GObject *source_object,
 {
   RequestReader *reader = user_data;
   GInputStream *stream = G_INPUT_STREAM (source_object);
+  GVfsDaemonSocketProtocolRequest request;
   gssize count_read;
 
   count_read = g_input_stream_read_finish (stream, res, NULL);
@@ -465,6 +595,7 @@ data_read_cb (GObject *source_object,
       return;
     }
 
+  reader->channel->priv->n_request_reads++;
   reader->data_pos += count_read;
 
   if (reader->data_pos < reader->data_len)
@@ -476,10 +607,16 @@ data_read_cb (GObject *source_object,
 				 data_read_cb, reader);
       return;
     }
-  
-  finish_request (reader);
+
+  /* Ownership of reader->data passed here */
+  memcpy (&request, reader->buffer, G_VFS_DAEMON_SOCKET_PROTOCOL_REQUEST_SIZE);
+  got_request (reader->channel, &request, reader->data, reader->data_len);
+  reader->data = NULL;
+  reader->data_len = 0;
+  reader->buffer_size = 0;
+
+  read_more_requests (reader);
 }
-  
 
 static void
 command_read_cb (GObject *source_object,
@@ -488,8 +625,6 @@ command_read_cb (GObject *source_object,
 {
   GInputStream *stream = G_INPUT_STREAM (source_object);
   RequestReader *reader = user_data;
-  GVfsDaemonSocketProtocolRequest *request;
-  guint32 data_len;
   gssize count_read;
 
   count_read = g_input_stream_read_finish (stream, res, NULL);
@@ -501,36 +636,10 @@ command_read_cb (GObject *source_object,
       return;
     }
 
+  reader->channel->priv->n_request_reads++;
   reader->buffer_size += count_read;
 
-  if (reader->buffer_size < G_VFS_DAEMON_SOCKET_PROTOCOL_REQUEST_SIZE)
-    {
-      g_input_stream_read_async (reader->command_stream,
-				 reader->buffer + reader->buffer_size,
-				 G_VFS_DAEMON_SOCKET_PROTOCOL_REQUEST_SIZE - reader->buffer_size,
-				 0, reader->cancellable,
-				 command_read_cb, reader);
-      return;
-    }
-
-  request = (GVfsDaemonSocketProtocolRequest *)reader->buffer;
-  data_len  = g_ntohl (request->data_len);
-
-  if (data_len > 0)
-    {
-      reader->data = g_malloc (data_len);
-      reader->data_len = data_len;
-      reader->data_pos = 0;
-
-      g_input_stream_read_async (reader->command_stream,
-				 reader->data + reader->data_pos,
-				 reader->data_len - reader->data_pos,
-				 0, reader->cancellable,
-				 data_read_cb, reader);
-      return;
-    }
-  
-  finish_request (reader);
+  process_requests (reader);
 }
 
 static void
@@ -542,12 +651,42 @@ start_request_reader (GVfsChannel *channel)
   reader->channel = g_object_ref (channel);
   reader->cancellable = g_object_ref (channel->priv->cancellable);
   reader->command_stream = g_object_ref (channel->priv->command_stream);
-  
-  g_input_stream_read_async (reader->command_stream,
-			     reader->buffer + reader->buffer_size,
-			     G_VFS_DAEMON_SOCKET_PROTOCOL_REQUEST_SIZE - reader->buffer_size,
-			     0, reader->cancellable,
-			     command_read_cb, reader);
+
+  read_more_requests (reader);
+}
+
+static void finish_current_job (GVfsChannel *channel);
+
+static void send_reply_cb (GObject *source_object,
+			   GAsyncResult *res,
+			   gpointer user_data);
+
+/* Writes what is left of the reply header and the data in one go */
+static void
+write_reply (GVfsChannel *channel)
+{
+  GOutputVector *vectors = channel->priv->reply_vectors;
+  guint n_vectors;
+
+  n_vectors = 0;
+  if (channel->priv->reply_buffer_pos < G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_SIZE)
+    {
+      vectors[n_vectors].buffer = channel->priv->reply_buffer + channel->priv->reply_buffer_pos;
+      vectors[n_vectors].size = G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_SIZE - channel->priv->reply_buffer_pos;
+      n_vectors++;
+    }
+  if (channel->priv->output_data != NULL &&
+      channel->priv->output_data_pos < channel->priv->output_data_size)
+    {
+      vectors[n_vectors].buffer = channel->priv->output_data + channel->priv->output_data_pos;
+      vectors[n_vectors].size = channel->priv->output_data_size - channel->priv->output_data_pos;
+      n_vectors++;
+    }
+
+  g_output_stream_writev_async (channel->priv->reply_stream,
+				vectors, n_vectors,
+				0, NULL,
+				send_reply_cb, channel);
 }
 
 static void
@@ -556,47 +695,42 @@ send_reply_cb (GObject *source_object,
 	       gpointer user_data)
 {
   GOutputStream *output_stream = G_OUTPUT_STREAM (source_object);
-  gssize bytes_written;
+  gsize bytes_written;
+  gsize header_left;
   GVfsChannel *channel = user_data;
-  GVfsChannelClass *class;
-  GVfsJob *job;
 
-  bytes_written = g_output_stream_write_finish (output_stream, res, NULL);
-  
-  if (bytes_written <= 0)
+  if (!g_output_stream_writev_finish (output_stream, res, &bytes_written, NULL) ||
+      bytes_written == 0)
     {
       g_vfs_channel_connection_closed (channel);
       goto error_out;
     }
 
-  if (channel->priv->reply_buffer_pos < G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_SIZE)
-    {
-      channel->priv->reply_buffer_pos += bytes_written;
+  channel->priv->n_reply_writes++;
 
-      /* Write more of reply header if needed */
-      if (channel->priv->reply_buffer_pos < G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_SIZE)
+  header_left = G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_SIZE - channel->priv->reply_buffer_pos;
+  if (header_left > 0)
+    {
+      if (bytes_written < header_left)
 	{
-	  g_output_stream_write_async (channel->priv->reply_stream,
-				       channel->priv->reply_buffer + channel->priv->reply_buffer_pos,
-				       G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_SIZE - channel->priv->reply_buffer_pos,
-				       0, NULL,
-				       send_reply_cb, channel);  
-	  return;
+	  channel->priv->reply_buffer_pos += bytes_written;
+	  bytes_written = 0;
+	}
+      else
+	{
+	  channel->priv->reply_buffer_pos = G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_SIZE;
+	  bytes_written -= header_left;
 	}
-      bytes_written = 0;
     }
 
   channel->priv->output_data_pos += bytes_written;
 
-  /* Write more of output_data if needed */
-  if (channel->priv->output_data != NULL &&
-      channel->priv->output_data_pos < channel->priv->output_data_size)
+  /* Write the rest of the reply if needed */
+  if (channel->priv->reply_buffer_pos < G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_SIZE ||
+      (channel->priv->output_data != NULL &&
+       channel->priv->output_data_pos < channel->priv->output_data_size))
     {
-      g_output_stream_write_async (channel->priv->reply_stream,
-				   channel->priv->output_data + channel->priv->output_data_pos,
-				   channel->priv->output_data_size - channel->priv->output_data_pos,
-				   0, NULL,
-				   send_reply_cb, channel);
+      write_reply (channel);
       return;
     }
 
@@ -610,6 +744,15 @@ send_reply_cb (GObject *source_object,
     }
   channel->priv->output_data = NULL;
 
+  finish_current_job (channel);
+}
+
+static void
+finish_current_job (GVfsChannel *channel)
+{
+  GVfsChannelClass *class;
+  GVfsJob *job;
+
   job = channel->priv->current_job;
   channel->priv->current_job = NULL;
   g_vfs_job_emit_finished (job);
@@ -629,8 +772,13 @@ send_reply_cb (GObject *source_object,
 
       channel->priv->current_job = class->close (channel);
       channel->priv->current_job_seq_nr = 0;
+      channel->priv->current_job_first_seq_nr = 0;
       g_vfs_job_source_new_job (G_VFS_JOB_SOURCE (channel), channel->priv->current_job);
     }
+  /* The job didn't reply, continue it under the same seq_nr */
+  else if (class->continue_job != NULL &&
+	   (channel->priv->current_job = class->continue_job (channel, job)) != NULL)
+    g_vfs_job_source_new_job (G_VFS_JOB_SOURCE (channel), channel->priv->current_job);
   /* Start queued request or readahead */
   else if (!start_queued_request (channel) &&
 	   class->readahead)
@@ -638,6 +786,7 @@ send_reply_cb (GObject *source_object,
       /* No queued requests, maybe we want to do a readahead call */
       channel->priv->current_job = class->readahead (channel, job);
       channel->priv->current_job_seq_nr = 0;
+      channel->priv->current_job_first_seq_nr = 0;
       if (channel->priv->current_job)
 	g_vfs_job_source_new_job (G_VFS_JOB_SOURCE (channel), channel->priv->current_job);
     }
@@ -656,27 +805,17 @@ g_vfs_channel_send_reply (GVfsChannel *channel,
   channel->priv->output_data = data;
   channel->priv->output_data_size = data_len;
   channel->priv->output_data_pos = 0;
+  channel->priv->n_replies++;
 
   if (reply != NULL)
     {
       memcpy (channel->priv->reply_buffer, reply, sizeof (GVfsDaemonSocketProtocolReply));
       channel->priv->reply_buffer_pos = 0;
-
-      g_output_stream_write_async (channel->priv->reply_stream,
-				   channel->priv->reply_buffer,
-				   G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_SIZE,
-				   0, NULL,
-				   send_reply_cb, channel);  
     }
   else
-    {
-      channel->priv->reply_buffer_pos = G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_SIZE;
-      g_output_stream_write_async (channel->priv->reply_stream,
-				   channel->priv->output_data,
-				   channel->priv->output_data_size,
-				   0, NULL,
-				   send_reply_cb, channel);  
-    }
+    channel->priv->reply_buffer_pos = G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_SIZE;
+
+  write_reply (channel);
 }
 
 /* Might be called on an i/o thread */
@@ -690,6 +829,27 @@ g_vfs_channel_send_reply_take (GVfsChannel *channel,
   g_vfs_channel_send_reply (channel, reply, data, data_len);
 }
 
+static gboolean
+finish_without_reply_cb (gpointer user_data)
+{
+  GVfsChannel *channel = user_data;
+
+  finish_current_job (channel);
+  g_object_unref (channel);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Might be called on an i/o thread
+ * Finishes the current job without answering its request, the
+ * continue_job class method must then take it over.
+ */
+void
+g_vfs_channel_send_no_reply (GVfsChannel *channel)
+{
+  g_idle_add (finish_without_reply_cb, g_object_ref (channel));
+}
+
 /* Might be called on an i/o thread
  */
 void
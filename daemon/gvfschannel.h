@@ -63,6 +63,15 @@ struct _GVfsChannelClass
 			      GError **error);
   GVfsJob *(*readahead)      (GVfsChannel *channel,
 			      GVfsJob *job);
+  /* Handles requests that get no reply, returns FALSE for other commands */
+  gboolean (*handle_hint)    (GVfsChannel *channel,
+			      guint32 command,
+			      guint32 arg1,
+			      guint32 arg2);
+  /* Returns the job taking over the request of a job that finished
+     without reply, see g_vfs_channel_send_no_reply() */
+  GVfsJob *(*continue_job)   (GVfsChannel *channel,
+			      GVfsJob *job);
 };
 
 GType g_vfs_channel_get_type (void);
@@ -86,6 +95,12 @@ void              g_vfs_channel_send_reply_take    (GVfsChannel
                                                     GVfsDaemonSocketProtocolReply *reply,
                                                     void                          *data,
                                                     gsize                          data_len);
+void              g_vfs_channel_send_no_reply      (GVfsChannel                   *channel);
+gboolean          g_vfs_channel_take_queued_request (GVfsChannel                  *channel,
+						    guint32                        command,
+						    gsize                          max_data_len,
+						    gpointer                      *data,
+						    gsize                         *data_len);
 guint32           g_vfs_channel_get_current_seq_nr (GVfsChannel                   *channel);
 GPid              g_vfs_channel_get_actual_consumer (GVfsChannel                  *channel);
 void              g_vfs_channel_force_close        (GVfsChannel                   *channel);
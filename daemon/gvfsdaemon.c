@@ -55,6 +55,40 @@ enum {
   LAST_SIGNAL
 };
 
+/* Job threads are added when a runnable job had to wait this long for one,
+ * or right away when jobs typically take longer than JOB_LATENCY_GROW. */
+#define JOB_THREADS_MIN 2
+
+/* Upper bound of job threads unless the backend sets MAX_JOB_THREADS */
+#define JOB_THREADS_MAX_DEFAULT 8
+#define JOB_WAIT_GROW_MSECS 50
+#define JOB_LATENCY_GROW (10 * G_TIME_SPAN_MILLISECOND)
+
+/* A queued job moves up one lane after waiting this long in its lane,
+ * so bulk work is delayed but never starved by interactive jobs. */
+#define JOB_AGING_MSECS 500
+
+/* With a single job thread, bulk jobs wait until no other job has been
+ * queued for this long */
+#define JOB_BULK_QUIET_MSECS 100
+
+typedef struct {
+  GVfsJob *job;
+  GVfsBackend *backend; /* NULL if the job is not bound to a backend */
+  gpointer handle;      /* the channel for per-handle jobs */
+  GVfsJobConcurrency concurrency;
+  GVfsJobPriority priority; /* class of the job */
+  GVfsJobPriority lane;     /* lane it is queued in, raised by aging */
+  gint64 queue_time;
+  gint64 lane_time;
+} QueuedJob;
+
+typedef struct {
+  guint n_running;
+  gboolean exclusive;
+  GHashTable *busy_handles;
+} BackendSlots;
+
 typedef struct {
   char *obj_path;
   GVfsRegisterPathCallback callback;
@@ -71,6 +105,19 @@ struct _GVfsDaemon
   gboolean main_daemon;
 
   GThreadPool *thread_pool;
+
+  /* Job scheduling, protected by sched_lock */
+  GMutex sched_lock;
+  GQueue pending_jobs[G_VFS_JOB_N_PRIORITIES];
+  GHashTable *backend_slots; /* GVfsBackend * -> BackendSlots */
+  gint max_threads;
+  guint thread_limit;
+  guint bulk_running;
+  gint64 last_foreground_time; /* last time a non-bulk job was queued */
+  guint grow_timeout_id;
+  guint bulk_timeout_id;
+  GVfsDaemonJobStats stats;
+
   GHashTable *registered_paths;
   GHashTable *client_connections;
   GList *jobs;
@@ -116,6 +163,11 @@ static gboolean          daemon_handle_mount       (GVfsDBusMountable     *objec
                                                     GVariant              *arg_mount_source,
                                                     gpointer               user_data);
 static void              g_vfs_daemon_re_register_job_sources (GVfsDaemon *daemon);
+static void              dispatch_jobs_unlocked    (GVfsDaemon            *daemon);
+static void              queue_job                 (GVfsDaemon            *daemon,
+                                                    GVfsJob               *job,
+                                                    GVfsBackend           *backend,
+                                                    gpointer               handle);
 
 
 
@@ -139,16 +191,39 @@ registered_path_free (RegisteredPath *data)
   g_free (data);
 }
 
+static void
+queued_job_free (QueuedJob *qjob)
+{
+  g_object_unref (qjob->job);
+  g_clear_object (&qjob->backend);
+  g_free (qjob);
+}
+
+static void
+backend_slots_free (BackendSlots *slots)
+{
+  g_hash_table_destroy (slots->busy_handles);
+  g_free (slots);
+}
+
 static void
 g_vfs_daemon_finalize (GObject *object)
 {
   GVfsDaemon *daemon;
+  guint i;
 
   daemon = G_VFS_DAEMON (object);
 
   if (daemon->thread_pool != NULL)
     g_thread_pool_free (daemon->thread_pool, TRUE, FALSE);
 
+  g_clear_handle_id (&daemon->grow_timeout_id, g_source_remove);
+  g_clear_handle_id (&daemon->bulk_timeout_id, g_source_remove);
+  for (i = 0; i < G_VFS_JOB_N_PRIORITIES; i++)
+    g_queue_clear_full (&daemon->pending_jobs[i], (GDestroyNotify) queued_job_free);
+  g_hash_table_destroy (daemon->backend_slots);
+  g_mutex_clear (&daemon->sched_lock);
+
   /* There may be some jobs outstanding if we've been force unmounted. */
   if (daemon->jobs)
     g_warning ("daemon->jobs != NULL when finalizing daemon!");
@@ -198,13 +273,342 @@ g_vfs_daemon_class_init (GVfsDaemonClass *klass)
 		  G_TYPE_NONE, 0);
 }
 
+static BackendSlots *
+lookup_backend_slots (GVfsDaemon *daemon,
+                      GVfsBackend *backend,
+                      gboolean create)
+{
+  BackendSlots *slots;
+
+  slots = g_hash_table_lookup (daemon->backend_slots, backend);
+  if (slots == NULL && create)
+    {
+      slots = g_new0 (BackendSlots, 1);
+      slots->busy_handles = g_hash_table_new (g_direct_hash, g_direct_equal);
+      g_hash_table_insert (daemon->backend_slots, backend, slots);
+    }
+
+  return slots;
+}
+
+static gboolean
+queued_job_can_start (GVfsDaemon *daemon,
+                      QueuedJob *qjob)
+{
+  BackendSlots *slots;
+
+  if (qjob->backend == NULL)
+    return TRUE;
+
+  slots = lookup_backend_slots (daemon, qjob->backend, FALSE);
+  if (slots == NULL)
+    return TRUE;
+
+  if (slots->exclusive)
+    return FALSE;
+
+  switch (qjob->concurrency)
+    {
+    case G_VFS_JOB_CONCURRENCY_EXCLUSIVE:
+      return slots->n_running == 0;
+    case G_VFS_JOB_CONCURRENCY_PER_HANDLE:
+      return qjob->handle == NULL ||
+        !g_hash_table_contains (slots->busy_handles, qjob->handle);
+    case G_VFS_JOB_CONCURRENCY_PARALLEL:
+    default:
+      return TRUE;
+    }
+}
+
+static void
+set_thread_limit_unlocked (GVfsDaemon *daemon,
+                           guint thread_limit)
+{
+  if (thread_limit == daemon->thread_limit)
+    return;
+
+  g_debug ("Job thread limit %u -> %u (queued: %u, running: %u, avg run: %" G_GINT64_FORMAT " us)\n",
+           daemon->thread_limit, thread_limit,
+           daemon->stats.queue_depth, daemon->stats.running,
+           daemon->stats.avg_run_usecs);
+
+  daemon->thread_limit = thread_limit;
+  daemon->stats.thread_limit = thread_limit;
+  g_thread_pool_set_max_threads (daemon->thread_pool, (gint) thread_limit, NULL);
+}
+
+static gboolean
+maybe_grow_unlocked (GVfsDaemon *daemon,
+                     QueuedJob *qjob)
+{
+  gint64 waited;
+
+  if (daemon->thread_limit >= (guint) daemon->max_threads)
+    return FALSE;
+
+  /* Interactive jobs don't wait for the pool to warm up */
+  waited = g_get_monotonic_time () - qjob->queue_time;
+  if (qjob->lane != G_VFS_JOB_PRIORITY_INTERACTIVE &&
+      waited < JOB_WAIT_GROW_MSECS * G_TIME_SPAN_MILLISECOND &&
+      daemon->stats.avg_run_usecs < JOB_LATENCY_GROW)
+    return FALSE;
+
+  set_thread_limit_unlocked (daemon, daemon->thread_limit + 1);
+  return TRUE;
+}
+
+static gboolean
+grow_timeout_cb (gpointer user_data)
+{
+  GVfsDaemon *daemon = G_VFS_DAEMON (user_data);
+
+  g_mutex_lock (&daemon->sched_lock);
+  daemon->grow_timeout_id = 0;
+  dispatch_jobs_unlocked (daemon);
+  g_mutex_unlock (&daemon->sched_lock);
+
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+bulk_timeout_cb (gpointer user_data)
+{
+  GVfsDaemon *daemon = G_VFS_DAEMON (user_data);
+
+  g_mutex_lock (&daemon->sched_lock);
+  daemon->bulk_timeout_id = 0;
+  dispatch_jobs_unlocked (daemon);
+  g_mutex_unlock (&daemon->sched_lock);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Bulk jobs leave one thread free for the other lanes. A single thread
+ * can't be shared like that and a running job can't be preempted, so
+ * there a bulk job starts only once no other job has been queued for
+ * JOB_BULK_QUIET_MSECS. The burst of requests a file manager sends when
+ * showing a folder then completes before a transfer takes the thread.
+ * Jobs that aged out of the bulk lane start regardless. */
+static gboolean
+bulk_job_can_start_unlocked (GVfsDaemon *daemon,
+                             QueuedJob *qjob,
+                             gboolean *deferred)
+{
+  if (daemon->max_threads == 1)
+    {
+      if (qjob->lane != G_VFS_JOB_PRIORITY_BULK ||
+          g_get_monotonic_time () - daemon->last_foreground_time >=
+          JOB_BULK_QUIET_MSECS * G_TIME_SPAN_MILLISECOND)
+        return TRUE;
+
+      *deferred = TRUE;
+      return FALSE;
+    }
+
+  return daemon->bulk_running < MAX (daemon->thread_limit, 2) - 1 ||
+         maybe_grow_unlocked (daemon, qjob);
+}
+
+static void
+start_queued_job_unlocked (GVfsDaemon *daemon,
+                           QueuedJob *qjob)
+{
+  BackendSlots *slots;
+
+  if (qjob->backend != NULL)
+    {
+      slots = lookup_backend_slots (daemon, qjob->backend, TRUE);
+      slots->n_running++;
+      if (qjob->concurrency == G_VFS_JOB_CONCURRENCY_EXCLUSIVE)
+        slots->exclusive = TRUE;
+      else if (qjob->concurrency == G_VFS_JOB_CONCURRENCY_PER_HANDLE &&
+               qjob->handle != NULL)
+        g_hash_table_add (slots->busy_handles, qjob->handle);
+    }
+
+  daemon->stats.running++;
+  if (qjob->priority == G_VFS_JOB_PRIORITY_BULK)
+    daemon->bulk_running++;
+  g_thread_pool_push (daemon->thread_pool, qjob, NULL); /* TODO: Check error */
+}
+
+static void
+age_pending_jobs_unlocked (GVfsDaemon *daemon)
+{
+  QueuedJob *qjob;
+  gint64 now;
+  guint lane;
+
+  now = g_get_monotonic_time ();
+
+  for (lane = G_VFS_JOB_PRIORITY_INTERACTIVE + 1; lane < G_VFS_JOB_N_PRIORITIES; lane++)
+    {
+      while ((qjob = g_queue_peek_head (&daemon->pending_jobs[lane])) != NULL &&
+             now - qjob->lane_time >= JOB_AGING_MSECS * G_TIME_SPAN_MILLISECOND)
+        {
+          g_queue_pop_head (&daemon->pending_jobs[lane]);
+          qjob->lane = lane - 1;
+          qjob->lane_time = now;
+          g_queue_push_tail (&daemon->pending_jobs[lane - 1], qjob);
+          daemon->stats.jobs_aged++;
+        }
+    }
+}
+
+/* Starts as many pending jobs as the backend concurrency declarations
+ * and the current thread limit allow, most urgent lane first and in
+ * queue order within a lane. An exclusive job that has to wait holds
+ * back later jobs of the same backend so it isn't starved. Bulk jobs
+ * are held back as bulk_job_can_start_unlocked() decides. */
+static void
+dispatch_jobs_unlocked (GVfsDaemon *daemon)
+{
+  GList *l, *next;
+  GList *blocked_backends;
+  QueuedJob *qjob;
+  gboolean throttled, bulk_deferred;
+  guint lane;
+
+  age_pending_jobs_unlocked (daemon);
+
+  blocked_backends = NULL;
+  throttled = FALSE;
+  bulk_deferred = FALSE;
+
+  for (lane = 0; lane < G_VFS_JOB_N_PRIORITIES; lane++)
+    {
+      for (l = daemon->pending_jobs[lane].head; l != NULL; l = next)
+        {
+          next = l->next;
+          qjob = l->data;
+
+          if (qjob->backend != NULL &&
+              g_list_find (blocked_backends, qjob->backend) != NULL)
+            continue;
+
+          if (!queued_job_can_start (daemon, qjob))
+            {
+              if (qjob->concurrency == G_VFS_JOB_CONCURRENCY_EXCLUSIVE)
+                blocked_backends = g_list_prepend (blocked_backends, qjob->backend);
+              continue;
+            }
+
+          if (qjob->priority == G_VFS_JOB_PRIORITY_BULK &&
+              !bulk_job_can_start_unlocked (daemon, qjob, &bulk_deferred))
+            {
+              throttled = TRUE;
+              continue;
+            }
+
+          if (daemon->stats.running >= daemon->thread_limit &&
+              !maybe_grow_unlocked (daemon, qjob))
+            {
+              throttled = TRUE;
+              goto out;
+            }
+
+          g_queue_delete_link (&daemon->pending_jobs[lane], l);
+          daemon->stats.queue_depth--;
+          start_queued_job_unlocked (daemon, qjob);
+        }
+    }
+
+ out:
+  g_list_free (blocked_backends);
+
+  if (throttled && daemon->grow_timeout_id == 0 &&
+      daemon->thread_limit < (guint) daemon->max_threads)
+    daemon->grow_timeout_id = g_timeout_add (JOB_WAIT_GROW_MSECS, grow_timeout_cb, daemon);
+
+  if (bulk_deferred && daemon->bulk_timeout_id == 0)
+    daemon->bulk_timeout_id = g_timeout_add (JOB_BULK_QUIET_MSECS, bulk_timeout_cb, daemon);
+}
+
 static void
 job_handler_callback (gpointer       data,
 		      gpointer       user_data)
 {
-  GVfsJob *job = G_VFS_JOB (data);
+  GVfsDaemon *daemon = G_VFS_DAEMON (user_data);
+  QueuedJob *qjob = data;
+  BackendSlots *slots;
+  gint64 start_time, run_time, wait_time;
 
-  g_vfs_job_run (job);
+  start_time = g_get_monotonic_time ();
+  wait_time = start_time - qjob->queue_time;
+
+  g_vfs_job_run (qjob->job);
+
+  run_time = g_get_monotonic_time () - start_time;
+
+  g_mutex_lock (&daemon->sched_lock);
+
+  if (qjob->backend != NULL)
+    {
+      slots = lookup_backend_slots (daemon, qjob->backend, FALSE);
+      slots->n_running--;
+      if (qjob->concurrency == G_VFS_JOB_CONCURRENCY_EXCLUSIVE)
+        slots->exclusive = FALSE;
+      else if (qjob->concurrency == G_VFS_JOB_CONCURRENCY_PER_HANDLE &&
+               qjob->handle != NULL)
+        g_hash_table_remove (slots->busy_handles, qjob->handle);
+
+      if (slots->n_running == 0)
+        g_hash_table_remove (daemon->backend_slots, qjob->backend);
+    }
+
+  daemon->stats.running--;
+  if (qjob->priority == G_VFS_JOB_PRIORITY_BULK)
+    daemon->bulk_running--;
+  daemon->stats.jobs_run++;
+  daemon->stats.total_wait_usecs += wait_time;
+  daemon->stats.max_wait_usecs = MAX (daemon->stats.max_wait_usecs, wait_time);
+  daemon->stats.avg_run_usecs = (daemon->stats.avg_run_usecs * 7 + run_time) / 8;
+
+  /* Give back threads one at a time once the queue has drained */
+  if (daemon->stats.queue_depth == 0 &&
+      daemon->thread_limit > JOB_THREADS_MIN &&
+      daemon->stats.running + 1 < daemon->thread_limit)
+    set_thread_limit_unlocked (daemon, daemon->thread_limit - 1);
+
+  dispatch_jobs_unlocked (daemon);
+
+  g_mutex_unlock (&daemon->sched_lock);
+
+  queued_job_free (qjob);
+}
+
+static void
+queue_job_in_thread (GVfsDaemon *daemon,
+                     GVfsJob *job,
+                     GVfsBackend *backend,
+                     gpointer handle)
+{
+  QueuedJob *qjob;
+
+  qjob = g_new0 (QueuedJob, 1);
+  qjob->job = g_object_ref (job);
+  qjob->priority = g_vfs_job_get_priority (job);
+  qjob->lane = qjob->priority;
+  qjob->queue_time = g_get_monotonic_time ();
+  qjob->lane_time = qjob->queue_time;
+  if (backend != NULL)
+    {
+      qjob->backend = g_object_ref (backend);
+      qjob->handle = handle;
+      qjob->concurrency = g_vfs_backend_get_job_concurrency (backend, job);
+    }
+  else
+    qjob->concurrency = G_VFS_JOB_CONCURRENCY_PARALLEL;
+
+  g_mutex_lock (&daemon->sched_lock);
+  if (qjob->priority != G_VFS_JOB_PRIORITY_BULK)
+    daemon->last_foreground_time = qjob->queue_time;
+  g_queue_push_tail (&daemon->pending_jobs[qjob->lane], qjob);
+  daemon->stats.queue_depth++;
+  daemon->stats.max_queue_depth = MAX (daemon->stats.max_queue_depth,
+                                       daemon->stats.queue_depth);
+  dispatch_jobs_unlocked (daemon);
+  g_mutex_unlock (&daemon->sched_lock);
 }
 
 static void
@@ -284,15 +688,26 @@ static void
 g_vfs_daemon_init (GVfsDaemon *daemon)
 {
   GError *error;
-  gint max_threads = 1; /* TODO: handle max threads */
+  guint i;
 
+  /* The thread limit adapts to the job load, see dispatch_jobs_unlocked() */
+  daemon->max_threads = JOB_THREADS_MAX_DEFAULT;
+  daemon->thread_limit = JOB_THREADS_MIN;
+  daemon->stats.thread_limit = daemon->thread_limit;
   daemon->thread_pool = g_thread_pool_new (job_handler_callback,
 					   daemon,
-					   max_threads,
+					   daemon->thread_limit,
 					   FALSE, NULL);
   /* TODO: verify thread_pool != NULL in a nicer way */
   g_assert (daemon->thread_pool != NULL);
 
+  g_mutex_init (&daemon->sched_lock);
+  for (i = 0; i < G_VFS_JOB_N_PRIORITIES; i++)
+    g_queue_init (&daemon->pending_jobs[i]);
+  daemon->backend_slots =
+    g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                           NULL, (GDestroyNotify)backend_slots_free);
+
   g_mutex_init (&daemon->lock);
 
   daemon->mount_counter = 0;
@@ -408,11 +823,48 @@ g_vfs_daemon_new (gboolean main_daemon, gboolean replace)
   return daemon;
 }
 
+/**
+ * g_vfs_daemon_set_max_threads:
+ * @daemon: A #GVfsDaemon.
+ * @max_threads: upper bound of job threads, or -1 for the default
+ *
+ * Sets the maximal number of worker threads used for jobs that can't be
+ * handled asynchronously. The number of threads actually used grows and
+ * shrinks between a small minimum and @max_threads depending on the queue
+ * depth and the observed job latency.
+ */
 void
 g_vfs_daemon_set_max_threads (GVfsDaemon                    *daemon,
 			      gint                           max_threads)
 {
-  g_thread_pool_set_max_threads (daemon->thread_pool, max_threads, NULL);
+  if (max_threads <= 0)
+    max_threads = JOB_THREADS_MAX_DEFAULT;
+
+  g_mutex_lock (&daemon->sched_lock);
+
+  daemon->max_threads = max_threads;
+  if (daemon->thread_limit > (guint) max_threads)
+    set_thread_limit_unlocked (daemon, max_threads);
+  dispatch_jobs_unlocked (daemon);
+
+  g_mutex_unlock (&daemon->sched_lock);
+}
+
+/**
+ * g_vfs_daemon_get_job_stats:
+ * @daemon: A #GVfsDaemon.
+ * @stats: (out): return location for the counters
+ *
+ * Gets a snapshot of the job scheduling counters, e.g. to tune the
+ * concurrency declarations of a backend.
+ */
+void
+g_vfs_daemon_get_job_stats (GVfsDaemon                    *daemon,
+                            GVfsDaemonJobStats            *stats)
+{
+  g_mutex_lock (&daemon->sched_lock);
+  *stats = daemon->stats;
+  g_mutex_unlock (&daemon->sched_lock);
 }
 
 static gboolean
@@ -451,11 +903,16 @@ job_source_new_job_callback (GVfsJobSource *job_source,
 			     GVfsDaemon *daemon)
 {
   GVfsBackend *backend = NULL;
+  gpointer handle = NULL;
 
   if (G_VFS_IS_BACKEND (job_source))
     backend = G_VFS_BACKEND (job_source);
   else if (G_VFS_IS_CHANNEL (job_source))
-    backend = g_vfs_channel_get_backend (G_VFS_CHANNEL (job_source));
+    {
+      backend = g_vfs_channel_get_backend (G_VFS_CHANNEL (job_source));
+      /* A channel wraps exactly one backend handle */
+      handle = job_source;
+    }
 
   if (backend != NULL)
     {
@@ -466,7 +923,7 @@ job_source_new_job_callback (GVfsJobSource *job_source,
                              (GClosureNotify) g_object_unref,
                              0);
     }
-  g_vfs_daemon_queue_job (daemon, job);
+  queue_job (daemon, job, backend, handle);
 }
 
 static void
@@ -659,9 +1116,11 @@ job_finished_callback (GVfsJob *job,
   g_object_unref (job);
 }
 
-void
-g_vfs_daemon_queue_job (GVfsDaemon *daemon,
-			GVfsJob *job)
+static void
+queue_job (GVfsDaemon *daemon,
+           GVfsJob *job,
+           GVfsBackend *backend,
+           gpointer handle)
 {
   g_debug ("Queued new job %p (%s)\n", job, g_type_name_from_instance ((gpointer)job));
   
@@ -677,10 +1136,18 @@ g_vfs_daemon_queue_job (GVfsDaemon *daemon,
   if (!g_vfs_job_try (job))
     {
       /* Couldn't finish / run async, queue worker thread */
-      g_thread_pool_push (daemon->thread_pool, job, NULL); /* TODO: Check error */
+      queue_job_in_thread (daemon, job, backend, handle);
     }
 }
 
+void
+g_vfs_daemon_queue_job (GVfsDaemon *daemon,
+			GVfsJob *job,
+			GVfsBackend *backend)
+{
+  queue_job (daemon, job, backend, NULL);
+}
+
 static void
 peer_unregister_skeleton (const gchar *obj_path,
                           RegisteredPath *reg_path,
@@ -1009,7 +1476,7 @@ g_vfs_daemon_initiate_mount (GVfsDaemon *daemon,
   g_object_unref (backend);
 
   job = g_vfs_job_mount_new (mount_spec, mount_source, is_automount, object, invocation, backend);
-  g_vfs_daemon_queue_job (daemon, job);
+  queue_job (daemon, job, backend, NULL);
   g_object_unref (job);
 }
 
@@ -1078,10 +1545,11 @@ g_vfs_daemon_has_blocking_processes (GVfsDaemon *daemon)
 }
 
 void
-g_vfs_daemon_run_job_in_thread (GVfsDaemon *daemon,
-				GVfsJob    *job)
+g_vfs_daemon_run_job_in_thread (GVfsDaemon  *daemon,
+				GVfsJob     *job,
+				GVfsBackend *backend)
 {
-  g_thread_pool_push (daemon->thread_pool, job, NULL); /* TODO: Check error */
+  queue_job_in_thread (daemon, job, backend, NULL);
 }
 
 void
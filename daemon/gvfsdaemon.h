@@ -52,6 +52,25 @@ struct _GVfsDaemonClass
   
 };
 
+typedef struct {
+  guint   queue_depth;      /* jobs waiting for a worker thread */
+  guint   max_queue_depth;
+  guint   running;          /* jobs currently running on a worker thread */
+  guint   thread_limit;     /* current adaptive worker thread limit */
+  guint64 jobs_run;
+  guint64 jobs_aged;        /* times a job was moved up a lane by aging */
+  gint64  total_wait_usecs; /* time spent queued, summed over jobs_run */
+  gint64  max_wait_usecs;
+  gint64  avg_run_usecs;    /* moving average of the job run time */
+} GVfsDaemonJobStats;
+
+/* Scheduler counters, reported by query_fs_info when asked for */
+#define G_VFS_ATTRIBUTE_DEBUG_JOB_QUEUE_DEPTH  "gvfs-debug::job-queue-depth"
+#define G_VFS_ATTRIBUTE_DEBUG_JOB_RUNNING      "gvfs-debug::job-running"
+#define G_VFS_ATTRIBUTE_DEBUG_JOB_THREAD_LIMIT "gvfs-debug::job-thread-limit"
+#define G_VFS_ATTRIBUTE_DEBUG_JOB_AVG_WAIT     "gvfs-debug::job-avg-wait-usecs"
+#define G_VFS_ATTRIBUTE_DEBUG_JOB_MAX_WAIT     "gvfs-debug::job-max-wait-usecs"
+
 typedef GDBusInterfaceSkeleton *  (*GVfsRegisterPathCallback)  (GDBusConnection *conn,
                                                                 const char      *obj_path,
                                                                 gpointer         data);
@@ -62,10 +81,13 @@ GVfsDaemon *g_vfs_daemon_new             (gboolean                       main_da
 					  gboolean                       replace);
 void        g_vfs_daemon_set_max_threads (GVfsDaemon                    *daemon,
 					  gint                           max_threads);
+void        g_vfs_daemon_get_job_stats   (GVfsDaemon                    *daemon,
+                                          GVfsDaemonJobStats            *stats);
 void        g_vfs_daemon_add_job_source  (GVfsDaemon                    *daemon,
 					  GVfsJobSource                 *job_source);
 void        g_vfs_daemon_queue_job       (GVfsDaemon                    *daemon,
-					  GVfsJob                       *job);
+					  GVfsJob                       *job,
+					  GVfsBackend                   *backend);
 void        g_vfs_daemon_register_path   (GVfsDaemon                    *daemon,
                                           const char                    *obj_path,
                                           GVfsRegisterPathCallback       callback,
@@ -81,7 +103,8 @@ void        g_vfs_daemon_initiate_mount  (GVfsDaemon                    *daemon,
 GArray     *g_vfs_daemon_get_blocking_processes (GVfsDaemon             *daemon);
 gboolean    g_vfs_daemon_has_blocking_processes (GVfsDaemon *daemon);
 void        g_vfs_daemon_run_job_in_thread      (GVfsDaemon             *daemon,
-						 GVfsJob                *job);
+						 GVfsJob                *job,
+						 GVfsBackend            *backend);
 void       g_vfs_daemon_close_active_channels (GVfsDaemon                *daemon,
 					       GVfsBackend *backend);
 
@@ -45,6 +45,8 @@ struct _GVfsFtpConnection
   GSocket *             listen_socket;          /* socket we are listening on for active FTP connections */
   GIOStream *        	data;                   /* ftp data stream or NULL if not in use */
 
+  gint64                last_activity;          /* monotonic time the last reply was received */
+
   int                   debug_id;               /* unique id for debugging purposes */
 };
 
@@ -121,6 +123,7 @@ g_vfs_ftp_connection_new (GSocketConnectable *addr,
   create_input_stream (conn);
   /* The first thing that needs to happen is receiving the welcome message */
   conn->waiting_for_reply = TRUE;
+  conn->last_activity = g_get_monotonic_time ();
 
   return conn;
 }
@@ -264,6 +267,7 @@ g_vfs_ftp_connection_receive (GVfsFtpConnection *conn,
    */
   if (response >= 200)
     conn->waiting_for_reply = FALSE;
+  conn->last_activity = g_get_monotonic_time ();
 
   return response;
 
@@ -275,6 +279,24 @@ fail:
   return 0;
 }
 
+/**
+ * g_vfs_ftp_connection_get_idle_time:
+ * @conn: a connection
+ *
+ * Gets the time since the server last replied on @conn. Servers close
+ * control connections that have been idle for too long, so this is used
+ * to decide when to keep a pooled connection alive.
+ *
+ * Returns: the idle time in microseconds
+ **/
+gint64
+g_vfs_ftp_connection_get_idle_time (GVfsFtpConnection *conn)
+{
+  g_return_val_if_fail (conn != NULL, 0);
+
+  return g_get_monotonic_time () - conn->last_activity;
+}
+
 GSocketAddress *
 g_vfs_ftp_connection_get_address (GVfsFtpConnection *conn, GError **error)
 {
@@ -613,6 +635,9 @@ g_vfs_ftp_connection_is_usable (GVfsFtpConnection *conn)
  * g_vfs_ftp_connection_enable_tls:
  * @conn: a connection without an active data connection
  * @server_identity: address of the server used to verify the certificate
+ * @implicit_tls: %TRUE if the server expects TLS right after connecting
+ * @session_source: %NULL or a TLS control connection to the same server
+ *     whose session should be resumed to save a full handshake
  * @cb: callback called if there's a verification error
  * @user_data: user data passed to @cb
  * @cancellable: cancellable to interrupt wait
@@ -629,6 +654,7 @@ gboolean
 g_vfs_ftp_connection_enable_tls (GVfsFtpConnection * conn,
                                  GSocketConnectable *server_identity,
                                  gboolean            implicit_tls,
+                                 GTlsClientConnection *session_source,
                                  CertificateCallback cb,
                                  gpointer            user_data,
                                  GCancellable *      cancellable,
@@ -651,6 +677,10 @@ g_vfs_ftp_connection_enable_tls (GVfsFtpConnection * conn,
   conn->commands = secure;
   create_input_stream (conn);
 
+  if (session_source)
+    g_tls_client_connection_copy_session_state (G_TLS_CLIENT_CONNECTION (secure),
+                                                session_source);
+
   g_signal_connect (secure, "accept-certificate", G_CALLBACK (cb), user_data);
 
   if (!g_tls_connection_handshake (G_TLS_CONNECTION (secure),
@@ -664,3 +694,25 @@ g_vfs_ftp_connection_enable_tls (GVfsFtpConnection * conn,
 
   return TRUE;
 }
+
+/**
+ * g_vfs_ftp_connection_get_tls_connection:
+ * @conn: a connection
+ *
+ * Gets the TLS connection used for @conn's control stream, so that its
+ * session can be passed to g_vfs_ftp_connection_enable_tls() for new
+ * connections.
+ *
+ * Returns: (transfer none): the TLS connection or %NULL if @conn doesn't
+ *     use TLS
+ **/
+GTlsClientConnection *
+g_vfs_ftp_connection_get_tls_connection (GVfsFtpConnection *conn)
+{
+  g_return_val_if_fail (conn != NULL, NULL);
+
+  if (!G_IS_TLS_CLIENT_CONNECTION (conn->commands))
+    return NULL;
+
+  return G_TLS_CLIENT_CONNECTION (conn->commands);
+}
@@ -54,6 +54,7 @@ gboolean                g_vfs_ftp_connection_is_usable        (GVfsFtpConnection
 GSocketAddress *        g_vfs_ftp_connection_get_address      (GVfsFtpConnection *      conn,
                                                                GError **                error);
 guint                   g_vfs_ftp_connection_get_debug_id     (GVfsFtpConnection *      conn);
+gint64                  g_vfs_ftp_connection_get_idle_time    (GVfsFtpConnection *      conn);
 
 gboolean                g_vfs_ftp_connection_open_data_connection
                                                               (GVfsFtpConnection *      conn,
@@ -74,6 +75,7 @@ GIOStream *             g_vfs_ftp_connection_get_data_stream  (GVfsFtpConnection
 gboolean                g_vfs_ftp_connection_enable_tls       (GVfsFtpConnection *      conn,
                                                                GSocketConnectable *     server_identity,
                                                                gboolean                 implicit_tls,
+                                                               GTlsClientConnection *   session_source,
                                                                CertificateCallback      cb,
                                                                gpointer                 user_data,
                                                                GCancellable *           cancellable,
@@ -84,6 +86,8 @@ gboolean                g_vfs_ftp_connection_data_connection_enable_tls (GVfsFtp
                                                                          gpointer            user_data,
                                                                          GCancellable *      cancellable,
                                                                          GError **           error);
+GTlsClientConnection *  g_vfs_ftp_connection_get_tls_connection
+                                                              (GVfsFtpConnection *      conn);
 
 
 
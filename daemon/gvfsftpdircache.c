@@ -21,6 +21,7 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 #include <sys/stat.h>
 
 #include <config.h>
@@ -28,14 +29,124 @@
 #include <glib/gi18n.h>
 
 #include "gvfsftpdircache.h"
+#include "gvfsdaemonutils.h"
+
+/*** CACHED FILE ***/
+
+/* Default limits, overridden by GVFS_FTP_CACHE_TTL (seconds) and
+ * GVFS_FTP_CACHE_SIZE (MiB) */
+#define DEFAULT_CACHE_TTL       60
+#define DEFAULT_CACHE_SIZE      16
+
+/* Rough cost of a hash table slot, used when accounting memory */
+#define HASH_SLOT_SIZE          (2 * sizeof (gpointer) + sizeof (guint))
+
+enum {
+  CACHED_FILE_HIDDEN    = 1 << 0,
+  CACHED_FILE_SYMLINK   = 1 << 1,
+  CACHED_FILE_HAS_SIZE  = 1 << 2,
+  CACHED_FILE_HAS_MODE  = 1 << 3,
+  CACHED_FILE_HAS_MTIME = 1 << 4
+};
+
+/* What the listings tell about a file, much smaller than a GFileInfo.
+ * The name and symlink target are allocated with the struct. */
+typedef struct {
+  const char *          name;           /* basename in gvfs terms */
+  const char *          symlink_target;
+  const char *          owner;          /* interned */
+  const char *          group;          /* interned */
+  guint64               size;
+  gint64                mtime;
+  guint32               mtime_usec;
+  guint32               mode;
+  guint8                type;           /* GFileType */
+  guint8                flags;
+  guint8                mtime_checked;  /* MDTM was tried, protected by the cache lock */
+} GVfsFtpCachedFile;
+
+static GVfsFtpCachedFile *
+g_vfs_ftp_cached_file_new (const char *name, GFileInfo *info)
+{
+  GVfsFtpCachedFile *cached;
+  const char *target;
+  gsize name_len, target_len;
+  char *strings;
+
+  target = NULL;
+  if (g_file_info_get_attribute_boolean (info, G_FILE_ATTRIBUTE_STANDARD_IS_SYMLINK))
+    target = g_file_info_get_symlink_target (info);
+
+  name_len = strlen (name) + 1;
+  target_len = target ? strlen (target) + 1 : 0;
+
+  cached = g_malloc0 (sizeof (GVfsFtpCachedFile) + name_len + target_len);
+  strings = (char *) (cached + 1);
+
+  memcpy (strings, name, name_len);
+  cached->name = strings;
+  if (target)
+    {
+      memcpy (strings + name_len, target, target_len);
+      cached->symlink_target = strings + name_len;
+      cached->flags |= CACHED_FILE_SYMLINK;
+    }
+
+  cached->type = g_file_info_get_file_type (info);
+
+  if (g_file_info_get_attribute_boolean (info, G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN))
+    cached->flags |= CACHED_FILE_HIDDEN;
+
+  if (g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_STANDARD_SIZE))
+    {
+      cached->size = g_file_info_get_size (info);
+      cached->flags |= CACHED_FILE_HAS_SIZE;
+    }
+
+  if (g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_UNIX_MODE))
+    {
+      cached->mode = g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_MODE);
+      cached->flags |= CACHED_FILE_HAS_MODE;
+    }
+
+  if (g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_TIME_MODIFIED))
+    {
+      cached->mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+      cached->mtime_usec = g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+      cached->flags |= CACHED_FILE_HAS_MTIME;
+    }
+
+  if (g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_OWNER_USER))
+    cached->owner = g_intern_string (g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_OWNER_USER));
+  if (g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_OWNER_GROUP))
+    cached->group = g_intern_string (g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_OWNER_GROUP));
+
+  return cached;
+}
+
+static gsize
+g_vfs_ftp_cached_file_get_size (GVfsFtpCachedFile *cached)
+{
+  gsize size;
+
+  size = sizeof (GVfsFtpCachedFile) + HASH_SLOT_SIZE + strlen (cached->name) + 1;
+  if (cached->symlink_target)
+    size += strlen (cached->symlink_target) + 1;
+
+  return size;
+}
 
 /*** CACHE ENTRY ***/
 
 struct _GVfsFtpDirCacheEntry
 {
-  GHashTable *          files;          /* GVfsFtpFile => GFileInfo mapping */
+  GHashTable *          files;          /* name => GVfsFtpCachedFile mapping */
   guint                 stamp;          /* cache's stamp when this entry was created */
   volatile int          refcount;       /* need to refount this struct for thread safety */
+  gint64                expires;        /* monotonic time after which the listing is redone */
+  gsize                 size;           /* approximate memory used */
+  const GVfsFtpFile *   dir;            /* key in the cache, while in it */
+  GList                 link;           /* in the cache's LRU queue */
 };
 
 static GVfsFtpDirCacheEntry *
@@ -44,12 +155,14 @@ g_vfs_ftp_dir_cache_entry_new (guint stamp)
   GVfsFtpDirCacheEntry *entry;
 
   entry = g_slice_new0 (GVfsFtpDirCacheEntry);
-  entry->files = g_hash_table_new_full (g_vfs_ftp_file_hash,
-                                        g_vfs_ftp_file_equal,
-                                        (GDestroyNotify) g_vfs_ftp_file_free,
-                                        g_object_unref);
+  entry->files = g_hash_table_new_full (g_str_hash,
+                                        g_str_equal,
+                                        NULL,
+                                        g_free);
   entry->stamp = stamp;
   entry->refcount = 1;
+  entry->size = sizeof (GVfsFtpDirCacheEntry);
+  entry->link.data = entry;
 
   return entry;
 }
@@ -85,11 +198,25 @@ g_vfs_ftp_dir_cache_entry_unref (GVfsFtpDirCacheEntry *entry)
 void
 g_vfs_ftp_dir_cache_entry_add (GVfsFtpDirCacheEntry *entry, GVfsFtpFile *file, GFileInfo *info)
 {
+  GVfsFtpCachedFile *cached, *old;
+  char *name;
+
   g_return_if_fail (entry != NULL);
   g_return_if_fail (file != NULL);
   g_return_if_fail (G_IS_FILE_INFO (info));
 
-  g_hash_table_insert (entry->files, file, info);
+  name = g_path_get_basename (g_vfs_ftp_file_get_gvfs_path (file));
+  cached = g_vfs_ftp_cached_file_new (name, info);
+  g_free (name);
+  g_vfs_ftp_file_free (file);
+  g_object_unref (info);
+
+  old = g_hash_table_lookup (entry->files, cached->name);
+  if (old)
+    entry->size -= g_vfs_ftp_cached_file_get_size (old);
+
+  g_hash_table_replace (entry->files, (char *) cached->name, cached);
+  entry->size += g_vfs_ftp_cached_file_get_size (cached);
 }
 
 /*** CACHE ***/
@@ -97,11 +224,27 @@ g_vfs_ftp_dir_cache_entry_add (GVfsFtpDirCacheEntry *entry, GVfsFtpFile *file, G
 struct _GVfsFtpDirCache
 {
   GHashTable *          directories;    /* GVfsFtpFile of directory => GVfsFtpDirCacheEntry mapping */
+  GQueue                lru;            /* entries, most recently used first */
+  gsize                 size;           /* memory used by all entries */
+  gsize                 max_size;
+  gint64                ttl;            /* in microseconds */
   guint                 stamp;          /* used to identify validity of cache when flushing */
-  GMutex                lock;           /* mutex for thread safety of stamp and hash table */
+  GMutex                lock;           /* mutex for thread safety of stamp, hash table and LRU */
   const GVfsFtpDirFuncs *funcs;         /* functions to call */
 };
 
+static gint64
+get_cache_limit (const char *variable, gint64 default_value)
+{
+  const char *str;
+
+  str = g_getenv (variable);
+  if (str == NULL)
+    return default_value;
+
+  return MAX (g_ascii_strtoll (str, NULL, 10), 0);
+}
+
 GVfsFtpDirCache *
 g_vfs_ftp_dir_cache_new (const GVfsFtpDirFuncs *funcs)
 {
@@ -114,6 +257,9 @@ g_vfs_ftp_dir_cache_new (const GVfsFtpDirFuncs *funcs)
                                               g_vfs_ftp_file_equal,
                                               (GDestroyNotify) g_vfs_ftp_file_free,
                                               (GDestroyNotify) g_vfs_ftp_dir_cache_entry_unref);
+  g_queue_init (&cache->lru);
+  cache->ttl = get_cache_limit ("GVFS_FTP_CACHE_TTL", DEFAULT_CACHE_TTL) * G_USEC_PER_SEC;
+  cache->max_size = get_cache_limit ("GVFS_FTP_CACHE_SIZE", DEFAULT_CACHE_SIZE) * 1024 * 1024;
   g_mutex_init (&cache->lock);
   cache->funcs = funcs;
 
@@ -125,11 +271,56 @@ g_vfs_ftp_dir_cache_free (GVfsFtpDirCache *cache)
 {
   g_return_if_fail (cache != NULL);
 
+  /* the LRU links are part of the entries */
   g_hash_table_destroy (cache->directories);
   g_mutex_clear (&cache->lock);
   g_slice_free (GVfsFtpDirCache, cache);
 }
 
+/* must be called with the lock held */
+static void
+g_vfs_ftp_dir_cache_remove_entry (GVfsFtpDirCache *     cache,
+                                  GVfsFtpDirCacheEntry *entry)
+{
+  g_queue_unlink (&cache->lru, &entry->link);
+  cache->size -= entry->size;
+  g_hash_table_remove (cache->directories, entry->dir);
+}
+
+/* must be called with the lock held */
+static void
+g_vfs_ftp_dir_cache_insert_entry (GVfsFtpDirCache *     cache,
+                                  const GVfsFtpFile *   dir,
+                                  GVfsFtpDirCacheEntry *entry)
+{
+  GVfsFtpDirCacheEntry *old;
+  GVfsFtpFile *key;
+
+  old = g_hash_table_lookup (cache->directories, dir);
+  if (old)
+    g_vfs_ftp_dir_cache_remove_entry (cache, old);
+
+  /* A listing bigger than the cache isn't kept, it would only push out
+   * everything else */
+  if (cache->ttl == 0 || entry->size > cache->max_size)
+    return;
+
+  while (cache->size + entry->size > cache->max_size)
+    {
+      old = g_queue_peek_tail (&cache->lru);
+      g_debug ("# dir cache full, dropping listing of %s\n",
+               g_vfs_ftp_file_get_gvfs_path (old->dir));
+      g_vfs_ftp_dir_cache_remove_entry (cache, old);
+    }
+
+  key = g_vfs_ftp_file_copy (dir);
+  entry->dir = key;
+  entry->expires = g_get_monotonic_time () + cache->ttl;
+  g_hash_table_insert (cache->directories, key, g_vfs_ftp_dir_cache_entry_ref (entry));
+  g_queue_push_head_link (&cache->lru, &entry->link);
+  cache->size += entry->size;
+}
+
 static GVfsFtpDirCacheEntry *
 g_vfs_ftp_dir_cache_lookup_entry (GVfsFtpDirCache *  cache,
                                   GVfsFtpTask *      task,
@@ -140,8 +331,17 @@ g_vfs_ftp_dir_cache_lookup_entry (GVfsFtpDirCache *  cache,
 
   g_mutex_lock (&cache->lock);
   entry = g_hash_table_lookup (cache->directories, dir);
+  if (entry && entry->expires < g_get_monotonic_time ())
+    {
+      g_vfs_ftp_dir_cache_remove_entry (cache, entry);
+      entry = NULL;
+    }
   if (entry)
-    g_vfs_ftp_dir_cache_entry_ref (entry);
+    {
+      g_vfs_ftp_dir_cache_entry_ref (entry);
+      g_queue_unlink (&cache->lru, &entry->link);
+      g_queue_push_head_link (&cache->lru, &entry->link);
+    }
   g_mutex_unlock (&cache->lock);
   if (entry && entry->stamp < stamp)
     g_vfs_ftp_dir_cache_entry_unref (entry);
@@ -178,23 +378,161 @@ g_vfs_ftp_dir_cache_lookup_entry (GVfsFtpDirCache *  cache,
       g_vfs_ftp_dir_cache_entry_unref (entry);
       return NULL;
     }
+  /* the key and its slot in the cache */
+  entry->size += HASH_SLOT_SIZE + 3 * sizeof (gpointer) +
+                 strlen (g_vfs_ftp_file_get_gvfs_path (dir)) + 1 +
+                 strlen (g_vfs_ftp_file_get_ftp_path (dir)) + 1;
   g_mutex_lock (&cache->lock);
-  g_hash_table_insert (cache->directories,
-                       g_vfs_ftp_file_copy (dir),
-                       g_vfs_ftp_dir_cache_entry_ref (entry));
+  g_vfs_ftp_dir_cache_insert_entry (cache, dir, entry);
   g_mutex_unlock (&cache->lock);
   return entry;
 }
 
+/* The etag is the mtime, so it has to follow any fix of it */
+static void
+g_vfs_ftp_dir_cache_set_mtime (GFileInfo *info,
+                               gint64     mtime,
+                               guint32    mtime_usec)
+{
+  char *etag = g_strdup_printf ("%" G_GINT64_FORMAT, mtime);
+  g_file_info_set_attribute_string (info,
+                                    G_FILE_ATTRIBUTE_ETAG_VALUE,
+                                    etag);
+  g_free (etag);
+
+  g_file_info_set_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED, mtime);
+  g_file_info_set_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC, mtime_usec);
+}
+
+/* Try to obtain correct mtime using the MDTM command if time is 00:00:00. */
+static void
+g_vfs_ftp_dir_cache_fix_mtime (GVfsFtpDirCache *  cache,
+                               GVfsFtpTask *      task,
+                               const GVfsFtpFile *file,
+                               GFileInfo *        info)
+{
+  g_autoptr(GDateTime) dt = NULL;
+  g_auto(GStrv) reply = NULL;
+  struct tm tm = { 0 };
+  gint num;
+  time_t mtime;
+
+  if (cache->funcs->exact_mtime)
+    return;
+
+  if (!g_vfs_backend_ftp_has_feature (task->backend, G_VFS_FTP_FEATURE_MDTM))
+    return;
+
+  if (g_file_info_get_file_type (info) != G_FILE_TYPE_REGULAR)
+    return;
+
+  dt = g_file_info_get_modification_date_time (info);
+  if (dt == NULL ||
+      g_date_time_get_hour (dt) != 0 ||
+      g_date_time_get_minute (dt) != 0 ||
+      g_date_time_get_second (dt) != 0)
+    return;
+
+  if (g_vfs_ftp_task_send_and_check (task, 0, NULL, NULL, &reply, "MDTM %s", g_vfs_ftp_file_get_ftp_path (file)) != 213)
+    {
+      g_vfs_ftp_task_clear_error (task);
+      return;
+    }
+
+  num = sscanf (reply[0] + 4, "%4d%2d%2d%2d%2d%2d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &tm.tm_sec);
+  if (num != 6)
+    return;
+
+  tm.tm_year -= 1900;
+  tm.tm_mon -= 1;
+  mtime = timegm (&tm);
+  if (mtime == -1)
+    return;
+
+  g_vfs_ftp_dir_cache_set_mtime (info, mtime, 0);
+}
+
+/* Builds the file info of @file from the cached listing. The mtime is
+ * fixed with MDTM the first time and the result kept in @cached. */
+static GFileInfo *
+g_vfs_ftp_dir_cache_get_file_info (GVfsFtpDirCache *  cache,
+                                   GVfsFtpTask *      task,
+                                   const GVfsFtpFile *file,
+                                   GVfsFtpCachedFile *cached,
+                                   gboolean           fix_mtime)
+{
+  GFileInfo *info;
+  gint64 mtime;
+  guint32 mtime_usec;
+  gboolean mtime_checked;
+
+  g_mutex_lock (&cache->lock);
+  mtime = cached->mtime;
+  mtime_usec = cached->mtime_usec;
+  mtime_checked = cached->mtime_checked;
+  g_mutex_unlock (&cache->lock);
+
+  info = g_file_info_new ();
+  g_file_info_set_name (info, cached->name);
+
+  if (cached->flags & CACHED_FILE_SYMLINK)
+    {
+      g_file_info_set_symlink_target (info, cached->symlink_target);
+      g_file_info_set_is_symlink (info, TRUE);
+    }
+  else
+    g_file_info_set_is_symlink (info, FALSE);
+
+  if (cached->flags & CACHED_FILE_HAS_SIZE)
+    g_file_info_set_size (info, cached->size);
+
+  if (cached->flags & CACHED_FILE_HAS_MODE)
+    g_file_info_set_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_MODE, cached->mode);
+  if (cached->owner)
+    g_file_info_set_attribute_string (info, G_FILE_ATTRIBUTE_OWNER_USER, cached->owner);
+  if (cached->group)
+    g_file_info_set_attribute_string (info, G_FILE_ATTRIBUTE_OWNER_GROUP, cached->group);
+
+  g_file_info_set_attribute_boolean (info, G_FILE_ATTRIBUTE_ACCESS_CAN_TRASH, FALSE);
+
+  gvfs_file_info_populate_default (info,
+                                   g_vfs_ftp_file_get_gvfs_path (file),
+                                   cached->type);
+
+  if (cached->flags & CACHED_FILE_HIDDEN)
+    g_file_info_set_is_hidden (info, TRUE);
+
+  if (cached->flags & CACHED_FILE_HAS_MTIME)
+    {
+      g_vfs_ftp_dir_cache_set_mtime (info, mtime, mtime_usec);
+
+      if (fix_mtime && !mtime_checked)
+        {
+          g_vfs_ftp_dir_cache_fix_mtime (cache, task, file, info);
+
+          g_mutex_lock (&cache->lock);
+          cached->mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+          cached->mtime_usec = g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+          cached->mtime_checked = TRUE;
+          g_mutex_unlock (&cache->lock);
+        }
+    }
+
+  return info;
+}
+
 static GFileInfo *
 g_vfs_ftp_dir_cache_lookup_file_internal (GVfsFtpDirCache *  cache,
                                           GVfsFtpTask *      task,
                                           const GVfsFtpFile *file,
-                                          guint              stamp)
+                                          guint              stamp,
+                                          gboolean           fix_mtime)
 {
   GVfsFtpDirCacheEntry *entry;
+  GVfsFtpCachedFile *cached;
   GVfsFtpFile *dir;
   GFileInfo *info;
+  char *name;
 
   if (g_vfs_ftp_task_is_in_error (task))
     return NULL;
@@ -207,11 +545,12 @@ g_vfs_ftp_dir_cache_lookup_file_internal (GVfsFtpDirCache *  cache,
       if (entry == NULL)
         return NULL;
 
-      info = g_hash_table_lookup (entry->files, file);
-      if (info != NULL)
+      name = g_path_get_basename (g_vfs_ftp_file_get_gvfs_path (file));
+      cached = g_hash_table_lookup (entry->files, name);
+      g_free (name);
+      if (cached != NULL)
         {
-          /* NB: the order of ref/unref is important here */
-          g_object_ref (info);
+          info = g_vfs_ftp_dir_cache_get_file_info (cache, task, file, cached, fix_mtime);
           g_vfs_ftp_dir_cache_entry_unref (entry);
           return info;
         }
@@ -222,7 +561,11 @@ g_vfs_ftp_dir_cache_lookup_file_internal (GVfsFtpDirCache *  cache,
   if (g_vfs_ftp_task_is_in_error (task))
     return NULL;
 
-  return cache->funcs->lookup_uncached (task, file);
+  info = cache->funcs->lookup_uncached (task, file);
+  if (info != NULL && fix_mtime)
+    g_vfs_ftp_dir_cache_fix_mtime (cache, task, file, info);
+
+  return info;
 }
 
 static GFileInfo *
@@ -273,7 +616,7 @@ g_vfs_ftp_dir_cache_resolve_symlink (GVfsFtpDirCache *  cache,
           g_object_unref (original);
           return NULL;
         }
-      info = g_vfs_ftp_dir_cache_lookup_file_internal (cache, task, link, stamp);
+      info = g_vfs_ftp_dir_cache_lookup_file_internal (cache, task, link, stamp, FALSE);
       if (info == NULL)
         {
           g_vfs_ftp_file_free (link);
@@ -315,49 +658,6 @@ g_vfs_ftp_dir_cache_resolve_symlink (GVfsFtpDirCache *  cache,
   return result;
 }
 
-/* Try to obtain correct mtime using the MDTM command if time is 00:00:00. */
-static void
-g_vfs_ftp_dir_cache_fix_mtime (GVfsFtpTask *      task,
-                               const GVfsFtpFile *file,
-                               GFileInfo *        info)
-{
-  g_autoptr(GDateTime) dt = NULL;
-  g_auto(GStrv) reply = NULL;
-  struct tm tm = { 0 };
-  gint num;
-  time_t mtime;
-
-  if (!g_vfs_backend_ftp_has_feature (task->backend, G_VFS_FTP_FEATURE_MDTM))
-    return;
-
-  if (g_file_info_get_file_type (info) != G_FILE_TYPE_REGULAR)
-    return;
-
-  dt = g_file_info_get_modification_date_time (info);
-  if (g_date_time_get_hour (dt) != 0 ||
-      g_date_time_get_minute (dt) != 0 ||
-      g_date_time_get_second (dt) != 0)
-    return;
-
-  if (g_vfs_ftp_task_send_and_check (task, 0, NULL, NULL, &reply, "MDTM %s", g_vfs_ftp_file_get_ftp_path (file)) != 213)
-    {
-      g_vfs_ftp_task_clear_error (task);
-      return;
-    }
-
-  num = sscanf (reply[0] + 4, "%4d%2d%2d%2d%2d%2d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &tm.tm_sec);
-  if (num != 6)
-    return;
-
-  tm.tm_year -= 1900;
-  tm.tm_mon -= 1;
-  mtime = timegm (&tm);
-  if (mtime == -1)
-    return;
-
-  g_file_info_set_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED, mtime);
-}
-
 GFileInfo *
 g_vfs_ftp_dir_cache_lookup_file (GVfsFtpDirCache *  cache,
                                  GVfsFtpTask *      task,
@@ -370,8 +670,7 @@ g_vfs_ftp_dir_cache_lookup_file (GVfsFtpDirCache *  cache,
   g_return_val_if_fail (task != NULL, NULL);
   g_return_val_if_fail (file != NULL, NULL);
 
-  info = g_vfs_ftp_dir_cache_lookup_file_internal (cache, task, file, 0);
-  g_vfs_ftp_dir_cache_fix_mtime (task, file, info);
+  info = g_vfs_ftp_dir_cache_lookup_file_internal (cache, task, file, 0, TRUE);
 
   if (info != NULL && resolve_symlinks)
     info = g_vfs_ftp_dir_cache_resolve_symlink (cache, task, file, info, 0);
@@ -388,7 +687,9 @@ g_vfs_ftp_dir_cache_lookup_dir (GVfsFtpDirCache *  cache,
 {
   GVfsFtpDirCacheEntry *entry;
   GHashTableIter iter;
-  gpointer file, info;
+  gpointer cached;
+  GVfsFtpFile *file;
+  GFileInfo *info;
   guint stamp;
   GList *result = NULL;
 
@@ -414,17 +715,21 @@ g_vfs_ftp_dir_cache_lookup_dir (GVfsFtpDirCache *  cache,
     return NULL;
 
   g_hash_table_iter_init (&iter, entry->files);
-  while (g_hash_table_iter_next (&iter, &file, &info))
+  while (g_hash_table_iter_next (&iter, NULL, &cached))
     {
-      g_object_ref (info);
+      file = g_vfs_ftp_file_new_child (dir, ((GVfsFtpCachedFile *) cached)->name, NULL);
+      if (file == NULL)
+        continue;
 
-      g_vfs_ftp_dir_cache_fix_mtime (task, file, info);
+      info = g_vfs_ftp_dir_cache_get_file_info (cache, task, file, cached, TRUE);
 
       if (resolve_symlinks)
         info = g_vfs_ftp_dir_cache_resolve_symlink (cache, task, file, info, stamp);
+      g_vfs_ftp_file_free (file);
       if (info == NULL)
         {
           g_list_free_full (result, g_object_unref);
+          g_vfs_ftp_dir_cache_entry_unref (entry);
           return NULL;
         }
 
@@ -440,11 +745,15 @@ void
 g_vfs_ftp_dir_cache_purge_dir (GVfsFtpDirCache *  cache,
                                const GVfsFtpFile *dir)
 {
+  GVfsFtpDirCacheEntry *entry;
+
   g_return_if_fail (cache != NULL);
   g_return_if_fail (dir != NULL);
 
   g_mutex_lock (&cache->lock);
-  g_hash_table_remove (cache->directories, dir);
+  entry = g_hash_table_lookup (cache->directories, dir);
+  if (entry)
+    g_vfs_ftp_dir_cache_remove_entry (cache, entry);
   g_mutex_unlock (&cache->lock);
 }
 
@@ -468,7 +777,6 @@ g_vfs_ftp_dir_cache_purge_file (GVfsFtpDirCache *  cache,
 /*** DIR CACHE FUNCS ***/
 
 #include "ParseFTPList.h"
-#include "gvfsdaemonutils.h"
 
 static GFileInfo *
 create_root_file_info (GVfsBackendFtp *ftp)
@@ -880,16 +1188,358 @@ g_vfs_ftp_dir_cache_funcs_process_default (GInputStream *        stream,
   return g_vfs_ftp_dir_cache_funcs_process (stream, debug_id, dir, entry, FALSE, cancellable, error);
 }
 
+/*** MLSD ***/
+
+/* Facts of one MLSD or MLST line, see RFC 3659 section 7 */
+typedef struct {
+  GFileType     type;
+  gboolean      is_self_or_parent;      /* type=cdir or type=pdir */
+  const char *  symlink_target;
+  gboolean      has_size;
+  guint64       size;
+  gboolean      has_mtime;
+  gint64        mtime;
+  guint32       mtime_usec;
+  gboolean      has_mode;
+  guint32       mode;
+  const char *  owner;
+  const char *  group;
+} GVfsFtpMlsxFacts;
+
+static gboolean
+g_vfs_ftp_parse_mlsx_type (const char *value, GVfsFtpMlsxFacts *facts)
+{
+  if (g_ascii_strcasecmp (value, "file") == 0)
+    facts->type = G_FILE_TYPE_REGULAR;
+  else if (g_ascii_strcasecmp (value, "dir") == 0)
+    facts->type = G_FILE_TYPE_DIRECTORY;
+  else if (g_ascii_strcasecmp (value, "cdir") == 0 ||
+           g_ascii_strcasecmp (value, "pdir") == 0)
+    {
+      facts->type = G_FILE_TYPE_DIRECTORY;
+      facts->is_self_or_parent = TRUE;
+    }
+  /* proftpd sends "OS.unix=slink:target", pure-ftpd "OS.unix=symlink" */
+  else if (g_ascii_strncasecmp (value, "OS.unix=slink", 13) == 0)
+    {
+      facts->type = G_FILE_TYPE_SYMBOLIC_LINK;
+      facts->symlink_target = value[13] == ':' ? value + 14 : "";
+    }
+  else if (g_ascii_strcasecmp (value, "OS.unix=symlink") == 0)
+    {
+      facts->type = G_FILE_TYPE_SYMBOLIC_LINK;
+      facts->symlink_target = "";
+    }
+  else if (g_ascii_strncasecmp (value, "OS.", 3) == 0)
+    facts->type = G_FILE_TYPE_SPECIAL;
+  else
+    return FALSE;
+
+  return TRUE;
+}
+
+static gboolean
+g_vfs_ftp_parse_mlsx_time (const char *value, GVfsFtpMlsxFacts *facts)
+{
+  struct tm tm = { 0 };
+  const char *usec;
+  time_t mtime;
+  guint i;
+
+  /* YYYYMMDDHHMMSS[.sss] in UTC */
+  if (sscanf (value, "%4d%2d%2d%2d%2d%2d",
+              &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+              &tm.tm_hour, &tm.tm_min, &tm.tm_sec) != 6)
+    return FALSE;
+
+  tm.tm_year -= 1900;
+  tm.tm_mon -= 1;
+  mtime = timegm (&tm);
+  if (mtime == -1)
+    return FALSE;
+
+  facts->has_mtime = TRUE;
+  facts->mtime = mtime;
+  facts->mtime_usec = 0;
+
+  usec = strchr (value, '.');
+  if (usec != NULL)
+    {
+      guint32 scale = 100000;
+
+      for (i = 1; g_ascii_isdigit (usec[i]) && scale > 0; i++, scale /= 10)
+        facts->mtime_usec += (usec[i] - '0') * scale;
+    }
+
+  return TRUE;
+}
+
+#define MLSX_SLINK_TYPE "type=OS.unix=slink:"
+
+/* Returns the ';' that ends fact, or NULL for the last one. The target
+ * of proftpd's "type=OS.unix=slink:target" is sent as is and may itself
+ * contain ';', so there only a ';' that is followed by something that
+ * looks like a fact name, or by nothing, ends the fact. */
+static char *
+g_vfs_ftp_parse_mlsx_fact_end (char *fact)
+{
+  char *end, *p;
+
+  if (g_ascii_strncasecmp (fact, MLSX_SLINK_TYPE, strlen (MLSX_SLINK_TYPE)) != 0)
+    return strchr (fact, ';');
+
+  for (end = strchr (fact + strlen (MLSX_SLINK_TYPE), ';');
+       end != NULL;
+       end = strchr (end + 1, ';'))
+    {
+      for (p = end + 1; g_ascii_isalnum (*p) || *p == '.' || *p == '-'; p++)
+        ;
+      if (end[1] == '\0' || (p != end + 1 && *p == '='))
+        return end;
+    }
+
+  return NULL;
+}
+
+/* Splits a line of the form "fact=value;fact=value; name" in place.
+ * Facts that aren't known are ignored. Returns the name or NULL if the
+ * line is malformed. */
+static const char *
+g_vfs_ftp_parse_mlsx (char *line, GVfsFtpMlsxFacts *facts)
+{
+  char *name, *fact, *value, *next;
+
+  memset (facts, 0, sizeof (GVfsFtpMlsxFacts));
+  facts->type = G_FILE_TYPE_UNKNOWN;
+
+  /* facts can't contain spaces, the name starts after the first one */
+  name = strchr (line, ' ');
+  if (name == NULL || name[1] == '\0')
+    return NULL;
+  *name++ = '\0';
+
+  for (fact = line; *fact != '\0'; fact = next)
+    {
+      next = g_vfs_ftp_parse_mlsx_fact_end (fact);
+      if (next != NULL)
+        *next++ = '\0';
+      else
+        next = fact + strlen (fact);
+
+      value = strchr (fact, '=');
+      if (value == NULL)
+        continue;
+      *value++ = '\0';
+
+      if (g_ascii_strcasecmp (fact, "type") == 0)
+        {
+          if (!g_vfs_ftp_parse_mlsx_type (value, facts))
+            g_debug ("# unknown MLSD type %s\n", value);
+        }
+      else if (g_ascii_strcasecmp (fact, "size") == 0 ||
+               g_ascii_strcasecmp (fact, "sizd") == 0)
+        {
+          facts->has_size = TRUE;
+          facts->size = g_ascii_strtoull (value, NULL, 10);
+        }
+      else if (g_ascii_strcasecmp (fact, "modify") == 0)
+        g_vfs_ftp_parse_mlsx_time (value, facts);
+      else if (g_ascii_strcasecmp (fact, "UNIX.mode") == 0)
+        {
+          facts->has_mode = TRUE;
+          facts->mode = g_ascii_strtoull (value, NULL, 8) & 07777;
+        }
+      /* prefer the names, but take the ids if that's all there is */
+      else if (g_ascii_strcasecmp (fact, "UNIX.ownername") == 0 ||
+               (g_ascii_strcasecmp (fact, "UNIX.owner") == 0 && facts->owner == NULL) ||
+               (g_ascii_strcasecmp (fact, "UNIX.uid") == 0 && facts->owner == NULL))
+        facts->owner = value;
+      else if (g_ascii_strcasecmp (fact, "UNIX.groupname") == 0 ||
+               (g_ascii_strcasecmp (fact, "UNIX.group") == 0 && facts->group == NULL) ||
+               (g_ascii_strcasecmp (fact, "UNIX.gid") == 0 && facts->group == NULL))
+        facts->group = value;
+    }
+
+  return name;
+}
+
+static GFileInfo *
+g_vfs_ftp_dir_cache_mlsx_info (const GVfsFtpFile *file,
+                               GVfsFtpMlsxFacts * facts)
+{
+  GFileInfo *info;
+  GFileType file_type;
+  char *s;
+
+  info = g_file_info_new ();
+
+  s = g_path_get_basename (g_vfs_ftp_file_get_gvfs_path (file));
+  g_file_info_set_name (info, s);
+  g_file_info_set_is_hidden (info, s[0] == '.');
+  g_free (s);
+
+  file_type = facts->type;
+  if (file_type == G_FILE_TYPE_SYMBOLIC_LINK)
+    {
+      g_file_info_set_symlink_target (info, facts->symlink_target);
+      g_file_info_set_is_symlink (info, TRUE);
+    }
+  else
+    {
+      g_file_info_set_is_symlink (info, FALSE);
+      if (file_type == G_FILE_TYPE_UNKNOWN)
+        file_type = G_FILE_TYPE_REGULAR;
+    }
+
+  if (facts->has_size)
+    g_file_info_set_size (info, facts->size);
+
+  if (facts->has_mode)
+    {
+      guint32 mode = facts->mode;
+
+      switch (file_type)
+        {
+        case G_FILE_TYPE_REGULAR: mode |= S_IFREG; break;
+        case G_FILE_TYPE_DIRECTORY: mode |= S_IFDIR; break;
+        case G_FILE_TYPE_SYMBOLIC_LINK: mode |= S_IFLNK; break;
+        default: break;
+        }
+      g_file_info_set_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_MODE, mode);
+    }
+  if (facts->owner)
+    g_file_info_set_attribute_string (info, G_FILE_ATTRIBUTE_OWNER_USER, facts->owner);
+  if (facts->group)
+    g_file_info_set_attribute_string (info, G_FILE_ATTRIBUTE_OWNER_GROUP, facts->group);
+
+  g_file_info_set_attribute_boolean (info, G_FILE_ATTRIBUTE_ACCESS_CAN_TRASH, FALSE);
+
+  gvfs_file_info_populate_default (info,
+                                   g_vfs_ftp_file_get_gvfs_path (file),
+                                   file_type);
+
+  if (facts->has_mtime)
+    {
+      char *etag = g_strdup_printf ("%" G_GINT64_FORMAT, facts->mtime);
+      g_file_info_set_attribute_string (info,
+                                        G_FILE_ATTRIBUTE_ETAG_VALUE,
+                                        etag);
+      g_free (etag);
+
+      g_file_info_set_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED, facts->mtime);
+      g_file_info_set_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC, facts->mtime_usec);
+    }
+
+  return info;
+}
+
+static gboolean
+g_vfs_ftp_dir_cache_funcs_process_mlsd (GInputStream *        stream,
+                                        int                   debug_id,
+                                        const GVfsFtpFile *   dir,
+                                        GVfsFtpDirCacheEntry *entry,
+                                        GCancellable *        cancellable,
+                                        GError **             error)
+{
+  GVfsFtpMlsxFacts facts;
+  GDataInputStream *data;
+  GVfsFtpFile *file;
+  const char *name;
+  char *line;
+  gsize length;
+
+  g_assert (error != NULL);
+  g_assert (*error == NULL);
+
+  data = g_data_input_stream_new (stream);
+  g_data_input_stream_set_newline_type (data, G_DATA_STREAM_NEWLINE_TYPE_LF);
+  while ((line = g_data_input_stream_read_line (data, &length, cancellable, error)))
+    {
+      if (length > 0 && line[length - 1] == '\r')
+        line[--length] = '\0';
+
+      g_debug ("<<%2d <<  %s\n", debug_id, line);
+      name = g_vfs_ftp_parse_mlsx (line, &facts);
+      if (name == NULL || facts.is_self_or_parent ||
+          strcmp (name, ".") == 0 || strcmp (name, "..") == 0)
+        {
+          g_free (line);
+          continue;
+        }
+
+      file = g_vfs_ftp_file_new_child (dir, name, NULL);
+      if (file == NULL)
+        {
+          g_debug ("# invalid filename, skipping");
+          g_free (line);
+          continue;
+        }
+
+      g_vfs_ftp_dir_cache_entry_add (entry, file,
+                                     g_vfs_ftp_dir_cache_mlsx_info (file, &facts));
+      g_free (line);
+    }
+
+  g_object_unref (data);
+  return *error != NULL;
+}
+
+/* MLST gets the same facts over the control connection, for files in
+ * directories that can't be listed */
+static GFileInfo *
+g_vfs_ftp_dir_cache_funcs_lookup_uncached_mlst (GVfsFtpTask *      task,
+                                                const GVfsFtpFile *file)
+{
+  GVfsFtpMlsxFacts facts;
+  GFileInfo *info = NULL;
+  char **reply;
+  guint i;
+
+  if (g_vfs_ftp_file_is_root (file))
+    return create_root_file_info (task->backend);
+
+  if (!g_vfs_ftp_task_send_and_check (task, 0, NULL, NULL, &reply,
+                                      "MLST %s", g_vfs_ftp_file_get_ftp_path (file)))
+    {
+      g_vfs_ftp_task_clear_error (task);
+      return g_vfs_ftp_dir_cache_funcs_lookup_uncached (task, file);
+    }
+
+  /* The facts are on the line starting with a space */
+  for (i = 1; reply[i] != NULL && info == NULL; i++)
+    {
+      if (reply[i][0] == ' ' &&
+          g_vfs_ftp_parse_mlsx (reply[i] + 1, &facts) != NULL)
+        info = g_vfs_ftp_dir_cache_mlsx_info (file, &facts);
+    }
+  g_strfreev (reply);
+
+  if (info == NULL)
+    return g_vfs_ftp_dir_cache_funcs_lookup_uncached (task, file);
+
+  return info;
+}
+
 const GVfsFtpDirFuncs g_vfs_ftp_dir_cache_funcs_unix = {
   "LIST -a",
   g_vfs_ftp_dir_cache_funcs_process_unix,
   g_vfs_ftp_dir_cache_funcs_lookup_uncached,
-  g_vfs_ftp_dir_cache_funcs_resolve_default
+  g_vfs_ftp_dir_cache_funcs_resolve_default,
+  FALSE
 };
 
 const GVfsFtpDirFuncs g_vfs_ftp_dir_cache_funcs_default = {
   "LIST",
   g_vfs_ftp_dir_cache_funcs_process_default,
   g_vfs_ftp_dir_cache_funcs_lookup_uncached,
-  g_vfs_ftp_dir_cache_funcs_resolve_default
+  g_vfs_ftp_dir_cache_funcs_resolve_default,
+  FALSE
+};
+
+const GVfsFtpDirFuncs g_vfs_ftp_dir_cache_funcs_mlsd = {
+  "MLSD",
+  g_vfs_ftp_dir_cache_funcs_process_mlsd,
+  g_vfs_ftp_dir_cache_funcs_lookup_uncached_mlst,
+  g_vfs_ftp_dir_cache_funcs_resolve_default,
+  TRUE
 };
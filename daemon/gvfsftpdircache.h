@@ -46,10 +46,12 @@ struct _GVfsFtpDirFuncs {
   GVfsFtpFile *         (* resolve_symlink)                     (GVfsFtpTask *          task,
                                                                  const GVfsFtpFile *    file,
                                                                  const char *           target);
+  gboolean              exact_mtime;                            /* listing has the time of day, no MDTM needed */
 };
 
 extern const GVfsFtpDirFuncs g_vfs_ftp_dir_cache_funcs_unix;
 extern const GVfsFtpDirFuncs g_vfs_ftp_dir_cache_funcs_default;
+extern const GVfsFtpDirFuncs g_vfs_ftp_dir_cache_funcs_mlsd;
 
 GVfsFtpDirCache *       g_vfs_ftp_dir_cache_new                 (const GVfsFtpDirFuncs *funcs);
 void                    g_vfs_ftp_dir_cache_free                (GVfsFtpDirCache *      cache);
@@ -183,6 +183,46 @@ reconnect_certificate_cb (GTlsConnection *conn,
          g_tls_certificate_is_same (certificate, ftp->certificate);
 }
 
+/* Opens and logs in a new control connection for task. The caller must
+ * already have accounted for it in the backend's connection count. */
+static gboolean
+g_vfs_ftp_task_connect (GVfsFtpTask *task)
+{
+  GVfsBackendFtp *ftp = task->backend;
+
+  task->conn = g_vfs_ftp_connection_new (ftp->addr, task->cancellable, &task->error);
+  if (G_UNLIKELY (task->conn == NULL))
+    return FALSE;
+
+  g_vfs_ftp_task_initial_handshake (task, reconnect_certificate_cb, ftp);
+  g_vfs_ftp_task_login (task, ftp->user, ftp->password);
+  g_vfs_ftp_task_setup_connection (task);
+  if (G_UNLIKELY (g_vfs_ftp_task_is_in_error (task)))
+    {
+      g_vfs_ftp_connection_free (task->conn);
+      task->conn = NULL;
+      return FALSE;
+    }
+
+  g_mutex_lock (&ftp->mutex);
+  ftp->stat_connects++;
+  g_mutex_unlock (&ftp->mutex);
+
+  return TRUE;
+}
+
+/* Adds the time task held its connection to the statistics.
+ * The backend's mutex must be locked. */
+static void
+g_vfs_ftp_task_account_hold_time (GVfsFtpTask *task)
+{
+  if (task->acquired == 0)
+    return;
+
+  task->backend->stat_hold_time += g_get_monotonic_time () - task->acquired;
+  task->acquired = 0;
+}
+
 /**
  * g_vfs_ftp_task_acquire_connection:
  * @task: a task without an associated connection
@@ -202,7 +242,7 @@ static gboolean
 g_vfs_ftp_task_acquire_connection (GVfsFtpTask *task)
 {
   GVfsBackendFtp *ftp;
-  gint64 end_time;
+  gint64 start_time, end_time;
   gulong id;
 
   g_return_val_if_fail (task != NULL, FALSE);
@@ -212,6 +252,7 @@ g_vfs_ftp_task_acquire_connection (GVfsFtpTask *task)
     return FALSE;
 
   ftp = task->backend;
+  start_time = g_get_monotonic_time ();
   g_mutex_lock (&ftp->mutex);
   id = g_cancellable_connect (task->cancellable,
         		      G_CALLBACK (do_broadcast),
@@ -248,18 +289,8 @@ g_vfs_ftp_task_acquire_connection (GVfsFtpTask *task)
           ftp->connections++;
           last_thread = g_thread_self ();
           g_mutex_unlock (&ftp->mutex);
-          task->conn = g_vfs_ftp_connection_new (ftp->addr, task->cancellable, &task->error);
-          if (G_LIKELY (task->conn != NULL))
-            {
-              g_vfs_ftp_task_initial_handshake (task, reconnect_certificate_cb, ftp);
-              g_vfs_ftp_task_login (task, ftp->user, ftp->password);
-              g_vfs_ftp_task_setup_connection (task);
-              if (G_LIKELY (!g_vfs_ftp_task_is_in_error (task)))
-                goto out_unlocked;
-
-              g_vfs_ftp_connection_free (task->conn);
-              task->conn = NULL;
-            }
+          if (g_vfs_ftp_task_connect (task))
+            goto out_unlocked;
 
           g_mutex_lock (&ftp->mutex);
           ftp->connections--;
@@ -306,6 +337,18 @@ g_vfs_ftp_task_acquire_connection (GVfsFtpTask *task)
 out_unlocked:
   g_cancellable_disconnect (task->cancellable, id);
 
+  if (task->conn != NULL)
+    {
+      gint64 now = g_get_monotonic_time ();
+
+      g_mutex_lock (&ftp->mutex);
+      ftp->stat_acquires++;
+      ftp->stat_acquire_time += now - start_time;
+      ftp->stat_acquire_time_max = MAX (ftp->stat_acquire_time_max, now - start_time);
+      g_mutex_unlock (&ftp->mutex);
+      task->acquired = now;
+    }
+
   return task->conn != NULL;
 }
 
@@ -320,7 +363,7 @@ out_unlocked:
  *
  * This function also closes all potentially open data connections.
  **/
-static void
+void
 g_vfs_ftp_task_release_connection (GVfsFtpTask *task)
 {
   g_return_if_fail (task != NULL);
@@ -332,6 +375,7 @@ g_vfs_ftp_task_release_connection (GVfsFtpTask *task)
   g_vfs_ftp_task_close_data_connection (task);
 
   g_mutex_lock (&task->backend->mutex);
+  g_vfs_ftp_task_account_hold_time (task);
   if (task->backend->queue && g_vfs_ftp_connection_is_usable (task->conn))
     {
       g_queue_push_tail (task->backend->queue, task->conn);
@@ -510,6 +554,7 @@ g_vfs_ftp_task_take_connection (GVfsFtpTask *task)
   ftp = task->backend;
   /* mark this connection as busy */
   g_mutex_lock (&ftp->mutex);
+  g_vfs_ftp_task_account_hold_time (task);
   ftp->busy_connections++;
   /* if all connections are busy, signal all waiting threads, 
    * so they stop waiting and return BUSY earlier */
@@ -753,6 +798,8 @@ g_vfs_ftp_task_receive (GVfsFtpTask *        task,
         g_vfs_ftp_task_set_error_from_response (task, response);
         break;
       case 4:
+        if (flags & G_VFS_FTP_PASS_400)
+          break;
         g_vfs_ftp_task_set_error_from_response (task, response);
         break;
       case 5:
@@ -1179,6 +1226,51 @@ g_vfs_ftp_task_open_data_connection (GVfsFtpTask *task)
                                                      &task->error);
 }
 
+static gboolean
+g_vfs_ftp_task_enable_tls (GVfsFtpTask *       task,
+                           gboolean            implicit_tls,
+                           CertificateCallback cb,
+                           gpointer            user_data)
+{
+  GVfsBackendFtp *ftp = task->backend;
+  GTlsClientConnection *session;
+  GList *walk;
+  gboolean success;
+
+  /* resume the session of an earlier connection that is still open, so
+   * that opening more connections doesn't cost a full handshake each time.
+   * If the last connection that did a handshake is gone, any idle one will
+   * do. */
+  session = g_weak_ref_get (&ftp->tls_session);
+  if (session == NULL)
+    {
+      g_mutex_lock (&ftp->mutex);
+      for (walk = ftp->queue ? ftp->queue->head : NULL; walk && session == NULL; walk = walk->next)
+        {
+          GTlsClientConnection *tls = g_vfs_ftp_connection_get_tls_connection (walk->data);
+
+          if (tls)
+            session = g_object_ref (tls);
+        }
+      g_mutex_unlock (&ftp->mutex);
+    }
+
+  success = g_vfs_ftp_connection_enable_tls (task->conn,
+                                             ftp->server_identity,
+                                             implicit_tls,
+                                             session,
+                                             cb,
+                                             user_data,
+                                             task->cancellable,
+                                             &task->error);
+  g_clear_object (&session);
+
+  if (success)
+    g_weak_ref_set (&ftp->tls_session, g_vfs_ftp_connection_get_tls_connection (task->conn));
+
+  return success;
+}
+
 /**
  * g_vfs_ftp_task_initial_handshake:
  * @task: a task
@@ -1203,13 +1295,7 @@ g_vfs_ftp_task_initial_handshake (GVfsFtpTask *task,
 
   if (task->backend->tls_mode == G_VFS_FTP_TLS_MODE_IMPLICIT)
     {
-      if (!g_vfs_ftp_connection_enable_tls (task->conn,
-                                            task->backend->server_identity,
-                                            TRUE,
-                                            cb,
-                                            user_data,
-                                            task->cancellable,
-                                            &task->error))
+      if (!g_vfs_ftp_task_enable_tls (task, TRUE, cb, user_data))
         return FALSE;
 
       if (!g_vfs_ftp_task_receive (task, 0, NULL))
@@ -1223,13 +1309,7 @@ g_vfs_ftp_task_initial_handshake (GVfsFtpTask *task,
       if (!g_vfs_ftp_task_send (task, 0, "AUTH TLS"))
         return FALSE;
 
-      if (!g_vfs_ftp_connection_enable_tls (task->conn,
-                                            task->backend->server_identity,
-                                            FALSE,
-                                            cb,
-                                            user_data,
-                                            task->cancellable,
-                                            &task->error))
+      if (!g_vfs_ftp_task_enable_tls (task, FALSE, cb, user_data))
         return FALSE;
     }
   else
@@ -1251,3 +1331,177 @@ g_vfs_ftp_task_initial_handshake (GVfsFtpTask *task,
 
   return TRUE;
 }
+
+/*** connection pool maintenance ***/
+
+#define G_VFS_FTP_DEFAULT_POOL_SIZE 2
+#define G_VFS_FTP_DEFAULT_KEEPALIVE_INTERVAL 60
+
+static guint
+get_pool_setting (const char *variable, guint default_value)
+{
+  const char *str;
+
+  str = g_getenv (variable);
+  if (str == NULL)
+    return default_value;
+
+  return CLAMP (g_ascii_strtoll (str, NULL, 10), 0, G_MAXUINT);
+}
+
+static gpointer
+g_vfs_ftp_task_pool_thread (gpointer data)
+{
+  GVfsBackendFtp *ftp = data;
+  GVfsFtpTask task = { ftp, NULL, ftp->pool_cancellable, };
+  GQueue idle = G_QUEUE_INIT;
+  GVfsFtpConnection *conn;
+  GList *walk, *next;
+
+  /* Take out connections that haven't been used for a while and send a
+   * NOOP, so the server doesn't close them for being idle. */
+  g_mutex_lock (&ftp->mutex);
+  if (ftp->queue && ftp->keepalive_interval > 0)
+    {
+      for (walk = ftp->queue->head; walk; walk = next)
+        {
+          next = walk->next;
+          conn = walk->data;
+          if (g_vfs_ftp_connection_get_idle_time (conn) < ftp->keepalive_interval * G_TIME_SPAN_SECOND)
+            continue;
+
+          g_queue_unlink (ftp->queue, walk);
+          g_queue_push_tail_link (&idle, walk);
+        }
+    }
+  g_mutex_unlock (&ftp->mutex);
+
+  while ((conn = g_queue_pop_head (&idle)))
+    {
+      task.conn = conn;
+      g_vfs_ftp_task_send (&task, 0, "NOOP");
+      g_vfs_ftp_task_clear_error (&task);
+      /* puts the connection back or frees it if the server closed it */
+      g_vfs_ftp_task_release_connection (&task);
+    }
+
+  /* Open connections until the pool has its target size, so bursts of
+   * jobs find a logged in connection waiting. */
+  while (!g_cancellable_is_cancelled (task.cancellable))
+    {
+      g_mutex_lock (&ftp->mutex);
+      if (ftp->queue == NULL ||
+          ftp->connections >= MIN (ftp->pool_size, ftp->max_connections))
+        {
+          g_mutex_unlock (&ftp->mutex);
+          break;
+        }
+      ftp->connections++;
+      g_mutex_unlock (&ftp->mutex);
+
+      if (!g_vfs_ftp_task_connect (&task))
+        {
+          /* leave finding the server's limit to acquiring connections */
+          g_debug ("# could not open pool connection: %s\n", task.error->message);
+          g_vfs_ftp_task_clear_error (&task);
+          g_mutex_lock (&ftp->mutex);
+          ftp->connections--;
+          g_mutex_unlock (&ftp->mutex);
+          break;
+        }
+
+      g_vfs_ftp_task_release_connection (&task);
+    }
+
+  g_mutex_lock (&ftp->mutex);
+  ftp->pool_thread_running = FALSE;
+  g_mutex_unlock (&ftp->mutex);
+
+  return NULL;
+}
+
+static gboolean
+g_vfs_ftp_task_pool_timeout (gpointer data)
+{
+  GVfsBackendFtp *ftp = data;
+  GThread *finished = NULL;
+
+  g_mutex_lock (&ftp->mutex);
+  if (ftp->queue != NULL && !ftp->pool_thread_running)
+    {
+      finished = ftp->pool_thread;
+      ftp->pool_thread_running = TRUE;
+      ftp->pool_thread = g_thread_new ("gvfsd-ftp pool", g_vfs_ftp_task_pool_thread, ftp);
+    }
+  g_mutex_unlock (&ftp->mutex);
+
+  if (finished)
+    g_thread_join (finished);
+
+  return G_SOURCE_CONTINUE;
+}
+
+/**
+ * g_vfs_ftp_task_start_pool:
+ * @ftp: a backend that was just mounted
+ *
+ * Starts keeping a few connections open in the background, so jobs don't
+ * have to connect and log in before they can start. Connections are opened
+ * until GVFS_FTP_POOL_SIZE connections (2 by default) exist and idle ones
+ * get a NOOP every GVFS_FTP_KEEPALIVE seconds (60 by default, 0 disables
+ * both).
+ **/
+void
+g_vfs_ftp_task_start_pool (GVfsBackendFtp *ftp)
+{
+  g_return_if_fail (G_VFS_IS_BACKEND_FTP (ftp));
+  g_return_if_fail (ftp->keepalive_id == 0);
+
+  ftp->pool_size = get_pool_setting ("GVFS_FTP_POOL_SIZE", G_VFS_FTP_DEFAULT_POOL_SIZE);
+  ftp->keepalive_interval = get_pool_setting ("GVFS_FTP_KEEPALIVE", G_VFS_FTP_DEFAULT_KEEPALIVE_INTERVAL);
+  if (ftp->keepalive_interval == 0)
+    return;
+
+  ftp->pool_cancellable = g_cancellable_new ();
+  g_vfs_ftp_task_pool_timeout (ftp);
+  ftp->keepalive_id = g_timeout_add_seconds (ftp->keepalive_interval,
+                                             g_vfs_ftp_task_pool_timeout,
+                                             ftp);
+}
+
+/**
+ * g_vfs_ftp_task_stop_pool:
+ * @ftp: the backend
+ *
+ * Stops the background work started by g_vfs_ftp_task_start_pool() and
+ * waits for it to finish. Call this after the connection queue was freed,
+ * so no new work can be started in the meantime. The backend calls it
+ * again when it is finalized, as the pool thread and the keepalive source
+ * don't hold a reference on it.
+ **/
+void
+g_vfs_ftp_task_stop_pool (GVfsBackendFtp *ftp)
+{
+  GThread *thread;
+
+  g_return_if_fail (G_VFS_IS_BACKEND_FTP (ftp));
+
+  if (ftp->keepalive_id)
+    {
+      g_source_remove (ftp->keepalive_id);
+      ftp->keepalive_id = 0;
+    }
+
+  if (ftp->pool_cancellable)
+    g_cancellable_cancel (ftp->pool_cancellable);
+
+  g_mutex_lock (&ftp->mutex);
+  thread = ftp->pool_thread;
+  ftp->pool_thread = NULL;
+  g_mutex_unlock (&ftp->mutex);
+
+  if (thread)
+    g_thread_join (thread);
+
+  g_clear_object (&ftp->pool_cancellable);
+}
@@ -33,7 +33,8 @@ typedef enum {
   G_VFS_FTP_PASS_300 = (1 << 1),
   G_VFS_FTP_PASS_500 = (1 << 2),
   G_VFS_FTP_PASS_550 = (1 << 3),
-  G_VFS_FTP_FAIL_200 = (1 << 4)
+  G_VFS_FTP_FAIL_200 = (1 << 4),
+  G_VFS_FTP_PASS_400 = (1 << 5)
 } GVfsFtpResponseFlags;
 
 #define G_VFS_FTP_RESPONSE_GROUP(response) ((response) / 100)
@@ -48,6 +49,7 @@ struct _GVfsFtpTask
   GError *              error;          /* NULL or current error - will be propagated to task */
   GVfsFtpConnection *   conn;           /* connection in use by this task or NULL if none */
   GVfsFtpMethod         method;         /* method currently in use (only valid after call to _setup_data_connection() */
+  gint64                acquired;       /* monotonic time conn was acquired, for statistics */
 };
 
 typedef void (* GVfsFtpErrorFunc) (GVfsFtpTask *task, gpointer data);
@@ -64,6 +66,7 @@ void                    g_vfs_ftp_task_set_error_from_response  (GVfsFtpTask *
 void                    g_vfs_ftp_task_give_connection          (GVfsFtpTask *          task,
                                                                  GVfsFtpConnection *    conn);
 GVfsFtpConnection *     g_vfs_ftp_task_take_connection          (GVfsFtpTask *          task);
+void                    g_vfs_ftp_task_release_connection       (GVfsFtpTask *          task);
 
 guint                   g_vfs_ftp_task_send                     (GVfsFtpTask *          task,
                                                                  GVfsFtpResponseFlags   flags,
@@ -97,6 +100,9 @@ gboolean                g_vfs_ftp_task_initial_handshake        (GVfsFtpTask *
                                                                  CertificateCallback    cb,
                                                                  gpointer               user_data);
 
+void                    g_vfs_ftp_task_start_pool               (GVfsBackendFtp *       ftp);
+void                    g_vfs_ftp_task_stop_pool                (GVfsBackendFtp *       ftp);
+
 
 G_END_DECLS
 
@@ -50,7 +50,7 @@ enum {
 
 struct _GVfsJobPrivate
 {
-  int dummy;
+  gint priority; /* -1 to use the class default */
 };
 
 G_DEFINE_TYPE_WITH_PRIVATE (GVfsJob, g_vfs_job, G_TYPE_OBJECT)
@@ -94,6 +94,8 @@ g_vfs_job_class_init (GVfsJobClass *klass)
   gobject_class->set_property = g_vfs_job_set_property;
   gobject_class->get_property = g_vfs_job_get_property;
 
+  klass->priority = G_VFS_JOB_PRIORITY_NORMAL;
+
   signals[CANCELLED] =
     g_signal_new ("cancelled",
 		  G_TYPE_FROM_CLASS (gobject_class),
@@ -132,11 +134,39 @@ static void
 g_vfs_job_init (GVfsJob *job)
 {
   job->priv = g_vfs_job_get_instance_private (job);
+  job->priv->priority = -1;
 
   job->cancellable = g_cancellable_new ();
   
 }
 
+/**
+ * g_vfs_job_set_priority:
+ * @job: a #GVfsJob
+ * @priority: the scheduling lane to use
+ *
+ * Overrides the default scheduling lane of the job class, e.g. when the
+ * caller hinted that an operation is part of a bulk transfer. This only
+ * has an effect before the job is queued.
+ */
+void
+g_vfs_job_set_priority (GVfsJob         *job,
+                        GVfsJobPriority  priority)
+{
+  g_return_if_fail (priority < G_VFS_JOB_N_PRIORITIES);
+
+  job->priv->priority = priority;
+}
+
+GVfsJobPriority
+g_vfs_job_get_priority (GVfsJob *job)
+{
+  if (job->priv->priority >= 0)
+    return job->priv->priority;
+
+  return G_VFS_JOB_GET_CLASS (job)->priority;
+}
+
 void
 g_vfs_job_set_backend_data (GVfsJob     *job,
 			    gpointer     backend_data,
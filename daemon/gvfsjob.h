@@ -42,6 +42,14 @@ typedef struct _GVfsJobClass   GVfsJobClass;
 /* Defined here to avoid circular includes */
 typedef struct _GVfsJobSource GVfsJobSource;
 
+/* Scheduling lanes for jobs waiting for a worker thread, most urgent first */
+typedef enum {
+  G_VFS_JOB_PRIORITY_INTERACTIVE,
+  G_VFS_JOB_PRIORITY_NORMAL,
+  G_VFS_JOB_PRIORITY_BULK,
+  G_VFS_JOB_N_PRIORITIES
+} GVfsJobPriority;
+
 struct _GVfsJob
 {
   GObject parent_instance;
@@ -75,6 +83,9 @@ struct _GVfsJobClass
 
   void     (*run)    (GVfsJob *job);
   gboolean (*try)    (GVfsJob *job);
+
+  /* Default scheduling lane for jobs of this class */
+  GVfsJobPriority priority;
 };
 
 GType g_vfs_job_get_type (void);
@@ -82,6 +93,9 @@ GType g_vfs_job_get_type (void);
 void     g_vfs_job_set_backend_data  (GVfsJob     *job,
 				      gpointer     backend_data,
 				      GDestroyNotify destroy);
+void     g_vfs_job_set_priority      (GVfsJob     *job,
+				      GVfsJobPriority priority);
+GVfsJobPriority g_vfs_job_get_priority (GVfsJob   *job);
 gboolean g_vfs_job_is_finished       (GVfsJob     *job);
 gboolean g_vfs_job_is_cancelled      (GVfsJob     *job);
 void     g_vfs_job_cancel            (GVfsJob     *job);
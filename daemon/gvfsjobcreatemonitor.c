@@ -64,6 +64,7 @@ g_vfs_job_create_monitor_class_init (GVfsJobCreateMonitorClass *klass)
   gobject_class->finalize = g_vfs_job_create_monitor_finalize;
   job_class->run = run;
   job_class->try = try;
+  job_class->priority = G_VFS_JOB_PRIORITY_INTERACTIVE;
   job_dbus_class->create_reply = create_reply;
 }
 
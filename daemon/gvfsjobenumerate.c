@@ -33,6 +33,13 @@
 #include "gvfsdaemonprotocol.h"
 #include <gvfsdbus.h>
 
+/* Compact batches start small so the first files show up quickly, and
+ * grow as the enumeration goes on. A batch is also sent once it has
+ * been collected for a while, for slow backends. */
+#define BATCH_MIN_SIZE  (4*1024)
+#define BATCH_MAX_SIZE  (1024*1024)
+#define BATCH_MAX_DELAY (100 * G_TIME_SPAN_MILLISECOND)
+
 G_DEFINE_TYPE (GVfsJobEnumerate, g_vfs_job_enumerate, G_VFS_TYPE_JOB_DBUS)
 
 static void         run        (GVfsJob        *job);
@@ -54,6 +61,8 @@ g_vfs_job_enumerate_finalize (GObject *object)
   g_file_attribute_matcher_unref (job->attribute_matcher);
   g_free (job->object_path);
   g_free (job->uri);
+  if (job->building_batch)
+    g_bytes_unref (gvfs_file_info_batch_free_to_bytes (job->building_batch));
   
   if (G_OBJECT_CLASS (g_vfs_job_enumerate_parent_class)->finalize)
     (*G_OBJECT_CLASS (g_vfs_job_enumerate_parent_class)->finalize) (object);
@@ -103,7 +112,10 @@ g_vfs_job_enumerate_new_handle (GVfsDBusMount *object,
   job->backend = backend;
   job->attributes = g_strdup (arg_attributes);
   job->attribute_matcher = g_file_attribute_matcher_new (arg_attributes);
-  job->flags = arg_flags;
+  job->flags = arg_flags & ~G_VFS_ENUMERATE_FLAG_COMPACT_INFOS;
+  job->compact_infos = (arg_flags & G_VFS_ENUMERATE_FLAG_COMPACT_INFOS) != 0;
+  job->batch_max_size = BATCH_MIN_SIZE;
+  job->last_send_time = g_get_monotonic_time ();
   job->uri = g_strdup (arg_uri);
 
   g_vfs_job_source_new_job (G_VFS_JOB_SOURCE (backend), G_VFS_JOB (job));
@@ -169,18 +181,66 @@ send_infos (GVfsJobEnumerate *job)
   job->n_building_infos = 0;
 }
 
+/* Sent without waiting for a reply, messages on the connection stay
+ * in order so Done still comes last */
+static void
+send_compact_infos (GVfsJobEnumerate *job)
+{
+  GDBusMethodInvocation *invocation = G_VFS_JOB_DBUS (job)->invocation;
+  GDBusMessage *message;
+  GBytes *bytes;
+  GError *error = NULL;
+
+  bytes = gvfs_file_info_batch_free_to_bytes (job->building_batch);
+  job->building_batch = NULL;
+
+  message = g_dbus_message_new_method_call (g_dbus_method_invocation_get_sender (invocation),
+                                            job->object_path,
+                                            gvfs_dbus_enumerator_interface_info ()->name,
+                                            "GotInfoCompact");
+  g_dbus_message_set_body (message,
+                           g_variant_new ("(@ay)",
+                                          g_variant_new_from_bytes (G_VARIANT_TYPE_BYTESTRING,
+                                                                    bytes, TRUE)));
+  g_dbus_message_set_flags (message, G_DBUS_MESSAGE_FLAGS_NO_REPLY_EXPECTED);
+
+  if (!g_dbus_connection_send_message (g_dbus_method_invocation_get_connection (invocation),
+                                       message,
+                                       G_DBUS_SEND_MESSAGE_FLAGS_NONE,
+                                       NULL,
+                                       &error))
+    {
+      g_debug ("send_compact_infos: %s (%s, %d)\n", error->message, g_quark_to_string (error->domain), error->code);
+      g_error_free (error);
+    }
+
+  g_object_unref (message);
+  g_bytes_unref (bytes);
+
+  job->batch_max_size = MIN (job->batch_max_size * 2, BATCH_MAX_SIZE);
+  job->last_send_time = g_get_monotonic_time ();
+}
+
+static void
+add_compact_info (GVfsJobEnumerate *job,
+                  GFileInfo *info)
+{
+  if (job->building_batch == NULL)
+    job->building_batch = gvfs_file_info_batch_new ();
+
+  gvfs_file_info_batch_add (job->building_batch, info);
+
+  if (gvfs_file_info_batch_get_size (job->building_batch) >= job->batch_max_size ||
+      g_get_monotonic_time () - job->last_send_time >= BATCH_MAX_DELAY)
+    send_compact_infos (job);
+}
+
 void
 g_vfs_job_enumerate_add_info (GVfsJobEnumerate *job,
 			      GFileInfo *info)
 {
   char *uri, *escaped_name;
   GVariant *v;
-  
-  if (job->building_infos == NULL)
-    {
-      job->building_infos = g_variant_builder_new (G_VARIANT_TYPE ("aa(suv)"));
-      job->n_building_infos = 0;
-    }
 
   uri = NULL;
   if (job->uri != NULL &&
@@ -201,6 +261,18 @@ g_vfs_job_enumerate_add_info (GVfsJobEnumerate *job,
 
   g_file_info_set_attribute_mask (info, job->attribute_matcher);
 
+  if (job->compact_infos)
+    {
+      add_compact_info (job, info);
+      return;
+    }
+
+  if (job->building_infos == NULL)
+    {
+      job->building_infos = g_variant_builder_new (G_VARIANT_TYPE ("aa(suv)"));
+      job->n_building_infos = 0;
+    }
+
   v = _g_dbus_append_file_info (info);
   g_variant_builder_add_value (job->building_infos, v);
   job->n_building_infos++;
@@ -248,6 +320,8 @@ g_vfs_job_enumerate_done (GVfsJobEnumerate *job)
 
   if (job->building_infos != NULL)
     send_infos (job);
+  if (job->building_batch != NULL)
+    send_compact_infos (job);
 
   proxy = create_enumerator_proxy (job);
   
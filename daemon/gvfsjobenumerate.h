@@ -27,6 +27,7 @@
 #include <gvfsjob.h>
 #include <gvfsjobdbus.h>
 #include <gvfsbackend.h>
+#include <gvfsfileinfo.h>
 
 G_BEGIN_DECLS
 
@@ -53,6 +54,12 @@ struct _GVfsJobEnumerate
 
   GVariantBuilder *building_infos;
   int n_building_infos;
+
+  /* Compact infos, for clients that support them */
+  gboolean compact_infos;
+  GVfsFileInfoBatch *building_batch;
+  gsize batch_max_size;
+  gint64 last_send_time;
 };
 
 struct _GVfsJobEnumerateClass
@@ -80,13 +80,14 @@ g_vfs_job_open_for_read_init (GVfsJobOpenForRead *job)
 {
 }
 
-gboolean
-g_vfs_job_open_for_read_new_handle (GVfsDBusMount *object,
-                                    GDBusMethodInvocation *invocation,
-                                    GUnixFDList *fd_list,
-                                    const gchar *arg_path_data,
-                                    guint arg_pid,
-                                    GVfsBackend *backend)
+static gboolean
+open_for_read_new_handle_common (GVfsDBusMount *object,
+                                 GDBusMethodInvocation *invocation,
+                                 const gchar *arg_path_data,
+                                 guint arg_flags,
+                                 guint arg_pid,
+                                 GVfsBackend *backend,
+                                 GVfsJobOpenForReadVersion version)
 {
   GVfsJobOpenForRead *job;
 
@@ -101,6 +102,8 @@ g_vfs_job_open_for_read_new_handle (GVfsDBusMount *object,
   job->filename = g_strdup (arg_path_data);
   job->backend = backend;
   job->pid = arg_pid;
+  job->flags = arg_flags;
+  job->version = version;
 
   g_vfs_job_source_new_job (G_VFS_JOB_SOURCE (backend), G_VFS_JOB (job));
   g_object_unref (job);
@@ -108,6 +111,41 @@ g_vfs_job_open_for_read_new_handle (GVfsDBusMount *object,
   return TRUE;
 }
 
+gboolean
+g_vfs_job_open_for_read_new_handle (GVfsDBusMount *object,
+                                    GDBusMethodInvocation *invocation,
+                                    GUnixFDList *fd_list,
+                                    const gchar *arg_path_data,
+                                    guint arg_pid,
+                                    GVfsBackend *backend)
+{
+  return open_for_read_new_handle_common (object,
+                                          invocation,
+                                          arg_path_data,
+                                          0,
+                                          arg_pid,
+                                          backend,
+                                          OPEN_FOR_READ_VERSION_ORIGINAL);
+}
+
+gboolean
+g_vfs_job_open_for_read_new_handle_with_flags (GVfsDBusMount *object,
+                                               GDBusMethodInvocation *invocation,
+                                               GUnixFDList *fd_list,
+                                               const gchar *arg_path_data,
+                                               guint arg_flags,
+                                               guint arg_pid,
+                                               GVfsBackend *backend)
+{
+  return open_for_read_new_handle_common (object,
+                                          invocation,
+                                          arg_path_data,
+                                          arg_flags,
+                                          arg_pid,
+                                          backend,
+                                          OPEN_FOR_READ_VERSION_WITH_FLAGS);
+}
+
 static void
 run (GVfsJob *job)
 {
@@ -163,9 +201,12 @@ create_reply (GVfsJob *job,
 {
   GVfsJobOpenForRead *open_job = G_VFS_JOB_OPEN_FOR_READ (job);
   GVfsReadChannel *channel;
+  GVfsSharedRing *ring;
   GError *error;
   int remote_fd;
   int fd_id;
+  int ring_fd_id;
+  guint32 flags;
   GUnixFDList *fd_list;
 
   g_assert (open_job->backend_handle != NULL);
@@ -194,6 +235,36 @@ create_reply (GVfsJob *job,
       g_error_free (error);
     }
 
+  flags = open_job->can_seek ? OPEN_FOR_READ_FLAG_CAN_SEEK : 0;
+  ring_fd_id = fd_id;
+  if (open_job->version == OPEN_FOR_READ_VERSION_WITH_FLAGS &&
+      (open_job->flags & OPEN_FOR_READ_FLAG_SHARED_MEMORY) &&
+      g_vfs_backend_get_shared_read_memory (open_job->backend))
+    {
+      /* Without a ring the client gets the data inline as usual */
+      error = NULL;
+      ring = g_vfs_shared_ring_new (G_VFS_SHARED_RING_SIZE, &error);
+      if (ring != NULL)
+        {
+          ring_fd_id = g_unix_fd_list_append (fd_list, g_vfs_shared_ring_get_fd (ring), NULL);
+          if (ring_fd_id != -1)
+            {
+              g_vfs_read_channel_set_shared_ring (channel, ring);
+              flags |= OPEN_FOR_READ_FLAG_SHARED_MEMORY;
+            }
+          else
+            {
+              g_vfs_shared_ring_free (ring);
+              ring_fd_id = fd_id;
+            }
+        }
+      else
+        {
+          g_debug ("create_reply: no shared memory ring: %s\n", error->message);
+          g_clear_error (&error);
+        }
+    }
+
   g_vfs_channel_set_backend_handle (G_VFS_CHANNEL (channel), open_job->backend_handle);
   open_job->backend_handle = NULL;
   open_job->read_channel = channel;
@@ -204,6 +275,11 @@ create_reply (GVfsJob *job,
     gvfs_dbus_mount_complete_open_icon_for_read (object, invocation,
                                                  fd_list, g_variant_new_handle (fd_id),
                                                  open_job->can_seek);
+  else if (open_job->version == OPEN_FOR_READ_VERSION_WITH_FLAGS)
+    gvfs_dbus_mount_complete_open_for_read_flags (object, invocation,
+                                                  fd_list, g_variant_new_handle (fd_id),
+                                                  g_variant_new_handle (ring_fd_id),
+                                                  flags);
   else
     gvfs_dbus_mount_complete_open_for_read (object, invocation,
                                             fd_list, g_variant_new_handle (fd_id),
@@ -38,6 +38,11 @@ G_BEGIN_DECLS
 
 typedef struct _GVfsJobOpenForReadClass   GVfsJobOpenForReadClass;
 
+typedef enum {
+  OPEN_FOR_READ_VERSION_ORIGINAL,
+  OPEN_FOR_READ_VERSION_WITH_FLAGS,
+} GVfsJobOpenForReadVersion;
+
 struct _GVfsJobOpenForRead
 {
   GVfsJobDBus parent_instance;
@@ -48,6 +53,8 @@ struct _GVfsJobOpenForRead
   gboolean can_seek;
   GVfsReadChannel *read_channel;
   gboolean read_icon;
+  guint32 flags;
+  GVfsJobOpenForReadVersion version;
 
   GPid pid;
 };
@@ -65,6 +72,13 @@ gboolean         g_vfs_job_open_for_read_new_handle    (GVfsDBusMount         *o
                                                         const gchar           *arg_path_data,
                                                         guint                  arg_pid,
                                                         GVfsBackend           *backend);
+gboolean         g_vfs_job_open_for_read_new_handle_with_flags (GVfsDBusMount         *object,
+                                                        GDBusMethodInvocation *invocation,
+                                                        GUnixFDList           *fd_list,
+                                                        const gchar           *arg_path_data,
+                                                        guint                  arg_flags,
+                                                        guint                  arg_pid,
+                                                        GVfsBackend           *backend);
 void             g_vfs_job_open_for_read_set_handle    (GVfsJobOpenForRead *job,
 							GVfsBackendHandle   handle);
 void             g_vfs_job_open_for_read_set_can_seek  (GVfsJobOpenForRead *job,
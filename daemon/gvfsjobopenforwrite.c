@@ -385,7 +385,8 @@ create_reply (GVfsJob *job,
         gvfs_dbus_mount_complete_open_for_write_flags (object, invocation,
                                                  fd_list, g_variant_new_handle (fd_id),
                                                  (open_job->can_seek ? OPEN_FOR_WRITE_FLAG_CAN_SEEK : 0) |
-                                                 (open_job->can_truncate ? OPEN_FOR_WRITE_FLAG_CAN_TRUNCATE : 0),
+                                                 (open_job->can_truncate ? OPEN_FOR_WRITE_FLAG_CAN_TRUNCATE : 0) |
+                                                 OPEN_FOR_WRITE_FLAG_PIPELINED_WRITES,
                                                  open_job->initial_offset);
         break;
     }
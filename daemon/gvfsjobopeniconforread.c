@@ -54,6 +54,7 @@ g_vfs_job_open_icon_for_read_class_init (GVfsJobOpenIconForReadClass *klass)
   gobject_class->finalize = g_vfs_job_open_icon_for_read_finalize;
   job_class->run = run;
   job_class->try = try;
+  job_class->priority = G_VFS_JOB_PRIORITY_INTERACTIVE;
 }
 
 static void
@@ -65,6 +65,7 @@ g_vfs_job_push_class_init (GVfsJobPushClass *klass)
   gobject_class->finalize = g_vfs_job_push_finalize;
   job_class->run = run;
   job_class->try = try;
+  job_class->priority = G_VFS_JOB_PRIORITY_BULK;
   job_dbus_class->create_reply = create_reply;
 }
 
@@ -69,6 +69,7 @@ g_vfs_job_query_info_class_init (GVfsJobQueryInfoClass *klass)
   gobject_class->finalize = g_vfs_job_query_info_finalize;
   job_class->run = run;
   job_class->try = try;
+  job_class->priority = G_VFS_JOB_PRIORITY_INTERACTIVE;
   job_dbus_class->create_reply = create_reply;
 }
 
@@ -64,6 +64,7 @@ g_vfs_job_query_info_write_class_init (GVfsJobQueryInfoWriteClass *klass)
 
   job_class->run = run;
   job_class->try = try;
+  job_class->priority = G_VFS_JOB_PRIORITY_INTERACTIVE;
   job_class->send_reply = send_reply;
 }
 
@@ -47,7 +47,8 @@ g_vfs_job_read_finalize (GObject *object)
   job = G_VFS_JOB_READ (object);
 
   g_object_unref (job->channel);
-  g_free (job->buffer);
+  if (!job->buffer_is_borrowed)
+    g_free (job->buffer);
   
   if (G_OBJECT_CLASS (g_vfs_job_read_parent_class)->finalize)
     (*G_OBJECT_CLASS (g_vfs_job_read_parent_class)->finalize) (object);
@@ -91,6 +92,30 @@ g_vfs_job_read_new (GVfsReadChannel *channel,
   return G_VFS_JOB (job);
 }
 
+/* Reads into @buffer, which is owned by the channel and must stay
+ * valid as long as the job */
+GVfsJob *
+g_vfs_job_read_new_for_buffer (GVfsReadChannel *channel,
+			       GVfsBackendHandle handle,
+			       char *buffer,
+			       gsize bytes_requested,
+			       GVfsBackend *backend)
+{
+  GVfsJobRead *job;
+  
+  job = g_object_new (G_VFS_TYPE_JOB_READ,
+		      NULL);
+
+  job->backend = backend;
+  job->channel = g_object_ref (channel);
+  job->handle = handle;
+  job->buffer = buffer;
+  job->buffer_is_borrowed = TRUE;
+  job->bytes_requested = bytes_requested;
+  
+  return G_VFS_JOB (job);
+}
+
 /* Might be called on an i/o thread */
 static void
 send_reply (GVfsJob *job)
@@ -107,7 +132,8 @@ send_reply (GVfsJob *job)
     {
       g_vfs_read_channel_send_data (op_job->channel,
 				    op_job->buffer,
-				    op_job->data_count);
+				    op_job->data_count,
+				    op_job->start_time);
     }
 }
 
@@ -123,7 +149,9 @@ run (GVfsJob *job)
 			_("Operation not supported"));
       return;
     }
-      
+
+  /* Time spent queued for a thread is not part of the link estimate */
+  op_job->start_time = g_get_monotonic_time ();
   class->read (op_job->backend,
 	       op_job,
 	       op_job->handle,
@@ -140,6 +168,7 @@ try (GVfsJob *job)
   if (class->try_read == NULL)
     return FALSE;
 
+  op_job->start_time = g_get_monotonic_time ();
   return class->try_read (op_job->backend,
 			  op_job,
 			  op_job->handle,
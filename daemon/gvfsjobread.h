@@ -47,7 +47,9 @@ struct _GVfsJobRead
   GVfsBackendHandle handle;
   gsize bytes_requested;
   char *buffer;
+  gboolean buffer_is_borrowed;
   gsize data_count;
+  gint64 start_time;   /* when the backend started the read */
 };
 
 struct _GVfsJobReadClass
@@ -61,6 +63,11 @@ GVfsJob *g_vfs_job_read_new        (GVfsReadChannel   *channel,
 				    GVfsBackendHandle  handle,
 				    gsize              bytes_requested,
 				    GVfsBackend       *backend);
+GVfsJob *g_vfs_job_read_new_for_buffer (GVfsReadChannel *channel,
+				    GVfsBackendHandle  handle,
+				    char              *buffer,
+				    gsize              bytes_requested,
+				    GVfsBackend       *backend);
 void     g_vfs_job_read_set_size   (GVfsJobRead       *job,
 				    gsize              data_size);
 
@@ -239,7 +239,8 @@ unmount_cb (GVfsBackend  *backend,
         {
           g_vfs_backend_set_block_requests (backend, TRUE);
           g_vfs_daemon_run_job_in_thread (g_vfs_backend_get_daemon (backend),
-                                          G_VFS_JOB (op_job));
+                                          G_VFS_JOB (op_job),
+                                          backend);
         }
     }
 }
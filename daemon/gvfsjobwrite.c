@@ -47,7 +47,7 @@ g_vfs_job_write_finalize (GObject *object)
   job = G_VFS_JOB_WRITE (object);
 
   g_object_unref (job->channel);
-  g_free (job->data);
+  g_free (job->buffer);
   
   if (G_OBJECT_CLASS (g_vfs_job_write_parent_class)->finalize)
     (*G_OBJECT_CLASS (g_vfs_job_write_parent_class)->finalize) (object);
@@ -87,6 +87,7 @@ g_vfs_job_write_new (GVfsWriteChannel *channel,
   job->channel = g_object_ref (channel);
   job->handle = handle;
   /* Takes ownership */
+  job->buffer = data;
   job->data = data;
   job->data_size = data_size;
   job->written_size = 0;
@@ -94,6 +95,36 @@ g_vfs_job_write_new (GVfsWriteChannel *channel,
   return G_VFS_JOB (job);
 }
 
+/* Creates a job writing what the partial write @job left over. The data
+ * moves to the new job instead of being copied, @job must not touch it
+ * anymore. */
+GVfsJob *
+g_vfs_job_write_new_remainder (GVfsJobWrite *job)
+{
+  GVfsJobWrite *next_job;
+
+  g_return_val_if_fail (g_vfs_job_write_is_partial (job), NULL);
+
+  next_job = g_object_new (G_VFS_TYPE_JOB_WRITE,
+			   NULL);
+
+  next_job->backend = job->backend;
+  next_job->channel = g_object_ref (job->channel);
+  next_job->handle = job->handle;
+  next_job->buffer = g_steal_pointer (&job->buffer);
+  next_job->data = job->data + job->written_size;
+  next_job->data_size = job->data_size - job->written_size;
+  next_job->written_size = 0;
+
+  job->data = NULL;
+  job->data_size = 0;
+
+  g_vfs_job_set_priority (G_VFS_JOB (next_job),
+			  g_vfs_job_get_priority (G_VFS_JOB (job)));
+
+  return G_VFS_JOB (next_job);
+}
+
 /* Might be called on an i/o thwrite */
 static void
 send_reply (GVfsJob *job)
@@ -106,6 +137,9 @@ send_reply (GVfsJob *job)
 
   if (job->failed)
     g_vfs_channel_send_error (G_VFS_CHANNEL (op_job->channel), job->error);
+  else if (g_vfs_job_write_is_partial (op_job))
+    /* The channel writes the rest in a new job */
+    g_vfs_channel_send_no_reply (G_VFS_CHANNEL (op_job->channel));
   else
     g_vfs_write_channel_send_written (op_job->channel,
 				      op_job->written_size);
@@ -154,3 +188,12 @@ g_vfs_job_write_set_written_size (GVfsJobWrite *job,
 {
   job->written_size = written_size;
 }
+
+/* Whether the backend wrote some, but not all of the data */
+gboolean
+g_vfs_job_write_is_partial (GVfsJobWrite *job)
+{
+  return !G_VFS_JOB (job)->failed &&
+    job->written_size > 0 &&
+    job->written_size < job->data_size;
+}
@@ -49,6 +49,8 @@ struct _GVfsJobWrite
   gsize data_size;
   
   gsize written_size;
+
+  char *buffer;    /* allocation data points into, owned by the job */
 };
 
 struct _GVfsJobWriteClass
@@ -63,8 +65,10 @@ GVfsJob *g_vfs_job_write_new              (GVfsWriteChannel  *channel,
 					   char              *data,
 					   gsize              data_size,
 					   GVfsBackend       *backend);
+GVfsJob *g_vfs_job_write_new_remainder    (GVfsJobWrite      *job);
 void     g_vfs_job_write_set_written_size (GVfsJobWrite      *job,
 					   gsize              written_size);
+gboolean g_vfs_job_write_is_partial       (GVfsJobWrite      *job);
 
 G_END_DECLS
 
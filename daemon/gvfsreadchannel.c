@@ -41,12 +41,40 @@
 #include <gvfsjobcloseread.h>
 #include <gvfsfileinfo.h>
 
+/* Reads start small and grow until they cover several times the
+ * bandwidth-delay product of the backend, measured per channel. */
+#define READ_SIZE_MIN (4 * 1024)
+#define READ_SIZE_RAMP (128 * 1024)
+#define READ_SIZE_MAX (4 * 1024 * 1024)
+#define READ_SIZE_BDP_FACTOR 4
+
+/* Maximal number of reads kept ahead of the client */
+#define READAHEAD_MAX 4
+
+/* Sequential reads after which the channel counts as a bulk transfer */
+#define READ_COUNT_BULK 8
+
 struct _GVfsReadChannel
 {
   GVfsChannel parent_instance;
 
   guint read_count;
   int seek_generation;
+
+  gboolean streaming;
+  guint32 read_size;
+  guint readahead_count;
+
+  /* Link estimate, kept across seeks */
+  gint64 min_latency;
+  guint64 max_bandwidth;
+
+  /* Shared memory the read data is passed in, if the client wants it */
+  GVfsSharedRing *ring;
+  gboolean ring_disabled;       /* the client couldn't map it */
+  char *ring_block;
+  guint32 ring_position;
+  guint32 shared_reply_data;
 };
 
 G_DEFINE_TYPE (GVfsReadChannel, g_vfs_read_channel, G_VFS_TYPE_CHANNEL)
@@ -62,10 +90,19 @@ static GVfsJob *read_channel_handle_request (GVfsChannel  *channel,
 					     GError      **error);
 static GVfsJob *read_channel_readahead      (GVfsChannel  *channel,
 					     GVfsJob       *job);
+static gboolean read_channel_handle_hint    (GVfsChannel  *channel,
+					     guint32       command,
+					     guint32       arg1,
+					     guint32       arg2);
   
 static void
 g_vfs_read_channel_finalize (GObject *object)
 {
+  GVfsReadChannel *read_channel = G_VFS_READ_CHANNEL (object);
+
+  if (read_channel->ring)
+    g_vfs_shared_ring_free (read_channel->ring);
+
   if (G_OBJECT_CLASS (g_vfs_read_channel_parent_class)->finalize)
     (*G_OBJECT_CLASS (g_vfs_read_channel_parent_class)->finalize) (object);
 }
@@ -80,11 +117,13 @@ g_vfs_read_channel_class_init (GVfsReadChannelClass *klass)
   channel_class->close = read_channel_close;
   channel_class->handle_request = read_channel_handle_request;
   channel_class->readahead = read_channel_readahead;
+  channel_class->handle_hint = read_channel_handle_hint;
 }
 
 static void
 g_vfs_read_channel_init (GVfsReadChannel *channel)
 {
+  channel->read_size = READ_SIZE_MIN;
 }
 
 static GVfsJob *
@@ -101,8 +140,9 @@ read_channel_close (GVfsChannel *channel)
  * gstreamer tends to do 4k reads and seeks, and
  * the first read when sniffing is also small, so
  * it makes sense to never read more that 4k
- * (one page) on the first read. It should not affect
- * long-file copy performance anyway.
+ * (one page) on the first read, unless the client
+ * told us it is streaming. After that the size
+ * adapts to the link, see update_read_size().
  */
 static guint32
 modify_read_size (GVfsReadChannel *channel,
@@ -110,30 +150,88 @@ modify_read_size (GVfsReadChannel *channel,
 {
   guint32 real_size;
 
-  if (channel->read_count <= 1)
-    real_size = 4*1024;
-  else if (channel->read_count <= 2)
-    real_size = 8*1024;
-  else if (channel->read_count <= 3)
-    real_size = 16*1024;
-  else if (channel->read_count <= 4)
-    real_size = 32*1024;
-  else if (channel->read_count <= 5)
-    real_size = 64*1024;
+  if (channel->read_count <= 1 && !channel->streaming)
+    real_size = READ_SIZE_MIN;
   else
-    real_size = 128*1024;
+    real_size = channel->read_size;
 
   if (requested_size > real_size)
       real_size = requested_size;
 
   /* Don't do ridicoulously large requests as this
      is just stupid on the network */
-  if (real_size > 256 * 1024)
-    real_size = 256 * 1024;
+  if (real_size > READ_SIZE_MAX)
+    real_size = READ_SIZE_MAX;
 
   return real_size;
 }
 
+/* Called when a read of the current size completed. Small reads mostly
+ * measure the latency of the backend and large reads its bandwidth, so
+ * the best values seen give an estimate of the bandwidth-delay product.
+ * The read size doubles (like the old fixed ladder) up to at least
+ * READ_SIZE_RAMP, and keeps growing while it is below a few times the
+ * bandwidth-delay product, so that high-latency links stay busy. */
+static void
+update_read_size (GVfsReadChannel *channel,
+		  gsize count,
+		  gint64 start_time)
+{
+  gint64 duration;
+  guint64 bandwidth, bdp, target;
+
+  duration = g_get_monotonic_time () - start_time;
+  if (count == 0 || start_time == 0 || duration <= 0)
+    return;
+
+  bandwidth = (guint64) count * G_USEC_PER_SEC / duration;
+  if (channel->min_latency == 0 || duration < channel->min_latency)
+    channel->min_latency = duration;
+  if (bandwidth > channel->max_bandwidth)
+    channel->max_bandwidth = bandwidth;
+
+  bdp = channel->max_bandwidth * channel->min_latency / G_USEC_PER_SEC;
+  target = CLAMP (bdp * READ_SIZE_BDP_FACTOR, READ_SIZE_RAMP, READ_SIZE_MAX);
+
+  if (count >= channel->read_size && channel->read_size < target)
+    channel->read_size = MIN (MAX ((guint64) channel->read_size * 2, bdp), target);
+}
+
+static GVfsJob *
+new_read_job (GVfsReadChannel *read_channel,
+	      guint32 requested_size)
+{
+  GVfsChannel *channel = G_VFS_CHANNEL (read_channel);
+  GVfsJob *job;
+  guint32 size;
+
+  size = modify_read_size (read_channel, requested_size);
+
+  /* Let the backend read right into the shared memory if there is room,
+     the data is handed to the client in g_vfs_read_channel_send_data() */
+  read_channel->ring_block = NULL;
+  if (read_channel->ring != NULL && !read_channel->ring_disabled)
+    read_channel->ring_block = g_vfs_shared_ring_reserve (read_channel->ring, size,
+							  &read_channel->ring_position);
+  if (read_channel->ring_block != NULL)
+    job = g_vfs_job_read_new_for_buffer (read_channel,
+					 g_vfs_channel_get_backend_handle (channel),
+					 read_channel->ring_block,
+					 size,
+					 g_vfs_channel_get_backend (channel));
+  else
+    job = g_vfs_job_read_new (read_channel,
+			      g_vfs_channel_get_backend_handle (channel),
+			      size,
+			      g_vfs_channel_get_backend (channel));
+
+  /* Copying a whole file shouldn't hold up metadata requests */
+  if (read_channel->streaming || read_channel->read_count >= READ_COUNT_BULK)
+    g_vfs_job_set_priority (job, G_VFS_JOB_PRIORITY_BULK);
+
+  return job;
+}
+
 static GVfsJob *
 read_channel_handle_request (GVfsChannel *channel,
 			     guint32 command,
@@ -160,10 +258,7 @@ read_channel_handle_request (GVfsChannel *channel,
     {
     case G_VFS_DAEMON_SOCKET_PROTOCOL_REQUEST_READ:
       read_channel->read_count++;
-      job = g_vfs_job_read_new (read_channel,
-				backend_handle,
-				modify_read_size (read_channel, arg1),
-				backend);
+      job = new_read_job (read_channel, arg1);
       break;
     case G_VFS_DAEMON_SOCKET_PROTOCOL_REQUEST_CLOSE:
       job = g_vfs_job_close_read_new (read_channel,
@@ -177,6 +272,9 @@ read_channel_handle_request (GVfsChannel *channel,
 	seek_type = G_SEEK_END;
       
       read_channel->read_count = 0;
+      read_channel->readahead_count = 0;
+      if (!read_channel->streaming)
+        read_channel->read_size = READ_SIZE_MIN;
       read_channel->seek_generation++;
       job = g_vfs_job_seek_read_new (read_channel,
 				     backend_handle,
@@ -214,6 +312,7 @@ read_channel_readahead (GVfsChannel  *channel,
   GVfsJob *readahead_job;
   GVfsReadChannel *read_channel;
   GVfsJobRead *read_job;
+  guint window;
 
   readahead_job = NULL;
   if (!job->failed &&
@@ -225,29 +324,57 @@ read_channel_readahead (GVfsChannel  *channel,
       /* If the last operation was a read and it succeeded then we
 	 might want to start a readahead. We don't do this for the
 	 first read op as we're not sure we're streaming larger
-	 parts of the file yet. However, after the second read we
-	 queue a readahead read. After this the reading side will
-	 constantly be one read operation behind, such that by
-	 the time the second read operation is done and a third
-	 read() is done we will send a read request but start
-	 reading the readahead data, and after that is done
-	 send a new request but start reading the result of the
-	 previous read request. This way the reading will be
-	 fully pipelined. */
+	 parts of the file yet. Every readahead stays one read
+	 operation ahead of the reading side: when it sends the
+	 next read request it starts reading the oldest readahead
+	 data, and the reply to that request becomes the newest
+	 readahead. This way the reading will be fully pipelined.
+	 The number of reads kept ahead grows with the number of
+	 sequential reads since the last seek, or starts at the
+	 maximum if the client announced it is streaming. */
+      if (read_channel->streaming)
+	window = READAHEAD_MAX;
+      else if (read_channel->read_count >= 2)
+	window = MIN (read_channel->read_count - 1, READAHEAD_MAX);
+      else
+	window = 0;
+
       if (read_job->data_count != 0 &&
-	  read_channel->read_count == 2)
+	  read_channel->readahead_count < window)
 	{
-	  read_channel->read_count++;
-	  readahead_job = g_vfs_job_read_new (read_channel,
-					      g_vfs_channel_get_backend_handle (channel),
-					      modify_read_size (read_channel, 8192),
-					      g_vfs_channel_get_backend (channel));
+	  read_channel->readahead_count++;
+	  readahead_job = new_read_job (read_channel, 0);
 	}
     }
 
   return readahead_job;
 }
 
+static gboolean
+read_channel_handle_hint (GVfsChannel *channel,
+			  guint32      command,
+			  guint32      arg1,
+			  guint32      arg2)
+{
+  GVfsReadChannel *read_channel = G_VFS_READ_CHANNEL (channel);
+
+  if (command == G_VFS_DAEMON_SOCKET_PROTOCOL_REQUEST_INLINE_DATA)
+    {
+      /* The ring is freed with the channel, a read may still use it */
+      g_debug ("read channel: client can't use shared memory\n");
+      read_channel->ring_disabled = TRUE;
+      return TRUE;
+    }
+
+  if (command != G_VFS_DAEMON_SOCKET_PROTOCOL_REQUEST_STREAMING)
+    return FALSE;
+
+  /* Skip the slow start, the client is going to read sequentially */
+  read_channel->streaming = TRUE;
+  read_channel->read_size = MAX (read_channel->read_size, READ_SIZE_RAMP);
+
+  return TRUE;
+}
 
 /* Might be called on an i/o thread
  */
@@ -291,21 +418,49 @@ g_vfs_read_channel_send_closed (GVfsReadChannel *read_channel)
 void
 g_vfs_read_channel_send_data (GVfsReadChannel  *read_channel,
 			      char            *buffer,
-			      gsize            count)
+			      gsize            count,
+			      gint64           start_time)
 {
   GVfsDaemonSocketProtocolReply reply;
   GVfsChannel *channel;
 
   channel = G_VFS_CHANNEL (read_channel);
 
-  reply.type = g_htonl (G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_DATA);
+  update_read_size (read_channel, count, start_time);
+
   reply.seq_nr = g_htonl (g_vfs_channel_get_current_seq_nr (channel));
   reply.arg1 = g_htonl (count);
   reply.arg2 = g_htonl (read_channel->seek_generation);
 
+  if (buffer != NULL && buffer == read_channel->ring_block && count > 0)
+    {
+      /* Already in shared memory, only send where it is */
+      g_vfs_shared_ring_commit (read_channel->ring,
+				read_channel->ring_position, count);
+      read_channel->ring_block = NULL;
+      read_channel->shared_reply_data = g_htonl (read_channel->ring_position);
+
+      reply.type = g_htonl (G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_DATA_SHARED);
+      g_vfs_channel_send_reply (channel, &reply,
+				&read_channel->shared_reply_data,
+				sizeof (read_channel->shared_reply_data));
+      return;
+    }
+
+  read_channel->ring_block = NULL;
+  reply.type = g_htonl (G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_DATA);
   g_vfs_channel_send_reply (channel, &reply, buffer, count);
 }
 
+/* Takes ownership of the ring */
+void
+g_vfs_read_channel_set_shared_ring (GVfsReadChannel *read_channel,
+				    GVfsSharedRing *ring)
+{
+  g_assert (read_channel->ring == NULL);
+  read_channel->ring = ring;
+}
+
 
 GVfsReadChannel *
 g_vfs_read_channel_new (GVfsBackend *backend,
@@ -26,6 +26,7 @@
 #include <glib-object.h>
 #include <gvfsjob.h>
 #include <gvfschannel.h>
+#include <gvfssharedring.h>
 
 G_BEGIN_DECLS
 
@@ -51,10 +52,13 @@ GVfsReadChannel *g_vfs_read_channel_new                (GVfsBackend        *back
                                                         GPid                actual_consumer);
 void            g_vfs_read_channel_send_data          (GVfsReadChannel     *read_channel,
 						       char               *buffer,
-						       gsize               count);
+						       gsize               count,
+						       gint64              start_time);
 void            g_vfs_read_channel_send_closed        (GVfsReadChannel     *read_channel);
 void            g_vfs_read_channel_send_seek_offset   (GVfsReadChannel     *read_channel,
 						      goffset             offset);
+void            g_vfs_read_channel_set_shared_ring    (GVfsReadChannel     *read_channel,
+						       GVfsSharedRing      *ring);
 
 G_END_DECLS
 
@@ -22,6 +22,7 @@
 
 #include <config.h>
 
+#include <string.h>
 #include <strings.h>
 #include <unistd.h>
 #include <errno.h>
@@ -42,14 +43,27 @@
 #include <gvfsjobclosewrite.h>
 #include <gvfsjobqueryinfowrite.h>
 
+/* Queued writes are merged into backend writes of up to this size */
+#define MAX_MERGED_WRITE_SIZE (4*1024*1024)
+
+/* Writes after which the channel counts as a bulk transfer */
+#define WRITE_COUNT_BULK 8
+
 struct _GVfsWriteChannel
 {
   GVfsChannel parent_instance;
+
+  /* Bytes written by earlier jobs for the current request */
+  gsize written_before;
+
+  guint write_count;   /* writes since open or the last seek */
 };
 
 G_DEFINE_TYPE (GVfsWriteChannel, g_vfs_write_channel, G_VFS_TYPE_CHANNEL)
 
 static GVfsJob *write_channel_close          (GVfsChannel  *channel);
+static GVfsJob *write_channel_continue_job   (GVfsChannel  *channel,
+					      GVfsJob      *job);
 static GVfsJob *write_channel_handle_request (GVfsChannel  *channel,
 					      guint32       command,
 					      guint32       seq_nr,
@@ -75,6 +89,7 @@ g_vfs_write_channel_class_init (GVfsWriteChannelClass *klass)
   gobject_class->finalize = g_vfs_write_channel_finalize;
   channel_class->close = write_channel_close;
   channel_class->handle_request = write_channel_handle_request;
+  channel_class->continue_job = write_channel_continue_job;
 }
 
 static void
@@ -90,6 +105,27 @@ write_channel_close (GVfsChannel *channel)
 				    g_vfs_channel_get_backend (channel));
 } 
 
+/* Short writes are finished without a reply, write the rest before
+ * answering so that clients can pipeline their writes.
+ */
+static GVfsJob *
+write_channel_continue_job (GVfsChannel *channel,
+			    GVfsJob *job)
+{
+  GVfsWriteChannel *write_channel;
+  GVfsJobWrite *write_job;
+
+  if (!G_VFS_IS_JOB_WRITE (job) ||
+      !g_vfs_job_write_is_partial (G_VFS_JOB_WRITE (job)))
+    return NULL;
+
+  write_channel = G_VFS_WRITE_CHANNEL (channel);
+  write_job = G_VFS_JOB_WRITE (job);
+  write_channel->written_before += write_job->written_size;
+
+  return g_vfs_job_write_new_remainder (write_job);
+}
+
 static GVfsJob *
 write_channel_handle_request (GVfsChannel *channel,
 			      guint32 command,
@@ -106,6 +142,8 @@ write_channel_handle_request (GVfsChannel *channel,
   GVfsBackend *backend;
   GVfsWriteChannel *write_channel;
   char *attrs;
+  gpointer next_data;
+  gsize next_data_len;
 
   write_channel = G_VFS_WRITE_CHANNEL (channel);
   backend_handle = g_vfs_channel_get_backend_handle (channel);
@@ -115,11 +153,34 @@ write_channel_handle_request (GVfsChannel *channel,
   switch (command)
     {
     case G_VFS_DAEMON_SOCKET_PROTOCOL_REQUEST_WRITE:
+      write_channel->written_before = 0;
+
+      /* Merge the writes queued behind this one, the reply then
+	 acknowledges all of them */
+      while (data_len < MAX_MERGED_WRITE_SIZE &&
+	     g_vfs_channel_take_queued_request (channel,
+						G_VFS_DAEMON_SOCKET_PROTOCOL_REQUEST_WRITE,
+						MAX_MERGED_WRITE_SIZE - data_len,
+						&next_data, &next_data_len))
+	{
+	  if (next_data_len > 0)
+	    {
+	      data = g_realloc (data, data_len + next_data_len);
+	      memcpy ((char *)data + data_len, next_data, next_data_len);
+	      data_len += next_data_len;
+	    }
+	  g_free (next_data);
+	}
+
       job = g_vfs_job_write_new (write_channel,
 				 backend_handle,
 				 data, data_len,
 				 backend);
       data = NULL; /* Pass ownership */
+
+      /* Uploading a whole file shouldn't hold up metadata requests */
+      if (++write_channel->write_count >= WRITE_COUNT_BULK)
+        g_vfs_job_set_priority (job, G_VFS_JOB_PRIORITY_BULK);
       break;
     case G_VFS_DAEMON_SOCKET_PROTOCOL_REQUEST_CLOSE:
       job = g_vfs_job_close_write_new (write_channel,
@@ -131,7 +192,8 @@ write_channel_handle_request (GVfsChannel *channel,
       seek_type = G_SEEK_SET;
       if (command == G_VFS_DAEMON_SOCKET_PROTOCOL_REQUEST_SEEK_END)
 	seek_type = G_SEEK_END;
-      
+
+      write_channel->write_count = 0;
       job = g_vfs_job_seek_write_new (write_channel,
 				      backend_handle,
 				      seek_type,
@@ -234,8 +296,9 @@ g_vfs_write_channel_send_written (GVfsWriteChannel  *write_channel,
 
   reply.type = g_htonl (G_VFS_DAEMON_SOCKET_PROTOCOL_REPLY_WRITTEN);
   reply.seq_nr = g_htonl (g_vfs_channel_get_current_seq_nr (channel));
-  reply.arg1 = g_htonl (bytes_written);
+  reply.arg1 = g_htonl (write_channel->written_before + bytes_written);
   reply.arg2 = 0;
+  write_channel->written_before = 0;
 
   g_vfs_channel_send_reply (channel, &reply, NULL, 0);
 }
@@ -66,8 +66,7 @@ static gint benchmark_run (gint argc, gchar *argv []);
 static GList    *benchmark_data_plots = NULL;
 static gboolean  benchmark_is_running = FALSE;
 
-#if 0
-static void
+G_GNUC_UNUSED static void
 benchmark_begin_data_plot (const gchar *name, const gchar *x_unit, const gchar *y_unit)
 {
   BenchmarkDataPlot *data_plot;
@@ -83,7 +82,7 @@ benchmark_begin_data_plot (const gchar *name, const gchar *x_unit, const gchar *
   benchmark_data_plots = g_list_prepend (benchmark_data_plots, data_plot);
 }
 
-static void
+G_GNUC_UNUSED static void
 benchmark_begin_data_set (void)
 {
   BenchmarkDataPlot *data_plot;
@@ -100,7 +99,7 @@ benchmark_begin_data_set (void)
   data_plot->data_sets = g_list_prepend (data_plot->data_sets, data_set);
 }
 
-static void
+G_GNUC_UNUSED static void
 benchmark_add_data_point (gdouble x, gdouble y)
 {
   BenchmarkDataPlot  *data_plot;
@@ -123,33 +122,37 @@ benchmark_add_data_point (gdouble x, gdouble y)
   g_array_append_val (data_set->points, data_point);
 }
 
-#endif
-
 static void
 benchmark_end (void)
 {
-  BenchmarkDataPlot *plot;
-  GList             *l;
+  GList *p, *l;
 
-  /* Dump plots */
+  /* Dump plots in the order they were begun, each under a comment with
+   * its name, and separate data sets by blank lines as gnuplot expects */
 
   if (!benchmark_data_plots)
     exit (1);
 
-  plot = benchmark_data_plots->data;
-  if (!plot)
-    exit (1);
-
-  for (l = plot->data_sets; l; l = g_list_next (l))
+  for (p = g_list_last (benchmark_data_plots); p; p = g_list_previous (p))
   {
-    BenchmarkDataSet *set = l->data;
-    guint             i;
+    BenchmarkDataPlot *plot = p->data;
 
-    for (i = 0; i < set->points->len; i++)
+    g_print ("# %s (%s, %s)\n", plot->name, plot->x_unit, plot->y_unit);
+
+    for (l = g_list_last (plot->data_sets); l; l = g_list_previous (l))
     {
-      BenchmarkDataPoint *point = &g_array_index (set->points, BenchmarkDataPoint, i);
+      BenchmarkDataSet *set = l->data;
+      guint             i;
+
+      for (i = 0; i < set->points->len; i++)
+      {
+        BenchmarkDataPoint *point = &g_array_index (set->points, BenchmarkDataPoint, i);
+
+        g_print ("%20lf %20lf\n", point->x, point->y);
+      }
 
-      g_print ("%20lf %20lf\n", point->x, point->y);
+      if (g_list_previous (l) || g_list_previous (p))
+        g_print ("\n\n");
     }
   }
 
@@ -0,0 +1,274 @@
+/* GIO - GLib Input, Output and Streaming Library
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#include <config.h>
+
+#include <stdio.h>
+#include <unistd.h>
+#include <locale.h>
+#include <errno.h>
+#include <string.h>
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#define BENCHMARK_UNIT_NAME "gvfs-enumerate"
+
+#include "benchmark-common.c"
+
+/* Lists a directory of many empty files over and over, one data point
+ * per listing. Every other entry is a symlink, so backends that have to
+ * resolve links while listing pay for that as well. A second plot asks
+ * only for the access attributes, which some backends (e.g. nfs://) have
+ * to query for each entry separately. The number of entries can be
+ * given after the scratch URI. */
+
+#define DEFAULT_FILES_NUM 100000
+#define SYMLINK_EVERY     2
+#define ITERATIONS_NUM    5
+
+static gint files_num = DEFAULT_FILES_NUM;
+
+static gboolean
+is_dir (GFile *file)
+{
+  GFileInfo *info;
+  gboolean res;
+
+  info = g_file_query_info (file, G_FILE_ATTRIBUTE_STANDARD_TYPE, 0, NULL, NULL);
+  res = info && g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY;
+  if (info)
+    g_object_unref (info);
+  return res;
+}
+
+static gchar *
+entry_name (gint i)
+{
+  if (i % SYMLINK_EVERY == SYMLINK_EVERY - 1)
+    return g_strdup_printf ("link-%04d", i);
+  return g_strdup_printf ("file-%04d", i);
+}
+
+static GFile *
+create_dir (GFile *base_dir)
+{
+  GFile         *scratch_dir;
+  GFile         *file;
+  GOutputStream *output_stream;
+  gchar         *name;
+  gchar         *target;
+  GError        *error = NULL;
+  gboolean       links_failed = FALSE;
+  gint           i;
+
+  name = g_strdup_printf ("gvfs-benchmark-enumerate-%d", getpid ());
+  scratch_dir = g_file_resolve_relative_path (base_dir, name);
+  g_free (name);
+
+  if (!g_file_make_directory (scratch_dir, NULL, &error))
+    {
+      g_printerr ("Failed to create scratch directory: %s\n", error->message);
+      g_error_free (error);
+      g_object_unref (scratch_dir);
+      return NULL;
+    }
+
+  for (i = 0; i < files_num; i++)
+    {
+      name = entry_name (i);
+      file = g_file_get_child (scratch_dir, name);
+      g_free (name);
+
+      if (i % SYMLINK_EVERY == SYMLINK_EVERY - 1)
+        {
+          target = entry_name (i - 1);
+          if (!links_failed &&
+              !g_file_make_symbolic_link (file, target, NULL, &error))
+            {
+              /* Not every backend has symlinks, list plain files then */
+              g_printerr ("Failed to create symlink, continuing without: %s\n", error->message);
+              g_clear_error (&error);
+              links_failed = TRUE;
+            }
+          g_free (target);
+          g_object_unref (file);
+          continue;
+        }
+
+      output_stream = G_OUTPUT_STREAM (g_file_create (file, G_FILE_CREATE_NONE, NULL, &error));
+      if (!output_stream)
+        {
+          g_printerr ("Failed to create scratch file: %s\n", error->message);
+          g_error_free (error);
+          g_object_unref (file);
+          g_object_unref (scratch_dir);
+          return NULL;
+        }
+
+      g_output_stream_close (output_stream, NULL, NULL);
+      g_object_unref (output_stream);
+      g_object_unref (file);
+    }
+
+  return scratch_dir;
+}
+
+static void
+delete_dir (GFile *scratch_dir)
+{
+  GFile  *file;
+  gchar  *name;
+  GError *error = NULL;
+  gint    i;
+
+  for (i = 0; i < files_num; i++)
+    {
+      name = entry_name (i);
+      file = g_file_get_child (scratch_dir, name);
+      g_free (name);
+
+      g_file_delete (file, NULL, NULL);
+      g_object_unref (file);
+    }
+
+  if (!g_file_delete (scratch_dir, NULL, &error))
+    {
+      g_printerr ("Failed to delete scratch directory: %s\n", error->message);
+      g_error_free (error);
+    }
+}
+
+static gint
+list_dir (GFile *scratch_dir, const gchar *attributes)
+{
+  GFileEnumerator *enumerator;
+  GFileInfo       *info;
+  GError          *error = NULL;
+  gint             n_files = 0;
+
+  enumerator = g_file_enumerate_children (scratch_dir, attributes,
+                                          G_FILE_QUERY_INFO_NONE,
+                                          NULL, &error);
+  if (!enumerator)
+    {
+      g_printerr ("Failed to list scratch directory: %s\n", error->message);
+      g_error_free (error);
+      return -1;
+    }
+
+  while ((info = g_file_enumerator_next_file (enumerator, NULL, &error)) != NULL)
+    {
+      n_files++;
+      g_object_unref (info);
+    }
+
+  if (error)
+    {
+      g_printerr ("Failed to list scratch directory: %s\n", error->message);
+      g_error_free (error);
+      n_files = -1;
+    }
+
+  g_object_unref (enumerator);
+  return n_files;
+}
+
+static gboolean
+measure (GFile *scratch_dir, const gchar *attributes)
+{
+  gint64 start;
+  gint   i;
+
+  benchmark_begin_data_set ();
+
+  for (i = 0; i < ITERATIONS_NUM; i++)
+    {
+      start = g_get_monotonic_time ();
+      if (list_dir (scratch_dir, attributes) < 0)
+        return FALSE;
+      benchmark_add_data_point (i, (gdouble) (g_get_monotonic_time () - start) / G_USEC_PER_SEC);
+    }
+
+  return TRUE;
+}
+
+static gint
+benchmark_run (gint argc, gchar *argv [])
+{
+  GFile    *base_dir;
+  GFile    *scratch_dir;
+  gboolean  res;
+
+  setlocale (LC_ALL, "");
+
+  if (argc < 2)
+    {
+      g_printerr ("Usage: %s <scratch URI> [number of entries]\n", argv [0]);
+      return 1;
+    }
+
+  if (argc > 2)
+    {
+      files_num = g_ascii_strtoll (argv [2], NULL, 10);
+      if (files_num <= 0)
+        {
+          g_printerr ("Invalid number of entries %s\n", argv [2]);
+          return 1;
+        }
+    }
+
+  base_dir = g_file_new_for_commandline_arg (argv [1]);
+
+  if (!is_dir (base_dir))
+    {
+      g_printerr ("Scratch URI %s is not a directory\n", argv [1]);
+      g_object_unref (base_dir);
+      return 1;
+    }
+
+  scratch_dir = create_dir (base_dir);
+  if (!scratch_dir)
+    {
+      g_object_unref (base_dir);
+      return 1;
+    }
+
+  benchmark_begin_data_plot ("enumerate", "iteration", "seconds");
+
+  /* Symlinks are followed, so they have to be resolved while listing */
+  res = measure (scratch_dir, G_FILE_ATTRIBUTE_STANDARD_NAME ","
+                              G_FILE_ATTRIBUTE_STANDARD_TYPE ","
+                              G_FILE_ATTRIBUTE_STANDARD_SIZE ","
+                              G_FILE_ATTRIBUTE_STANDARD_SYMLINK_TARGET ","
+                              G_FILE_ATTRIBUTE_TIME_MODIFIED);
+
+  if (res)
+    {
+      benchmark_begin_data_plot ("enumerate-access", "iteration", "seconds");
+      res = measure (scratch_dir, G_FILE_ATTRIBUTE_STANDARD_NAME ","
+                                  "access::*");
+    }
+
+  delete_dir (scratch_dir);
+  g_object_unref (scratch_dir);
+  g_object_unref (base_dir);
+
+  return res ? 0 : 1;
+}